@@ -61,14 +61,14 @@ int main()
                 true, true,
                 false, NULL,
                 NULL, false,
-                NULL, false,
+                NULL, false, 0,
                 0., 0.,
                 0.,  0.,
                 0., Impute,
                 SubSet, Smallest,
                 false, NULL, 0,
                 Higher, Inverse, false,
-                1, 1);
+                1, MersenneTwister, 1);
 
     /* Check which row has the highest outlier score
        (see file 'predict.cpp' for the documentation) */
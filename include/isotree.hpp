@@ -48,7 +48,9 @@
 
 /* Standard headers */
 #include <stddef.h>
+#include <stdint.h>
 #include <vector>
+#include <memory>
 
 /* For sparse matrices */
 #ifdef _FOR_R
@@ -71,6 +73,11 @@ typedef enum  GainCriterion  {Averaged, Pooled,   NoCrit}      Criterion;      /
 typedef enum  CoefType       {Uniform,  Normal}                CoefType;       /* For extended model */
 typedef enum  UseDepthImp    {Lower,    Higher,   Same}        UseDepthImp;    /* For NA imputation */
 typedef enum  WeighImpRows   {Inverse,  Prop,     Flat}        WeighImpRows;   /* For NA imputation */
+typedef enum  RNGType        {MersenneTwister, Xoshiro}        RNGType;
+typedef enum  MappedDataUse  {UseForFitting, UseForPrediction, UseForImputation} MappedDataUse; /* For mapped data files */
+
+/* Produces the next chunk of rows when fitting to data read in parts - see 'fit_iforest_streaming' */
+typedef size_t (*ChunkReader)(void *reader_data, double **numeric_data, int **categ_data, double **sample_weights);
 
 /* Notes about new categorical action:
 *  - For single-variable case, if using 'Smallest', can then pass data at prediction time
@@ -253,26 +260,104 @@ typedef struct ImputeNode {
 
 } ImputeNode; /* this is for each tree node */
 
+/* Imputation nodes of a tree in the layout produced by 'compact_imputer': only the terminal
+   nodes are kept, with their numeric sums and weights one node after another in a flat array
+   (after the look-ups to parent nodes, every numeric column has data at every terminal node),
+   and with only the non-zero category sums, stored as (column, category, value) entries. */
+typedef struct CompactImputeTree {
+    bool                   as_float;    /* whether the values are in the 'float' arrays instead of the 'double' ones */
+    std::vector<uint32_t>  terminal_ix; /* position of each tree node among the terminal nodes */
+    std::vector<double>    num_dbl;     /* 'num_sum' followed by 'num_weight' for each terminal node */
+    std::vector<float>     num_flt;
+    std::vector<size_t>    cat_indptr;  /* entries of terminal node 'i' are in [cat_indptr[i], cat_indptr[i+1]) */
+    std::vector<uint32_t>  cat_col;
+    std::vector<uint32_t>  cat_cat;
+    std::vector<double>    cat_dbl;
+    std::vector<float>     cat_flt;
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->as_float,
+            this->terminal_ix,
+            this->num_dbl,
+            this->num_flt,
+            this->cat_indptr,
+            this->cat_col,
+            this->cat_cat,
+            this->cat_dbl,
+            this->cat_flt
+            );
+    }
+    #endif
+    CompactImputeTree() {};
+
+} CompactImputeTree;
+
 typedef struct Imputer {
     size_t               ncols_numeric;
     size_t               ncols_categ;
     std::vector<int>     ncat;
     std::vector<std::vector<ImputeNode>> imputer_tree;
+    std::vector<CompactImputeTree> imputer_tree_compact; /* used instead of 'imputer_tree' after 'compact_imputer' */
     std::vector<double>  col_means;
     std::vector<int>     col_modes;
 
     #ifdef _ENABLE_CEREAL
+    /* imputers in the compact layout are written with a leading SIZE_MAX in place of
+       'ncols_numeric', so that the format of the non-compact ones remains the same */
     template<class Archive>
-    void serialize(Archive &archive)
+    void save(Archive &archive) const
     {
-        archive(
-            this->ncols_numeric,
-            this->ncols_categ,
-            this->ncat,
-            this->imputer_tree,
-            this->col_means,
-            this->col_modes
-            );
+        if (!this->imputer_tree_compact.size())
+            archive(
+                this->ncols_numeric,
+                this->ncols_categ,
+                this->ncat,
+                this->imputer_tree,
+                this->col_means,
+                this->col_modes
+                );
+        else
+            archive(
+                (size_t) SIZE_MAX,
+                this->ncols_numeric,
+                this->ncols_categ,
+                this->ncat,
+                this->imputer_tree_compact,
+                this->col_means,
+                this->col_modes
+                );
+    }
+
+    template<class Archive>
+    void load(Archive &archive)
+    {
+        size_t first_field;
+        archive(first_field);
+        if (first_field != SIZE_MAX)
+        {
+            this->ncols_numeric = first_field;
+            archive(
+                this->ncols_categ,
+                this->ncat,
+                this->imputer_tree,
+                this->col_means,
+                this->col_modes
+                );
+        }
+
+        else
+            archive(
+                this->ncols_numeric,
+                this->ncols_categ,
+                this->ncat,
+                this->imputer_tree_compact,
+                this->col_means,
+                this->col_modes
+                );
     }
     #endif
 
@@ -280,6 +365,140 @@ typedef struct Imputer {
 
 } Imputer;
 
+/* Data from a file mapped into memory through 'map_data_file' - the pointers are into the file itself */
+typedef struct MappedData {
+    double*     numeric_data;
+    size_t      ncols_numeric;
+    int*        categ_data;
+    size_t      ncols_categ;
+    int*        ncat;
+    double*     Xc;           /* only for sparse matrices */
+    sparse_ix*  Xc_ind;       /* only for sparse matrices */
+    sparse_ix*  Xc_indptr;    /* only for sparse matrices */
+    size_t      nrows;
+    void*       mapped_addr;
+    size_t      mapped_size;
+} MappedData;
+
+/* Index of the terminal nodes at which the rows of a reference set end up in each tree of a
+   model, built through 'build_neighbors_index' and queried through 'query_neighbors_index' */
+typedef struct NeighborsIndex {
+    size_t               nrows;
+    std::vector<size_t>  node_offset;   /* where the nodes of each tree start in the arrays below, plus the total */
+    std::vector<size_t>  parent;        /* indices within the same tree */
+    std::vector<size_t>  depth;
+    std::vector<size_t>  range_st;      /* rows under a node are at positions [range_st, range_end) in 'ordered_rows' */
+    std::vector<size_t>  range_end;
+    std::vector<size_t>  ordered_rows;  /* [tree * nrows + pos] - rows sorted by the depth-first order of their terminal node */
+    std::vector<size_t>  row_nodes;     /* [row * ntrees + tree] - terminal node of each row in each tree */
+} NeighborsIndex;
+
+/* Layout of the start of the files written by 'write_mapped_data' */
+typedef struct MappedDataHeader {
+    char      magic[8];           /* "ISOTDATA" */
+    uint32_t  version;
+    uint32_t  byte_order;         /* 0x01020304 as written by the computer that wrote the file */
+    uint64_t  nrows;
+    uint64_t  ncols_numeric;
+    uint64_t  ncols_categ;
+    uint64_t  nnz;                /* only for sparse matrices */
+    uint32_t  is_sparse;
+    uint32_t  sparse_ix_bytes;    /* size of the indices of sparse matrices */
+    uint64_t  offset_numeric;     /* offsets from the start of the file, zero if the array is not present */
+    uint64_t  offset_Xc_ind;
+    uint64_t  offset_Xc_indptr;
+    uint64_t  offset_categ;
+    uint64_t  offset_ncat;
+    uint64_t  reserved[4];
+} MappedDataHeader;
+
+/* Nodes of models in the files written by 'write_model_file', which are used in place of
+   'IsoTree' and 'IsoHPlane' when predicting from a file mapped through 'map_model_file' */
+typedef struct MappedTreeNode {
+    double    num_split;
+    double    pct_tree_left;
+    double    score;
+    double    range_low;
+    double    range_high;
+    double    remainder;
+    uint64_t  col_num;
+    uint64_t  tree_left;          /* indices within the same tree */
+    uint64_t  tree_right;
+    uint64_t  cat_split_st;       /* position of the first entry of 'cat_split' in the section of categorical splits */
+    uint32_t  cat_split_size;
+    int32_t   chosen_cat;
+    int32_t   col_type;           /* as 'ColType' */
+    uint32_t  reserved;
+} MappedTreeNode;
+
+typedef struct MappedHPlaneNode {
+    double    split_point;
+    double    score;
+    double    range_low;
+    double    range_high;
+    double    remainder;
+    uint64_t  hplane_left;        /* indices within the same tree */
+    uint64_t  hplane_right;
+    uint64_t  col_st;             /* position of the first column in the per-column arrays */
+    uint64_t  ncols;
+    uint64_t  num_st;             /* position of the first numeric column in 'coef' and 'mean' */
+    uint64_t  cat_st;             /* position of the first categorical column in 'chosen_cat', 'fill_new', 'cat_coef_indptr' */
+} MappedHPlaneNode;
+
+/* Model from a file mapped into memory through 'map_model_file' - the pointers are into the file itself */
+typedef struct MappedModel {
+    bool               is_extended;
+    NewCategAction     new_cat_action;
+    CategSplit         cat_split_type;
+    MissingAction      missing_action;
+    double             exp_avg_depth;
+    double             exp_avg_sep;
+    size_t             orig_sample_size;
+    size_t             ntrees;
+    uint64_t*          tree_offsets;     /* [ntrees + 1] - position of the first node of each tree, plus the total */
+    MappedTreeNode*    nodes;            /* only for single-variable models */
+    signed char*       cat_split;        /* only for single-variable models */
+    MappedHPlaneNode*  hplanes;          /* the rest are only for extended models */
+    uint64_t*          col_num;
+    int32_t*           col_type;
+    double*            fill_val;
+    double*            coef;
+    double*            mean;
+    int32_t*           chosen_cat;
+    double*            fill_new;
+    uint64_t*          cat_coef_indptr;
+    double*            cat_coef;
+    void*              mapped_addr;
+    size_t             mapped_size;
+} MappedModel;
+
+/* Layout of the start of the files written by 'write_model_file' */
+typedef struct MappedModelHeader {
+    char      magic[8];           /* "ISOTMODL" */
+    uint32_t  version;            /* revision of the format that wrote the file */
+    uint32_t  min_version;        /* oldest revision that can read it */
+    uint32_t  byte_order;         /* 0x01020304 as written by the computer that wrote the file */
+    uint32_t  header_bytes;       /* size of this struct, the table of sections follows it */
+    uint32_t  is_extended;
+    uint32_t  new_cat_action;
+    uint32_t  cat_split_type;
+    uint32_t  missing_action;
+    uint64_t  ntrees;
+    uint64_t  nsections;
+    uint64_t  file_size;
+    uint64_t  checksum;           /* FNV-1a of the 64-bit words of the whole file, taking this field as zero */
+    double    exp_avg_depth;
+    double    exp_avg_sep;
+    uint64_t  orig_sample_size;
+    uint64_t  reserved[5];
+} MappedModelHeader;
+
+typedef struct MappedModelSection {
+    uint32_t  kind;
+    uint32_t  elem_bytes;
+    uint64_t  count;
+    uint64_t  offset;             /* from the start of the file, multiple of 64 */
+} MappedModelSection;
 
 
 /*  Fit Isolation Forest model, or variant of it such as SCiForest
@@ -390,6 +609,8 @@ typedef struct Imputer {
 *       entry 0 <= i < j < n will be located at position
 *           p(i,j) = (i * (n - (i+1)/2) + j - i - 1).
 *       Can be converted to a dense square matrix through function 'tmat_to_dense'.
+*       All the threads add their separation depths to this same array while fitting, so no additional
+*       memory of this size is allocated per thread.
 * - output_depths[nrows]
 *       Array in which to calculate average path depths or standardized outlierness metric (see documentation
 *       for 'standardize_depth') as the model is being fit. Pass NULL to avoid doing these calculations alongside
@@ -410,6 +631,12 @@ typedef struct Imputer {
 *       sample, so if not using sub-samples, it's better to pass column weights calculated externally. For
 *       categorical columns, will calculate expected kurtosis if the column was converted to numerical by
 *       assigning to each category a random number ~ Unif(0, 1).
+* - kurt_sample_size
+*       When passing 'weigh_by_kurt=true', number of rows in a random sample (taken once for the whole model)
+*       in which to calculate the kurtosis of each column, in which case the same column weights will be used
+*       for all the trees instead of calculating them in the sub-sample of each tree. This is much faster when
+*       there are many columns. If it's larger than 'nrows', will use all the rows. Pass zero to calculate the
+*       kurtosis in the sub-sample of each tree. Ignored when passing 'weigh_by_kurt=false'.
 * - prob_pick_by_gain_avg
 *       Probability of making each split in the single-variable model by choosing a column and split point in that
 *       same column as both the column and split point that gives the largest averaged gain (as proposed in [4]) across
@@ -523,6 +750,13 @@ typedef struct Imputer {
 *       'categ_data', and 'Xc', will get overwritten with the imputations produced.
 * - random_seed
 *       Seed that will be used to generate random numbers used by the model.
+* - rng_type
+*       Family of random number generators to use. Options are a) "MersenneTwister" (the generator
+*       used in previous versions - note however that results for a given seed will not match with
+*       those versions, as the sampling procedures have changed), b) "Xoshiro", which uses the
+*       xoshiro256++ generator - this is faster and has a much smaller state, but will produce
+*       different results for the same seed. Each tree gets its own stream
+*       derived from 'random_seed', so results do not depend on the number of threads.
 * - nthreads
 *       Number of parallel threads to use. Note that, the more threads, the more memory will be
 *       allocated, even if the thread does not end up being used. Ignored when not building with
@@ -566,14 +800,14 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 bool   limit_depth, bool penalize_range,
                 bool   standardize_dist, double tmat[],
                 double output_depths[], bool standardize_depth,
-                double col_weights[], bool weigh_by_kurt,
+                double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
                 double min_gain, MissingAction missing_action,
                 CategSplit cat_split_type, NewCategAction new_cat_action,
                 bool   all_perm, Imputer *imputer, size_t min_imp_obs,
                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
-                uint64_t random_seed, int nthreads);
+                uint64_t random_seed, RNGType rng_type, int nthreads);
 
 
 /* Add additional trees to already-fitted isolation forest model
@@ -708,12 +942,15 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
 *       what was originally passed to 'fit_iforest'.
 * - random_seed
 *       Seed that will be used to generate random numbers used by the model.
+* - rng_type
+*       Same parameter as for 'fit_iforest' (see the documentation in there for details). Can be changed from
+*       what was originally passed to 'fit_iforest'.
 */
 int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              double numeric_data[],  size_t ncols_numeric,
              int    categ_data[],    size_t ncols_categ,    int ncat[],
              double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
-             size_t ndim, size_t ntry, CoefType coef_type,
+             size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
              double sample_weights[], size_t nrows, size_t max_depth,
              bool   limit_depth,   bool penalize_range,
              double col_weights[], bool weigh_by_kurt,
@@ -723,9 +960,223 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              CategSplit cat_split_type, NewCategAction new_cat_action,
              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
              bool   all_perm, std::vector<ImputeNode> *impute_nodes, size_t min_imp_obs,
-             uint64_t random_seed);
+             uint64_t random_seed, RNGType rng_type);
+
+
+/* Add multiple additional trees to already-fitted isolation forest model
+* 
+* Same as 'add_tree', but builds 'ntrees' trees at once, in parallel, sharing the same processed data
+* and the same per-thread working memory across all of them. The trees are appended to the model
+* in the same order and with the same random seeds as if they had been added one by one through
+* 'add_tree' using the same 'random_seed' (i.e. the trees are identical to those from calling
+* 'add_tree' 'ntrees' times with the same data and parameters), so the results do not depend
+* on the number of threads.
+* Parameters are the same as for 'add_tree' (see the documentation in there for details), with the
+* following differences:
+* 
+* Parameters
+* ==========
+* - ntrees
+*       Number of trees to add to the model.
+* - imputer
+*       Pointer to already-fitted imputer object to which imputation nodes for the new trees will be
+*       appended (in the compact layout if the imputer was converted through 'compact_imputer').
+*       Pass NULL if the model was not built with an imputer.
+* - nthreads
+*       Number of parallel threads to use. Note that, the more threads, the more memory will be
+*       allocated, even if the thread does not end up being used.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) upon completion.
+* If the process receives an interrupt signal, will return instead
+* 'EXIT_FAILURE' (typically =1), and the model will be left without any of the new trees.
+*/
+int add_trees(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+              double numeric_data[],  size_t ncols_numeric,
+              int    categ_data[],    size_t ncols_categ,    int ncat[],
+              double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+              size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+              double sample_weights[], size_t nrows, size_t ntrees, size_t max_depth,
+              bool   limit_depth,   bool penalize_range,
+              double col_weights[], bool weigh_by_kurt,
+              double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+              double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+              double min_gain, MissingAction missing_action,
+              CategSplit cat_split_type, NewCategAction new_cat_action,
+              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+              bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+              uint64_t random_seed, RNGType rng_type, int nthreads);
 
 
+/* Data and per-thread memory that are kept across different fits to the same data
+* 
+* The contents of this struct are internal to the library - it can only be used through
+* 'create_training_session', 'delete_training_session', and the overloads of 'fit_iforest',
+* 'add_tree' and 'add_trees' that take it in place of the data.
+*/
+typedef struct TrainingSession TrainingSession;
+
+/* Prepare data for fitting several models to it
+* 
+* Fitting a model requires some preprocessing of the data (such as determining which columns
+* are constant or have missing values, or building structures for sampling rows by weight),
+* plus memory for each thread, which gets allocated as the trees are built. When fitting many
+* models to the same data (e.g. with different hyperparameters or seeds), this object allows
+* doing all that only once, by passing it to the overloads of 'fit_iforest', 'add_tree' and
+* 'add_trees' that take a 'TrainingSession' instead of the data.
+* 
+* The session does not make a copy of the data - the arrays that are passed here must remain
+* valid and unmodified for as long as the session is used. Note that the object is not thread-safe,
+* so the same session cannot be used for fitting two models at the same time.
+* 
+* Parameters
+* ==========
+* - numeric_data, ncols_numeric, categ_data, ncols_categ, ncat, Xc, Xc_ind, Xc_indptr, sample_weights, nrows
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details).
+* - nthreads
+*       Number of parallel threads to use when preprocessing the data.
+* 
+* Returns
+* =======
+* Pointer to a newly-allocated session object, which must be freed through 'delete_training_session'.
+*/
+TrainingSession* create_training_session(double numeric_data[],  size_t ncols_numeric,
+                                         int    categ_data[],    size_t ncols_categ,    int ncat[],
+                                         double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                                         double sample_weights[], size_t nrows, int nthreads);
+
+/* Free a session object produced by 'create_training_session' */
+void delete_training_session(TrainingSession *session);
+
+/* Fit Isolation Forest model to data from a training session
+* 
+* Same as the 'fit_iforest' that takes the data, but the data, the structures for sampling rows
+* by weight, the column weights by kurtosis (when using a shared sample and the same seed), and the
+* memory for each thread are taken from a 'TrainingSession' object (see 'create_training_session'),
+* which keeps them for later calls. The resulting model is the same as from the 'fit_iforest' that
+* takes the data, when passing the same data and parameters.
+* 
+* Parameters are the same as for the 'fit_iforest' that takes the data (see the documentation in there
+* for details), except that the data and the sample weights are the ones from the session. Note that, if passing
+* 'impute_at_fit=true', the data that was passed to 'create_training_session' will get modified, and the
+* session will update its preprocessed data accordingly, so later fits from the same session will use
+* the imputed data.
+*/
+int fit_iforest(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                bool   with_replacement, bool weight_as_sample,
+                size_t sample_size, size_t ntrees, size_t max_depth,
+                bool   limit_depth, bool penalize_range,
+                bool   standardize_dist, double tmat[],
+                double output_depths[], bool standardize_depth,
+                double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
+                double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                double min_gain, MissingAction missing_action,
+                CategSplit cat_split_type, NewCategAction new_cat_action,
+                bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+                UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
+                uint64_t random_seed, RNGType rng_type, int nthreads);
+
+/* Add additional trees to already-fitted isolation forest model, using the data from a training session
+* 
+* Same as the 'add_tree' that takes the data, but the data and the memory for building the tree are taken
+* from a 'TrainingSession' object (see 'create_training_session'). The session must have been created with
+* the same data that is to be used for this tree. Parameters are the same as for the 'add_tree' that
+* takes the data (see the documentation in there for details).
+*/
+int add_tree(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+             size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+             size_t max_depth, bool limit_depth, bool penalize_range,
+             double col_weights[], bool weigh_by_kurt,
+             double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+             double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+             double min_gain, MissingAction missing_action,
+             CategSplit cat_split_type, NewCategAction new_cat_action,
+             UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+             bool   all_perm, std::vector<ImputeNode> *impute_nodes, size_t min_imp_obs,
+             uint64_t random_seed, RNGType rng_type);
+
+/* Add multiple additional trees to already-fitted isolation forest model, using the data from a training session
+* 
+* Same as the 'add_trees' that takes the data, but the data and the memory for building the trees are taken
+* from a 'TrainingSession' object (see 'create_training_session').
+*/
+int add_trees(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+              size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+              size_t ntrees, size_t max_depth, bool limit_depth, bool penalize_range,
+              double col_weights[], bool weigh_by_kurt,
+              double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+              double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+              double min_gain, MissingAction missing_action,
+              CategSplit cat_split_type, NewCategAction new_cat_action,
+              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+              bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+              uint64_t random_seed, RNGType rng_type, int nthreads);
+
+
+/* Fit Isolation Forest model to data that is read in chunks
+* 
+* Same as 'fit_iforest', but instead of taking the whole data as one array, it takes a function
+* that produces the data in chunks of rows, which gets called until it signals that there are
+* no more rows. The sample for each tree is drawn in one pass over the chunks through reservoir
+* sampling (weighted if using sample weights as sampling probabilities), and the trees are built
+* afterwards from their samples, so the memory required is proportional to
+* 'ntrees * sample_size * (ncols_numeric + ncols_categ)' regardless of the number of rows in the data.
+* 
+* Note that the samples are drawn differently than in 'fit_iforest', so the results will not be the
+* same as when passing the same data at once. Sampling is always done without replacement, and this
+* function does not support sparse data, imputers, nor outputs calculated during the fitting procedure
+* (distances and depths).
+* 
+* Parameters
+* ==========
+* - read_chunk
+*       Function which, each time it is called, sets 'numeric_data', 'categ_data' and 'sample_weights'
+*       to point to the next chunk of rows and returns the number of rows in it, in the same format as
+*       the data for 'fit_iforest' (column-major arrays with as many rows as the chunk has). Pointers
+*       for data that is not used (e.g. categorical data when 'ncols_categ=0') can be left untouched.
+*       The arrays only need to remain valid until the next call. Should return zero once there are no
+*       more rows, or '(size_t)-1' if it failed to produce the data, in which case the fitting procedure
+*       will be aborted. It is always called from the same thread that calls this function.
+*       Either all the chunks or none of them should have sample weights.
+* - reader_data
+*       Pointer that will be passed as first argument to 'read_chunk'.
+* - ncols_numeric, ncols_categ, ncat
+*       Number of numeric and categorical columns in each chunk, and number of categories
+*       of each categorical column, same as for 'fit_iforest'.
+* - weight_as_sample
+*       Whether the sample weights produced by 'read_chunk' (if any) are to be taken as sampling
+*       probabilities, or as distribution density weights (same as for 'fit_iforest').
+* - sample_size
+*       Number of rows to sample for each tree. Unlike in 'fit_iforest', it cannot be zero, as the
+*       number of rows is not known beforehand. If the data has fewer rows than this, will take all of them.
+* - ndim, ntry, coef_type, coef_by_prop, ntrees, max_depth, limit_depth, penalize_range, col_weights,
+*   weigh_by_kurt, prob_pick_by_gain_avg, prob_split_by_gain_avg, prob_pick_by_gain_pl, prob_split_by_gain_pl,
+*   min_gain, missing_action, cat_split_type, new_cat_action, all_perm, random_seed, rng_type, nthreads
+*       Same as for 'fit_iforest' (see the documentation in there for details).
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) upon completion.
+* If the process receives an interrupt signal (also while reading the chunks), if 'read_chunk'
+* signals a failure, if only some of the chunks have sample weights, or if there were no rows
+* to sample, will return instead 'EXIT_FAILURE' (typically =1).
+*/
+int fit_iforest_streaming(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          ChunkReader read_chunk, void *reader_data,
+                          size_t ncols_numeric, size_t ncols_categ, int ncat[],
+                          size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                          bool   weight_as_sample, size_t sample_size, size_t ntrees, size_t max_depth,
+                          bool   limit_depth, bool penalize_range,
+                          double col_weights[], bool weigh_by_kurt,
+                          double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                          double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                          double min_gain, MissingAction missing_action,
+                          CategSplit cat_split_type, NewCategAction new_cat_action,
+                          bool   all_perm, uint64_t random_seed, RNGType rng_type, int nthreads);
+
 /* Predict outlier score, average depth, or terminal node numbers
 * 
 * Parameters
@@ -847,9 +1298,13 @@ void predict_iforest(double numeric_data[], int categ_data[],
 * - nrows
 *       Number of rows in 'numeric_data', 'Xc', 'Xr, 'categ_data'.
 * - nthreads
-*       Number of parallel threads to use. Note that, the more threads, the more memory will be
-*       allocated, even if the thread does not end up being used. Ignored when not building with
-*       OpenMP support.
+*       Number of parallel threads to use. When there are few rows compared to the number of trees,
+*       calculations are distributed by trees and each thread allocates its own output matrix, so
+*       the more threads, the more memory will be allocated. Otherwise, calculations are distributed
+*       by blocks of rows in the output, with little extra memory per thread, unless some row
+*       gets divided between both branches of a tree (models with missing_action = 'Divide' or
+*       new_cat_action = 'Weighted' when there are missing values or new categories).
+*       Ignored when not building with OpenMP support.
 * - assume_full_distr
 *       Whether to assume that the fitted model represents a full population distribution (will use a
 *       standardizing criterion assuming infinite sample, and the results of the similarity between two points
@@ -903,6 +1358,182 @@ void calc_similarity(double numeric_data[], int categ_data[],
                      double tmat[], double rmat[], size_t n_from);
 
 
+/* Calculate distance or similarity between data points, writing them to a file
+* 
+* Same calculations as 'calc_similarity', but the output is written into a memory-mapped
+* file instead of an array in memory, so it can be used when the resulting matrix does not
+* fit in memory. The results are calculated by blocks of rows and written about sequentially.
+* The file will contain only the raw numbers in the endianness of the computer that writes it,
+* either as 'double' or as 'float' (32-bit floating point), in the same layout as 'tmat' (upper
+* triangular part of the pairwise distances matrix, when 'n_from' = 0) or as 'rmat' (row-major
+* matrix with the distances from each of the first 'n_from' rows to each of the remaining rows).
+* 
+* Parameters
+* ==========
+* - file_path
+*       Name of the file to write. If it already exists, will be overwritten.
+* - as_float
+*       Whether to write the results as 32-bit floating point numbers ('float') instead
+*       of 'double', which takes half as much space.
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, nrows, nthreads, assume_full_distr,
+*   standardize_dist, model_outputs, model_outputs_ext
+*       Same as for 'calc_similarity'.
+* - n_from
+*       When calculating distances between two groups of points, the number of rows
+*       belonging to the first group, which will be assumed to be the first 'n_from'
+*       rows. Pass zero to calculate pairwise distances between all the rows.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the results were written successfully,
+* or 'EXIT_FAILURE' (typically =1) if the file could not be created or written (e.g. if there
+* is not enough space in the disk for it), or if some row has to be divided between both
+* branches of a tree (models with 'missing_action' = 'Divide' or 'new_cat_action' = 'Weighted',
+* when there are missing values or new categories), which requires holding the full outputs in
+* memory ('calc_similarity' should be used instead). The file is deleted if returning 'EXIT_FAILURE'.
+*/
+int calc_similarity_to_file(const char *file_path, bool as_float,
+                            double numeric_data[], int categ_data[],
+                            double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                            size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                            IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                            size_t n_from);
+
+
+/* Build an index for finding nearest neighbours in a reference set of rows
+* 
+* Passes each row of the reference set through each tree of the model, storing the terminal
+* node at which it ends up and the rows that end up under each node, so that nearest neighbours
+* for new rows can be found through 'query_neighbors_index' without calculating the distances to
+* every row in the reference set.
+* 
+* The index is tied to the model with which it was built, and should be rebuilt if the trees
+* in the model change (e.g. after adding more trees).
+* 
+* Parameters
+* ==========
+* - index (out)
+*       Object where the index will be built. Any previous contents will be overwritten.
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, nrows
+*       The reference rows, in the same format as for 'calc_similarity'.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if using the extended model.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if using the single-variable model.
+* - nthreads
+*       Number of parallel threads to use.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the index was built successfully, or
+* 'EXIT_FAILURE' (typically =1) if some row has to be divided between both branches of a
+* tree (models with 'missing_action' = 'Divide' or 'new_cat_action' = 'Weighted', when
+* there are missing values or new categories), in which case it cannot be indexed.
+*/
+int build_neighbors_index(NeighborsIndex &index,
+                          double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          int nthreads);
+
+
+/* Find nearest neighbours of new rows among the rows of a reference set
+* 
+* Parameters
+* ==========
+* - index
+*       Index built from the reference rows through 'build_neighbors_index', with the same model
+*       that is passed here.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if using the extended model.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if using the single-variable model.
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, nrows
+*       The rows for which to find nearest neighbours, in the same format as for 'calc_similarity'.
+* - k
+*       Number of neighbours to find for each row. Must be at most the number of rows in the index.
+* - assume_full_distr
+*       Same as for 'calc_similarity'.
+* - standardize_dist
+*       Whether to output standardized distances (as 'calc_similarity' does) or average separation
+*       depths, in which case nearer neighbours have larger numbers.
+* - neighbors[nrows * k] (out)
+*       Array where to write the indices of the nearest neighbours of each row (as positions in
+*       the reference set), as a row-major matrix with the nearest neighbour first.
+* - distances[nrows * k] (out)
+*       Array where to write the distances (or average separation depths) corresponding to each
+*       entry in 'neighbors'.
+* - nthreads
+*       Number of parallel threads to use. Each thread will process different rows.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the neighbours were found successfully, or
+* 'EXIT_FAILURE' (typically =1) if 'k' is larger than the number of reference rows, if the
+* index does not correspond to the trees in the model, or if some row has to be divided between
+* both branches of a tree (see the documentation for 'build_neighbors_index').
+*/
+int query_neighbors_index(NeighborsIndex &index,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, size_t k, bool assume_full_distr, bool standardize_dist,
+                          size_t neighbors[], double distances[], int nthreads);
+
+
+/* Calculate a sparse graph with the pairs of rows that are close to each other
+* 
+* Calculates the same distances or average separation depths as 'calc_similarity', but only
+* for the pairs of rows that are below a given distance from each other and/or among the nearest
+* neighbours of each other, producing a sparse matrix in CSR format instead of a dense matrix.
+* The rows are indexed as in 'build_neighbors_index' and the neighbours of each row are found
+* by visiting the rows that end up in the same nodes as it, so the memory requirements are
+* proportional to the number of rows times the number of trees plus the number of pairs in the
+* output, rather than to the number of rows squared as for 'calc_similarity'.
+* 
+* Parameters
+* ==========
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, nrows, nthreads, assume_full_distr,
+*   standardize_dist, model_outputs, model_outputs_ext
+*       Same as for 'calc_similarity'.
+* - threshold
+*       Pairs of rows will be output only if their distance is at most this number (when passing
+*       'standardize_dist' = 'true'), or if their average separation depth is at least this
+*       number (when passing 'standardize_dist' = 'false'). Pass NAN to output pairs regardless
+*       of their distance, in which case 'top_m' must be passed.
+* - top_m
+*       Maximum number of pairs to output for each row, which will be the ones with the smallest
+*       distance to that row (ties might be resolved in any way). If passing both 'threshold'
+*       and 'top_m', will output the pairs that meet both criteria. Pass zero to output pairs
+*       regardless of how many there are for each row, in which case 'threshold' must be passed.
+*       Note that the resulting graph will not necessarily be symmetric when passing it.
+* - indptr (out)
+*       Vector where to write the position at which the entries for each row start in 'indices'
+*       and 'values', with 'nrows' + 1 entries.
+* - indices (out)
+*       Vector where to write the other row in each pair, sorted in ascending order for each row.
+*       A row is never paired with itself.
+* - values (out)
+*       Vector where to write the distance or average separation depth for each pair.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the graph was calculated successfully, or
+* 'EXIT_FAILURE' (typically =1) if passing neither 'threshold' nor 'top_m', or if some row has
+* to be divided between both branches of a tree (see the documentation for 'build_neighbors_index').
+*/
+int calc_similarity_graph(double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          double threshold, size_t top_m,
+                          std::vector<size_t> &indptr, std::vector<size_t> &indices, std::vector<double> &values);
+
+
 /* Impute missing values in new data
 * 
 * Parameters
@@ -969,6 +1600,27 @@ void impute_missing_values(double numeric_data[], int categ_data[],
                            IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                            Imputer &imputer);
 
+/* Convert the imputation nodes of an already-fitted imputer to the compact layout
+* 
+* Keeps only the terminal nodes of each tree, with their numeric statistics in one flat array
+* per tree and only the non-zero category sums, optionally as 32-bit floats, which can reduce
+* the memory used by the imputer by a large factor when there are categorical columns. The
+* imputer can be used in the same way afterwards ('impute_missing_values', 'merge_models',
+* 'add_trees', serialization). Imputations are the same as before when not using 'as_float'.
+* 
+* Parameters
+* ==========
+* - imputer (in, out)
+*       Imputer object fitted through 'fit_iforest'. Its member 'imputer_tree' will be emptied
+*       and member 'imputer_tree_compact' will be filled instead.
+* - as_float
+*       Whether to store the sums and weights as 'float' (32-bit) instead of 'double'. This
+*       halves the memory needed for them, at the expense of some precision in the imputations.
+* - nthreads
+*       Number of parallel threads to use.
+*/
+void compact_imputer(Imputer &imputer, bool as_float, int nthreads);
+
 /* Append trees from one model into another
 * 
 * Parameters
@@ -1008,7 +1660,11 @@ void impute_missing_values(double numeric_data[], int categ_data[],
 * - imputer (in, out)
 *       Pointer to imputation object which has already been fit through 'fit_iforest' along with
 *       either 'model' or 'ext_model' in the same call to 'fit_iforest'.
-*       The imputation nodes from 'iother' will be merged into this (will be at the end of vector member 'imputer_tree').
+*       The imputation nodes from 'iother' will be merged into this (will be at the end of vector member 'imputer_tree',
+*       or of 'imputer_tree_compact' if either of the two imputers is in the compact layout from 'compact_imputer').
+*       Note that if only 'iother' is in the compact layout, this imputer will be converted to the compact layout
+*       (as through 'compact_imputer'), storing its values as 'float' if 'iother' stores them as 'float'.
+*       If only this imputer is in the compact layout, the nodes from 'iother' are converted to its layout instead.
 *       Hyperparameters related to imputation might differ between 'imputer' and 'iother' ('imputer' will preserve its
 *       hyperparameters after the merge).
 *       Pass NULL if this is not to be used.
@@ -1025,6 +1681,295 @@ void merge_models(IsoForest*     model,      IsoForest*     other,
                   Imputer*       imputer,    Imputer*       iother);
 
 
+/* Forest with a fixed number of trees, in which new trees replace the oldest ones
+* 
+* The contents of this struct are internal to the library - it can only be used through
+* 'create_rolling_forest', 'delete_rolling_forest', 'update_rolling_forest' and 'get_rolling_forest_model'.
+*/
+typedef struct RollingForest RollingForest;
+
+/* Create a forest with a fixed number of trees that are replaced by new ones as more data arrives
+* 
+* Parameters
+* ==========
+* - capacity
+*       Maximum number of trees that the model will have. Once it reaches this number, each new tree
+*       that is added replaces the oldest one.
+* 
+* Returns
+* =======
+* Pointer to a new 'RollingForest' object, which must be freed with 'delete_rolling_forest'. It will
+* not contain any model until 'update_rolling_forest' is called.
+*/
+RollingForest* create_rolling_forest(size_t capacity);
+
+/* Free a forest object produced by 'create_rolling_forest' */
+void delete_rolling_forest(RollingForest *rolling_forest);
+
+/* Grow new trees on a chunk of data and put them in place of the oldest trees in a rolling forest
+* 
+* The new trees are fit only to the data passed here, in the same way as 'fit_iforest' would do
+* for a model with 'ntrees' trees. Until the forest reaches its capacity, they are added to the
+* existing ones, and afterwards they replace the trees that were added the earliest.
+* 
+* Each update produces a new model object. Models obtained through 'get_rolling_forest_model' before
+* the update are left untouched and can continue being used for predictions while it runs, and
+* 'get_rolling_forest_model' does not wait for it to finish. Note that this is not lock-free: the
+* pointer to the current model is read and swapped through 'std::atomic_load' and 'std::atomic_store',
+* which typical standard library implementations guard with a short-lived internal lock.
+* The trees that remain are moved into the new model from the model that was current
+* before the last update, which the forest keeps until the next update (so up to two models are kept
+* in memory), or are copied from the current model if the previous one is still being used somewhere.
+* Updates to the same forest can be called from different threads, but they will run one at a time.
+* 
+* Parameters are the same as for 'fit_iforest' (see the documentation in there for details), with
+* the following differences:
+* 
+* Parameters
+* ==========
+* - rolling_forest
+*       Pointer to the object created through 'create_rolling_forest'.
+* - ndim
+*       Must be the same in every call to this function for the same forest. The type of model
+*       is determined in the first update (extended model if 'ndim>1', same as for 'fit_iforest'),
+*       and later updates grow trees of the same type as the ones that are already in the forest.
+* - ntrees
+*       Number of new trees to grow on this data. If it's larger than the capacity of the forest,
+*       will grow only as many trees as the capacity.
+* - random_seed
+*       Seed that will be used for the random number generators. Each new tree will use a different
+*       seed derived from this one and from the number of trees that were grown before it, so it's
+*       fine to pass the same seed in each call.
+* 
+* Does not support calculating outputs while fitting, nor building an imputer.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) upon completion.
+* If the process receives an interrupt signal, or if 'ndim' does not match with the trees
+* that are already in the forest, will return instead 'EXIT_FAILURE' (typically =1), and
+* the model will remain the same as before.
+*/
+int update_rolling_forest(RollingForest *rolling_forest,
+                          double numeric_data[],  size_t ncols_numeric,
+                          int    categ_data[],    size_t ncols_categ,    int ncat[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                          double sample_weights[], bool with_replacement, bool weight_as_sample,
+                          size_t nrows, size_t sample_size, size_t ntrees, size_t max_depth,
+                          bool   limit_depth, bool penalize_range,
+                          double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
+                          double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                          double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                          double min_gain, MissingAction missing_action,
+                          CategSplit cat_split_type, NewCategAction new_cat_action,
+                          bool   all_perm, uint64_t random_seed, RNGType rng_type, int nthreads);
+
+/* Get the current model from a rolling forest
+* 
+* The model obtained here will not be modified by later calls to 'update_rolling_forest', so it
+* can be used for predictions (e.g. passing 'model.get()' to 'predict_iforest') at the same time as
+* the forest gets updated. In order to use the newer trees, need to call this function again.
+* 
+* Parameters
+* ==========
+* - rolling_forest
+*       Pointer to the object created through 'create_rolling_forest'.
+* - model (out)
+*       Will be set to the current single-variable model, or to an empty pointer if the
+*       forest uses the extended model or has not yet been updated.
+* - model_ext (out)
+*       Will be set to the current extended model, or to an empty pointer if the forest
+*       uses the single-variable model or has not yet been updated.
+*/
+void get_rolling_forest_model(RollingForest *rolling_forest,
+                              std::shared_ptr<IsoForest> &model,
+                              std::shared_ptr<ExtIsoForest> &model_ext);
+
+
+/* Write data to a file in the layout that can be memory-mapped through 'map_data_file'
+* 
+* The file consists of a header ('MappedDataHeader') followed by the arrays for the data, each
+* starting at an offset which is a multiple of 64 bytes: numeric data (either as a column-major
+* matrix of doubles, or as the non-zero values of a CSC matrix followed by its indices and index
+* pointer, which are stored with the size of 'sparse_ix'), categorical data (column-major 32-bit
+* integers), and the number of categories of each categorical column. The numbers are stored with the
+* endianness of the computer that writes the file, and such a file cannot be mapped in a computer with
+* different endianness.
+* 
+* Parameters
+* ==========
+* - file_path
+*       Name of the file to write. If it already exists, will be overwritten.
+* - numeric_data, ncols_numeric, categ_data, ncols_categ, ncat, Xc, Xc_ind, Xc_indptr, nrows
+*       Data to write, in the same format as taken by 'fit_iforest' (see the documentation in there
+*       for details). Sparse data must be in CSC format.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the file was written successfully,
+* or 'EXIT_FAILURE' (typically =1) otherwise.
+*/
+int write_mapped_data(const char *file_path,
+                      double numeric_data[],  size_t ncols_numeric,
+                      int    categ_data[],    size_t ncols_categ,    int ncat[],
+                      double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                      size_t nrows);
+
+
+/* Map into memory a data file written by 'write_mapped_data'
+* 
+* The data is not read nor copied - the pointers in the output object point directly into the
+* mapped file, so they can be passed to 'fit_iforest', 'predict_iforest', 'calc_similarity' and
+* 'impute_missing_values' the same way as arrays in memory would be, e.g.:
+*     predict_iforest(mapped.numeric_data, mapped.categ_data,
+*                     mapped.Xc, mapped.Xc_ind, mapped.Xc_indptr,
+*                     NULL, NULL, NULL,
+*                     mapped.nrows, nthreads, true, &model, NULL, outlier_scores, NULL);
+* 
+* The pages get loaded as they are accessed and are shared with other processes that map the same file.
+* 
+* Parameters
+* ==========
+* - mapped (out)
+*       Object where to put the pointers to the data. Must be released through 'unmap_data_file'.
+*       Data that is not in the file (e.g. categorical columns) will have NULL pointers.
+* - file_path
+*       Name of the file to map.
+* - use
+*       What the data will be used for, which determines the hints given to the operating system
+*       about the pattern in which the data will be accessed (see 'advise_mapped_data'), and
+*       whether it can be modified. When passing 'UseForImputation', the mapping will be writable
+*       and shared with the file, so the imputed values (from 'impute_missing_values' or from
+*       'fit_iforest' with 'impute_at_fit=true') will be written into the file. Otherwise, the data
+*       is mapped as read-only, and trying to modify it will end the process.
+* - verify
+*       Whether to check that all the row indices of sparse data are within the number of rows and
+*       sorted within each column, and that all the categories are within the number of categories
+*       of their column. Data with invalid values would make the functions that use it read outside
+*       of the arrays. This requires reading all of the indices and categorical data when the file is
+*       mapped, so it should only be skipped for files that come from a trusted source. The sizes of
+*       the arrays and the column pointers of sparse data ('Xc_indptr') are always checked.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the file was mapped successfully,
+* or 'EXIT_FAILURE' (typically =1) if it could not be opened or is not a valid data file.
+*/
+int map_data_file(MappedData &mapped, const char *file_path, MappedDataUse use, bool verify);
+
+
+/* Give hints about the pattern in which the mapped data will be accessed
+* 
+* When fitting a model, each column is first read in full while preparing the data (e.g. for finding
+* constant columns and columns with missing values), and the rows are then accessed at the positions
+* sampled for each tree, so the default read-ahead of the operating system is kept ('UseForFitting').
+* When predicting or imputing, the rows are processed in order, so each column is read sequentially and
+* its pages can be loaded further ahead and dropped soon after use ('UseForPrediction' and
+* 'UseForImputation'). The hints are already set by
+* 'map_data_file', but can be changed with this function if the same mapping is used for something else.
+* These are only hints to the operating system and do not change the results. Note that this function
+* does not make a read-only mapping writable.
+*/
+void advise_mapped_data(MappedData &mapped, MappedDataUse use);
+void unmap_data_file(MappedData &mapped);
+
+
+/* Write a model to a file in a layout that can be used for predictions right after being mapped
+* into memory through 'map_model_file', without de-serializing it
+* 
+* The file consists of a header ('MappedModelHeader'), a table with the kind, element size,
+* number of elements and offset of each section ('MappedModelSection'), and the sections
+* themselves, each starting at an offset which is a multiple of 64 bytes. The sections hold
+* the nodes of all the trees one after the other as plain structs ('MappedTreeNode' or
+* 'MappedHPlaneNode') along with where each tree starts, and the variable-length parts of the
+* nodes (such as categorical splits or the columns of hyperplanes) in separate arrays which
+* the nodes index into. The header contains a checksum of the whole file, and the
+* revision of the format together with the oldest revision that is able to read it - later
+* revisions are meant to add new kinds of sections, which older readers will skip.
+* 
+* The numbers are stored with the endianness of the computer that writes the file, and such
+* a file cannot be mapped in a computer with different endianness. The file does not depend
+* on Cereal, and is written one tree at a time without making a copy of the whole model.
+* 
+* Parameters
+* ==========
+* - file_path
+*       Name of the file to write. If it already exists, will be overwritten.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the model to write is an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the model to write is a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the file was written successfully,
+* or 'EXIT_FAILURE' (typically =1) otherwise.
+*/
+int write_model_file(const char *file_path, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext);
+
+
+/* Map into memory a model file written by 'write_model_file'
+* 
+* The model is not read nor copied - the pointers in the output object point directly into the
+* mapped file, and can be passed to 'predict_mapped_model', which traverses the nodes of the trees
+* in the file itself. Only the header and the table of sections are read when mapping it, and the
+* pages with the nodes get loaded as the predictions reach them and are shared with other processes
+* that map the same file, so mapping a large model takes about the same time as mapping a small one
+* and does not need memory for a copy of it.
+* 
+* Parameters
+* ==========
+* - mapped (out)
+*       Object where to put the pointers to the model. Must be released through 'unmap_model_file'.
+* - file_path
+*       Name of the file to map.
+* - verify
+*       Whether to read the whole file in order to verify its checksum and that the indices stored
+*       in the nodes of the trees are within the bounds of the arrays in the file. If passing 'false',
+*       only the header and the table of sections will be checked, and a corrupted file could make
+*       the predictions read outside of the mapped memory.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the file was mapped successfully,
+* or 'EXIT_FAILURE' (typically =1) if it could not be opened, is not a valid model file,
+* was written by a newer revision of the format that this one cannot read, or was written
+* in a computer with different endianness.
+*/
+int map_model_file(MappedModel &mapped, const char *file_path, bool verify);
+void unmap_model_file(MappedModel &mapped);
+
+
+/* Predict outlier score, average depth, or terminal node numbers from a model mapped through 'map_model_file'
+* 
+* This produces the same outputs as 'predict_iforest' with the model from which the file was
+* written, taking the data in the same format, but reads the nodes from the mapped file.
+* 
+* Parameters
+* ==========
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, Xr, Xr_ind, Xr_indptr, nrows, nthreads, standardize
+*       Same as for 'predict_iforest' (see the documentation there for details).
+* - model
+*       Model mapped from a file through 'map_model_file'.
+* - output_depths[nrows] (out)
+*       Pointer to array where the output average depths or outlier scores will be written into.
+*       Must already be initialized to zeros.
+* - tree_num[nrows * ntrees] (out)
+*       Pointer to array where the output terminal node numbers will be written into.
+*       Pass NULL if only average depths or outlier scores are desired.
+*/
+void predict_mapped_model(double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          double Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                          size_t nrows, int nthreads, bool standardize,
+                          MappedModel &model, double output_depths[], sparse_ix tree_num[]);
+
+
 /* Serialization and de-serialization functions using Cereal
 * 
 * Parameters
@@ -2,11 +2,13 @@ import numpy as np, pandas as pd
 from scipy.sparse import csc_matrix, csr_matrix, issparse, isspmatrix_csc, isspmatrix_csr, vstack as sp_vstack
 import warnings
 import multiprocessing
+import itertools
+import mmap
 import ctypes
 import json
-from ._cpp_interface import isoforest_cpp_obj
+from ._cpp_interface import isoforest_cpp_obj, training_session_cpp_obj, write_mapped_data_file, neighbors_index_cpp_obj
 
-__all__ = ["IsolationForest"]
+__all__ = ["IsolationForest", "TrainingSession", "MappedData"]
 
 class IsolationForest:
     """
@@ -228,6 +230,12 @@ class IsolationForest:
         sample, so if not using sub-samples, it's better to pass column weights calculated externally. For
         categorical columns, will calculate expected kurtosis if the column was converted to numerical by
         assigning to each category a random number ~ Unif(0, 1).
+    kurtosis_sample_size : None or int
+        When passing 'weigh_by_kurtosis=True', number of rows in a random sample (taken once for the whole model)
+        in which to calculate the kurtosis of each column, in which case the same column weights will be used for
+        all the trees instead of calculating them in the sub-sample of each tree. This is much faster when there
+        are many columns. If it's larger than the number of rows, will use all the rows. If passing None, will
+        calculate the kurtosis in the sub-sample of each tree. Ignored when passing 'weigh_by_kurtosis=False'.
     coefs : str, one of "normal" or "uniform"
         For the extended model, whether to sample random coefficients according to a normal distribution ~ N(0, 1)
         (as proposed in [3]) or according to a uniform distribution ~ Unif(-1, +1) as proposed in [4]. Ignored for the
@@ -266,6 +274,11 @@ class IsolationForest:
         and not recommended to change from the default. Ignored when passing 'build_imputer' = 'False'.
     random_seed : int
         Seed that will be used to generate random numbers used by the model.
+    rng_type : str, one of "mersenne_twister", "xoshiro"
+        Family of random number generators to use. Passing "mersenne_twister" will use the same generator
+        as earlier versions (note however that results for a given seed will not match with those versions,
+        as the sampling procedures have changed), while "xoshiro" will use the xoshiro256++ generator - this
+        is faster and has a much smaller state, but will produce different results for the same seed.
     random_state : RandomState
         NumPy random state object - if passed, will be used to generate an integer for 'random_seed', and
         the value that was originally passed to 'random_seed' will be ignored. This is only kept as
@@ -311,11 +324,12 @@ class IsolationForest:
                  categ_split_type = "subset", all_perm = False,
                  coef_by_prop = False, recode_categ = True,
                  weights_as_sample_prob = True, sample_with_replacement = False,
-                 penalize_range = True, weigh_by_kurtosis = False,
+                 penalize_range = True, weigh_by_kurtosis = False, kurtosis_sample_size = None,
                  coefs = "normal", assume_full_distr = True,
                  build_imputer = False, min_imp_obs = 3,
                  depth_imp = "higher", weigh_imp_rows = "inverse",
-                 random_seed = 1, random_state = None, nthreads = -1):
+                 random_seed = 1, rng_type = "mersenne_twister",
+                 random_state = None, nthreads = -1):
         if sample_size is not None:
             assert sample_size > 0
             assert isinstance(sample_size, int)
@@ -332,6 +346,9 @@ class IsolationForest:
         assert isinstance(ntry, int)
         assert random_seed >= 1
         assert isinstance(min_imp_obs, int)
+        if kurtosis_sample_size is not None:
+            assert kurtosis_sample_size > 0
+            assert isinstance(kurtosis_sample_size, int)
         assert min_imp_obs >= 1
 
         if random_state is not None:
@@ -343,6 +360,7 @@ class IsolationForest:
         assert coefs             in ["normal",        "uniform"]
         assert depth_imp         in ["lower",         "higher",   "same"]
         assert weigh_imp_rows    in ["inverse",       "prop",     "flat"]
+        assert rng_type          in ["mersenne_twister", "xoshiro"]
 
         assert prob_pick_avg_gain     >= 0
         assert prob_pick_pooled_gain  >= 0
@@ -420,6 +438,7 @@ class IsolationForest:
         self.weigh_imp_rows          =  weigh_imp_rows
         self.min_imp_obs             =  min_imp_obs
         self.random_seed             =  random_seed
+        self.rng_type                =  rng_type
         self.random_state            =  random_state
         self.nthreads                =  nthreads
 
@@ -430,6 +449,7 @@ class IsolationForest:
         self.sample_with_replacement =  bool(sample_with_replacement)
         self.penalize_range          =  bool(penalize_range)
         self.weigh_by_kurtosis       =  bool(weigh_by_kurtosis)
+        self.kurtosis_sample_size    =  kurtosis_sample_size
         self.assume_full_distr       =  bool(assume_full_distr)
         self.build_imputer           =  bool(build_imputer)
 
@@ -444,6 +464,7 @@ class IsolationForest:
         self.is_fitted_     =  False
         self._cpp_obj       =  isoforest_cpp_obj()
         self._is_extended_  =  self.ndim > 1
+        self._neighbors_index = None
 
     def __str__(self):
         msg = ""
@@ -479,7 +500,7 @@ class IsolationForest:
 
         Parameters
         ----------
-        X : array or array-like (n_samples, n_features)
+        X : array or array-like (n_samples, n_features), or TrainingSession
             Data to which to fit the model. Can pass a NumPy array, Pandas DataFrame, or SciPy sparse CSC matrix.
             If passing a DataFrame, will assume that columns are:
             `Numeric`:
@@ -487,6 +508,8 @@ class IsolationForest:
             `Categorical`:
                 If their dtype is 'object', 'Categorical', or 'bool'.
             Other dtypes are not supported.
+            Can also pass a 'TrainingSession' object with already-prepared data, which is faster when fitting
+            many models to the same data.
         y : None
             Not used. Kept as argument for compatibility with SciKit-learn pipelining.
         sample_weights : None or array(n_samples,)
@@ -494,6 +517,7 @@ class IsolationForest:
             probability (i.e. the observation has a larger effect on the fitted model, if using sub-samples), or
             distribution density (i.e. if the weight is two, it has the same effect of including the same data
             point twice), according to parameter 'weights_as_sample_prob' in the model constructor method.
+            If passing a 'TrainingSession', the weights must be passed to it instead.
         column_weights : None or array(n_features,)
             Sampling weights for each column in 'X'. Ignored when picking columns by deterministic criterion.
             If passing None, each column will have a uniform weight. Cannot be used when weighting by kurtosis.
@@ -503,6 +527,12 @@ class IsolationForest:
         self : obj
             This object.
         """
+        session = None
+        if isinstance(X, TrainingSession):
+            if sample_weights is not None:
+                raise ValueError("When passing a 'TrainingSession', 'sample_weights' must be passed to it instead.")
+            session = X
+            sample_weights = session._sample_weights
         if self.sample_size is None and sample_weights is not None and self.weights_as_sample_prob:
             raise ValueError("Sampling weights are only supported when using sub-samples for each tree.")
         if column_weights is not None and self.weigh_by_kurtosis:
@@ -550,6 +580,7 @@ class IsolationForest:
                                 ctypes.c_bool(False).value,
                                 ctypes.c_bool(False).value,
                                 ctypes.c_bool(self.weigh_by_kurtosis).value,
+                                ctypes.c_size_t(0 if self.kurtosis_sample_size is None else self.kurtosis_sample_size).value,
                                 ctypes.c_double(self.prob_pick_avg_gain).value,
                                 ctypes.c_double(self.prob_split_avg_gain).value,
                                 ctypes.c_double(self.prob_pick_pooled_gain).value,
@@ -562,10 +593,156 @@ class IsolationForest:
                                 ctypes.c_size_t(self.min_imp_obs).value,
                                 self.depth_imp,
                                 self.weigh_imp_rows,
-                                ctypes.c_bool(self.build_imputer).value,
+                                ctypes.c_bool(self.build_imputer and session is None and not isinstance(X, MappedData)).value,
                                 ctypes.c_bool(False).value,
                                 ctypes.c_uint64(seed).value,
-                                ctypes.c_int(self.nthreads).value)
+                                self.rng_type,
+                                ctypes.c_int(self.nthreads).value,
+                                None if session is None else session._cpp_obj)
+        self.is_fitted_ = True
+        return self
+
+    def fit_chunks(self, chunks, column_weights = None):
+        """
+        Fit isolation forest model to data that comes in chunks
+
+        Fits the model to data that is passed in parts, without ever having all of it in memory at
+        once. The sub-sample for each tree is drawn in one pass over the chunks (through reservoir
+        sampling), so the memory required depends on the number of trees and on the sample size,
+        but not on the number of rows in the data. The chunks can for example be read from files,
+        or be the output of a generator.
+
+        Note
+        ----
+        The samples are drawn differently than in 'fit', so the results will not be the same as
+        when passing all the data at once. This requires passing 'sample_size' to the constructor,
+        always samples without replacement (so 'sample_with_replacement' must be False), only
+        supports numeric data in dense arrays, and does not support building an imputer nor
+        'kurtosis_sample_size'.
+
+        Parameters
+        ----------
+        chunks : iterable
+            Iterable (e.g. a list or a generator) producing the chunks of rows, each being either a
+            2D array-like with numeric columns, or a tuple '(X, sample_weights)' with the sample weights
+            for each row of 'X' (either all the chunks or none of them should have weights). All the
+            chunks must have the same columns.
+            The sample weights are taken as either sampling probabilities or as distribution density
+            weights according to parameter 'weights_as_sample_prob' in the model constructor method.
+        column_weights : None or array(n_features,)
+            Sampling weights for each column in the data. Ignored when picking columns by deterministic criterion.
+            If passing None, each column will have a uniform weight. Cannot be used when weighting by kurtosis.
+
+        Returns
+        -------
+        self : obj
+            This object.
+        """
+        if self.sample_size is None:
+            raise ValueError("Fitting to chunks requires passing 'sample_size'.")
+        if self.build_imputer:
+            raise ValueError("Cannot build an imputer when fitting to chunks.")
+        if self.sample_with_replacement:
+            raise ValueError("Fitting to chunks always samples without replacement.")
+        if self.kurtosis_sample_size is not None:
+            raise ValueError("Cannot pass 'kurtosis_sample_size' when fitting to chunks.")
+        if column_weights is not None and self.weigh_by_kurtosis:
+            raise ValueError("Cannot pass column weights when weighting columns by kurtosis.")
+        self._reset_obj()
+
+        def split_chunk(chunk):
+            if isinstance(chunk, tuple):
+                X, sample_weights = chunk
+                return X, sample_weights
+            return chunk, None
+
+        chunks = iter(chunks)
+        try:
+            first_chunk = next(chunks)
+        except StopIteration:
+            raise ValueError("Got no chunks to fit the model to.")
+        X, sample_weights = split_chunk(first_chunk)
+        has_weights = sample_weights is not None
+        ncols = np.array(X).shape[1]
+
+        self._ncols_numeric = ncols
+        self._ncols_categ   = 0
+        self.cols_numeric_  = np.array([])
+        self.cols_categ_    = np.array([])
+        self._cat_mapping   = list()
+
+        def process_chunks():
+            nrows = 0
+            for chunk in itertools.chain([first_chunk], chunks):
+                X, sample_weights = split_chunk(chunk)
+                if (sample_weights is not None) != has_weights:
+                    raise ValueError("Either all the chunks or none of them must have sample weights.")
+                if issparse(X):
+                    raise ValueError("Fitting to chunks does not support sparse matrices.")
+                X = np.asfortranarray(np.array(X)).astype(ctypes.c_double)
+                if (len(X.shape) != 2) or (X.shape[1] != ncols):
+                    raise ValueError("All the chunks must be two-dimensional and have the same columns.")
+                if sample_weights is not None:
+                    sample_weights = np.array(sample_weights).reshape(-1).astype(ctypes.c_double)
+                    if sample_weights.shape[0] != X.shape[0]:
+                        raise ValueError("'sample_weights' has different number of rows than its chunk.")
+                nrows += X.shape[0]
+                yield X, sample_weights
+            if nrows == 0:
+                raise ValueError("Input data has zero rows.")
+
+        if column_weights is not None:
+            column_weights = np.array(column_weights).reshape(-1).astype(ctypes.c_double)
+            if ncols != column_weights.shape[0]:
+                raise ValueError("'column_weights' has %d entries, but data has %d columns." % (column_weights.shape[0], ncols))
+        if self.ndim > ncols:
+            msg  = "Model was meant to take %d variables for each split, but data has %d columns."
+            msg += " Will decrease number of splitting variables to match number of columns."
+            msg = msg % (self.ndim, ncols)
+            warnings.warn(msg)
+            self.ndim = ncols
+            self._is_extended_ = self.ndim > 1
+
+        if self.max_depth == "auto":
+            max_depth = 0
+            limit_depth = True
+        elif self.max_depth is None:
+            max_depth = 0
+            limit_depth = False
+        else:
+            max_depth = self.max_depth
+            limit_depth = False
+
+        if isinstance(self.random_state, np.random.RandomState):
+            seed = self.random_state.randint(np.iinfo(np.int32).max)
+        else:
+            seed = self.random_seed
+
+        self._cpp_obj.fit_model_streaming(process_chunks(), column_weights,
+                                          ctypes.c_size_t(ncols).value,
+                                          ctypes.c_size_t(self.ndim).value,
+                                          ctypes.c_size_t(self.ntry).value,
+                                          self.coefs,
+                                          ctypes.c_bool(self.coef_by_prop).value,
+                                          ctypes.c_bool(self.weights_as_sample_prob).value,
+                                          ctypes.c_size_t(self.sample_size).value,
+                                          ctypes.c_size_t(self.ntrees).value,
+                                          ctypes.c_size_t(max_depth).value,
+                                          ctypes.c_bool(limit_depth).value,
+                                          ctypes.c_bool(self.penalize_range).value,
+                                          ctypes.c_bool(self.weigh_by_kurtosis).value,
+                                          ctypes.c_double(self.prob_pick_avg_gain).value,
+                                          ctypes.c_double(self.prob_split_avg_gain).value,
+                                          ctypes.c_double(self.prob_pick_pooled_gain).value,
+                                          ctypes.c_double(self.prob_split_pooled_gain).value,
+                                          ctypes.c_double(self.min_gain).value,
+                                          self.missing_action,
+                                          self.categ_split_type,
+                                          self.new_categ_action,
+                                          ctypes.c_bool(self.all_perm).value,
+                                          ctypes.c_uint64(seed).value,
+                                          self.rng_type,
+                                          ctypes.c_int(self.nthreads).value)
         self.is_fitted_ = True
         return self
 
@@ -655,6 +832,9 @@ class IsolationForest:
                 warnings.warn(msg)
                 self.build_imputer = True
 
+        if isinstance(X, TrainingSession):
+            raise ValueError("Cannot use a 'TrainingSession' with 'fit_predict', only with 'fit' and 'partial_fit'.")
+
         self._reset_obj()
         X_num, X_cat, ncat, sample_weights, column_weights, nrows = self._process_data(X, None, column_weights)
 
@@ -699,6 +879,7 @@ class IsolationForest:
                                                                    ctypes.c_bool(output_outlierness is not None).value,
                                                                    ctypes.c_bool(output_outlierness == "score").value,
                                                                    ctypes.c_bool(self.weigh_by_kurtosis).value,
+                                                                   ctypes.c_size_t(0 if self.kurtosis_sample_size is None else self.kurtosis_sample_size).value,
                                                                    ctypes.c_double(self.prob_pick_avg_gain).value,
                                                                    ctypes.c_double(self.prob_split_avg_gain).value,
                                                                    ctypes.c_double(self.prob_pick_pooled_gain).value,
@@ -714,6 +895,7 @@ class IsolationForest:
                                                                    ctypes.c_bool(output_imputed).value,
                                                                    ctypes.c_bool(self.all_perm).value,
                                                                    ctypes.c_uint64(seed).value,
+                                                                   self.rng_type,
                                                                    ctypes.c_int(self.nthreads).value)
         self.is_fitted_ = True
 
@@ -731,7 +913,31 @@ class IsolationForest:
             return outp
 
     def _process_data(self, X, sample_weights, column_weights):
-        if X.__class__.__name__ == "DataFrame":
+        columns = None
+        if isinstance(X, TrainingSession):
+            self._ncols_numeric = X._ncols_numeric
+            self._ncols_categ   = X._ncols_categ
+            self.cols_numeric_  = X.cols_numeric_
+            self.cols_categ_    = X.cols_categ_
+            self._cat_mapping   = X._cat_mapping
+            columns = X._columns
+            X_num = X._X_num
+            X_cat = X._X_cat
+            nrows = X.nrows_
+
+        elif isinstance(X, MappedData):
+            self._ncols_numeric = X._ncols_numeric
+            self._ncols_categ   = X._ncols_categ
+            self.cols_numeric_  = np.array([])
+            self.cols_categ_    = np.array([])
+            self._cat_mapping   = [np.arange(nc) for nc in X._ncat] if X._ncat is not None else list()
+            X._advise("fit")
+            X_num = X._X_num
+            X_cat = X._X_cat
+            nrows = X.nrows_
+
+        elif X.__class__.__name__ == "DataFrame":
+            columns = X.columns.values
             ### https://stackoverflow.com/questions/25039626/how-do-i-find-numeric-columns-in-pandas
             X_num = X.select_dtypes(include = [np.number, np.datetime64]).to_numpy()
             X_num = np.asfortranarray(X_num).astype(ctypes.c_double)
@@ -771,14 +977,6 @@ class IsolationForest:
                         X_cat[X_cat.columns[cl]] = X_cat[X_cat.columns[cl]].cat.codes
                     else:
                         X_cat[X_cat.columns[cl]], self._cat_mapping[cl] = pd.factorize(X_cat[X_cat.columns[cl]])
-                    if (self.all_perm
-                        and (self.ndim == 1)
-                        and (self.prob_pick_pooled_gain or self.prob_split_pooled_gain)
-                    ):
-                        if np.math.factorial(self._cat_mapping[cl].shape[0]) > np.iinfo(ctypes.c_size_t).max:
-                            msg  = "Number of permutations for categorical variables is larger than "
-                            msg += "maximum representable integer. Try using 'all_perm=False'."
-                            raise ValueError(msg)
                     # https://github.com/pandas-dev/pandas/issues/30618
                     if self._cat_mapping[cl].__class__.__name__ == "CategoricalIndex":
                         self._cat_mapping[cl] = self._cat_mapping[cl].to_numpy()
@@ -825,6 +1023,14 @@ class IsolationForest:
 
         if X_cat is not None:
             ncat = np.array([self._cat_mapping[cl].shape[0] for cl in range(X_cat.shape[1])], dtype = ctypes.c_int)
+            if (self.all_perm
+                and (self.ndim == 1)
+                and (self.prob_pick_pooled_gain or self.prob_split_pooled_gain)
+            ):
+                if np.math.factorial(ncat.max()) > np.iinfo(ctypes.c_size_t).max:
+                    msg  = "Number of permutations for categorical variables is larger than "
+                    msg += "maximum representable integer. Try using 'all_perm=False'."
+                    raise ValueError(msg)
         else:
             ncat = None
 
@@ -844,8 +1050,8 @@ class IsolationForest:
             if ncols != column_weights.shape[0]:
                 raise ValueError("'column_weights' has %d entries, but data has %d columns." % (column_weights.shape[0], ncols))
             if (X_num is not None) and (X_cat is not None):
-                column_weights = np.r_[column_weights[X.columns.values == self.cols_numeric_],
-                                       column_weights[X.columns.values == self.cols_categ_]]
+                column_weights = np.r_[column_weights[columns == self.cols_numeric_],
+                                       column_weights[columns == self.cols_categ_]]
 
         if self.ndim > 1:
             if self.ndim > ncols:
@@ -858,6 +1064,12 @@ class IsolationForest:
         return X_num, X_cat, ncat, sample_weights, column_weights, nrows
 
     def _process_data_new(self, X, allow_csr = True, allow_csc = True):
+        if isinstance(X, MappedData):
+            if (X._ncols_numeric != self._ncols_numeric) or (X._ncols_categ != self._ncols_categ):
+                raise ValueError("Input has different number of columns than data to which model was fit.")
+            X._advise("predict")
+            return X._X_num, X._X_cat, X.nrows_
+
         if X.__class__.__name__ == "DataFrame":
             if (self.cols_numeric_.shape[0] + self.cols_categ_.shape[0]) > 0:
                 missing_cols = np.setdiff1d(np.array(X.columns.values), np.r_[self.cols_numeric_, self.cols_categ_])
@@ -930,6 +1142,10 @@ class IsolationForest:
         return X_num, X_cat, nrows
 
     def _rearrange_imputed(self, orig, X_num, X_cat):
+        if isinstance(orig, MappedData):
+            ### the values were imputed in the mapped data itself
+            return orig
+
         if orig.__class__.__name__ == "DataFrame":
             if X_num is not None:
                 df_num = pd.DataFrame(X_num, columns = self.cols_numeric_)
@@ -1025,7 +1241,8 @@ class IsolationForest:
         else:
             return tree_num
 
-    def predict_distance(self, X, output = "dist", square_mat = False, X_ref = None):
+    def predict_distance(self, X, output = "dist", square_mat = False, X_ref = None,
+                         output_file = None, output_dtype = "float64"):
         """
         Predict approximate distances between points
 
@@ -1038,7 +1255,10 @@ class IsolationForest:
 
         Note
         ----
-        The more threads that are set for the model, the higher the memory requirement will be as each
+        When there are few rows compared to the number of trees, or when some row needs to be
+        divided between both branches of a tree (models with ``missing_action="divide"`` or
+        ``new_categ_action="weighted"`` when there are missing values or new categories), the more
+        threads that are set for the model, the higher the memory requirement will be as each
         thread will allocate an array with one entry per combination.
 
         Parameters
@@ -1061,12 +1281,24 @@ class IsolationForest:
             ``X`` and each point in ``X_ref``. If passing ``None`` (the default), will calculate
             pairwise distances between the points in ``X``.
             Must be of the same type as ``X`` (e.g. array, DataFrame, CSC).
+        output_file : str or None
+            File where to write the distances instead of holding them in memory, for when the output
+            is too large to fit in memory. The file will be overwritten if it exists, and will contain
+            only the raw numbers (with the endianness of this computer), in the same layout as the output
+            when not passing it (upper triangular part as a 1-d array, or row-major matrix when passing
+            ``X_ref``). The distances are calculated by blocks of rows and written to the file
+            sequentially. Cannot be used together with ``square_mat=True``, nor when some row needs to
+            be divided between both branches of a tree (see the note above).
+        output_dtype : str, one of "float64", "float32"
+            Type of the numbers to write when passing ``output_file``. Passing "float32" halves
+            the size of the file. Ignored when not passing ``output_file``.
 
         Returns
         -------
         dist : array(n_samples * (n_samples - 1) / 2,) or array(n_samples, n_samples) or array(n_samples, n_ref)
             Approximate distances or average separation depth between points, according to
             parameter 'output'. Shape and size depends on parameter ``square_mat``, or ``X_ref`` if passed.
+            If passing ``output_file``, will be a read-only ``np.memmap`` of that file.
         """
         assert self.is_fitted_
         if not self._is_extended_:
@@ -1076,6 +1308,11 @@ class IsolationForest:
                 msg += "if 'missing_action' != 'divide'."
                 raise ValueError(msg)
         assert output in ["dist", "avg_sep"]
+        if output_file is not None:
+            if square_mat and X_ref is None:
+                raise ValueError("Cannot pass 'square_mat=True' together with 'output_file'.")
+            if output_dtype not in ["float64", "float32"]:
+                raise ValueError("'output_dtype' must be one of 'float64' or 'float32'.")
 
         if X_ref is None:
             nobs_group1 = 0
@@ -1094,6 +1331,26 @@ class IsolationForest:
         if nrows == 1:
             raise ValueError("Cannot calculate pairwise distances for only 1 row.")
 
+        if output_file is not None:
+            output_file = str(output_file)
+            written = self._cpp_obj.dist_to_file(X_num, X_cat, self._is_extended_, output_file,
+                                                 ctypes.c_bool(output_dtype == "float32").value,
+                                                 ctypes.c_size_t(nrows).value,
+                                                 ctypes.c_int(self.nthreads).value,
+                                                 ctypes.c_bool(self.assume_full_distr).value,
+                                                 ctypes.c_bool(output == "dist").value,
+                                                 ctypes.c_size_t(nobs_group1).value)
+            if not written:
+                msg  = "Could not write distances to file '%s'. " % output_file
+                msg += "Note that this is not possible when some row gets divided between both branches "
+                msg += "of a tree (missing values or new categories with 'missing_action' = 'divide')."
+                raise ValueError(msg)
+            if X_ref is not None:
+                shape = (nobs_group1, nrows - nobs_group1)
+            else:
+                shape = (int((nrows * (nrows - 1)) / 2),)
+            return np.memmap(output_file, dtype = output_dtype, mode = "r", shape = shape)
+
         tmat, dmat, rmat = self._cpp_obj.dist(X_num, X_cat, self._is_extended_,
                                               ctypes.c_size_t(nrows).value,
                                               ctypes.c_int(self.nthreads).value,
@@ -1109,6 +1366,155 @@ class IsolationForest:
         else:
             return tmat
 
+    def predict_distance_graph(self, X, threshold = None, top_m = None, output = "dist"):
+        """
+        Predict approximate distances between nearby points as a sparse graph
+
+        Calculates the same distances as ``predict_distance``, but only for the pairs of points that
+        are below a given distance of each other and/or among the nearest neighbours of each other,
+        producing a sparse matrix instead of a dense one. The neighbours of each point are found in
+        the same way as in ``kneighbors``, so the memory requirements are proportional to the number
+        of points times the number of trees plus the number of pairs in the output, which allows
+        calculating it for large numbers of points.
+
+        Parameters
+        ----------
+        X : array or array-like (n_samples, n_features)
+            Observations for which to calculate approximate distances. Can pass
+            a NumPy array, Pandas DataFrame, or SciPy sparse CSC matrix.
+        threshold : float or None
+            Pairs of points will be output only if their distance is at most this number (when passing
+            ``output="dist"``), or if their average separation depth is at least this number (when
+            passing ``output="avg_sep"``). If passing ``None``, must pass ``top_m``.
+        top_m : int or None
+            Maximum number of pairs to output for each point, which will be the ones with the smallest
+            distances (ties might be resolved in any way). If passing both ``threshold`` and ``top_m``,
+            will output the pairs that meet both criteria. Note that the resulting matrix is not
+            necessarily symmetric when passing it. If passing ``None``, must pass ``threshold``.
+        output : str, one of "dist", "avg_sep"
+            Type of distances to output, same as for ``predict_distance``.
+
+        Returns
+        -------
+        dist : CSR(n_samples, n_samples)
+            Sparse matrix in which entry (i,j) contains the distance or average separation depth between
+            points 'i' and 'j' if they meet the criteria, with no entries in the diagonal.
+        """
+        assert self.is_fitted_
+        assert output in ["dist", "avg_sep"]
+        if threshold is None and top_m is None:
+            raise ValueError("Must pass at least one of 'threshold' or 'top_m'.")
+        if top_m is not None:
+            top_m = int(top_m)
+            if top_m <= 0:
+                raise ValueError("'top_m' must be a positive integer.")
+
+        X_num, X_cat, nrows = self._process_data_new(X, allow_csr = False)
+        res = self._cpp_obj.dist_graph(X_num, X_cat, self._is_extended_,
+                                       ctypes.c_size_t(nrows).value,
+                                       ctypes.c_int(self.nthreads).value,
+                                       ctypes.c_bool(self.assume_full_distr).value,
+                                       ctypes.c_bool(output == "dist").value,
+                                       ctypes.c_double(np.nan if threshold is None else threshold).value,
+                                       ctypes.c_size_t(0 if top_m is None else top_m).value)
+        if res is None:
+            msg  = "Could not calculate distances graph. Note that this is not possible when some row gets "
+            msg += "divided between both branches of a tree (missing values or new categories with "
+            msg += "'missing_action' = 'divide')."
+            raise ValueError(msg)
+        indptr, indices, values = res
+        return csr_matrix((values, indices, indptr), shape = (nrows, nrows))
+
+    def build_neighbors_index(self, X_ref):
+        """
+        Build an index for finding nearest neighbours among a set of points
+
+        Passes each point from ``X_ref`` through each tree in the model, storing the terminal node
+        at which it ends up and the points that end up under each node, so that nearest neighbours
+        (according to the same distances as calculated by ``predict_distance``) for new points can later
+        be found through ``kneighbors`` without calculating distances to all the points in ``X_ref``.
+
+        Note
+        ----
+        The index is discarded when the trees in the model change (e.g. after calling ``partial_fit``
+        or ``append_trees``), and needs to be built again. It is not possible to build it when some point
+        needs to be divided between both branches of a tree (models with ``missing_action="divide"`` or
+        ``new_categ_action="weighted"`` when there are missing values or new categories).
+
+        Parameters
+        ----------
+        X_ref : array or array-like (n_ref, n_features)
+            Points among which to search for nearest neighbours. Can pass
+            a NumPy array, Pandas DataFrame, or SciPy sparse CSC matrix.
+
+        Returns
+        -------
+        self : obj
+            This object.
+        """
+        assert self.is_fitted_
+        X_num, X_cat, nrows = self._process_data_new(X_ref, allow_csr = False)
+        index_obj = neighbors_index_cpp_obj()
+        built = self._cpp_obj.build_neighbors_index(index_obj, X_num, X_cat, self._is_extended_,
+                                                    ctypes.c_size_t(nrows).value,
+                                                    ctypes.c_int(self.nthreads).value)
+        if not built:
+            msg  = "Could not build neighbors index. Note that this is not possible when some row gets "
+            msg += "divided between both branches of a tree (missing values or new categories with "
+            msg += "'missing_action' = 'divide')."
+            raise ValueError(msg)
+        self._neighbors_index = index_obj
+        return self
+
+    def kneighbors(self, X, n_neighbors = 5, output = "dist"):
+        """
+        Find nearest neighbours among the points from ``build_neighbors_index``
+
+        Finds, for each point in ``X``, the points passed to ``build_neighbors_index`` with the smallest
+        approximate distance to it, which are the same that would be obtained by calculating all the
+        distances with ``predict_distance(X, X_ref=X_ref)`` (except for ties), but visiting only the
+        points that end up in the same nodes as the point in ``X`` in most trees.
+
+        Parameters
+        ----------
+        X : array or array-like (n_samples, n_features)
+            Points for which to find nearest neighbours. Can pass
+            a NumPy array, Pandas DataFrame, or SciPy sparse CSC matrix.
+        n_neighbors : int
+            Number of neighbours to find for each point. Must be at most the number
+            of points in the index.
+        output : str, one of "dist", "avg_sep"
+            Type of distances to output, same as for ``predict_distance``.
+
+        Returns
+        -------
+        dist : array(n_samples, n_neighbors)
+            Distances (or average separation depths) between each point and its neighbours, nearest first.
+        ind : array(n_samples, n_neighbors)
+            Indices of the neighbours of each point, as row numbers in the data passed to ``build_neighbors_index``.
+        """
+        assert self.is_fitted_
+        if self._neighbors_index is None:
+            raise ValueError("Must call 'build_neighbors_index' first.")
+        assert output in ["dist", "avg_sep"]
+        n_neighbors = int(n_neighbors)
+        if n_neighbors < 0:
+            raise ValueError("'n_neighbors' must be a non-negative integer.")
+
+        X_num, X_cat, nrows = self._process_data_new(X, allow_csr = False)
+        res = self._cpp_obj.query_neighbors_index(self._neighbors_index, X_num, X_cat, self._is_extended_,
+                                                  ctypes.c_size_t(nrows).value,
+                                                  ctypes.c_size_t(n_neighbors).value,
+                                                  ctypes.c_int(self.nthreads).value,
+                                                  ctypes.c_bool(self.assume_full_distr).value,
+                                                  ctypes.c_bool(output == "dist").value)
+        if res is None:
+            msg  = "Could not find neighbors. 'n_neighbors' must be at most the number of rows in the index, "
+            msg += "and the rows cannot get divided between both branches of a tree."
+            raise ValueError(msg)
+        ind, dist = res
+        return dist, ind.astype(int)
+
     def transform(self, X):
         """
         Impute missing values in the data using isolation forest model
@@ -1178,6 +1584,8 @@ class IsolationForest:
         imputed : array-like(n_samples, n_columns)
             Input data 'X' with missing values imputed according to the model.
         """
+        if isinstance(X, TrainingSession):
+            raise ValueError("Cannot use a 'TrainingSession' with 'fit_transform', only with 'fit' and 'partial_fit'.")
         if self.sample_size is None:
             outp = self.fit_predict(X = X, column_weights = column_weights, output_imputed = True)
             return outp["imputed"]
@@ -1185,33 +1593,49 @@ class IsolationForest:
             self.fit(X = X, column_weights = column_weights)
             return self.transform(X)
 
-    def partial_fit(self, X, sample_weights = None, column_weights = None):
+    def partial_fit(self, X, sample_weights = None, column_weights = None, ntrees = 1):
         """
-        Add additional (single) tree to isolation forest model
+        Add additional tree(s) to isolation forest model
 
-        Adds a single tree fit to the full (non-subsampled) data passed here. Must
+        Adds one or more trees fit to the full (non-subsampled) data passed here. Must
         have the same columns as previously-fitted data.
 
         Parameters
         ----------
-        X : array or array-like (n_samples, n_features)
+        X : array or array-like (n_samples, n_features), or TrainingSession
             Data to which to fit the new tree. Can pass a NumPy array, Pandas DataFrame, or SciPy sparse CSC matrix.
             If passing a DataFrame, will assume that columns are categorical if their dtype is 'object', 'Categorical', or 'bool',
             and will assume they are numerical if their dtype is a subtype of NumPy's 'number' or 'datetime64'.
             Other dtypes are not supported.
+            Can also pass a 'TrainingSession' object with already-prepared data, which must have the same
+            columns and categories as the data to which the model was fit.
         sample_weights : None or array(n_samples,)
             Sample observation weights for each row of 'X', with higher weights indicating
             distribution density (i.e. if the weight is two, it has the same effect of including the same data
             point twice). If not 'None', model must have been built with 'weights_as_sample_prob' = 'False'.
+            If passing a 'TrainingSession', the weights must be passed to it instead.
         column_weights : None or array(n_features,)
             Sampling weights for each column in 'X'. Ignored when picking columns by deterministic criterion.
             If passing None, each column will have a uniform weight. Cannot be used when weighting by kurtosis.
+        ntrees : int
+            Number of trees to add. When adding more than one, the trees are built in parallel
+            (according to parameter 'nthreads' in the constructor), and the result is the same as
+            calling this function that many times.
 
         Returns
         -------
         self : obj
             This object.
         """
+        assert ntrees > 0
+        ntrees = int(ntrees)
+        session = None
+        if isinstance(X, TrainingSession):
+            if sample_weights is not None:
+                raise ValueError("When passing a 'TrainingSession', 'sample_weights' must be passed to it instead.")
+            session = X
+            if (session._sample_weights is not None) and (self.weights_as_sample_prob):
+                raise ValueError("Cannot use sampling weights with 'partial_fit'.")
         if (sample_weights is not None) and (self.weights_as_sample_prob):
             raise ValueError("Cannot use sampling weights with 'partial_fit'.")
         if (column_weights is not None) and (self.weigh_by_kurtosis):
@@ -1220,13 +1644,21 @@ class IsolationForest:
         if not self.is_fitted_:
             return self.fit(X = X, sample_weights = sample_weights, column_weights = column_weights)
         
-        X_num, X_cat, nrows = self._process_data_new(X, allow_csr = False)
+        if session is not None:
+            if (session._ncols_numeric != self._ncols_numeric) or (session._ncols_categ != self._ncols_categ):
+                raise ValueError("'TrainingSession' has different columns than the data to which the model was fit.")
+            for cl in range(self._ncols_categ):
+                if not np.array_equal(session._cat_mapping[cl], self._cat_mapping[cl]):
+                    raise ValueError("'TrainingSession' has different categories than the data to which the model was fit.")
+            X_num, X_cat, nrows = None, None, session.nrows_
+        else:
+            X_num, X_cat, nrows = self._process_data_new(X, allow_csr = False)
         if sample_weights is not None:
             sample_weights = sample_weights.reshape(-1).astype(ctypes.c_double)
             assert sample_weights.shape[0] == X.shape[0]
         if column_weights is not None:
             column_weights = column_weights.reshape(-1).astype(ctypes.c_double)
-            assert column_weights.shape[0] == X.shape[1]
+            assert column_weights.shape[0] == self._ncols_numeric + self._ncols_categ
         ncat = None
         if self._ncols_categ > 0:
             ncat = np.array([arr.shape[0] for arr in self._cat_mapping]).astype(ctypes.c_int)
@@ -1264,8 +1696,13 @@ class IsolationForest:
                                self.depth_imp,
                                self.weigh_imp_rows,
                                ctypes.c_bool(self.all_perm).value,
-                               ctypes.c_int(self.nthreads).value)
-        self.ntrees += 1
+                               ctypes.c_int(self.nthreads).value,
+                               self.rng_type,
+                               ctypes.c_size_t(ntrees).value,
+                               ctypes.c_int(self.nthreads).value,
+                               None if session is None else session._cpp_obj)
+        self.ntrees += ntrees
+        self._neighbors_index = None
         return self
 
     def get_num_nodes(self):
@@ -1286,6 +1723,34 @@ class IsolationForest:
                                                         ctypes.c_int(self.nthreads).value)
         return n_nodes, n_terminal
 
+    def compact_imputer(self, use_float32 = False):
+        """
+        Convert the imputer to a more compact layout
+
+        Converts the imputation nodes of the model to a layout that keeps only the terminal
+        nodes and only the non-zero category frequencies, which can reduce the memory used by
+        the imputer (and the size of the files produced by ``export_model`` and pickle) by a large
+        factor, particularly when there are categorical columns. The imputations produced
+        afterwards are the same as before (unless passing ``use_float32=True``), and the model
+        can still have trees appended to it.
+
+        Parameters
+        ----------
+        use_float32 : bool
+            Whether to store the imputation statistics as 32-bit floating point numbers instead of
+            64-bit, which halves their size, at the expense of some precision in the imputed values.
+
+        Returns
+        -------
+        self : obj
+            This object.
+        """
+        assert self.is_fitted_
+        if not self.build_imputer:
+            raise ValueError("Model was built with 'build_imputer' = 'False'.")
+        self._cpp_obj.compact_imputer(ctypes.c_bool(use_float32).value, ctypes.c_int(self.nthreads).value)
+        return self
+
     def append_trees(self, other):
         """
         Appends isolation trees from another Isolation Forest model into this one
@@ -1309,6 +1774,10 @@ class IsolationForest:
         models (e.g. fit to different numbers of columns) will result in wrong results and
         potentially crashing the Python process when using it.
 
+        If the imputer of ``other`` is in the compact layout (see ``compact_imputer``) and the imputer
+        of this model is not, the imputer of this model will be converted to the compact layout too
+        (using ``float32`` if ``other`` uses it).
+
         Parameters
         ----------
         other : IsolationForest
@@ -1332,6 +1801,7 @@ class IsolationForest:
 
         self._cpp_obj.append_trees_from_other(other._cpp_obj, self._is_extended_)
         self.ntrees += other.ntrees
+        self._neighbors_index = None
 
         return self
 
@@ -1504,12 +1974,14 @@ class IsolationForest:
             "weigh_imp_rows" : self.weigh_imp_rows,
             "min_imp_obs" : int(self.min_imp_obs),
             "random_seed" : self.random_seed,
+            "rng_type" : self.rng_type,
             "all_perm" : self.all_perm,
             "coef_by_prop" : self.coef_by_prop,
             "weights_as_sample_prob" : self.weights_as_sample_prob,
             "sample_with_replacement" : self.sample_with_replacement,
             "penalize_range" : self.penalize_range,
             "weigh_by_kurtosis" : self.weigh_by_kurtosis,
+            "kurtosis_sample_size" : self.kurtosis_sample_size,
             "assume_full_distr" : self.assume_full_distr,
         }
 
@@ -1546,14 +2018,256 @@ class IsolationForest:
         self.weigh_imp_rows = metadata["params"]["weigh_imp_rows"]
         self.min_imp_obs = metadata["params"]["min_imp_obs"]
         self.random_seed = metadata["params"]["random_seed"]
+        self.rng_type = metadata["params"].get("rng_type", "mersenne_twister")
         self.all_perm = metadata["params"]["all_perm"]
         self.coef_by_prop = metadata["params"]["coef_by_prop"]
         self.weights_as_sample_prob = metadata["params"]["weights_as_sample_prob"]
         self.sample_with_replacement = metadata["params"]["sample_with_replacement"]
         self.penalize_range = metadata["params"]["penalize_range"]
         self.weigh_by_kurtosis = metadata["params"]["weigh_by_kurtosis"]
+        self.kurtosis_sample_size = metadata["params"].get("kurtosis_sample_size", None)
         self.assume_full_distr = metadata["params"]["assume_full_distr"]
 
         self.is_fitted_ = True
         self._is_extended_ = self.ndim > 1
         return self
+
+class TrainingSession:
+    """
+    Data prepared for fitting many isolation forest models
+
+    Converts and encodes the data only once, and keeps it in the C++ library along with
+    other information determined from it (such as which columns have missing values) and
+    with the memory used while building trees, so that fitting many models to the same
+    data (e.g. with different hyperparameters or random seeds) will not need to repeat
+    those steps. This object can be passed in place of 'X' to the methods 'fit' and
+    'partial_fit' of 'IsolationForest' objects.
+
+    Note
+    ----
+    A session cannot be used for fitting two models at the same time (e.g. from different
+    Python threads).
+
+    Models fit from a session do not impute the missing values in the session's data (which
+    the C++ library would otherwise do when building an imputer), as that would change the
+    data used by later fits from the same session.
+
+    Parameters
+    ----------
+    X : array or array-like (n_samples, n_features)
+        Data to which models will be fit. Same input types as for 'IsolationForest.fit'.
+    sample_weights : None or array(n_samples,)
+        Sample observation weights for each row of 'X'. Whether they are taken as sampling
+        probabilities or as distribution density is determined by parameter 'weights_as_sample_prob'
+        of each model that is fit to this session.
+    recode_categ : bool
+        Whether to re-encode categorical variables which were already passed as pandas categoricals
+        (see the documentation of 'IsolationForest' for details).
+    nthreads : int
+        Number of parallel threads to use when preparing the data. If passing a negative number, will use
+        the maximum number of available threads in the system.
+
+    Attributes
+    ----------
+    nrows_ : int
+        Number of rows in the data.
+    cols_numeric_ : array(n_num_features,)
+        Array with the names of the columns that were taken as numerical
+        (Only when passing a DataFrame object).
+    cols_categ_ : array(n_categ_features,)
+        Array with the names of the columns that were taken as categorical
+        (Only when passing a DataFrame object).
+    """
+    def __init__(self, X, sample_weights = None, recode_categ = True, nthreads = -1):
+        if nthreads is None:
+            nthreads = 1
+        elif nthreads < 1:
+            nthreads = multiprocessing.cpu_count()
+
+        helper = IsolationForest(ndim = 1, recode_categ = recode_categ)
+        X_num, X_cat, ncat, sample_weights, column_weights, nrows = helper._process_data(X, sample_weights, None)
+        if issparse(X_num):
+            ### the C++ object keeps pointers to the arrays, which other calls with
+            ### the same matrix object would otherwise replace with converted copies
+            X_num = X_num.copy()
+            X_num.indices = X_num.indices.astype(ctypes.c_size_t)
+            X_num.indptr  = X_num.indptr.astype(ctypes.c_size_t)
+
+        self.nrows_          =  nrows
+        self.cols_numeric_   =  helper.cols_numeric_
+        self.cols_categ_     =  helper.cols_categ_
+        self._cat_mapping    =  helper._cat_mapping
+        self._ncols_numeric  =  helper._ncols_numeric
+        self._ncols_categ    =  helper._ncols_categ
+        self._columns        =  np.array(X.columns.values) if X.__class__.__name__ == "DataFrame" else None
+        self._X_num          =  X_num
+        self._X_cat          =  X_cat
+        self._sample_weights =  sample_weights
+
+        self._cpp_obj = training_session_cpp_obj()
+        self._cpp_obj.prepare(X_num, X_cat, ncat, sample_weights,
+                              ctypes.c_size_t(nrows).value,
+                              ctypes.c_size_t(self._ncols_numeric).value,
+                              ctypes.c_size_t(self._ncols_categ).value,
+                              ctypes.c_int(nthreads).value)
+
+    def __str__(self):
+        msg  = "Isolation Forest training session\n"
+        msg += "Rows: %d\n" % self.nrows_
+        if self._ncols_numeric > 0:
+            msg += "Numeric columns: %d\n" % self._ncols_numeric
+        if self._ncols_categ:
+            msg += "Categorical columns: %d\n" % self._ncols_categ
+        return msg
+
+    def __repr__(self):
+        return self.__str__()
+
+class MappedData:
+    """
+    Data from a file mapped into memory
+
+    Maps into memory a file with data in a binary columnar layout (as written by 'MappedData.write'),
+    which can then be passed in place of 'X' to the methods of 'IsolationForest' objects (such as
+    'fit', 'predict' and 'transform'). The data is not parsed nor copied into memory - the arrays
+    that are passed to the C++ library point directly into the file, pages of which get loaded by
+    the operating system as they are accessed, and are shared with other processes that map the same file.
+
+    Note
+    ----
+    The data is taken as numeric columns followed by categorical columns (encoded as integers,
+    with negative values for missing ones), without column names.
+
+    Note
+    ----
+    Files with sparse data (as written by the C++ function 'write_mapped_data') are not supported here.
+
+    Parameters
+    ----------
+    file : str
+        Path to the file to map.
+    writable : bool
+        Whether changes to the data should be written to the file. If passing 'True', methods that
+        impute missing values ('transform', 'fit_transform') will write the imputed values into the file
+        itself. If passing 'False', the imputed values will only be visible through this object.
+    verify : bool
+        Whether to check that all the categorical values in the file are within the number of categories
+        of their column (values outside of it would make the C++ library read outside of its arrays).
+        This requires reading all of the categorical data when the file is mapped, so it should only
+        be skipped for files that come from a trusted source.
+
+    Attributes
+    ----------
+    nrows_ : int
+        Number of rows in the data.
+    """
+    _header_dtype = np.dtype([
+        ("magic", "S8"), ("version", np.uint32), ("byte_order", np.uint32),
+        ("nrows", np.uint64), ("ncols_numeric", np.uint64), ("ncols_categ", np.uint64), ("nnz", np.uint64),
+        ("is_sparse", np.uint32), ("sparse_ix_bytes", np.uint32),
+        ("offset_numeric", np.uint64), ("offset_Xc_ind", np.uint64), ("offset_Xc_indptr", np.uint64),
+        ("offset_categ", np.uint64), ("offset_ncat", np.uint64), ("reserved", np.uint64, (4,))
+    ])
+
+    def __init__(self, file, writable = False, verify = True):
+        with open(file, "r+b" if writable else "rb") as f:
+            ### copy-on-write mappings are still writable from the C++ side, but never modify the file
+            self._mmap = mmap.mmap(f.fileno(), 0, access = mmap.ACCESS_WRITE if writable else mmap.ACCESS_COPY)
+        if len(self._mmap) < self._header_dtype.itemsize:
+            raise ValueError("File is not a valid data file.")
+        header = np.frombuffer(self._mmap, dtype = self._header_dtype, count = 1)[0]
+        if (header["magic"] != b"ISOTDATA") or (header["version"] != 1):
+            raise ValueError("File is not a valid data file.")
+        if header["byte_order"] != 0x01020304:
+            raise ValueError("File was written in a computer with different endianness.")
+        if header["is_sparse"]:
+            raise ValueError("Files with sparse data are not supported.")
+
+        self.nrows_ = int(header["nrows"])
+        self._ncols_numeric = int(header["ncols_numeric"])
+        self._ncols_categ = int(header["ncols_categ"])
+        self._writable = writable
+        self._X_num = None
+        self._X_cat = None
+        self._ncat = None
+        if self._ncols_numeric:
+            self._X_num = np.frombuffer(self._mmap, dtype = ctypes.c_double,
+                                        count = self.nrows_ * self._ncols_numeric,
+                                        offset = int(header["offset_numeric"]))
+            self._X_num = self._X_num.reshape((self.nrows_, self._ncols_numeric), order = "F")
+        if self._ncols_categ:
+            self._X_cat = np.frombuffer(self._mmap, dtype = ctypes.c_int,
+                                        count = self.nrows_ * self._ncols_categ,
+                                        offset = int(header["offset_categ"]))
+            self._X_cat = self._X_cat.reshape((self.nrows_, self._ncols_categ), order = "F")
+            self._ncat = np.frombuffer(self._mmap, dtype = ctypes.c_int,
+                                       count = self._ncols_categ,
+                                       offset = int(header["offset_ncat"])).copy()
+            if verify:
+                if np.any(self._ncat < 0) or np.any(self._X_cat >= self._ncat.reshape((1, -1))):
+                    raise ValueError("File has categorical values outside of the number of categories.")
+        if self.nrows_ == 0:
+            raise ValueError("Input data has zero rows.")
+
+    def _advise(self, use):
+        ### columns are read in full and then at sampled rows when fitting, and in order otherwise
+        if hasattr(self._mmap, "madvise") and hasattr(mmap, "MADV_NORMAL") and hasattr(mmap, "MADV_SEQUENTIAL"):
+            self._mmap.madvise(mmap.MADV_NORMAL if use == "fit" else mmap.MADV_SEQUENTIAL)
+
+    @staticmethod
+    def write(file, X = None, X_categ = None, ncat = None):
+        """
+        Write data to a file that can be mapped into memory
+
+        Parameters
+        ----------
+        file : str
+            Path to the file to write. If it already exists, will be overwritten.
+        X : None or array(n_samples, n_numeric_features)
+            Numeric data to write. Must be a dense array.
+        X_categ : None or array(n_samples, n_categ_features)
+            Categorical data to write, encoded as integers from zero to the number of categories
+            of each column minus one, and with negative values for missing ones.
+        ncat : None or array(n_categ_features,)
+            Number of categories of each categorical column. If passing None and passing
+            'X_categ', will be taken as the maximum value in each column plus one.
+        """
+        if (X is None) and (X_categ is None):
+            raise ValueError("Must pass either 'X' or 'X_categ'.")
+        nrows = None
+        ncols_numeric = 0
+        ncols_categ = 0
+        if X is not None:
+            if issparse(X):
+                raise ValueError("Sparse matrices are not supported.")
+            X = np.asfortranarray(np.array(X)).astype(ctypes.c_double)
+            nrows = X.shape[0]
+            ncols_numeric = X.shape[1]
+        if X_categ is not None:
+            X_categ = np.asfortranarray(np.array(X_categ)).astype(ctypes.c_int)
+            if (nrows is not None) and (X_categ.shape[0] != nrows):
+                raise ValueError("'X' and 'X_categ' have different number of rows.")
+            nrows = X_categ.shape[0]
+            ncols_categ = X_categ.shape[1]
+            if ncat is None:
+                ncat = X_categ.max(axis = 0).reshape(-1) + 1
+            ncat = np.array(ncat).reshape(-1).astype(ctypes.c_int)
+            if ncat.shape[0] != ncols_categ:
+                raise ValueError("'ncat' has %d entries, but 'X_categ' has %d columns." % (ncat.shape[0], ncols_categ))
+            ncat = np.maximum(ncat, 0)
+        write_mapped_data_file(file, X, X_categ, ncat,
+                               ctypes.c_size_t(nrows).value,
+                               ctypes.c_size_t(ncols_numeric).value,
+                               ctypes.c_size_t(ncols_categ).value)
+
+    def __str__(self):
+        msg  = "Isolation Forest mapped data\n"
+        msg += "Rows: %d\n" % self.nrows_
+        if self._ncols_numeric > 0:
+            msg += "Numeric columns: %d\n" % self._ncols_numeric
+        if self._ncols_categ:
+            msg += "Categorical columns: %d\n" % self._ncols_categ
+        return msg
+
+    def __repr__(self):
+        return self.__str__()
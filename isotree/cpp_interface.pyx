@@ -49,7 +49,7 @@ cimport numpy as np
 import pandas as pd
 from scipy.sparse import issparse, isspmatrix_csc, isspmatrix_csr
 from libcpp cimport bool as bool_t ###don't confuse it with Python bool
-from libc.stdint cimport uint64_t
+from libc.stdint cimport uint64_t, uint32_t
 from libcpp.vector cimport vector
 from libcpp.string cimport string as cpp_string
 from libc.string cimport memcpy
@@ -97,6 +97,10 @@ cdef extern from "isotree.hpp":
         Prop
         Flat
 
+    ctypedef enum RNGType:
+        MersenneTwister
+        Xoshiro
+
     ctypedef struct IsoTree:
         ColType       col_type
         size_t        col_num
@@ -154,14 +158,39 @@ cdef extern from "isotree.hpp":
         vector[double]          cat_weight
         size_t                  parent
 
+    ctypedef struct CompactImputeTree:
+        bool_t            as_float
+        vector[uint32_t]  terminal_ix
+        vector[double]    num_dbl
+        vector[float]     num_flt
+        vector[size_t]    cat_indptr
+        vector[uint32_t]  cat_col
+        vector[uint32_t]  cat_cat
+        vector[double]    cat_dbl
+        vector[float]     cat_flt
+
     ctypedef struct Imputer:
         size_t          ncols_numeric
         size_t          ncols_categ
         vector[int]     ncat
         vector[vector[ImputeNode]] imputer_tree
+        vector[CompactImputeTree]  imputer_tree_compact
         vector[double]  col_means
         vector[int]     col_modes
 
+    ctypedef struct TrainingSession:
+        pass
+
+    ctypedef struct NeighborsIndex:
+        size_t          nrows
+        vector[size_t]  node_offset
+        vector[size_t]  parent
+        vector[size_t]  depth
+        vector[size_t]  range_st
+        vector[size_t]  range_end
+        vector[size_t]  ordered_rows
+        vector[size_t]  row_nodes
+
 
     int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                     double *numeric_data,  size_t ncols_numeric,
@@ -173,14 +202,14 @@ cdef extern from "isotree.hpp":
                     bool_t limit_depth, bool_t penalize_range,
                     bool_t standardize_dist, double *tmat,
                     double *output_depths, bool_t standardize_depth,
-                    double *col_weights, bool_t weigh_by_kurt,
+                    double *col_weights, bool_t weigh_by_kurt, size_t kurt_sample_size,
                     double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                     double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
                     double min_gain, MissingAction missing_action,
                     CategSplit cat_split_type, NewCategAction new_cat_action,
                     bool_t all_perm, Imputer *imputer, size_t min_imp_obs,
                     UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool_t impute_at_fit,
-                    uint64_t random_seed, int nthreads)
+                    uint64_t random_seed, RNGType rng_type, int nthreads)
 
     void predict_iforest(double *numeric_data, int *categ_data,
                          double *Xc, sparse_ix *Xc_ind, sparse_ix *Xc_indptr,
@@ -201,28 +230,109 @@ cdef extern from "isotree.hpp":
                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                          double tmat[], double rmat[], size_t n_from)
 
+    int calc_similarity_to_file(const char *file_path, bool_t as_float,
+                                double numeric_data[], int categ_data[],
+                                double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                                size_t nrows, int nthreads, bool_t assume_full_distr, bool_t standardize_dist,
+                                IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                                size_t n_from)
+
+    int build_neighbors_index(NeighborsIndex &index,
+                              double numeric_data[], int categ_data[],
+                              double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                              size_t nrows, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                              int nthreads)
+
+    int query_neighbors_index(NeighborsIndex &index,
+                              IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                              double numeric_data[], int categ_data[],
+                              double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                              size_t nrows, size_t k, bool_t assume_full_distr, bool_t standardize_dist,
+                              size_t neighbors[], double distances[], int nthreads)
+
+    int calc_similarity_graph(double numeric_data[], int categ_data[],
+                              double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                              size_t nrows, int nthreads, bool_t assume_full_distr, bool_t standardize_dist,
+                              IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                              double threshold, size_t top_m,
+                              vector[size_t] &indptr, vector[size_t] &indices, vector[double] &values)
+
     void impute_missing_values(double *numeric_data, int *categ_data,
                                double *Xr, sparse_ix *Xr_ind, sparse_ix *Xr_indptr,
                                size_t nrows, int nthreads,
                                IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                                Imputer &imputer)
 
-    int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
-                 double *numeric_data,  size_t ncols_numeric,
-                 int    *categ_data,    size_t ncols_categ,    int *ncat,
-                 double *Xc, sparse_ix *Xc_ind, sparse_ix *Xc_indptr,
-                 size_t ndim, size_t ntry, CoefType coef_type, bool_t coef_by_prop,
-                 double *sample_weights,
-                 size_t nrows, size_t max_depth,
-                 bool_t   limit_depth,  bool_t penalize_range,
-                 double *col_weights, bool_t weigh_by_kurt,
-                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
-                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
-                 double min_gain, MissingAction missing_action,
-                 CategSplit cat_split_type, NewCategAction new_cat_action,
-                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
-                 bool_t  all_perm, vector[ImputeNode] *impute_nodes, size_t min_imp_obs,
-                 uint64_t random_seed)
+    void compact_imputer(Imputer &imputer, bool_t as_float, int nthreads)
+
+    int add_trees(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                  double *numeric_data,  size_t ncols_numeric,
+                  int    *categ_data,    size_t ncols_categ,    int *ncat,
+                  double *Xc, sparse_ix *Xc_ind, sparse_ix *Xc_indptr,
+                  size_t ndim, size_t ntry, CoefType coef_type, bool_t coef_by_prop,
+                  double *sample_weights,
+                  size_t nrows, size_t ntrees, size_t max_depth,
+                  bool_t   limit_depth,  bool_t penalize_range,
+                  double *col_weights, bool_t weigh_by_kurt,
+                  double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                  double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                  double min_gain, MissingAction missing_action,
+                  CategSplit cat_split_type, NewCategAction new_cat_action,
+                  UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+                  bool_t  all_perm, Imputer *imputer, size_t min_imp_obs,
+                  uint64_t random_seed, RNGType rng_type, int nthreads)
+
+    bool_t interrupt_switch
+
+    ctypedef size_t (*ChunkReader)(void *reader_data, double **numeric_data, int **categ_data, double **sample_weights)
+
+    int fit_iforest_streaming(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                              ChunkReader read_chunk, void *reader_data,
+                              size_t ncols_numeric, size_t ncols_categ, int *ncat,
+                              size_t ndim, size_t ntry, CoefType coef_type, bool_t coef_by_prop,
+                              bool_t weight_as_sample, size_t sample_size, size_t ntrees, size_t max_depth,
+                              bool_t limit_depth, bool_t penalize_range,
+                              double *col_weights, bool_t weigh_by_kurt,
+                              double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                              double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                              double min_gain, MissingAction missing_action,
+                              CategSplit cat_split_type, NewCategAction new_cat_action,
+                              bool_t all_perm, uint64_t random_seed, RNGType rng_type, int nthreads)
+
+    TrainingSession* create_training_session(double *numeric_data,  size_t ncols_numeric,
+                                             int    *categ_data,    size_t ncols_categ,    int *ncat,
+                                             double *Xc, sparse_ix *Xc_ind, sparse_ix *Xc_indptr,
+                                             double *sample_weights, size_t nrows, int nthreads)
+
+    void delete_training_session(TrainingSession *session)
+
+    int fit_iforest(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                    size_t ndim, size_t ntry, CoefType coef_type, bool_t coef_by_prop,
+                    bool_t with_replacement, bool_t weight_as_sample,
+                    size_t sample_size, size_t ntrees, size_t max_depth,
+                    bool_t limit_depth, bool_t penalize_range,
+                    bool_t standardize_dist, double *tmat,
+                    double *output_depths, bool_t standardize_depth,
+                    double *col_weights, bool_t weigh_by_kurt, size_t kurt_sample_size,
+                    double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                    double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                    double min_gain, MissingAction missing_action,
+                    CategSplit cat_split_type, NewCategAction new_cat_action,
+                    bool_t all_perm, Imputer *imputer, size_t min_imp_obs,
+                    UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool_t impute_at_fit,
+                    uint64_t random_seed, RNGType rng_type, int nthreads)
+
+    int add_trees(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                  size_t ndim, size_t ntry, CoefType coef_type, bool_t coef_by_prop,
+                  size_t ntrees, size_t max_depth, bool_t limit_depth, bool_t penalize_range,
+                  double *col_weights, bool_t weigh_by_kurt,
+                  double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                  double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                  double min_gain, MissingAction missing_action,
+                  CategSplit cat_split_type, NewCategAction new_cat_action,
+                  UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+                  bool_t  all_perm, Imputer *imputer, size_t min_imp_obs,
+                  uint64_t random_seed, RNGType rng_type, int nthreads)
 
     void merge_models(IsoForest*     model,      IsoForest*     other,
                       ExtIsoForest*  ext_model,  ExtIsoForest*  ext_other,
@@ -242,6 +352,12 @@ cdef extern from "isotree.hpp":
     void deserialize_imputer(Imputer &output, cpp_string &serialized, bool_t move_str)
     bool_t has_msvc()
 
+    int write_mapped_data(const char *file_path,
+                          double *numeric_data,  size_t ncols_numeric,
+                          int    *categ_data,    size_t ncols_categ,    int *ncat,
+                          double *Xc, sparse_ix *Xc_ind, sparse_ix *Xc_indptr,
+                          size_t nrows)
+
     void dealloc_IsoForest(IsoForest &model_outputs)
     void dealloc_IsoExtForest(ExtIsoForest &model_outputs_ext)
     void dealloc_Imputer(Imputer &imputer)
@@ -266,6 +382,118 @@ cdef int* get_ptr_int_mat(np.ndarray[int, ndim = 2] a):
     return &a[0, 0]
 
 
+cdef class training_session_cpp_obj:
+    cdef TrainingSession *session
+    ### the C++ object only keeps pointers to these arrays
+    cdef object X_num
+    cdef object X_cat
+    cdef object ncat
+    cdef object sample_weights
+
+    ### Note: the pointer starts as NULL, as Cython zero-fills new objects
+    def __dealloc__(self):
+        if self.session != NULL:
+            delete_training_session(self.session)
+            self.session = NULL
+
+    ### the session only points to the data of the Python object that holds it
+    def __reduce__(self):
+        raise TypeError("Training sessions cannot be pickled.")
+
+    def prepare(self, X_num, X_cat, ncat, sample_weights,
+                size_t nrows, size_t ncols_numeric, size_t ncols_categ, int nthreads):
+        cdef double*     numeric_data_ptr    =  NULL
+        cdef int*        categ_data_ptr      =  NULL
+        cdef int*        ncat_ptr            =  NULL
+        cdef double*     Xc_ptr              =  NULL
+        cdef sparse_ix*  Xc_ind_ptr          =  NULL
+        cdef sparse_ix*  Xc_indptr_ptr       =  NULL
+        cdef double*     sample_weights_ptr  =  NULL
+
+        if X_num is not None:
+            if not issparse(X_num):
+                numeric_data_ptr  =  get_ptr_dbl_mat(X_num)
+            else:
+                Xc_ptr         =  get_ptr_dbl_vec(X_num.data)
+                Xc_ind_ptr     =  get_ptr_szt_vec(X_num.indices)
+                Xc_indptr_ptr  =  get_ptr_szt_vec(X_num.indptr)
+        if X_cat is not None:
+            categ_data_ptr     =  get_ptr_int_mat(X_cat)
+            ncat_ptr           =  get_ptr_int_vec(ncat)
+        if sample_weights is not None:
+            sample_weights_ptr =  get_ptr_dbl_vec(sample_weights)
+
+        self.X_num           =  X_num
+        self.X_cat           =  X_cat
+        self.ncat            =  ncat
+        self.sample_weights  =  sample_weights
+
+        if self.session != NULL:
+            delete_training_session(self.session)
+            self.session = NULL
+        self.session = \
+        create_training_session(numeric_data_ptr,  ncols_numeric,
+                                categ_data_ptr,    ncols_categ,    ncat_ptr,
+                                Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                                sample_weights_ptr, nrows, nthreads)
+
+
+def write_mapped_data_file(fpath, X_num, X_cat, ncat, size_t nrows, size_t ncols_numeric, size_t ncols_categ):
+    cdef double*  numeric_data_ptr  =  NULL
+    cdef int*     categ_data_ptr    =  NULL
+    cdef int*     ncat_ptr          =  NULL
+    if X_num is not None:
+        numeric_data_ptr  =  get_ptr_dbl_mat(X_num)
+    if X_cat is not None:
+        categ_data_ptr    =  get_ptr_int_mat(X_cat)
+        ncat_ptr          =  get_ptr_int_vec(ncat)
+
+    py_byte_string = fpath.encode()
+    cdef char *fpath_as_char = py_byte_string
+    cdef int ret_val = \
+    write_mapped_data(fpath_as_char,
+                      numeric_data_ptr, ncols_numeric,
+                      categ_data_ptr, ncols_categ, ncat_ptr,
+                      NULL, NULL, NULL, nrows)
+    if ret_val == return_EXIT_FAILURE():
+        raise IOError("Could not write file '%s'." % fpath)
+
+cdef class chunk_reader_state:
+    cdef object chunks
+    cdef object X_num
+    cdef object sample_weights
+    cdef object error
+
+    def __init__(self, chunks):
+        self.chunks = chunks
+        self.X_num = None
+        self.sample_weights = None
+        self.error = None
+
+cdef size_t read_py_chunk(void *reader_data, double **numeric_data, int **categ_data, double **sample_weights) noexcept with gil:
+    cdef chunk_reader_state state = <chunk_reader_state> reader_data
+    ### the arrays are kept in the state object until the next chunk is read
+    while True:
+        try:
+            state.X_num, state.sample_weights = next(state.chunks)
+        except StopIteration:
+            return 0
+        except BaseException as e:
+            state.error = e
+            return <size_t> -1
+        if state.X_num.shape[0] > 0:
+            break
+    numeric_data[0] = get_ptr_dbl_mat(state.X_num)
+    if state.sample_weights is not None:
+        sample_weights[0] = get_ptr_dbl_vec(state.sample_weights)
+    return state.X_num.shape[0]
+
+cdef class neighbors_index_cpp_obj:
+    cdef NeighborsIndex index
+
+    def __init__(self):
+        pass
+
 # @cython.auto_pickle(True)
 cdef class isoforest_cpp_obj:
     cdef IsoForest     isoforest
@@ -297,13 +525,14 @@ cdef class isoforest_cpp_obj:
                   bool_t limit_depth, bool_t penalize_range,
                   bool_t calc_dist, bool_t standardize_dist, bool_t sq_dist,
                   bool_t calc_depth, bool_t standardize_depth,
-                  bool_t weigh_by_kurt,
+                  bool_t weigh_by_kurt, size_t kurt_sample_size,
                   double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                   double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
                   double min_gain, missing_action, cat_split_type, new_cat_action,
                   bool_t build_imputer, size_t min_imp_obs,
                   depth_imp, weigh_imp_rows, bool_t impute_at_fit,
-                  bool_t all_perm, uint64_t random_seed, int nthreads):
+                  bool_t all_perm, uint64_t random_seed, rng_type, int nthreads,
+                  training_session_cpp_obj session = None):
         cdef double*     numeric_data_ptr    =  NULL
         cdef int*        categ_data_ptr      =  NULL
         cdef int*        ncat_ptr            =  NULL
@@ -334,6 +563,7 @@ cdef class isoforest_cpp_obj:
         cdef MissingAction   missing_action_C  =  Divide
         cdef UseDepthImp     depth_imp_C       =  Same
         cdef WeighImpRows    weigh_imp_rows_C  =  Flat
+        cdef RNGType         rng_type_C        =  MersenneTwister
 
         if coef_type == "uniform":
             coef_type_C       =  Uniform
@@ -355,6 +585,8 @@ cdef class isoforest_cpp_obj:
             weigh_imp_rows_C  =  Inverse
         elif weigh_imp_rows == "prop":
             weigh_imp_rows_C  =  Prop
+        if rng_type == "xoshiro":
+            rng_type_C        =  Xoshiro
 
         cdef np.ndarray[double, ndim = 1]  tmat    =  np.empty(0, dtype = ctypes.c_double)
         cdef np.ndarray[double, ndim = 2]  dmat    =  np.empty((0, 0), dtype = ctypes.c_double)
@@ -393,25 +625,43 @@ cdef class isoforest_cpp_obj:
 
         cdef int ret_val = 0
 
-        ret_val = \
-        fit_iforest(model_ptr, ext_model_ptr,
-                    numeric_data_ptr,  ncols_numeric,
-                    categ_data_ptr,    ncols_categ,    ncat_ptr,
-                    Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
-                    ndim, ntry, coef_type_C, coef_by_prop,
-                    sample_weights_ptr, with_replacement, weight_as_sample,
-                    nrows, sample_size, ntrees, max_depth,
-                    limit_depth, penalize_range,
-                    standardize_dist, tmat_ptr,
-                    depths_ptr, standardize_depth,
-                    col_weights_ptr, weigh_by_kurt,
-                    prob_pick_by_gain_avg, prob_split_by_gain_avg,
-                    prob_pick_by_gain_pl,  prob_split_by_gain_pl,
-                    min_gain, missing_action_C,
-                    cat_split_type_C, new_cat_action_C,
-                    all_perm, imputer_ptr, min_imp_obs,
-                    depth_imp_C, weigh_imp_rows_C, impute_at_fit,
-                    random_seed, nthreads)
+        if session is not None:
+            ret_val = \
+            fit_iforest(session.session, model_ptr, ext_model_ptr,
+                        ndim, ntry, coef_type_C, coef_by_prop,
+                        with_replacement, weight_as_sample,
+                        sample_size, ntrees, max_depth,
+                        limit_depth, penalize_range,
+                        standardize_dist, tmat_ptr,
+                        depths_ptr, standardize_depth,
+                        col_weights_ptr, weigh_by_kurt, kurt_sample_size,
+                        prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                        prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                        min_gain, missing_action_C,
+                        cat_split_type_C, new_cat_action_C,
+                        all_perm, imputer_ptr, min_imp_obs,
+                        depth_imp_C, weigh_imp_rows_C, impute_at_fit,
+                        random_seed, rng_type_C, nthreads)
+        else:
+            ret_val = \
+            fit_iforest(model_ptr, ext_model_ptr,
+                        numeric_data_ptr,  ncols_numeric,
+                        categ_data_ptr,    ncols_categ,    ncat_ptr,
+                        Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                        ndim, ntry, coef_type_C, coef_by_prop,
+                        sample_weights_ptr, with_replacement, weight_as_sample,
+                        nrows, sample_size, ntrees, max_depth,
+                        limit_depth, penalize_range,
+                        standardize_dist, tmat_ptr,
+                        depths_ptr, standardize_depth,
+                        col_weights_ptr, weigh_by_kurt, kurt_sample_size,
+                        prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                        prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                        min_gain, missing_action_C,
+                        cat_split_type_C, new_cat_action_C,
+                        all_perm, imputer_ptr, min_imp_obs,
+                        depth_imp_C, weigh_imp_rows_C, impute_at_fit,
+                        random_seed, rng_type_C, nthreads)
 
         if ret_val == return_EXIT_FAILURE():
             raise KeyboardInterrupt("Error: procedure was interrupted.")
@@ -421,6 +671,74 @@ cdef class isoforest_cpp_obj:
 
         return depths, tmat, dmat, X_num, X_cat
 
+    def fit_model_streaming(self, chunks, col_weights, size_t ncols_numeric,
+                            size_t ndim, size_t ntry, coef_type, bool_t coef_by_prop,
+                            bool_t weight_as_sample, size_t sample_size, size_t ntrees, size_t max_depth,
+                            bool_t limit_depth, bool_t penalize_range, bool_t weigh_by_kurt,
+                            double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                            double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                            double min_gain, missing_action, cat_split_type, new_cat_action,
+                            bool_t all_perm, uint64_t random_seed, rng_type, int nthreads):
+        cdef double*  col_weights_ptr  =  NULL
+        if col_weights is not None:
+            col_weights_ptr  =  get_ptr_dbl_vec(col_weights)
+
+        cdef CoefType        coef_type_C       =  Normal
+        cdef CategSplit      cat_split_type_C  =  SubSet
+        cdef NewCategAction  new_cat_action_C  =  Weighted
+        cdef MissingAction   missing_action_C  =  Divide
+        cdef RNGType         rng_type_C        =  MersenneTwister
+
+        if coef_type == "uniform":
+            coef_type_C       =  Uniform
+        if cat_split_type == "single_categ":
+            cat_split_type_C  =  SingleCateg
+        if new_cat_action == "smallest":
+            new_cat_action_C  =  Smallest
+        elif new_cat_action == "random":
+            new_cat_action_C  =  Random
+        if missing_action == "impute":
+            missing_action_C  =  Impute
+        elif missing_action == "fail":
+            missing_action_C  =  Fail
+        if rng_type == "xoshiro":
+            rng_type_C        =  Xoshiro
+
+        cdef IsoForest*     model_ptr      =  NULL
+        cdef ExtIsoForest*  ext_model_ptr  =  NULL
+
+        dealloc_IsoForest(self.isoforest)
+        dealloc_IsoExtForest(self.ext_isoforest)
+        dealloc_Imputer(self.imputer)
+        if ndim == 1:
+            self.isoforest      =  IsoForest()
+            model_ptr           =  &self.isoforest
+        else:
+            self.ext_isoforest  =  ExtIsoForest()
+            ext_model_ptr       =  &self.ext_isoforest
+
+        cdef chunk_reader_state state = chunk_reader_state(chunks)
+        cdef int ret_val = \
+        fit_iforest_streaming(model_ptr, ext_model_ptr,
+                              read_py_chunk, <void*> state,
+                              ncols_numeric, 0, NULL,
+                              ndim, ntry, coef_type_C, coef_by_prop,
+                              weight_as_sample, sample_size, ntrees, max_depth,
+                              limit_depth, penalize_range,
+                              col_weights_ptr, weigh_by_kurt,
+                              prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                              prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                              min_gain, missing_action_C,
+                              cat_split_type_C, new_cat_action_C,
+                              all_perm, random_seed, rng_type_C, nthreads)
+
+        if state.error is not None:
+            raise state.error
+        if ret_val == return_EXIT_FAILURE():
+            if interrupt_switch:
+                raise KeyboardInterrupt("Error: procedure was interrupted.")
+            raise RuntimeError("Error: could not fit the model to the chunks.")
+
     def fit_tree(self, X_num, X_cat, ncat, sample_weights, col_weights,
                  size_t nrows, size_t ncols_numeric, size_t ncols_categ,
                  size_t ndim, size_t ntry, coef_type, bool_t coef_by_prop,
@@ -431,7 +749,9 @@ cdef class isoforest_cpp_obj:
                  double min_gain, missing_action, cat_split_type, new_cat_action,
                  bool_t build_imputer, size_t min_imp_obs,
                  depth_imp, weigh_imp_rows,
-                 bool_t all_perm, uint64_t random_seed):
+                 bool_t all_perm, uint64_t random_seed, rng_type,
+                 size_t ntrees, int nthreads,
+                 training_session_cpp_obj session = None):
         cdef double*     numeric_data_ptr    =  NULL
         cdef int*        categ_data_ptr      =  NULL
         cdef int*        ncat_ptr            =  NULL
@@ -462,6 +782,7 @@ cdef class isoforest_cpp_obj:
         cdef MissingAction   missing_action_C  =  Divide
         cdef UseDepthImp     depth_imp_C       =  Same
         cdef WeighImpRows    weigh_imp_rows_C  =  Flat
+        cdef RNGType         rng_type_C        =  MersenneTwister
         
 
         if coef_type == "uniform":
@@ -484,6 +805,8 @@ cdef class isoforest_cpp_obj:
             weigh_imp_rows_C  =  Inverse
         elif weigh_imp_rows == "prop":
             weigh_imp_rows_C  =  Prop
+        if rng_type == "xoshiro":
+            rng_type_C        =  Xoshiro
 
         cdef IsoForest*     model_ptr      =  NULL
         cdef ExtIsoForest*  ext_model_ptr  =  NULL
@@ -492,26 +815,41 @@ cdef class isoforest_cpp_obj:
         else:
             ext_model_ptr       =  &self.ext_isoforest
 
-        cdef vector[ImputeNode] *imputer_tree_ptr = NULL
+        cdef Imputer *imputer_ptr = NULL
         if build_imputer:
-            self.imputer.imputer_tree.push_back(vector[ImputeNode]()) ### emplace back doesn't work in cython
-            imputer_tree_ptr = &self.imputer.imputer_tree.back()
-
-        add_tree(model_ptr, ext_model_ptr,
-                 numeric_data_ptr,  ncols_numeric,
-                 categ_data_ptr,    ncols_categ,    ncat_ptr,
-                 Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
-                 ndim, ntry, coef_type_C, coef_by_prop,
-                 sample_weights_ptr,
-                 nrows, max_depth,
-                 limit_depth,  penalize_range,
-                 col_weights_ptr, weigh_by_kurt,
-                 prob_pick_by_gain_avg, prob_split_by_gain_avg,
-                 prob_pick_by_gain_pl,  prob_split_by_gain_pl,
-                 min_gain, missing_action_C,
-                 cat_split_type_C, new_cat_action_C,
-                 depth_imp_C, weigh_imp_rows_C,
-                 all_perm, imputer_tree_ptr, min_imp_obs, random_seed)
+            imputer_ptr = &self.imputer
+
+        cdef int ret_val
+        if session is not None:
+            ret_val = add_trees(session.session, model_ptr, ext_model_ptr,
+                                ndim, ntry, coef_type_C, coef_by_prop,
+                                ntrees, max_depth, limit_depth,  penalize_range,
+                                col_weights_ptr, weigh_by_kurt,
+                                prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                                prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                                min_gain, missing_action_C,
+                                cat_split_type_C, new_cat_action_C,
+                                depth_imp_C, weigh_imp_rows_C,
+                                all_perm, imputer_ptr, min_imp_obs, random_seed, rng_type_C, nthreads)
+        else:
+            ret_val = add_trees(model_ptr, ext_model_ptr,
+                                numeric_data_ptr,  ncols_numeric,
+                                categ_data_ptr,    ncols_categ,    ncat_ptr,
+                                Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                                ndim, ntry, coef_type_C, coef_by_prop,
+                                sample_weights_ptr,
+                                nrows, ntrees, max_depth,
+                                limit_depth,  penalize_range,
+                                col_weights_ptr, weigh_by_kurt,
+                                prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                                prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                                min_gain, missing_action_C,
+                                cat_split_type_C, new_cat_action_C,
+                                depth_imp_C, weigh_imp_rows_C,
+                                all_perm, imputer_ptr, min_imp_obs, random_seed, rng_type_C, nthreads)
+
+        if ret_val == return_EXIT_FAILURE():
+            raise KeyboardInterrupt("Error: procedure was interrupted.")
 
     def predict(self, X_num, X_cat, is_extended,
                 size_t nrows, int nthreads, bool_t standardize, bool_t output_tree_num):
@@ -633,6 +971,178 @@ cdef class isoforest_cpp_obj:
 
         return tmat, dmat, rmat
 
+    def dist_to_file(self, X_num, X_cat, is_extended, fpath, bool_t as_float,
+                     size_t nrows, int nthreads, bool_t assume_full_distr,
+                     bool_t standardize_dist, size_t n_from):
+
+        cdef double*     numeric_data_ptr  =  NULL
+        cdef int*        categ_data_ptr    =  NULL
+        cdef double*     Xc_ptr            =  NULL
+        cdef sparse_ix*  Xc_ind_ptr        =  NULL
+        cdef sparse_ix*  Xc_indptr_ptr     =  NULL
+
+        if X_num is not None:
+            if not issparse(X_num):
+                numeric_data_ptr  =  get_ptr_dbl_mat(X_num)
+            else:
+                if X_num.data.shape[0]:
+                    Xc_ptr         =  get_ptr_dbl_vec(X_num.data)
+                if X_num.indices.shape[0]:
+                    Xc_ind_ptr     =  get_ptr_szt_vec(X_num.indices)
+                Xc_indptr_ptr  =  get_ptr_szt_vec(X_num.indptr)
+        if X_cat is not None:
+            categ_data_ptr     =  get_ptr_int_mat(X_cat)
+
+        cdef IsoForest*     model_ptr      =  NULL
+        cdef ExtIsoForest*  ext_model_ptr  =  NULL
+        if not is_extended:
+            model_ptr      =  &self.isoforest
+        else:
+            ext_model_ptr  =  &self.ext_isoforest
+
+        py_byte_string = fpath.encode()
+        cdef char *fpath_as_char = py_byte_string
+        cdef int ret_val = \
+        calc_similarity_to_file(fpath_as_char, as_float,
+                                numeric_data_ptr, categ_data_ptr,
+                                Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                                nrows, nthreads, assume_full_distr, standardize_dist,
+                                model_ptr, ext_model_ptr, n_from)
+        return ret_val != return_EXIT_FAILURE()
+
+    def dist_graph(self, X_num, X_cat, is_extended,
+                   size_t nrows, int nthreads, bool_t assume_full_distr,
+                   bool_t standardize_dist, double threshold, size_t top_m):
+
+        cdef double*     numeric_data_ptr  =  NULL
+        cdef int*        categ_data_ptr    =  NULL
+        cdef double*     Xc_ptr            =  NULL
+        cdef sparse_ix*  Xc_ind_ptr        =  NULL
+        cdef sparse_ix*  Xc_indptr_ptr     =  NULL
+
+        if X_num is not None:
+            if not issparse(X_num):
+                numeric_data_ptr  =  get_ptr_dbl_mat(X_num)
+            else:
+                if X_num.data.shape[0]:
+                    Xc_ptr         =  get_ptr_dbl_vec(X_num.data)
+                if X_num.indices.shape[0]:
+                    Xc_ind_ptr     =  get_ptr_szt_vec(X_num.indices)
+                Xc_indptr_ptr  =  get_ptr_szt_vec(X_num.indptr)
+        if X_cat is not None:
+            categ_data_ptr     =  get_ptr_int_mat(X_cat)
+
+        cdef IsoForest*     model_ptr      =  NULL
+        cdef ExtIsoForest*  ext_model_ptr  =  NULL
+        if not is_extended:
+            model_ptr      =  &self.isoforest
+        else:
+            ext_model_ptr  =  &self.ext_isoforest
+
+        cdef vector[size_t]  indptr
+        cdef vector[size_t]  indices
+        cdef vector[double]  values
+        cdef int ret_val = \
+        calc_similarity_graph(numeric_data_ptr, categ_data_ptr,
+                              Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                              nrows, nthreads, assume_full_distr, standardize_dist,
+                              model_ptr, ext_model_ptr,
+                              threshold, top_m,
+                              indptr, indices, values)
+        if ret_val == return_EXIT_FAILURE():
+            return None
+
+        cdef np.ndarray[size_t, ndim = 1]  indptr_np   =  np.empty(indptr.size(), dtype = ctypes.c_size_t)
+        cdef np.ndarray[size_t, ndim = 1]  indices_np  =  np.empty(indices.size(), dtype = ctypes.c_size_t)
+        cdef np.ndarray[double, ndim = 1]  values_np   =  np.empty(values.size(), dtype = ctypes.c_double)
+        memcpy(&indptr_np[0], indptr.data(), indptr.size() * sizeof(size_t))
+        if indices.size():
+            memcpy(&indices_np[0], indices.data(), indices.size() * sizeof(size_t))
+            memcpy(&values_np[0], values.data(), values.size() * sizeof(double))
+        return indptr_np, indices_np, values_np
+
+    def build_neighbors_index(self, neighbors_index_cpp_obj index_obj, X_num, X_cat, is_extended,
+                              size_t nrows, int nthreads):
+
+        cdef double*     numeric_data_ptr  =  NULL
+        cdef int*        categ_data_ptr    =  NULL
+        cdef double*     Xc_ptr            =  NULL
+        cdef sparse_ix*  Xc_ind_ptr        =  NULL
+        cdef sparse_ix*  Xc_indptr_ptr     =  NULL
+
+        if X_num is not None:
+            if not issparse(X_num):
+                numeric_data_ptr  =  get_ptr_dbl_mat(X_num)
+            else:
+                if X_num.data.shape[0]:
+                    Xc_ptr         =  get_ptr_dbl_vec(X_num.data)
+                if X_num.indices.shape[0]:
+                    Xc_ind_ptr     =  get_ptr_szt_vec(X_num.indices)
+                Xc_indptr_ptr  =  get_ptr_szt_vec(X_num.indptr)
+        if X_cat is not None:
+            categ_data_ptr     =  get_ptr_int_mat(X_cat)
+
+        cdef IsoForest*     model_ptr      =  NULL
+        cdef ExtIsoForest*  ext_model_ptr  =  NULL
+        if not is_extended:
+            model_ptr      =  &self.isoforest
+        else:
+            ext_model_ptr  =  &self.ext_isoforest
+
+        cdef int ret_val = \
+        build_neighbors_index(index_obj.index,
+                              numeric_data_ptr, categ_data_ptr,
+                              Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                              nrows, model_ptr, ext_model_ptr, nthreads)
+        return ret_val != return_EXIT_FAILURE()
+
+    def query_neighbors_index(self, neighbors_index_cpp_obj index_obj, X_num, X_cat, is_extended,
+                              size_t nrows, size_t k, int nthreads, bool_t assume_full_distr,
+                              bool_t standardize_dist):
+
+        cdef double*     numeric_data_ptr  =  NULL
+        cdef int*        categ_data_ptr    =  NULL
+        cdef double*     Xc_ptr            =  NULL
+        cdef sparse_ix*  Xc_ind_ptr        =  NULL
+        cdef sparse_ix*  Xc_indptr_ptr     =  NULL
+
+        if X_num is not None:
+            if not issparse(X_num):
+                numeric_data_ptr  =  get_ptr_dbl_mat(X_num)
+            else:
+                if X_num.data.shape[0]:
+                    Xc_ptr         =  get_ptr_dbl_vec(X_num.data)
+                if X_num.indices.shape[0]:
+                    Xc_ind_ptr     =  get_ptr_szt_vec(X_num.indices)
+                Xc_indptr_ptr  =  get_ptr_szt_vec(X_num.indptr)
+        if X_cat is not None:
+            categ_data_ptr     =  get_ptr_int_mat(X_cat)
+
+        cdef np.ndarray[size_t, ndim = 2]  neighbors  =  np.zeros((nrows, k), dtype = ctypes.c_size_t)
+        cdef np.ndarray[double, ndim = 2]  distances  =  np.zeros((nrows, k), dtype = ctypes.c_double)
+        cdef size_t*  neighbors_ptr  =  NULL
+        cdef double*  distances_ptr  =  NULL
+        if nrows and k:
+            neighbors_ptr  =  &neighbors[0, 0]
+            distances_ptr  =  &distances[0, 0]
+
+        cdef IsoForest*     model_ptr      =  NULL
+        cdef ExtIsoForest*  ext_model_ptr  =  NULL
+        if not is_extended:
+            model_ptr      =  &self.isoforest
+        else:
+            ext_model_ptr  =  &self.ext_isoforest
+
+        cdef int ret_val = \
+        query_neighbors_index(index_obj.index, model_ptr, ext_model_ptr,
+                              numeric_data_ptr, categ_data_ptr,
+                              Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                              nrows, k, assume_full_distr, standardize_dist,
+                              neighbors_ptr, distances_ptr, nthreads)
+        if ret_val == return_EXIT_FAILURE():
+            return None
+        return neighbors, distances
+
     def impute(self, X_num, X_cat, bool_t is_extended, size_t nrows, int nthreads):
         cdef double*     numeric_data_ptr  =  NULL
         cdef int*        categ_data_ptr    =  NULL
@@ -681,6 +1191,9 @@ cdef class isoforest_cpp_obj:
             get_num_nodes(self.ext_isoforest, &n_nodes[0], &n_terminal[0], nthreads)
         return n_nodes, n_terminal
 
+    def compact_imputer(self, bool_t as_float, int nthreads):
+        compact_imputer(self.imputer, as_float, nthreads)
+
     def append_trees_from_other(self, isoforest_cpp_obj other, bool_t is_extended):
         cdef IsoForest *ptr_model = NULL
         cdef IsoForest *ptr_other = NULL
@@ -696,9 +1209,9 @@ cdef class isoforest_cpp_obj:
             ptr_model = &self.isoforest
             ptr_other = &other.isoforest
 
-        if self.imputer.imputer_tree.size():
+        if self.imputer.imputer_tree.size() or self.imputer.imputer_tree_compact.size():
             ptr_imp = &self.imputer
-        if other.imputer.imputer_tree.size():
+        if other.imputer.imputer_tree.size() or other.imputer.imputer_tree_compact.size():
             prt_iother = &other.imputer
 
         merge_models(ptr_model, ptr_other,
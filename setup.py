@@ -65,6 +65,17 @@ if platform[:3] != "dar":
 ### uncomment line below
 # use_omp = True
 
+### Optional build flags (see 'src/isotree.hpp'):
+### - environment variable 'ISOTREE_32BIT_INDICES=1' uses 32-bit row indices
+###   when building trees, which is faster but limits the data to less than 2^32 rows.
+### - environment variable 'ISOTREE_DOUBLE_IMPUTE_SUMS=1' accumulates imputed values
+###   as 'double' instead of 'long double', which halves the memory used when imputing.
+extra_macros = []
+if environ.get('ISOTREE_32BIT_INDICES') is not None:
+    extra_macros.append(("_USE_32BIT_INDICES", None))
+if environ.get('ISOTREE_DOUBLE_IMPUTE_SUMS') is not None:
+    extra_macros.append(("_USE_DOUBLE_IMPUTE_SUMS", None))
+
 setup(
     name  = "isotree",
     packages = ["isotree"],
@@ -80,12 +91,13 @@ setup(
                                 sources=["isotree/cpp_interface.pyx", "src/fit_model.cpp", "src/isoforest.cpp",
                                          "src/extended.cpp", "src/helpers_iforest.cpp", "src/predict.cpp", "src/utils.cpp",
                                          "src/crit.cpp", "src/dist.cpp", "src/impute.cpp", "src/mult.cpp", "src/dealloc.cpp",
-                                         "src/merge_models.cpp", "src/serialize.cpp"],
+                                         "src/merge_models.cpp", "src/serialize.cpp", "src/mapped_data.cpp", "src/mapped_model.cpp",
+                                         "src/knn_index.cpp"],
                                 include_dirs=[np.get_include(), ".", "./src", cycereal.get_cereal_include_dir()],
                                 language="c++",
                                 install_requires = ["numpy", "pandas>=0.24.0", "cython", "scipy"],
                                 define_macros = [("_USE_MERSENNE_TWISTER", None),
-                                                 ("_ENABLE_CEREAL", None)]
+                                                 ("_ENABLE_CEREAL", None)] + extra_macros
                             )]
     )
 
@@ -139,6 +139,143 @@ double* set_R_nan_as_C_nan(double *x, size_t n, int nthreads)
     return x;
 }
 
+/* The C++ session only keeps pointers to the data, so it gets its own copy here,
+   with R's NA values already converted to C's NaN */
+typedef struct RTrainingSession {
+    std::vector<double>     X_num;
+    std::vector<int>        X_cat;
+    std::vector<int>        ncat;
+    std::vector<double>     Xc;
+    std::vector<sparse_ix>  Xc_ind;
+    std::vector<sparse_ix>  Xc_indptr;
+    std::vector<double>     sample_weights;
+    TrainingSession         session;
+} RTrainingSession;
+
+// [[Rcpp::export]]
+SEXP prepare_training_session(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp::IntegerVector ncat,
+                              Rcpp::NumericVector Xc, Rcpp::IntegerVector Xc_ind, Rcpp::IntegerVector Xc_indptr,
+                              Rcpp::NumericVector sample_weights,
+                              size_t nrows, size_t ncols_numeric, size_t ncols_categ, int nthreads)
+{
+    std::unique_ptr<RTrainingSession> session_ptr = std::unique_ptr<RTrainingSession>(new RTrainingSession());
+    RTrainingSession &sess = *session_ptr;
+
+    if (X_num.size())
+        set_R_nan_as_C_nan(&X_num[0], nrows * ncols_numeric, sess.X_num, nthreads);
+
+    if (X_cat.size())
+    {
+        sess.X_cat.assign(X_cat.begin(), X_cat.end());
+        sess.ncat.assign(ncat.begin(), ncat.end());
+    }
+
+    if (Xc.size())
+    {
+        set_R_nan_as_C_nan(&Xc[0], Xc.size(), sess.Xc, nthreads);
+        sess.Xc_ind.assign(Xc_ind.begin(), Xc_ind.end());
+        sess.Xc_indptr.assign(Xc_indptr.begin(), Xc_indptr.end());
+    }
+
+    if (sample_weights.size())
+        sess.sample_weights.assign(sample_weights.begin(), sample_weights.end());
+
+    initialize_training_session(sess.session,
+                                sess.X_num.size()? sess.X_num.data() : NULL, ncols_numeric,
+                                sess.X_cat.size()? sess.X_cat.data() : NULL, ncols_categ,
+                                sess.ncat.size()? sess.ncat.data() : NULL,
+                                sess.Xc.size()? sess.Xc.data() : NULL,
+                                sess.Xc_ind.size()? sess.Xc_ind.data() : NULL,
+                                sess.Xc_indptr.size()? sess.Xc_indptr.data() : NULL,
+                                sess.sample_weights.size()? sess.sample_weights.data() : NULL,
+                                nrows, nthreads);
+
+    return Rcpp::XPtr<RTrainingSession>(session_ptr.release(), true);
+}
+
+/* Mapped data is passed to the library as-is, so its missing values must already be C's NaN
+   (which 'write_mapped_data_R' takes care of). The file can only be written to when it was
+   mapped for imputation, which is why this also keeps track of it. */
+typedef struct RMappedData {
+    MappedData  mapped;
+    bool        writable;
+} RMappedData;
+
+void unmap_R_mapped_data(RMappedData *mapped_ptr)
+{
+    unmap_data_file(mapped_ptr->mapped);
+    delete mapped_ptr;
+}
+
+RMappedData* get_mapped_data(SEXP mapped_R_ptr, MappedDataUse use)
+{
+    if (Rf_isNull(mapped_R_ptr))
+        return NULL;
+    RMappedData *mapped_ptr = static_cast<RMappedData*>(R_ExternalPtrAddr(mapped_R_ptr));
+    advise_mapped_data(mapped_ptr->mapped, use);
+    return mapped_ptr;
+}
+
+// [[Rcpp::export]]
+bool write_mapped_data_R(Rcpp::CharacterVector file_path,
+                         Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp::IntegerVector ncat,
+                         size_t nrows, size_t ncols_numeric, size_t ncols_categ, int nthreads)
+{
+    double*  numeric_data_ptr  =  NULL;
+    int*     categ_data_ptr    =  NULL;
+    int*     ncat_ptr          =  NULL;
+    std::vector<double> Xcpp;
+
+    if (X_num.size())
+        numeric_data_ptr = set_R_nan_as_C_nan(&X_num[0], X_num.size(), Xcpp, nthreads);
+
+    if (X_cat.size())
+    {
+        categ_data_ptr  =  &X_cat[0];
+        ncat_ptr        =  &ncat[0];
+    }
+
+    std::string file_path_str = Rcpp::as<std::string>(file_path);
+    return write_mapped_data(file_path_str.c_str(),
+                             numeric_data_ptr, ncols_numeric,
+                             categ_data_ptr, ncols_categ, ncat_ptr,
+                             NULL, NULL, NULL, nrows) == EXIT_SUCCESS;
+}
+
+/* Under R, 'sparse_ix' is 'int', and the files record the size of their sparse indices, so files with
+   sparse data written from other builds of the library would not be mapped here. Sparse data is not
+   supported from R anyway (the same as in Python), so only dense files are accepted. */
+// [[Rcpp::export]]
+Rcpp::List map_data_file_R(Rcpp::CharacterVector file_path, bool writable, bool verify)
+{
+    std::unique_ptr<RMappedData> mapped_ptr = std::unique_ptr<RMappedData>(new RMappedData());
+    MappedData &mapped = mapped_ptr->mapped;
+    mapped_ptr->writable = writable;
+
+    std::string file_path_str = Rcpp::as<std::string>(file_path);
+    if (map_data_file(mapped, file_path_str.c_str(), writable? UseForImputation : UseForPrediction, verify) != EXIT_SUCCESS)
+        Rcpp::stop("Could not map file '" + file_path_str + "' - it might not exist or not be a valid data file.");
+
+    if (mapped.Xc_indptr != NULL)
+    {
+        unmap_data_file(mapped);
+        Rcpp::stop("Files with sparse data are not supported.");
+    }
+
+    Rcpp::IntegerVector ncat = Rcpp::IntegerVector();
+    if (mapped.ncols_categ)
+        ncat = Rcpp::IntegerVector(mapped.ncat, mapped.ncat + mapped.ncols_categ);
+
+    Rcpp::List outp = Rcpp::List::create(
+                Rcpp::_["nrows"]      = Rcpp::wrap((double) mapped.nrows),
+                Rcpp::_["ncols_num"]  = Rcpp::wrap((int) mapped.ncols_numeric),
+                Rcpp::_["ncols_cat"]  = Rcpp::wrap((int) mapped.ncols_categ),
+                Rcpp::_["ncat"]       = ncat
+        );
+    outp["ptr"] = Rcpp::XPtr<RMappedData, Rcpp::PreserveStorage, unmap_R_mapped_data, false>(mapped_ptr.release(), true);
+    return outp;
+}
+
 // [[Rcpp::export]]
 Rcpp::List fit_model(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp::IntegerVector ncat,
                      Rcpp::NumericVector Xc, Rcpp::IntegerVector Xc_ind, Rcpp::IntegerVector Xc_indptr,
@@ -147,14 +284,15 @@ Rcpp::List fit_model(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp:
                      Rcpp::CharacterVector coef_type, bool coef_by_prop, bool with_replacement, bool weight_as_sample,
                      size_t sample_size, size_t ntrees,  size_t max_depth, bool limit_depth,
                      bool penalize_range, bool calc_dist, bool standardize_dist, bool sq_dist,
-                     bool calc_depth, bool standardize_depth, bool weigh_by_kurt,
+                     bool calc_depth, bool standardize_depth, bool weigh_by_kurt, size_t kurt_sample_size,
                      double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                      double prob_pick_by_gain_pl,  double prob_split_by_gain_pl, double min_gain,
                      Rcpp::CharacterVector cat_split_type, Rcpp::CharacterVector new_cat_action,
                      Rcpp::CharacterVector missing_action, bool all_perm,
                      bool build_imputer, bool output_imputations, size_t min_imp_obs,
                      Rcpp::CharacterVector depth_imp, Rcpp::CharacterVector weigh_imp_rows,
-                     int random_seed, int nthreads)
+                     int random_seed, Rcpp::CharacterVector rng_type, int nthreads,
+                     SEXP session_R_ptr, SEXP mapped_R_ptr)
 {
     double*     numeric_data_ptr    =  NULL;
     int*        categ_data_ptr      =  NULL;
@@ -188,6 +326,14 @@ Rcpp::List fit_model(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp:
             Xc_ptr = set_R_nan_as_C_nan(Xc_ptr, Xc.size(), Xcpp, nthreads);
     }
 
+    RMappedData *mapped_ptr = get_mapped_data(mapped_R_ptr, UseForFitting);
+    if (mapped_ptr != NULL)
+    {
+        numeric_data_ptr  =  mapped_ptr->mapped.numeric_data;
+        categ_data_ptr    =  mapped_ptr->mapped.categ_data;
+        ncat_ptr          =  mapped_ptr->mapped.ncat;
+    }
+
     if (sample_weights.size())
     {
         sample_weights_ptr  =  &sample_weights[0];
@@ -204,6 +350,7 @@ Rcpp::List fit_model(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp:
     MissingAction   missing_action_C  =  Divide;
     UseDepthImp     depth_imp_C       =  Higher;
     WeighImpRows    weigh_imp_rows_C  =  Inverse;
+    RNGType         rng_type_C        =  MersenneTwister;
 
     if (Rcpp::as<std::string>(coef_type) == std::string("uniform"))
     {
@@ -245,6 +392,10 @@ Rcpp::List fit_model(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp:
     {
         weigh_imp_rows_C  =  Flat;
     }
+    if (Rcpp::as<std::string>(rng_type) == std::string("xoshiro"))
+    {
+        rng_type_C        =  Xoshiro;
+    }
 
     Rcpp::NumericVector  tmat    =  Rcpp::NumericVector();
     Rcpp::NumericMatrix  dmat    =  Rcpp::NumericMatrix();
@@ -282,25 +433,50 @@ Rcpp::List fit_model(Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat, Rcpp:
     if (build_imputer)
         imputer_ptr    =  std::unique_ptr<Imputer>(new Imputer());
 
-    int ret_val = 
-    fit_iforest(model_ptr.get(), ext_model_ptr.get(),
-                numeric_data_ptr,  ncols_numeric,
-                categ_data_ptr,    ncols_categ,    ncat_ptr,
-                Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
-                ndim, ntry, coef_type_C, coef_by_prop,
-                sample_weights_ptr, with_replacement, weight_as_sample,
-                nrows, sample_size, ntrees, max_depth,
-                limit_depth, penalize_range,
-                standardize_dist, tmat_ptr,
-                depths_ptr, standardize_depth,
-                col_weights_ptr, weigh_by_kurt,
-                prob_pick_by_gain_avg, prob_split_by_gain_avg,
-                prob_pick_by_gain_pl,  prob_split_by_gain_pl,
-                min_gain, missing_action_C,
-                cat_split_type_C, new_cat_action_C,
-                all_perm, imputer_ptr.get(), min_imp_obs,
-                depth_imp_C, weigh_imp_rows_C, output_imputations,
-                (uint64_t) random_seed, nthreads);
+    int ret_val;
+    if (!Rf_isNull(session_R_ptr))
+    {
+        RTrainingSession *sess = static_cast<RTrainingSession*>(R_ExternalPtrAddr(session_R_ptr));
+        ret_val =
+        fit_iforest(&sess->session, model_ptr.get(), ext_model_ptr.get(),
+                    ndim, ntry, coef_type_C, coef_by_prop,
+                    with_replacement, weight_as_sample,
+                    sample_size, ntrees, max_depth,
+                    limit_depth, penalize_range,
+                    standardize_dist, tmat_ptr,
+                    depths_ptr, standardize_depth,
+                    col_weights_ptr, weigh_by_kurt, kurt_sample_size,
+                    prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                    prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                    min_gain, missing_action_C,
+                    cat_split_type_C, new_cat_action_C,
+                    all_perm, imputer_ptr.get(), min_imp_obs,
+                    depth_imp_C, weigh_imp_rows_C, false,
+                    (uint64_t) random_seed, rng_type_C, nthreads);
+    }
+
+    else
+    {
+        ret_val =
+        fit_iforest(model_ptr.get(), ext_model_ptr.get(),
+                    numeric_data_ptr,  ncols_numeric,
+                    categ_data_ptr,    ncols_categ,    ncat_ptr,
+                    Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                    ndim, ntry, coef_type_C, coef_by_prop,
+                    sample_weights_ptr, with_replacement, weight_as_sample,
+                    nrows, sample_size, ntrees, max_depth,
+                    limit_depth, penalize_range,
+                    standardize_dist, tmat_ptr,
+                    depths_ptr, standardize_depth,
+                    col_weights_ptr, weigh_by_kurt, kurt_sample_size,
+                    prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                    prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                    min_gain, missing_action_C,
+                    cat_split_type_C, new_cat_action_C,
+                    all_perm, imputer_ptr.get(), min_imp_obs,
+                    depth_imp_C, weigh_imp_rows_C, output_imputations,
+                    (uint64_t) random_seed, rng_type_C, nthreads);
+    }
 
     if (ret_val == EXIT_FAILURE)
     {
@@ -382,7 +558,8 @@ Rcpp::RawVector fit_tree(SEXP model_R_ptr,
                          Rcpp::CharacterVector cat_split_type, Rcpp::CharacterVector new_cat_action,
                          Rcpp::CharacterVector missing_action, bool build_imputer, size_t min_imp_obs, SEXP imp_R_ptr,
                          Rcpp::CharacterVector depth_imp, Rcpp::CharacterVector weigh_imp_rows,
-                         bool all_perm, uint64_t random_seed)
+                         bool all_perm, uint64_t random_seed, Rcpp::CharacterVector rng_type,
+                         size_t ntrees, int nthreads, SEXP session_R_ptr, SEXP mapped_R_ptr)
 {
     double*     numeric_data_ptr    =  NULL;
     int*        categ_data_ptr      =  NULL;
@@ -416,6 +593,14 @@ Rcpp::RawVector fit_tree(SEXP model_R_ptr,
             Xc_ptr = set_R_nan_as_C_nan(Xc_ptr, Xc.size(), Xcpp, 1);
     }
 
+    RMappedData *mapped_ptr = get_mapped_data(mapped_R_ptr, UseForFitting);
+    if (mapped_ptr != NULL)
+    {
+        numeric_data_ptr  =  mapped_ptr->mapped.numeric_data;
+        categ_data_ptr    =  mapped_ptr->mapped.categ_data;
+        ncat_ptr          =  ncat.size()? &ncat[0] : NULL;
+    }
+
     if (sample_weights.size())
     {
         sample_weights_ptr  =  &sample_weights[0];
@@ -432,6 +617,7 @@ Rcpp::RawVector fit_tree(SEXP model_R_ptr,
     MissingAction   missing_action_C  =  Divide;
     UseDepthImp     depth_imp_C       =  Higher;
     WeighImpRows    weigh_imp_rows_C  =  Inverse;
+    RNGType         rng_type_C        =  MersenneTwister;
 
     if (Rcpp::as<std::string>(coef_type) == std::string("uniform"))
     {
@@ -473,6 +659,10 @@ Rcpp::RawVector fit_tree(SEXP model_R_ptr,
     {
         weigh_imp_rows_C  =  Flat;
     }
+    if (Rcpp::as<std::string>(rng_type) == std::string("xoshiro"))
+    {
+        rng_type_C        =  Xoshiro;
+    }
 
     IsoForest*     model_ptr      =  NULL;
     ExtIsoForest*  ext_model_ptr  =  NULL;
@@ -482,29 +672,48 @@ Rcpp::RawVector fit_tree(SEXP model_R_ptr,
     else
         ext_model_ptr  =  static_cast<ExtIsoForest*>(R_ExternalPtrAddr(model_R_ptr));
 
-    std::vector<ImputeNode>  *imp_ptr = NULL;
     if (build_imputer)
-    {
         imputer_ptr = static_cast<Imputer*>(R_ExternalPtrAddr(imp_R_ptr));
-        imputer_ptr->imputer_tree.emplace_back();
-        imp_ptr     = &imputer_ptr->imputer_tree.back();
-    }
-
-    add_tree(model_ptr, ext_model_ptr,
-             numeric_data_ptr,  ncols_numeric,
-             categ_data_ptr,    ncols_categ,    ncat_ptr,
-             Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
-             ndim, ntry, coef_type_C, coef_by_prop,
-             sample_weights_ptr,
-             nrows, max_depth,
-             limit_depth,  penalize_range,
-             col_weights_ptr, weigh_by_kurt,
-             prob_pick_by_gain_avg, prob_split_by_gain_avg,
-             prob_pick_by_gain_pl,  prob_split_by_gain_pl,
-             min_gain, missing_action_C,
-             cat_split_type_C, new_cat_action_C,
-             depth_imp_C, weigh_imp_rows_C, all_perm,
-             imp_ptr, min_imp_obs, (uint64_t)random_seed);
+
+    int ret_val;
+    if (!Rf_isNull(session_R_ptr))
+    {
+        RTrainingSession *sess = static_cast<RTrainingSession*>(R_ExternalPtrAddr(session_R_ptr));
+        ret_val =
+        add_trees(&sess->session, model_ptr, ext_model_ptr,
+                  ndim, ntry, coef_type_C, coef_by_prop,
+                  ntrees, max_depth, limit_depth,  penalize_range,
+                  col_weights_ptr, weigh_by_kurt,
+                  prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                  prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                  min_gain, missing_action_C,
+                  cat_split_type_C, new_cat_action_C,
+                  depth_imp_C, weigh_imp_rows_C, all_perm,
+                  imputer_ptr, min_imp_obs, (uint64_t)random_seed, rng_type_C, nthreads);
+    }
+
+    else
+    {
+        ret_val =
+        add_trees(model_ptr, ext_model_ptr,
+                  numeric_data_ptr,  ncols_numeric,
+                  categ_data_ptr,    ncols_categ,    ncat_ptr,
+                  Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                  ndim, ntry, coef_type_C, coef_by_prop,
+                  sample_weights_ptr,
+                  nrows, ntrees, max_depth,
+                  limit_depth,  penalize_range,
+                  col_weights_ptr, weigh_by_kurt,
+                  prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                  prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                  min_gain, missing_action_C,
+                  cat_split_type_C, new_cat_action_C,
+                  depth_imp_C, weigh_imp_rows_C, all_perm,
+                  imputer_ptr, min_imp_obs, (uint64_t)random_seed, rng_type_C, nthreads);
+    }
+
+    if (ret_val == EXIT_FAILURE)
+        Rcpp::stop("Procedure was interrupted.");
 
     if (ndim == 1)
         return serialize_cpp_obj(model_ptr);
@@ -517,7 +726,7 @@ void predict_iso(SEXP model_R_ptr, Rcpp::NumericVector outp, Rcpp::IntegerVector
                  Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat,
                  Rcpp::NumericVector Xc, Rcpp::IntegerVector Xc_ind, Rcpp::IntegerVector Xc_indptr,
                  Rcpp::NumericVector Xr, Rcpp::IntegerVector Xr_ind, Rcpp::IntegerVector Xr_indptr,
-                 size_t nrows, int nthreads, bool standardize)
+                 size_t nrows, int nthreads, bool standardize, SEXP mapped_R_ptr)
 {
     double*     numeric_data_ptr    =  NULL;
     int*        categ_data_ptr      =  NULL;
@@ -558,6 +767,13 @@ void predict_iso(SEXP model_R_ptr, Rcpp::NumericVector outp, Rcpp::IntegerVector
         Xr_indptr_ptr      =  &Xr_indptr[0];
     }
 
+    RMappedData *mapped_ptr = get_mapped_data(mapped_R_ptr, UseForPrediction);
+    if (mapped_ptr != NULL)
+    {
+        numeric_data_ptr  =  mapped_ptr->mapped.numeric_data;
+        categ_data_ptr    =  mapped_ptr->mapped.categ_data;
+    }
+
     if (tree_num.size())
     {
         tree_num_ptr = &tree_num[0];
@@ -597,7 +813,7 @@ void dist_iso(SEXP model_R_ptr, Rcpp::NumericVector tmat, Rcpp::NumericVector dm
               Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat,
               Rcpp::NumericVector Xc, Rcpp::IntegerVector Xc_ind, Rcpp::IntegerVector Xc_indptr,
               size_t nrows, int nthreads, bool assume_full_distr,
-              bool standardize_dist, bool sq_dist, size_t n_from)
+              bool standardize_dist, bool sq_dist, size_t n_from, SEXP mapped_R_ptr)
 {
     double*     numeric_data_ptr    =  NULL;
     int*        categ_data_ptr      =  NULL;
@@ -625,6 +841,13 @@ void dist_iso(SEXP model_R_ptr, Rcpp::NumericVector tmat, Rcpp::NumericVector dm
         Xc_indptr_ptr  =  &Xc_indptr[0];
     }
 
+    RMappedData *mapped_ptr = get_mapped_data(mapped_R_ptr, UseForPrediction);
+    if (mapped_ptr != NULL)
+    {
+        numeric_data_ptr  =  mapped_ptr->mapped.numeric_data;
+        categ_data_ptr    =  mapped_ptr->mapped.categ_data;
+    }
+
     double*  tmat_ptr    =  n_from? (double*)NULL : &tmat[0];
     double*  dmat_ptr    =  (sq_dist & !n_from)? &dmat[0] : NULL;
     double*  rmat_ptr    =  n_from? &rmat[0] : NULL;
@@ -658,11 +881,78 @@ void dist_iso(SEXP model_R_ptr, Rcpp::NumericVector tmat, Rcpp::NumericVector dm
         tmat_to_dense(tmat_ptr, dmat_ptr, nrows, !standardize_dist);
 }
 
+// [[Rcpp::export]]
+bool dist_iso_to_file(SEXP model_R_ptr, Rcpp::CharacterVector file_path, bool as_float, bool is_extended,
+                      Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat,
+                      Rcpp::NumericVector Xc, Rcpp::IntegerVector Xc_ind, Rcpp::IntegerVector Xc_indptr,
+                      size_t nrows, int nthreads, bool assume_full_distr,
+                      bool standardize_dist, size_t n_from, SEXP mapped_R_ptr)
+{
+    double*     numeric_data_ptr    =  NULL;
+    int*        categ_data_ptr      =  NULL;
+    double*     Xc_ptr              =  NULL;
+    sparse_ix*  Xc_ind_ptr          =  NULL;
+    sparse_ix*  Xc_indptr_ptr       =  NULL;
+    std::vector<double> Xcpp;
+
+    if (X_num.size())
+    {
+        numeric_data_ptr  =  &X_num[0];
+    }
+
+    if (X_cat.size())
+    {
+        categ_data_ptr    =  &X_cat[0];
+    }
+
+    if (Xc_indptr.size())
+    {
+        if (Xc.size())
+            Xc_ptr         =  &Xc[0];
+        if (Xc_ind.size())
+            Xc_ind_ptr     =  &Xc_ind[0];
+        Xc_indptr_ptr  =  &Xc_indptr[0];
+    }
+
+    RMappedData *mapped_ptr = get_mapped_data(mapped_R_ptr, UseForPrediction);
+    if (mapped_ptr != NULL)
+    {
+        numeric_data_ptr  =  mapped_ptr->mapped.numeric_data;
+        categ_data_ptr    =  mapped_ptr->mapped.categ_data;
+    }
+
+    IsoForest*     model_ptr      =  NULL;
+    ExtIsoForest*  ext_model_ptr  =  NULL;
+    if (is_extended)
+        ext_model_ptr  =  static_cast<ExtIsoForest*>(R_ExternalPtrAddr(model_R_ptr));
+    else
+        model_ptr      =  static_cast<IsoForest*>(R_ExternalPtrAddr(model_R_ptr));
+
+
+    MissingAction missing_action = is_extended?
+                                   ext_model_ptr->missing_action
+                                     :
+                                   model_ptr->missing_action;
+    if (missing_action != Fail)
+    {
+        if (X_num.size()) numeric_data_ptr = set_R_nan_as_C_nan(numeric_data_ptr, X_num.size(), Xcpp, nthreads);
+        if (Xc.size())    Xc_ptr           = set_R_nan_as_C_nan(Xc_ptr, Xc.size(), Xcpp, nthreads);
+    }
+
+
+    std::string file_path_str = Rcpp::as<std::string>(file_path);
+    return calc_similarity_to_file(file_path_str.c_str(), as_float,
+                                   numeric_data_ptr, categ_data_ptr,
+                                   Xc_ptr, Xc_ind_ptr, Xc_indptr_ptr,
+                                   nrows, nthreads, assume_full_distr, standardize_dist,
+                                   model_ptr, ext_model_ptr, n_from) == EXIT_SUCCESS;
+}
+
 // [[Rcpp::export]]
 Rcpp::List impute_iso(SEXP model_R_ptr, SEXP imputer_R_ptr, bool is_extended,
                       Rcpp::NumericVector X_num, Rcpp::IntegerVector X_cat,
                       Rcpp::NumericVector Xr, Rcpp::IntegerVector Xr_ind, Rcpp::IntegerVector Xr_indptr,
-                      size_t nrows, int nthreads)
+                      size_t nrows, int nthreads, SEXP mapped_R_ptr)
 {
     double*     numeric_data_ptr    =  NULL;
     int*        categ_data_ptr      =  NULL;
@@ -670,6 +960,17 @@ Rcpp::List impute_iso(SEXP model_R_ptr, SEXP imputer_R_ptr, bool is_extended,
     sparse_ix*  Xr_ind_ptr          =  NULL;
     sparse_ix*  Xr_indptr_ptr       =  NULL;
 
+    /* read-only mappings get imputed in a copy, which is what gets returned */
+    RMappedData *mapped_ptr = get_mapped_data(mapped_R_ptr, UseForImputation);
+    if (mapped_ptr != NULL && !mapped_ptr->writable)
+    {
+        MappedData &mapped = mapped_ptr->mapped;
+        if (mapped.ncols_numeric)
+            X_num = Rcpp::NumericVector(mapped.numeric_data, mapped.numeric_data + nrows * mapped.ncols_numeric);
+        if (mapped.ncols_categ)
+            X_cat = Rcpp::IntegerVector(mapped.categ_data, mapped.categ_data + nrows * mapped.ncols_categ);
+    }
+
     if (X_num.size())
     {
         numeric_data_ptr  =  &X_num[0];
@@ -692,6 +993,12 @@ Rcpp::List impute_iso(SEXP model_R_ptr, SEXP imputer_R_ptr, bool is_extended,
     if (X_num.size()) numeric_data_ptr = set_R_nan_as_C_nan(numeric_data_ptr, X_num.size(), nthreads);
     if (Xr.size())    Xr_ptr           = set_R_nan_as_C_nan(Xr_ptr, Xr.size(), nthreads);
 
+    if (mapped_ptr != NULL && mapped_ptr->writable)
+    {
+        numeric_data_ptr  =  mapped_ptr->mapped.numeric_data;
+        categ_data_ptr    =  mapped_ptr->mapped.categ_data;
+    }
+
     IsoForest*     model_ptr      =  NULL;
     ExtIsoForest*  ext_model_ptr  =  NULL;
     if (is_extended)
@@ -789,4 +1096,12 @@ Rcpp::List append_trees_from_other(SEXP model_R_ptr, SEXP other_R_ptr,
     return out;
 }
 
+// [[Rcpp::export]]
+Rcpp::RawVector compact_imputer_R(SEXP imp_R_ptr, bool as_float, int nthreads)
+{
+    Imputer* imputer_ptr = static_cast<Imputer*>(R_ExternalPtrAddr(imp_R_ptr));
+    compact_imputer(*imputer_ptr, as_float, nthreads);
+    return serialize_cpp_obj(imputer_ptr);
+}
+
 #endif /* _FOR_R */
@@ -49,7 +49,7 @@
 #define pw3(x) ((x) * (x) * (x))
 #define pw4(x) ((x) * (x) * (x) * (x))
 
-double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, double x[], MissingAction missing_action)
+double calc_kurtosis(ix_t ix_arr[], size_t st, size_t end, double x[], MissingAction missing_action)
 {
     long double m = 0;
     long double M2 = 0, M3 = 0, M4 = 0;
@@ -103,7 +103,102 @@ double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, double x[], Missing
 }
 
 
-double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, size_t col_num,
+/* Kurtosis of a contiguous array, calculated in two passes (mean, then central moments).
+   The sums are accumulated in double precision within blocks, using independent accumulators
+   that the compiler can map to SIMD registers, and the block sums are then added in long double,
+   which keeps the rounding errors bounded by the block size rather than by the number of rows. */
+#define KURT_BLOCK_SIZE 256
+#define KURT_NACC 4
+static double calc_kurtosis_contiguous(double *restrict x, size_t n)
+{
+    if (n <= 1) return 0;
+
+    long double s1 = 0;
+    for (size_t st = 0; st < n; st += KURT_BLOCK_SIZE)
+    {
+        size_t end = std::min(n, st + KURT_BLOCK_SIZE);
+        double acc[KURT_NACC] = {0};
+        size_t row = st;
+        for (; row + KURT_NACC <= end; row += KURT_NACC)
+            for (size_t lane = 0; lane < KURT_NACC; lane++)
+                acc[lane] += x[row + lane];
+        for (; row < end; row++)
+            acc[0] += x[row];
+        for (size_t lane = 0; lane < KURT_NACC; lane++)
+            s1 += acc[lane];
+    }
+    double mean = (double)(s1 / (long double)n);
+
+    long double M2 = 0, M4 = 0;
+    for (size_t st = 0; st < n; st += KURT_BLOCK_SIZE)
+    {
+        size_t end = std::min(n, st + KURT_BLOCK_SIZE);
+        double acc2[KURT_NACC] = {0};
+        double acc4[KURT_NACC] = {0};
+        double diff_sq;
+        size_t row = st;
+        for (; row + KURT_NACC <= end; row += KURT_NACC)
+        {
+            for (size_t lane = 0; lane < KURT_NACC; lane++)
+            {
+                diff_sq = pw2(x[row + lane] - mean);
+                acc2[lane] += diff_sq;
+                acc4[lane] += pw2(diff_sq);
+            }
+        }
+        for (; row < end; row++)
+        {
+            diff_sq = pw2(x[row] - mean);
+            acc2[0] += diff_sq;
+            acc4[0] += pw2(diff_sq);
+        }
+        for (size_t lane = 0; lane < KURT_NACC; lane++)
+        {
+            M2 += acc2[lane];
+            M4 += acc4[lane];
+        }
+    }
+
+    if (M2 <= 0) return 0;
+    return ( M4 / M2 ) * ( (long double)n / M2 );
+}
+
+/* Same as the single-column version for dense numeric data, but for all the columns at once:
+   the sample of each column is first gathered into a contiguous buffer (discarding missing
+   values), and the moments are then calculated over that buffer without indirections.
+   'buffer_arr' must have space for at least (end - st + 1) elements. */
+void calc_kurtosis_all_cols(ix_t ix_arr[], size_t st, size_t end, double numeric_data[],
+                            size_t nrows, size_t ncols_numeric, MissingAction missing_action,
+                            double *restrict buffer_arr, double *restrict kurt_out)
+{
+    double xval;
+    size_t cnt;
+    for (size_t col = 0; col < ncols_numeric; col++)
+    {
+        double *restrict x = numeric_data + col * nrows;
+        cnt = 0;
+        if (missing_action == Fail)
+        {
+            for (size_t row = st; row <= end; row++)
+                buffer_arr[cnt++] = x[ix_arr[row]];
+        }
+
+        else
+        {
+            for (size_t row = st; row <= end; row++)
+            {
+                xval = x[ix_arr[row]];
+                if (!is_na_or_inf(xval))
+                    buffer_arr[cnt++] = xval;
+            }
+        }
+
+        kurt_out[col] = calc_kurtosis_contiguous(buffer_arr, cnt);
+    }
+}
+
+
+double calc_kurtosis(ix_t ix_arr[], size_t st, size_t end, size_t col_num,
                      double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                      MissingAction missing_action)
 {
@@ -123,11 +218,11 @@ double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, size_t col_num,
     size_t end_col = Xc_indptr[col_num + 1] - 1;
     size_t curr_pos = st_col;
     size_t ind_end_col = Xc_ind[end_col];
-    size_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
+    ix_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
 
     if (missing_action != Fail)
     {
-        for (size_t *row = ptr_st;
+        for (ix_t *row = ptr_st;
              row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
             )
         {
@@ -162,7 +257,7 @@ double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, size_t col_num,
 
     else
     {
-        for (size_t *row = ptr_st;
+        for (ix_t *row = ptr_st;
              row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
             )
         {
@@ -196,7 +291,7 @@ double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, size_t col_num,
 }
 
 
-double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, int x[], int ncat, size_t buffer_cnt[], double buffer_prob[],
+double calc_kurtosis(ix_t ix_arr[], size_t st, size_t end, int x[], int ncat, size_t buffer_cnt[], double buffer_prob[],
                      MissingAction missing_action, CategSplit cat_split_type, RNG_engine &rnd_generator)
 {
     /* This calculation proceeds as follows:
@@ -388,7 +483,7 @@ double categ_gain(size_t cnt_left, size_t cnt_right,
 
 /* for split-criterion in hyperplanes (see below for version aimed at single-variable splits) */
 double eval_guided_crit(double *restrict x, size_t n, GainCriterion criterion, double min_gain,
-                        double &split_point, double &xmin, double &xmax)
+                        double &split_point, double &xmin, double &xmax, double *restrict buffer_arr)
 {
     /* Note: the input 'x' is supposed to be a linear combination of standardized variables, so
        all numbers are assumed to be small and in the same scale */
@@ -401,7 +496,7 @@ double eval_guided_crit(double *restrict x, size_t n, GainCriterion criterion, d
     }
 
     /* sort in ascending order */
-    std::sort(x, x + n);
+    sort_doubles(x, n, buffer_arr);
     if (x[0] == x[n-1]) return -HUGE_VAL;
     xmin = x[0]; xmax = x[n-1];
 
@@ -486,7 +581,7 @@ double eval_guided_crit(double *restrict x, size_t n, GainCriterion criterion, d
 
 /* for split-criterion in single-variable splits */
 #define std_val(x, m, sd) ( ((x) - (m)) / (sd)  )
-double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, double *restrict x,
+double eval_guided_crit(ix_t *restrict ix_arr, size_t st, size_t end, double *restrict x,
                         size_t &split_ix, double &split_point, double &xmin, double &xmax,
                         GainCriterion criterion, double min_gain, MissingAction missing_action)
 {
@@ -497,6 +592,8 @@ double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, double *
     if (st >= end) return -HUGE_VAL;
     else if (st == (end-1))
     {
+        if (x[ix_arr[st]] > x[ix_arr[end]])
+            std::swap(ix_arr[st], ix_arr[end]);
         split_point = avg_between(x[ix_arr[st]], x[ix_arr[end]]);
         split_ix    = st;
         return 0;
@@ -602,16 +699,16 @@ double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, double *
         return best_gain;
 }
 
-double eval_guided_crit(size_t ix_arr[], size_t st, size_t end,
+double eval_guided_crit(ix_t ix_arr[], size_t st, size_t end,
                         size_t col_num, double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
-                        double buffer_arr[], size_t buffer_pos[],
+                        double buffer_arr[], ix_t buffer_pos[],
                         double &split_point, double &xmin, double &xmax,
                         GainCriterion criterion, double min_gain, MissingAction missing_action)
 {
     todense(ix_arr, st, end,
             col_num, Xc, Xc_ind, Xc_indptr,
             buffer_arr);
-    std::iota(buffer_pos, buffer_pos + (end - st + 1), (size_t)0);
+    std::iota(buffer_pos, buffer_pos + (end - st + 1), (ix_t)0);
     size_t temp;
     return eval_guided_crit(buffer_pos, 0, end - st, buffer_arr, temp, split_point,
                             xmin, xmax, criterion, min_gain, missing_action);
@@ -634,7 +731,7 @@ double eval_guided_crit(size_t ix_arr[], size_t st, size_t end,
    Gini gain is not easily comparable to that of numerical columns, so it's not offered as an option here.
 */
 /* https://math.stackexchange.com/questions/3343384/expected-variance-and-kurtosis-from-pmf-in-which-possible-discrete-values-are-dr */
-double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, int *restrict x, int ncat,
+double eval_guided_crit(ix_t *restrict ix_arr, size_t st, size_t end, int *restrict x, int ncat,
                         size_t *restrict buffer_cnt, size_t *restrict buffer_pos, double *restrict buffer_prob,
                         int &chosen_cat, char *restrict split_categ, char *restrict buffer_split,
                         GainCriterion criterion, double min_gain, bool all_perm, MissingAction missing_action, CategSplit cat_split_type)
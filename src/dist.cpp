@@ -44,6 +44,8 @@
 */
 #include "isotree.hpp" 
 
+/* rows per block when calculating the distances in tiles */
+#define SIM_TILE_SIZE 64
 
 /* Calculate distance or similarity between data points
 * 
@@ -85,9 +87,13 @@
 * - nrows
 *       Number of rows in 'numeric_data', 'Xc', 'Xr, 'categ_data'.
 * - nthreads
-*       Number of parallel threads to use. Note that, the more threads, the more memory will be
-*       allocated, even if the thread does not end up being used. Ignored when not building with
-*       OpenMP support.
+*       Number of parallel threads to use. When there are few rows compared to the number of trees,
+*       calculations are distributed by trees and each thread allocates its own output matrix, so
+*       the more threads, the more memory will be allocated. Otherwise, calculations are distributed
+*       by blocks of rows in the output, with little extra memory per thread, unless some row
+*       gets divided between both branches of a tree (models with missing_action = 'Divide' or
+*       new_cat_action = 'Weighted' when there are missing values or new categories).
+*       Ignored when not building with OpenMP support.
 * - assume_full_distr
 *       Whether to assume that the fitted model represents a full population distribution (will use a
 *       standardizing criterion assuming infinite sample, and the results of the similarity between two points
@@ -148,6 +154,15 @@ void calc_similarity(double numeric_data[], int categ_data[],
 
     if (tmat != NULL) n_from = 0;
 
+    /* Calculating by trees requires one full output matrix per thread, whereas calculating by
+       blocks of rows requires instead storing the terminal node of each row in each tree. The
+       latter is not possible if some row gets divided between both branches of a tree. */
+    size_t n_pairs = n_from? (n_from * (nrows - n_from)) : ((nrows * (nrows - 1)) / 2);
+    if (n_pairs * (size_t)std::max(1, std::min(nthreads, (int)ntrees)) >= nrows * ntrees &&
+        calc_similarity_tiled(prediction_data, model_outputs, model_outputs_ext,
+                              tmat, rmat, n_from, assume_full_distr, standardize_dist, nthreads))
+        return;
+
     if ((size_t)nthreads > ntrees)
         nthreads = (int)ntrees;
     #ifdef _OPENMP
@@ -187,7 +202,7 @@ void calc_similarity(double numeric_data[], int categ_data[],
     }
     
     /* gather and transform the results */
-    gather_sim_result(&worker_memory, NULL,
+    gather_sim_result(&worker_memory,
                       &prediction_data, NULL,
                       model_outputs, model_outputs_ext,
                       tmat, rmat, n_from,
@@ -195,22 +210,330 @@ void calc_similarity(double numeric_data[], int categ_data[],
                       standardize_dist, nthreads);
 }
 
+/* Calculate distance or similarity between data points, writing them to a file
+* 
+* Same calculations as 'calc_similarity', but the output is written into a memory-mapped
+* file instead of an array in memory, so it can be used when the resulting matrix does not
+* fit in memory. The results are calculated by blocks of rows and written about sequentially.
+* The file will contain only the raw numbers in the endianness of the computer that writes it,
+* either as 'double' or as 'float' (32-bit floating point), in the same layout as 'tmat' (upper
+* triangular part of the pairwise distances matrix, when 'n_from' = 0) or as 'rmat' (row-major
+* matrix with the distances from each of the first 'n_from' rows to each of the remaining rows).
+* 
+* Parameters
+* ==========
+* - file_path
+*       Name of the file to write. If it already exists, will be overwritten.
+* - as_float
+*       Whether to write the results as 32-bit floating point numbers ('float') instead
+*       of 'double', which takes half as much space.
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, nrows, nthreads, assume_full_distr,
+*   standardize_dist, model_outputs, model_outputs_ext
+*       Same as for 'calc_similarity'.
+* - n_from
+*       When calculating distances between two groups of points, the number of rows
+*       belonging to the first group, which will be assumed to be the first 'n_from'
+*       rows. Pass zero to calculate pairwise distances between all the rows.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the results were written successfully,
+* or 'EXIT_FAILURE' (typically =1) if the file could not be created or written (e.g. if there
+* is not enough space in the disk for it), or if some row has to be divided between both
+* branches of a tree (models with 'missing_action' = 'Divide' or 'new_cat_action' = 'Weighted',
+* when there are missing values or new categories), which requires holding the full outputs in
+* memory ('calc_similarity' should be used instead). The file is deleted if returning 'EXIT_FAILURE'.
+*/
+int calc_similarity_to_file(const char *file_path, bool as_float,
+                            double numeric_data[], int categ_data[],
+                            double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                            size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                            IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                            size_t n_from)
+{
+    PredictionData prediction_data = {numeric_data, categ_data, nrows,
+                                      Xc, Xc_ind, Xc_indptr,
+                                      NULL, NULL, NULL};
+
+    size_t n_out = n_from? (n_from * (nrows - n_from)) : ((nrows * (nrows - 1)) / 2);
+    size_t n_bytes = n_out * (as_float? sizeof(float) : sizeof(double));
+    void *mapped_addr;
+    if (map_output_file(file_path, n_bytes, &mapped_addr) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    bool calculated;
+    if (as_float)
+        calculated = calc_similarity_tiled(prediction_data, model_outputs, model_outputs_ext,
+                                           n_from? (float*)NULL : (float*)mapped_addr,
+                                           n_from? (float*)mapped_addr : (float*)NULL,
+                                           n_from, assume_full_distr, standardize_dist, nthreads);
+    else
+        calculated = calc_similarity_tiled(prediction_data, model_outputs, model_outputs_ext,
+                                           n_from? (double*)NULL : (double*)mapped_addr,
+                                           n_from? (double*)mapped_addr : (double*)NULL,
+                                           n_from, assume_full_distr, standardize_dist, nthreads);
+
+    /* an incomplete file is not left behind */
+    if (unmap_output_file(mapped_addr, n_bytes) != EXIT_SUCCESS || !calculated)
+    {
+        remove(file_path);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Calculate separation depths by blocks of rows, writing them directly to the output
+* 
+* Each row is first passed through every tree, recording the node at which it ends up,
+* after which the separation depth between two rows in a given tree can be obtained from
+* the deepest node that both of them share. Each thread is then in charge of a block of rows
+* in the output matrix, so there is no need for holding one output matrix per thread, and
+* the final distances or average separation depths are calculated right away.
+* 
+* The blocks of rows are taken in order and each of them covers a contiguous range of the
+* output (either 'tmat' or 'rmat'), so the outputs are written about sequentially, which
+* allows them to be in a memory-mapped file. They can be either 'double' or 'float'.
+* 
+* Will return 'false' without having written anything to the outputs if any row has to be
+* divided between both branches of a tree, in which case it should be calculated by trees.
+*/
+template <class real_t>
+bool calc_similarity_tiled(PredictionData &prediction_data,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           real_t *restrict tmat, real_t *restrict rmat, size_t n_from,
+                           bool assume_full_distr, bool standardize_dist, int nthreads)
+{
+    size_t nrows  = prediction_data.nrows;
+    size_t ntrees = (model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size();
+    std::vector<size_t> row_nodes(nrows * ntrees);
+    if (!get_row_nodes_for_sim(prediction_data, model_outputs, model_outputs_ext, row_nodes.data(), nthreads))
+        return false;
+
+    /* separation between rows in the same terminal node depends on how many rows end up there */
+    std::vector<TreeNodesForSimilarity> tree_nodes(ntrees);
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) \
+            shared(ntrees, nrows, row_nodes, tree_nodes, model_outputs, model_outputs_ext, assume_full_distr)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        if (model_outputs != NULL)
+            get_tree_nodes_for_sim(tree_nodes[tree], model_outputs->trees[tree]);
+        else
+            get_tree_nodes_for_sim(tree_nodes[tree], model_outputs_ext->hplanes[tree]);
+
+        std::vector<size_t> node_count(tree_nodes[tree].parent.size(), 0);
+        for (size_t row = 0; row < nrows; row++)
+            node_count[row_nodes[row * ntrees + tree]]++;
+
+        for (size_t node = 0; node < node_count.size(); node++)
+        {
+            if (node_count[node] < 2) continue;
+            tree_nodes[tree].leaf_sep[node] = calc_leaf_separation((model_outputs != NULL)?
+                                                                      model_outputs->trees[tree][node].remainder
+                                                                        :
+                                                                      model_outputs_ext->hplanes[tree][node].remainder,
+                                                                   node_count[node], assume_full_distr);
+        }
+    }
+
+    /* now calculate by blocks of rows in the output, taking column blocks within them */
+    double div_trees = calc_sim_divisor(&prediction_data, NULL, model_outputs, model_outputs_ext,
+                                        ntrees, assume_full_distr, standardize_dist);
+    double ntrees_dbl = (double) ntrees;
+    size_t row_end = n_from? n_from : nrows;
+    size_t nblocks = (row_end + SIM_TILE_SIZE - 1) / SIM_TILE_SIZE;
+    size_t n_to = nrows - n_from;
+    size_t ncomb = (nrows * (nrows - 1)) / 2;
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) \
+            shared(nblocks, row_end, nrows, n_from, n_to, ncomb, ntrees, row_nodes, tree_nodes, tmat, rmat, \
+                   div_trees, ntrees_dbl, standardize_dist)
+    for (size_t_for block = 0; block < nblocks; block++)
+    {
+        double sep;
+        size_t row_st = block * SIM_TILE_SIZE;
+        size_t row_lim = std::min(row_st + SIM_TILE_SIZE, row_end);
+        size_t col_st = n_from? n_from : (row_st + 1);
+        for (size_t col_block = col_st; col_block < nrows; col_block += SIM_TILE_SIZE)
+        {
+            size_t col_lim = std::min(col_block + SIM_TILE_SIZE, nrows);
+            for (size_t row = row_st; row < row_lim; row++)
+            {
+                if (tmat != NULL)
+                {
+                    for (size_t col = std::max(col_block, row + 1); col < col_lim; col++)
+                    {
+                        sep = calc_pair_separation(row_nodes.data() + row * ntrees,
+                                                   row_nodes.data() + col * ntrees,
+                                                   tree_nodes);
+                        tmat[ix_comb(row, col, nrows, ncomb)] = standardize_dist?
+                                                                  exp2( - sep / div_trees) : ((sep + ntrees) / ntrees_dbl);
+                    }
+                }
+
+                else
+                {
+                    for (size_t col = col_block; col < col_lim; col++)
+                    {
+                        sep = calc_pair_separation(row_nodes.data() + row * ntrees,
+                                                   row_nodes.data() + col * ntrees,
+                                                   tree_nodes);
+                        rmat[row * n_to + col - n_from] = standardize_dist?
+                                                            exp2( - sep / div_trees) : ((sep + ntrees) / ntrees_dbl);
+                    }
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+/* Pass the rows through every tree, recording the terminal node at which each one ends up
+* 
+* The output 'row_nodes' has one entry per row and tree, in row-major order (i.e. the nodes
+* for a given row are contiguous). Will return 'false' if some row has to be divided between
+* both branches of a tree, in which case the contents of 'row_nodes' are not to be used.
+*/
+bool get_row_nodes_for_sim(PredictionData &prediction_data,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           size_t *restrict row_nodes, int nthreads)
+{
+    size_t nrows  = prediction_data.nrows;
+    size_t ntrees = (model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size();
+
+    if ((size_t)nthreads > ntrees)
+        nthreads = (int)ntrees;
+    #ifdef _OPENMP
+    std::vector<WorkerForSimilarity> worker_memory(nthreads);
+    std::vector<std::vector<size_t>> nodes_buffer(nthreads, std::vector<size_t>(nrows));
+    #else
+    std::vector<WorkerForSimilarity> worker_memory(1);
+    std::vector<std::vector<size_t>> nodes_buffer(1, std::vector<size_t>(nrows));
+    #endif
+    for (size_t ix = 0; ix < worker_memory.size(); ix++)
+    {
+        worker_memory[ix].row_node = nodes_buffer[ix].data();
+        worker_memory[ix].rows_divided = false;
+    }
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) \
+            shared(ntrees, nrows, worker_memory, row_nodes, prediction_data, model_outputs, model_outputs_ext)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        WorkerForSimilarity &workspace = worker_memory[omp_get_thread_num()];
+        if (workspace.rows_divided) continue;
+        initialize_worker_for_sim(workspace, prediction_data,
+                                  model_outputs, model_outputs_ext, 0, false);
+        if (model_outputs != NULL)
+            traverse_tree_sim(workspace, prediction_data, *model_outputs, model_outputs->trees[tree], (size_t)0);
+        else
+            traverse_hplane_sim(workspace, prediction_data, *model_outputs_ext, model_outputs_ext->hplanes[tree], (size_t)0);
+        if (workspace.rows_divided) continue;
+
+        for (size_t row = 0; row < nrows; row++)
+            row_nodes[row * ntrees + tree] = workspace.row_node[row];
+    }
+
+    for (WorkerForSimilarity &w : worker_memory)
+        if (w.rows_divided) return false;
+    return true;
+}
+
+/* Separation added to a pair of rows that end up in the same terminal node, given how many
+   rows from the data for which separations are calculated end up in it */
+double calc_leaf_separation(double remainder, size_t n_rows_in_node, bool assume_full_distr)
+{
+    double exp_remainder = assume_full_distr? 3. :
+                            expected_separation_depth((long double) remainder + (long double) n_rows_in_node);
+    return (exp_remainder <= 1)? 1. : exp_remainder;
+}
+
+void get_tree_nodes_for_sim(TreeNodesForSimilarity &tree_nodes, std::vector<IsoTree> &trees)
+{
+    tree_nodes.parent.assign(trees.size(), 0);
+    tree_nodes.depth.assign(trees.size(), 0);
+    tree_nodes.leaf_sep.assign(trees.size(), 0);
+    /* children are always added after their parent */
+    for (size_t node = 0; node < trees.size(); node++)
+    {
+        if (trees[node].score >= 0) continue;
+        tree_nodes.parent[trees[node].tree_left]  = node;
+        tree_nodes.parent[trees[node].tree_right] = node;
+        tree_nodes.depth[trees[node].tree_left]   = tree_nodes.depth[node] + 1;
+        tree_nodes.depth[trees[node].tree_right]  = tree_nodes.depth[node] + 1;
+    }
+}
+
+void get_tree_nodes_for_sim(TreeNodesForSimilarity &tree_nodes, std::vector<IsoHPlane> &hplanes)
+{
+    tree_nodes.parent.assign(hplanes.size(), 0);
+    tree_nodes.depth.assign(hplanes.size(), 0);
+    tree_nodes.leaf_sep.assign(hplanes.size(), 0);
+    for (size_t node = 0; node < hplanes.size(); node++)
+    {
+        if (hplanes[node].score >= 0) continue;
+        tree_nodes.parent[hplanes[node].hplane_left]  = node;
+        tree_nodes.parent[hplanes[node].hplane_right] = node;
+        tree_nodes.depth[hplanes[node].hplane_left]   = tree_nodes.depth[node] + 1;
+        tree_nodes.depth[hplanes[node].hplane_right]  = tree_nodes.depth[node] + 1;
+    }
+}
+
+/* Sum of separation depths between two rows across all trees, given the nodes at which they end up,
+   adding the same amounts as 'traverse_tree_sim' (+1 for each non-root node that they share) */
+double calc_pair_separation(size_t *restrict nodes_row1, size_t *restrict nodes_row2,
+                            std::vector<TreeNodesForSimilarity> &tree_nodes)
+{
+    double sep = 0;
+    size_t node1, node2;
+    for (size_t tree = 0; tree < tree_nodes.size(); tree++)
+    {
+        node1 = nodes_row1[tree];
+        node2 = nodes_row2[tree];
+        TreeNodesForSimilarity &curr_nodes = tree_nodes[tree];
+
+        if (node1 == node2)
+        {
+            if (curr_nodes.depth[node1] > 1)
+                sep += (double) (curr_nodes.depth[node1] - 1);
+            sep += curr_nodes.leaf_sep[node1];
+        }
+
+        else
+        {
+            while (node1 != node2)
+            {
+                if (curr_nodes.depth[node1] >= curr_nodes.depth[node2])
+                    node1 = curr_nodes.parent[node1];
+                else
+                    node2 = curr_nodes.parent[node2];
+            }
+            sep += (double) curr_nodes.depth[node1];
+        }
+    }
+    return sep;
+}
+
 void traverse_tree_sim(WorkerForSimilarity   &workspace,
                        PredictionData        &prediction_data,
                        IsoForest             &model_outputs,
                        std::vector<IsoTree>  &trees,
                        size_t                curr_tree)
 {
-    if (workspace.st == workspace.end)
+    /* when recording nodes, rows are taken down to a terminal node even if they are alone */
+    if (workspace.st == workspace.end && workspace.row_node == NULL)
         return;
 
-    if (!workspace.tmat_sep.size())
+    /* sorted indices are required for adding separations by blocks */
+    if (workspace.row_node == NULL)
     {
         std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
-        if (workspace.ix_arr[workspace.st] >= workspace.n_from)
-            return;
-        if (workspace.ix_arr[workspace.end] < workspace.n_from)
-            return;
+        if (!workspace.tmat_sep.size())
+        {
+            if (workspace.ix_arr[workspace.st] >= workspace.n_from)
+                return;
+            if (workspace.ix_arr[workspace.end] < workspace.n_from)
+                return;
+        }
     }
 
     /* Note: the first separation step will not be added here, as it simply consists of adding +1
@@ -218,14 +541,21 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
        obtain the average separation depth. */
     if (trees[curr_tree].score >= 0.)
     {
+        if (workspace.row_node != NULL)
+        {
+            for (size_t row = workspace.st; row <= workspace.end; row++)
+                workspace.row_node[workspace.ix_arr[row]] = curr_tree;
+            return;
+        }
+
         long double rem = (long double) trees[curr_tree].remainder;
         if (!workspace.weights_arr.size())
         {
             rem += (long double)(workspace.end - workspace.st + 1);
             if (workspace.tmat_sep.size())
-                increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      prediction_data.nrows, workspace.tmat_sep.data(),
-                                      workspace.assume_full_distr? 3. : expected_separation_depth(rem));
+                increase_comb_counter_sorted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                             prediction_data.nrows, workspace.tmat_sep.data(), (double*)NULL,
+                                             workspace.assume_full_distr? 3. : expected_separation_depth(rem));
             else
                 increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
                                                 workspace.n_from, prediction_data.nrows, workspace.rmat.data(),
@@ -237,7 +567,7 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
             if (!workspace.assume_full_distr)
             {
                 rem += std::accumulate(workspace.ix_arr.begin() + workspace.st,
-                                       workspace.ix_arr.begin() + workspace.end,
+                                       workspace.ix_arr.begin() + workspace.end + 1,
                                        (long double) 0.,
                                        [&workspace](long double curr, size_t ix)
                                                       {return curr + (long double)workspace.weights_arr[ix];}
@@ -245,9 +575,9 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
             }
 
             if (workspace.tmat_sep.size())
-                increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      prediction_data.nrows, workspace.tmat_sep.data(),
-                                      workspace.weights_arr.data(),
+                increase_comb_counter_sorted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                             prediction_data.nrows, workspace.tmat_sep.data(),
+                                             workspace.weights_arr.data(),
                                       workspace.assume_full_distr? 3. : expected_separation_depth(rem));
             else
                 increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
@@ -258,16 +588,16 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
         return;
     }
 
-    else if (curr_tree > 0)
+    else if (curr_tree > 0 && workspace.row_node == NULL)
     {
         if (workspace.tmat_sep.size())
             if (!workspace.weights_arr.size())
-                increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      prediction_data.nrows, workspace.tmat_sep.data(), -1.);
+                increase_comb_counter_sorted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                             prediction_data.nrows, workspace.tmat_sep.data(), (double*)NULL, -1.);
             else
-                increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                      prediction_data.nrows, workspace.tmat_sep.data(),
-                                      workspace.weights_arr.data(), -1.);
+                increase_comb_counter_sorted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                             prediction_data.nrows, workspace.tmat_sep.data(),
+                                             workspace.weights_arr.data(), -1.);
         else
             if (!workspace.weights_arr.size())
                 increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end,
@@ -280,8 +610,8 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
 
 
     /* divide according to tree */
-    if (prediction_data.Xc_indptr != NULL && workspace.tmat_sep.size())
-        std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
+    if (prediction_data.Xc_indptr != NULL && (workspace.tmat_sep.size() || workspace.row_node != NULL))
+        ensure_sorted_ix(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.buffer_ix.data());
     size_t st_NA, end_NA, split_ix;
     switch(trees[curr_tree].col_type)
     {
@@ -296,7 +626,7 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
                 divide_subset_split(workspace.ix_arr.data(), workspace.st, workspace.end, trees[curr_tree].col_num,
                                     prediction_data.Xc, prediction_data.Xc_ind, prediction_data.Xc_indptr,
                                     trees[curr_tree].num_split, model_outputs.missing_action,
-                                    st_NA, end_NA, split_ix);
+                                    st_NA, end_NA, split_ix, workspace.buffer_ix.data());
 
             break;
         }
@@ -359,7 +689,7 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
             }
 
 
-            if (split_ix < orig_end)
+            if (split_ix <= orig_end)
             {
                 workspace.st  = split_ix;
                 workspace.end = orig_end;
@@ -374,8 +704,14 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
 
         case Divide: /* new_cat_action = 'Weighted' will also fall here */
         {
+            if (workspace.row_node != NULL && end_NA > st_NA)
+            {
+                workspace.rows_divided = true;
+                return;
+            }
+
             std::vector<double> weights_arr;
-            std::vector<size_t> ix_arr;
+            std::vector<ix_t> ix_arr;
             if (end_NA > workspace.st)
             {
                 weights_arr.assign(workspace.weights_arr.begin(),
@@ -396,7 +732,7 @@ void traverse_tree_sim(WorkerForSimilarity   &workspace,
                                   trees[curr_tree].tree_left);
             }
 
-            if (st_NA < orig_end)
+            if (st_NA <= orig_end)
             {
                 workspace.st = st_NA;
                 workspace.end = orig_end;
@@ -433,16 +769,21 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
                          std::vector<IsoHPlane>  &hplanes,
                          size_t                  curr_tree)
 {
-    if (workspace.st == workspace.end)
+    /* when recording nodes, rows are taken down to a terminal node even if they are alone */
+    if (workspace.st == workspace.end && workspace.row_node == NULL)
         return;
 
-    if (!workspace.tmat_sep.size())
+    /* sorted indices are required for adding separations by blocks */
+    if (workspace.row_node == NULL)
     {
         std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
-        if (workspace.ix_arr[workspace.st] >= workspace.n_from)
-            return;
-        if (workspace.ix_arr[workspace.end] < workspace.n_from)
-            return;
+        if (!workspace.tmat_sep.size())
+        {
+            if (workspace.ix_arr[workspace.st] >= workspace.n_from)
+                return;
+            if (workspace.ix_arr[workspace.end] < workspace.n_from)
+                return;
+        }
     }
 
     /* Note: the first separation step will not be added here, as it simply consists of adding +1
@@ -450,13 +791,20 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
        obtain the average separation depth. */
     if (hplanes[curr_tree].score >= 0)
     {
+        if (workspace.row_node != NULL)
+        {
+            for (size_t row = workspace.st; row <= workspace.end; row++)
+                workspace.row_node[workspace.ix_arr[row]] = curr_tree;
+            return;
+        }
+
         if (workspace.tmat_sep.size())
-            increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                  prediction_data.nrows, workspace.tmat_sep.data(),
-                                  workspace.assume_full_distr? 3. : 
-                                  expected_separation_depth((long double) hplanes[curr_tree].remainder
-                                                              + (long double)(workspace.end - workspace.st + 1))
-                                  );
+            increase_comb_counter_sorted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                         prediction_data.nrows, workspace.tmat_sep.data(), (double*)NULL,
+                                         workspace.assume_full_distr? 3. : 
+                                         expected_separation_depth((long double) hplanes[curr_tree].remainder
+                                                                     + (long double)(workspace.end - workspace.st + 1))
+                                         );
         else
             increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.n_from,
                                             prediction_data.nrows, workspace.rmat.data(),
@@ -467,18 +815,18 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
         return;
     }
 
-    else if (curr_tree > 0)
+    else if (curr_tree > 0 && workspace.row_node == NULL)
     {
         if (workspace.tmat_sep.size())
-            increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                  prediction_data.nrows, workspace.tmat_sep.data(), -1.);
+            increase_comb_counter_sorted(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                         prediction_data.nrows, workspace.tmat_sep.data(), (double*)NULL, -1.);
         else
             increase_comb_counter_in_groups(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.n_from,
                                             prediction_data.nrows, workspace.rmat.data(), -1.);
     }
 
-    if (prediction_data.Xc_indptr != NULL && workspace.tmat_sep.size())
-        std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
+    if (prediction_data.Xc_indptr != NULL && (workspace.tmat_sep.size() || workspace.row_node != NULL))
+        ensure_sorted_ix(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.buffer_ix.data());
 
     /* reconstruct linear combination */
     size_t ncols_numeric = 0;
@@ -557,7 +905,8 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
 
     /* divide data */
     size_t split_ix = divide_subset_split(workspace.ix_arr.data(), workspace.comb_val.data(),
-                                          workspace.st, workspace.end, hplanes[curr_tree].split_point);
+                                          workspace.st, workspace.end, hplanes[curr_tree].split_point,
+                                          (prediction_data.Xc_indptr != NULL)? workspace.buffer_ix.data() : NULL);
 
     /* continue splitting recursively */
     size_t orig_end = workspace.end;
@@ -571,7 +920,7 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
                             hplanes[curr_tree].hplane_left);
     }
 
-    if (split_ix < orig_end)
+    if (split_ix <= orig_end)
     {
         workspace.st  = split_ix;
         workspace.end = orig_end;
@@ -585,7 +934,6 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
 }
 
 void gather_sim_result(std::vector<WorkerForSimilarity> *worker_memory,
-                       std::vector<WorkerMemory> *worker_memory_m,
                        PredictionData *prediction_data, InputData *input_data,
                        IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                        double *restrict tmat, double *restrict rmat, size_t n_from,
@@ -596,40 +944,23 @@ void gather_sim_result(std::vector<WorkerForSimilarity> *worker_memory,
                     (prediction_data->nrows * (prediction_data->nrows - 1)) / 2
                         :
                     (input_data->nrows * (input_data->nrows - 1)) / 2;
-    size_t n_to  = (prediction_data != NULL)? (prediction_data->nrows - n_from) : 0;
 
     #ifdef _OPENMP
     if (nthreads > 1)
     {
-        if (worker_memory != NULL)
+        for (WorkerForSimilarity &w : *worker_memory)
         {
-            for (WorkerForSimilarity &w : *worker_memory)
+            if (w.tmat_sep.size())
             {
-                if (w.tmat_sep.size())
-                {
-                    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(ncomb, tmat, w, worker_memory)
-                    for (size_t_for ix = 0; ix < ncomb; ix++)
-                        tmat[ix] += w.tmat_sep[ix];
-                }
-                else if (w.rmat.size())
-                {
-                    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(rmat, w, worker_memory)
-                    for (size_t_for ix = 0; ix < w.rmat.size(); ix++)
-                        rmat[ix] += w.rmat[ix];
-                }
+                #pragma omp parallel for schedule(static) num_threads(nthreads) shared(ncomb, tmat, w, worker_memory)
+                for (size_t_for ix = 0; ix < ncomb; ix++)
+                    tmat[ix] += w.tmat_sep[ix];
             }
-        }
-
-        else
-        {
-            for (WorkerMemory &w : *worker_memory_m)
+            else if (w.rmat.size())
             {
-                if (w.tmat_sep.size())
-                {
-                    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(ncomb, tmat, w, worker_memory_m)
-                    for (size_t_for ix = 0; ix < ncomb; ix++)
-                        tmat[ix] += w.tmat_sep[ix];
-                }
+                #pragma omp parallel for schedule(static) num_threads(nthreads) shared(rmat, w, worker_memory)
+                for (size_t_for ix = 0; ix < w.rmat.size(); ix++)
+                    rmat[ix] += w.rmat[ix];
             }
         }
     }
@@ -637,54 +968,37 @@ void gather_sim_result(std::vector<WorkerForSimilarity> *worker_memory,
     else
     #endif
     {
-        if (worker_memory != NULL)
-        {
-            if ((*worker_memory)[0].tmat_sep.size())
-                std::copy((*worker_memory)[0].tmat_sep.begin(), (*worker_memory)[0].tmat_sep.end(), tmat);
-            else
-                std::copy((*worker_memory)[0].rmat.begin(), (*worker_memory)[0].rmat.end(), rmat);
-        }
-        
+        if ((*worker_memory)[0].tmat_sep.size())
+            std::copy((*worker_memory)[0].tmat_sep.begin(), (*worker_memory)[0].tmat_sep.end(), tmat);
         else
-        {
-            std::copy((*worker_memory_m)[0].tmat_sep.begin(), (*worker_memory_m)[0].tmat_sep.end(), tmat);
-        }
+            std::copy((*worker_memory)[0].rmat.begin(), (*worker_memory)[0].rmat.end(), rmat);
     }
 
+    transform_sim_result(prediction_data, input_data,
+                         model_outputs, model_outputs_ext,
+                         tmat, rmat, n_from,
+                         ntrees, assume_full_distr,
+                         standardize_dist, nthreads);
+}
+
+/* Convert summed separation depths into average separation depths or standardized distances */
+void transform_sim_result(PredictionData *prediction_data, InputData *input_data,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          double *restrict tmat, double *restrict rmat, size_t n_from,
+                          size_t ntrees, bool assume_full_distr,
+                          bool standardize_dist, int nthreads)
+{
+    size_t ncomb = (prediction_data != NULL)?
+                    (prediction_data->nrows * (prediction_data->nrows - 1)) / 2
+                        :
+                    (input_data->nrows * (input_data->nrows - 1)) / 2;
+    size_t n_to  = (prediction_data != NULL)? (prediction_data->nrows - n_from) : 0;
+
     double ntrees_dbl = (double) ntrees;
     if (standardize_dist)
     {
-        /* Note: the separation distances up this point are missing the first hop, which is always
-           a +1 to every combination. Thus, it needs to be added back for the average separation depth.
-           For the standardized metric, it takes the expected divisor as 2(=3-1) instead of 3, given
-           that every combination will always get a +1 at the beginning. Since what's obtained here
-           is a sum across all trees, adding this +1 means adding the number of trees. */
-        double div_trees = ntrees_dbl;
-        if (assume_full_distr)
-        {
-            div_trees *= 2;
-        }
-
-        else if (input_data != NULL)
-        {
-            div_trees *= (expected_separation_depth(input_data->nrows) - 1);
-        }
-
-        else
-        {
-            div_trees *= ((
-                               (model_outputs != NULL)?
-                                expected_separation_depth_hotstart(model_outputs->exp_avg_sep,
-                                                                    model_outputs->orig_sample_size,
-                                                                    model_outputs->orig_sample_size + prediction_data->nrows)
-                                    :
-                                expected_separation_depth_hotstart(model_outputs_ext->exp_avg_sep,
-                                                                    model_outputs_ext->orig_sample_size,
-                                                                    model_outputs_ext->orig_sample_size + prediction_data->nrows)
-                          ) - 1);
-        }
-
-        
+        double div_trees = calc_sim_divisor(prediction_data, input_data, model_outputs, model_outputs_ext,
+                                            ntrees, assume_full_distr, standardize_dist);
         if (tmat != NULL)
             #pragma omp parallel for schedule(static) num_threads(nthreads) shared(ncomb, tmat, ntrees_dbl, div_trees)
             for (size_t_for ix = 0; ix < ncomb; ix++)
@@ -708,6 +1022,47 @@ void gather_sim_result(std::vector<WorkerForSimilarity> *worker_memory,
     }
 }
 
+/* Divisor for the sum of separation depths across trees when calculating standardized distances,
+   or the number of trees when calculating average separation depths */
+double calc_sim_divisor(PredictionData *prediction_data, InputData *input_data,
+                        IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                        size_t ntrees, bool assume_full_distr, bool standardize_dist)
+{
+    double div_trees = (double) ntrees;
+    if (!standardize_dist)
+        return div_trees;
+
+    /* Note: the separation distances up this point are missing the first hop, which is always
+       a +1 to every combination. Thus, it needs to be added back for the average separation depth.
+       For the standardized metric, it takes the expected divisor as 2(=3-1) instead of 3, given
+       that every combination will always get a +1 at the beginning. Since what's obtained here
+       is a sum across all trees, adding this +1 means adding the number of trees. */
+    if (assume_full_distr)
+    {
+        div_trees *= 2;
+    }
+
+    else if (input_data != NULL)
+    {
+        div_trees *= (expected_separation_depth(input_data->nrows) - 1);
+    }
+
+    else
+    {
+        div_trees *= ((
+                           (model_outputs != NULL)?
+                            expected_separation_depth_hotstart(model_outputs->exp_avg_sep,
+                                                                model_outputs->orig_sample_size,
+                                                                model_outputs->orig_sample_size + prediction_data->nrows)
+                                :
+                            expected_separation_depth_hotstart(model_outputs_ext->exp_avg_sep,
+                                                                model_outputs_ext->orig_sample_size,
+                                                                model_outputs_ext->orig_sample_size + prediction_data->nrows)
+                      ) - 1);
+    }
+    return div_trees;
+}
+
 void initialize_worker_for_sim(WorkerForSimilarity  &workspace,
                                PredictionData       &prediction_data,
                                IsoForest            *model_outputs,
@@ -723,11 +1078,16 @@ void initialize_worker_for_sim(WorkerForSimilarity  &workspace,
     if (!workspace.ix_arr.size())
     {
         workspace.ix_arr.resize(prediction_data.nrows);
-        std::iota(workspace.ix_arr.begin(), workspace.ix_arr.end(), (size_t)0);
-        if (!n_from)
-          workspace.tmat_sep.resize((prediction_data.nrows * (prediction_data.nrows - 1)) / 2, 0);
-        else
-          workspace.rmat.resize(prediction_data.nrows * n_from, 0);
+        std::iota(workspace.ix_arr.begin(), workspace.ix_arr.end(), (ix_t)0);
+        if (workspace.row_node == NULL) /* tiled calculations write to the output directly */
+        {
+            if (!n_from)
+              workspace.tmat_sep.resize((prediction_data.nrows * (prediction_data.nrows - 1)) / 2, 0);
+            else
+              workspace.rmat.resize((prediction_data.nrows - n_from) * n_from, 0);
+        }
+        if (prediction_data.Xc_indptr != NULL)
+            workspace.buffer_ix.resize(prediction_data.nrows);
     }
 
     if (model_outputs != NULL && (model_outputs->missing_action == Divide || model_outputs->new_cat_action == Weighted))
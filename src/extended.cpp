@@ -54,15 +54,12 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
     long double sum_weight = -HUGE_VAL;
     size_t hplane_from = hplanes.size() - 1;
     std::unique_ptr<RecursionState> recursion_state;
-    std::vector<bool> col_is_taken;
-    std::unordered_set<size_t> col_is_taken_s;
 
     /* calculate imputation statistics if desired */
     if (impute_nodes != NULL)
     {
         if (input_data.Xc_indptr != NULL)
-            std::sort(workspace.ix_arr.begin() + workspace.st,
-                      workspace.ix_arr.begin() + workspace.end + 1);
+            ensure_sorted_ix(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.buffer_ix.data());
         build_impute_node(impute_nodes->back(), workspace,
                           input_data, model_params,
                           *impute_nodes, curr_depth,
@@ -86,7 +83,7 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
 
     /* for sparse matrices, need to sort the indices */
     if (input_data.Xc_indptr != NULL && impute_nodes == NULL)
-        std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
+        ensure_sorted_ix(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.buffer_ix.data());
 
     /* pick column to split according to criteria */
     workspace.prob_split_type = workspace.rbin(workspace.rnd_generator);
@@ -117,15 +114,7 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
 
     for (size_t attempt = 0; attempt < workspace.ntry; attempt++)
     {
-        if (input_data.ncols_tot < 1e3)
-        {
-            if (!col_is_taken.size())
-                col_is_taken.resize(input_data.ncols_tot, false);
-            else
-                col_is_taken.assign(input_data.ncols_tot, false);
-        }
-        else
-            col_is_taken_s.clear();
+        clear_cols_taken(workspace);
         workspace.ntaken = 0;
         workspace.ncols_tried = 0;
         std::fill(workspace.comb_val.begin(),
@@ -133,23 +122,17 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
                   (double)0);
 
         workspace.tried_all = false;
-        if (model_params.ndim < input_data.ncols_tot / 2 || workspace.col_sampler.max())
+        if (model_params.ndim < input_data.ncols_tot / 2 || workspace.col_sampler.tree_weights.size())
         {
             while(workspace.ncols_tried < std::max(input_data.ncols_tot / 2, model_params.ndim))
             {
+                if (!workspace.col_sampler.n_active) break;
                 workspace.ncols_tried++;
                 decide_column(input_data.ncols_numeric, input_data.ncols_categ,
                               workspace.col_chosen, workspace.col_type,
-                              workspace.rnd_generator, workspace.runif,
-                              workspace.col_sampler);
+                              workspace.rnd_generator, workspace.col_sampler);
 
-                if (
-                        (workspace.col_type == Numeric && !workspace.cols_possible[workspace.col_chosen])
-                            ||
-                        (workspace.col_type == Categorical && !workspace.cols_possible[workspace.col_chosen + input_data.ncols_numeric])
-                            ||
-                        is_col_taken(col_is_taken, col_is_taken_s, input_data, workspace.col_chosen, workspace.col_type)
-                    )
+                if (is_col_taken(workspace, input_data, workspace.col_chosen, workspace.col_type))
                     continue;
 
 
@@ -161,7 +144,7 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
 
                 else
                 {
-                    add_chosen_column(workspace, input_data, model_params, col_is_taken, col_is_taken_s);
+                    add_chosen_column(workspace, input_data, model_params);
                     if (++workspace.ntaken >= model_params.ndim)
                         break;
                 }
@@ -169,89 +152,37 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
             }
 
             if (workspace.ntaken < model_params.ndim)
-            {
-                update_col_sampler(workspace, input_data);
                 goto probe_all;
-            }
         }
 
         else /* probe all columns */
         {
             probe_all:
                 workspace.tried_all = true;
-                std::iota(workspace.cols_shuffled.begin(), workspace.cols_shuffled.end(), (size_t)0);
-                if (model_params.ndim < input_data.ncols_tot)
+                size_t n_active;
+                if (model_params.ndim < workspace.col_sampler.n_active)
                 {
+                    n_active = shuffle_active_cols(workspace.col_sampler, workspace.cols_shuffled.data(),
+                                                   workspace.rnd_generator);
+                }
 
-                    if (!workspace.col_sampler.max())
-                    {
-                        std::shuffle(workspace.cols_shuffled.begin(),
-                                     workspace.cols_shuffled.end(),
-                                     workspace.rnd_generator);
-                    }
-
-                    else
-                    {
-                        if (!model_params.weigh_by_kurt)
-                        {
-                            weighted_shuffle(workspace.cols_shuffled.data(), input_data.ncols_tot, input_data.col_weights,
-                                             workspace.buffer_dbl.data(), workspace.rnd_generator);
-                        }
-
-                        else
-                        {
-                            std::vector<double> col_weights = workspace.col_sampler.probabilities();
-                            /* sampler will fail if passed weights of zero, so need to discard those first and then remap */
-                            std::iota(workspace.buffer_szt.begin(), workspace.buffer_szt.begin() + input_data.ncols_tot, (size_t)0);
-                            long st = input_data.ncols_tot - 1;
-                            for (long col = st; col >= 0; col--)
-                            {
-                                if (col_weights[col] <= 0)
-                                {
-                                    std::swap(col_weights[st], col_weights[col]);
-                                    std::swap(workspace.buffer_szt[st], workspace.buffer_szt[col]);
-                                    st--;
-                                }
-                            }
-
-                            if ((size_t)st == input_data.ncols_tot - 1)
-                            {
-                                weighted_shuffle(workspace.cols_shuffled.data(), input_data.ncols_tot, col_weights.data(),
-                                                 workspace.buffer_dbl.data(), workspace.rnd_generator);
-                            }
-
-                            else if (st < 0)
-                            {
-                                goto terminal_statistics;
-                            }
-
-                            else if (st == 0)
-                            {
-                                std::copy(workspace.buffer_szt.begin(),
-                                          workspace.buffer_szt.begin() + input_data.ncols_tot,
-                                          workspace.cols_shuffled.begin());
-                            }
-
-                            else
-                            {
-                                weighted_shuffle(workspace.buffer_szt.data(), (size_t) ++st, col_weights.data(),
-                                                 workspace.buffer_dbl.data(), workspace.rnd_generator);
-                                std::copy(workspace.buffer_szt.begin(),
-                                          workspace.buffer_szt.begin() + input_data.ncols_tot,
-                                          workspace.cols_shuffled.begin());
-                            }
-                        }
-                    }
+                else
+                {
+                    n_active = workspace.col_sampler.n_active;
+                    std::copy(workspace.col_sampler.col_indices.begin(),
+                              workspace.col_sampler.col_indices.begin() + n_active,
+                              workspace.cols_shuffled.begin());
                 }
 
-                for (size_t col : workspace.cols_shuffled)
+                for (size_t ix = 0; ix < n_active; ix++)
                 {
+                    size_t col = workspace.cols_shuffled[ix];
                     if (
-                        !workspace.cols_possible[col]
+                        !is_col_available(workspace.col_sampler, col)
                             ||
                         (workspace.ntaken
                             &&
-                         is_col_taken(col_is_taken, col_is_taken_s, input_data,
+                         is_col_taken(workspace, input_data,
                                        (col < input_data.ncols_numeric)? col : col - input_data.ncols_numeric,
                                        (col < input_data.ncols_numeric)? Numeric : Categorical)
                          )
@@ -278,21 +209,18 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
 
                     else
                     {
-                        add_chosen_column(workspace, input_data, model_params, col_is_taken, col_is_taken_s);
+                        add_chosen_column(workspace, input_data, model_params);
                         if (++workspace.ntaken >= model_params.ndim)
                             break;
                     }
                 }
-
-                if (model_params.weigh_by_kurt)
-                    update_col_sampler(workspace, input_data);
         }
     
         /* evaluate gain if necessary */
         if (workspace.criterion != NoCrit)
             workspace.this_gain = eval_guided_crit(workspace.comb_val.data(), workspace.end - workspace.st + 1,
                                                    workspace.criterion, model_params.min_gain, workspace.this_split_point,
-                                                   workspace.xmin, workspace.xmax);
+                                                   workspace.xmin, workspace.xmax, workspace.buffer_dbl.data());
         
         /* pass to the output object */
         if (workspace.ntry == 1 || workspace.this_gain > hplanes.back().score)
@@ -435,9 +363,10 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
         }
     }
 
-    /* divide */
+    /* divide (for sparse inputs, keeping the indices sorted) */
     workspace.split_ix = divide_subset_split(workspace.ix_arr.data(), workspace.comb_val.data(),
-                                             workspace.st, workspace.end, hplanes.back().split_point);
+                                             workspace.st, workspace.end, hplanes.back().split_point,
+                                             (input_data.Xc_indptr != NULL)? workspace.buffer_ix.data() : NULL);
 
     /* set as non-terminal */
     hplanes.back().score = -1;
@@ -525,10 +454,9 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
 }
 
 
-void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params,
-                       std::vector<bool> &col_is_taken, std::unordered_set<size_t> &col_is_taken_s)
+void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params)
 {
-    set_col_as_taken(col_is_taken, col_is_taken_s, input_data, workspace.col_chosen, workspace.col_type);
+    set_col_as_taken(workspace, input_data, workspace.col_chosen, workspace.col_type);
     workspace.col_take[workspace.ntaken]      = workspace.col_chosen;
     workspace.col_take_type[workspace.ntaken] = workspace.col_type;
 
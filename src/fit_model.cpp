@@ -154,6 +154,8 @@ bool interrupt_switch;
 *       entry 0 <= i < j < n will be located at position
 *           p(i,j) = (i * (n - (i+1)/2) + j - i - 1).
 *       Can be converted to a dense square matrix through function 'tmat_to_dense'.
+*       All the threads add their separation depths to this same array while fitting, so no additional
+*       memory of this size is allocated per thread.
 * - output_depths[nrows]
 *       Array in which to calculate average path depths or standardized outlierness metric (see documentation
 *       for 'standardize_depth') as the model is being fit. Pass NULL to avoid doing these calculations alongside
@@ -174,6 +176,12 @@ bool interrupt_switch;
 *       sample, so if not using sub-samples, it's better to pass column weights calculated externally. For
 *       categorical columns, will calculate expected kurtosis if the column was converted to numerical by
 *       assigning to each category a random number ~ Unif(0, 1).
+* - kurt_sample_size
+*       When passing 'weigh_by_kurt=true', number of rows in a random sample (taken once for the whole model)
+*       in which to calculate the kurtosis of each column, in which case the same column weights will be used
+*       for all the trees instead of calculating them in the sub-sample of each tree. This is much faster when
+*       there are many columns. If it's larger than 'nrows', will use all the rows. Pass zero to calculate the
+*       kurtosis in the sub-sample of each tree. Ignored when passing 'weigh_by_kurt=false'.
 * - prob_pick_by_gain_avg
 *       Probability of making each split in the single-variable model by choosing a column and split point in that
 *       same column as both the column and split point that gives the largest averaged gain (as proposed in [4]) across
@@ -287,6 +295,13 @@ bool interrupt_switch;
 *       'categ_data', and 'Xc', will get overwritten with the imputations produced.
 * - random_seed
 *       Seed that will be used to generate random numbers used by the model.
+* - rng_type
+*       Family of random number generators to use. Options are a) "MersenneTwister" (the generator
+*       used in previous versions - note however that results for a given seed will not match with
+*       those versions, as the sampling procedures have changed), b) "Xoshiro", which uses the
+*       xoshiro256++ generator - this is faster and has a much smaller state, but will produce
+*       different results for the same seed. Each tree gets its own stream
+*       derived from 'random_seed', so results do not depend on the number of threads.
 * - nthreads
 *       Number of parallel threads to use. Note that, the more threads, the more memory will be
 *       allocated, even if the thread does not end up being used. Ignored when not building with
@@ -330,35 +345,198 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 bool   limit_depth, bool penalize_range,
                 bool   standardize_dist, double tmat[],
                 double output_depths[], bool standardize_depth,
-                double col_weights[], bool weigh_by_kurt,
+                double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
                 double min_gain, MissingAction missing_action,
                 CategSplit cat_split_type, NewCategAction new_cat_action,
                 bool   all_perm, Imputer *imputer, size_t min_imp_obs,
                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
-                uint64_t random_seed, int nthreads)
+                uint64_t random_seed, RNGType rng_type, int nthreads)
+{
+    TrainingSession session;
+    initialize_training_session(session,
+                                numeric_data, ncols_numeric,
+                                categ_data, ncols_categ, ncat,
+                                Xc, Xc_ind, Xc_indptr,
+                                sample_weights, nrows, nthreads);
+    return fit_iforest(&session, model_outputs, model_outputs_ext,
+                       ndim, ntry, coef_type, coef_by_prop,
+                       with_replacement, weight_as_sample,
+                       sample_size, ntrees, max_depth,
+                       limit_depth, penalize_range,
+                       standardize_dist, tmat,
+                       output_depths, standardize_depth,
+                       col_weights, weigh_by_kurt, kurt_sample_size,
+                       prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                       prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                       min_gain, missing_action,
+                       cat_split_type, new_cat_action,
+                       all_perm, imputer, min_imp_obs,
+                       depth_imp, weigh_imp_rows, impute_at_fit,
+                       random_seed, rng_type, nthreads);
+}
+
+/* Prepare data for fitting several models to it
+* 
+* Fitting a model requires some preprocessing of the data (such as determining which columns
+* are constant or have missing values, or building structures for sampling rows by weight),
+* plus memory for each thread, which gets allocated as the trees are built. When fitting many
+* models to the same data (e.g. with different hyperparameters or seeds), this object allows
+* doing all that only once, by passing it to the overloads of 'fit_iforest', 'add_tree' and
+* 'add_trees' that take a 'TrainingSession' instead of the data.
+* 
+* The session does not make a copy of the data - the arrays that are passed here must remain
+* valid and unmodified for as long as the session is used. Note that the object is not thread-safe,
+* so the same session cannot be used for fitting two models at the same time.
+* 
+* Parameters
+* ==========
+* - numeric_data, ncols_numeric, categ_data, ncols_categ, ncat, Xc, Xc_ind, Xc_indptr, sample_weights, nrows
+*       Same parameters as for 'fit_iforest' (see the documentation in there for details).
+* - nthreads
+*       Number of parallel threads to use when preprocessing the data.
+* 
+* Returns
+* =======
+* Pointer to a newly-allocated session object, which must be freed through 'delete_training_session'.
+*/
+TrainingSession* create_training_session(double numeric_data[],  size_t ncols_numeric,
+                                         int    categ_data[],    size_t ncols_categ,    int ncat[],
+                                         double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                                         double sample_weights[], size_t nrows, int nthreads)
+{
+    std::unique_ptr<TrainingSession> session = std::unique_ptr<TrainingSession>(new TrainingSession);
+    initialize_training_session(*session,
+                                numeric_data, ncols_numeric,
+                                categ_data, ncols_categ, ncat,
+                                Xc, Xc_ind, Xc_indptr,
+                                sample_weights, nrows, nthreads);
+    return session.release();
+}
+
+void delete_training_session(TrainingSession *session)
+{
+    delete session;
+}
+
+void initialize_training_session(TrainingSession &session,
+                                 double numeric_data[],  size_t ncols_numeric,
+                                 int    categ_data[],    size_t ncols_categ,    int ncat[],
+                                 double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                                 double sample_weights[], size_t nrows, int nthreads)
 {
     /* calculate maximum number of categories to use later */
     int max_categ = 0;
     for (size_t col = 0; col < ncols_categ; col++)
         max_categ = (ncat[col] > max_categ)? ncat[col] : max_categ;
 
+    /* put data in structs to shorten function calls */
+    session.input_data = {numeric_data, ncols_numeric, categ_data, ncat, max_categ, ncols_categ,
+                          nrows, ncols_numeric + ncols_categ, sample_weights,
+                          false, NULL,
+                          Xc, Xc_ind, Xc_indptr,
+                          0, 0, std::vector<double>(),
+                          std::vector<double>(), std::vector<size_t>(),
+                          std::vector<char>(), 0,
+                          std::vector<char>(), std::vector<char>()};
+
+    /* determine which columns have missing values and which ones are constant */
+    profile_columns(session.input_data, nthreads);
+
+    session.worker_memory.clear();
+    session.kurt_weights.clear();
+}
+
+/* Clears everything that depends on the parameters of a fit, keeping the allocated memory.
+   The coefficients for categorical columns in the extended model only depend on the data. */
+void reset_worker_memory(WorkerMemory &workspace)
+{
+    workspace.ix_arr.clear();
+    workspace.ix_all.clear();
+    workspace.weights_map.clear();
+    workspace.weights_arr.clear();
+    workspace.is_repeated.clear();
+    workspace.categs.clear();
+    workspace.btree_weights.clear();
+    workspace.col_sampler.col_indices.clear();
+    workspace.col_sampler.col_pos.clear();
+    workspace.col_sampler.dropped.clear();
+    workspace.col_sampler.col_weights.clear();
+    workspace.col_sampler.tree_weights.clear();
+
+    workspace.buffer_dbl.clear();
+    workspace.buffer_szt.clear();
+    workspace.buffer_chr.clear();
+    workspace.buffer_ix.clear();
+    workspace.this_split_categ.clear();
+    workspace.col_workers.clear();
+    workspace.cols_eval.clear();
+    workspace.cols_eval_gain.clear();
+
+    workspace.cols_shuffled.clear();
+    workspace.col_taken_gen.clear();
+    workspace.comb_val.clear();
+    workspace.col_take.clear();
+    workspace.col_take_type.clear();
+    workspace.ext_offset.clear();
+    workspace.ext_coef.clear();
+    workspace.ext_mean.clear();
+    workspace.ext_fill_val.clear();
+    workspace.ext_fill_new.clear();
+    workspace.chosen_cat.clear();
+
+    workspace.tmat_stripes = NULL;
+    workspace.tmat_ix.clear();
+    workspace.row_depths.clear();
+    workspace.impute_stripes = NULL;
+}
+
+/* Fit Isolation Forest model to data from a training session
+* 
+* Same as the 'fit_iforest' that takes the data, but the data, the structures for sampling rows
+* by weight, the column weights by kurtosis (when using a shared sample and the same seed), and the
+* memory for each thread are taken from a 'TrainingSession' object (see 'create_training_session'),
+* which keeps them for later calls. The resulting model is the same as from the 'fit_iforest' that
+* takes the data, when passing the same data and parameters.
+* 
+* Parameters are the same as for the 'fit_iforest' that takes the data (see the documentation in there
+* for details), except that the data and the sample weights are the ones from the session. Note that, if passing
+* 'impute_at_fit=true', the data that was passed to 'create_training_session' will get modified, and the
+* session will update its preprocessed data accordingly, so later fits from the same session will use
+* the imputed data. The Python and R interfaces do not request it when fitting from a session.
+*/
+int fit_iforest(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                bool   with_replacement, bool weight_as_sample,
+                size_t sample_size, size_t ntrees, size_t max_depth,
+                bool   limit_depth, bool penalize_range,
+                bool   standardize_dist, double tmat[],
+                double output_depths[], bool standardize_depth,
+                double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
+                double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                double min_gain, MissingAction missing_action,
+                CategSplit cat_split_type, NewCategAction new_cat_action,
+                bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+                UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
+                uint64_t random_seed, RNGType rng_type, int nthreads)
+{
+    InputData &input_data = session->input_data;
     bool calc_dist = tmat != NULL;
 
     if (calc_dist || sample_size == 0)
-        sample_size = nrows;
+        sample_size = input_data.nrows;
+
+    /* the data is prepared only once per session, but these can change from one fit to another */
+    input_data.weight_as_sample = weight_as_sample;
+    input_data.col_weights = col_weights;
+    input_data.has_missing.clear();
+    input_data.n_missing = 0;
 
-    /* put data in structs to shorten function calls */
-    InputData input_data     = {numeric_data, ncols_numeric, categ_data, ncat, max_categ, ncols_categ,
-                                nrows, ncols_numeric + ncols_categ, sample_weights,
-                                weight_as_sample, col_weights,
-                                Xc, Xc_ind, Xc_indptr,
-                                0, 0, std::vector<double>(),
-                                std::vector<char>(), 0};
     ModelParams model_params = {with_replacement, sample_size, ntrees,
                                 limit_depth? log2ceil(sample_size) : max_depth? max_depth : (sample_size - 1),
-                                penalize_range, random_seed, weigh_by_kurt,
+                                penalize_range, random_seed, rng_type, weigh_by_kurt,
                                 prob_pick_by_gain_avg, (model_outputs == NULL)? 0 : prob_split_by_gain_avg,
                                 prob_pick_by_gain_pl,  (model_outputs == NULL)? 0 : prob_split_by_gain_pl,
                                 min_gain, cat_split_type, new_cat_action, missing_action, all_perm,
@@ -366,11 +544,61 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                                 coef_type, coef_by_prop, calc_dist, (bool)(output_depths != NULL), impute_at_fit,
                                 depth_imp, weigh_imp_rows, min_imp_obs};
 
-    /* if using weights as sampling probability, build a binary tree for faster sampling */
+    /* if using weights as sampling probability, build a binary tree for faster sampling,
+       or an alias table if sampling with replacement - these are shared across all trees,
+       and are kept in the session for later fits */
     if (input_data.weight_as_sample && input_data.sample_weights != NULL)
     {
-        build_btree_sampler(input_data.btree_weights_init, input_data.sample_weights,
-                            input_data.nrows, input_data.log2_n, input_data.btree_offset);
+        if (model_params.with_replacement && !input_data.alias_prob.size())
+            build_alias_sampler(input_data.alias_prob, input_data.alias_ix,
+                                input_data.sample_weights, input_data.nrows);
+        else if (!model_params.with_replacement && !input_data.btree_weights_init.size())
+            build_btree_sampler(input_data.btree_weights_init, input_data.sample_weights,
+                                input_data.nrows, input_data.log2_n, input_data.btree_offset);
+    }
+
+    /* if weighing columns by kurtosis in a shared sample, calculate the weights only once here
+       and then use them as column weights for all the trees - these depend on the seed and on
+       how the columns are handled, so they can only be reused if those don't change */
+    std::vector<double> &kurt_weights = session->kurt_weights;
+    if (model_params.weigh_by_kurt && kurt_sample_size &&
+        !(
+            kurt_weights.size() &&
+            session->kurt_sample_size    == kurt_sample_size &&
+            session->kurt_seed           == model_params.random_seed &&
+            session->kurt_rng_type       == model_params.rng_type &&
+            session->kurt_missing_action == model_params.missing_action &&
+            session->kurt_cat_split_type == model_params.cat_split_type
+        ))
+    {
+        RNG_engine rnd_generator;
+        rnd_generator.seed(~model_params.random_seed, model_params.rng_type);
+        std::vector<ix_t> ix_arr(std::min(kurt_sample_size, input_data.nrows));
+        std::vector<ix_t> ix_all;
+        std::vector<double> btree_weights, alias_prob;
+        std::vector<size_t> alias_ix;
+        std::vector<bool>   is_repeated;
+        sample_random_rows(ix_arr, input_data.nrows, false, rnd_generator, ix_all,
+                           NULL, btree_weights, 0, 0, is_repeated, alias_prob, alias_ix);
+
+        std::vector<double> buffer_dbl(std::max(ix_arr.size(), (size_t)input_data.max_categ + 1));
+        std::vector<size_t> buffer_szt(2 * input_data.max_categ);
+        kurt_weights.resize(input_data.ncols_tot);
+        calc_kurtosis_weights(kurt_weights.data(), ix_arr.data(), 0, ix_arr.size() - 1,
+                              input_data, model_params,
+                              buffer_dbl.data(), buffer_szt.data(), rnd_generator);
+
+        session->kurt_sample_size    = kurt_sample_size;
+        session->kurt_seed           = model_params.random_seed;
+        session->kurt_rng_type       = model_params.rng_type;
+        session->kurt_missing_action = model_params.missing_action;
+        session->kurt_cat_split_type = model_params.cat_split_type;
+    }
+
+    if (model_params.weigh_by_kurt && kurt_sample_size)
+    {
+        input_data.col_weights = kurt_weights.data();
+        model_params.weigh_by_kurt = false;
     }
 
     /* if imputing missing values on-the-fly, need to determine which are missing */
@@ -407,14 +635,60 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
     if (imputer != NULL)
         initialize_imputer(*imputer, input_data, ntrees, nthreads);
 
-    /* initialize thread-private memory */
+    /* initialize thread-private memory - if there are more threads than trees and the
+       columns are chosen by gain, the remaining threads are used for evaluating columns */
+    int nthreads_cols = 1;
     if ((size_t)nthreads > ntrees)
+    {
+        if (model_outputs != NULL && (prob_pick_by_gain_avg > 0 || prob_pick_by_gain_pl > 0))
+            nthreads_cols = nthreads / (int)ntrees;
         nthreads = (int)ntrees;
+    }
+    std::vector<WorkerMemory> &worker_memory = session->worker_memory;
     #ifdef _OPENMP
-        std::vector<WorkerMemory> worker_memory(nthreads);
+        worker_memory.resize(nthreads);
+        #if (_OPENMP < 200801) || defined(_WIN32) || defined(_WIN64) /* OpenMP < 3.0 */
+        if (nthreads > 1) nthreads_cols = 1;
+        #else
+        int prev_max_active_levels = omp_get_max_active_levels();
+        if (nthreads > 1 && nthreads_cols > 1)
+            omp_set_max_active_levels(std::max(prev_max_active_levels, 2));
+        #endif
     #else
-        std::vector<WorkerMemory> worker_memory(1);
+        worker_memory.resize(1);
+        nthreads_cols = 1;
     #endif
+    for (WorkerMemory &w : worker_memory)
+    {
+        reset_worker_memory(w);
+        w.nthreads_cols = nthreads_cols;
+    }
+
+    /* if calculating similarity/distance, all threads add to the output matrix, locking the
+       stripes of rows that they write to, so the memory usage doesn't grow with the threads */
+    TmatStripes tmat_stripes;
+    if (calc_dist)
+    {
+        size_t n_stripes = (nthreads > 1)? std::min(input_data.nrows, (size_t)64 * (size_t)nthreads) : 1;
+        tmat_stripes.tmat = tmat;
+        tmat_stripes.rows_per_stripe = (input_data.nrows + n_stripes - 1) / n_stripes;
+        tmat_stripes.locks = std::vector<std::mutex>(n_stripes);
+        std::fill(tmat, tmat + (input_data.nrows * (input_data.nrows - 1)) / 2, 0.);
+        for (WorkerMemory &w : worker_memory)
+            w.tmat_stripes = &tmat_stripes;
+    }
+
+    /* same for imputations of missing values, locking the rows that get added to */
+    ImputeStripes impute_stripes;
+    if (model_params.impute_at_fit)
+    {
+        impute_stripes.impute_vec = &impute_vec;
+        impute_stripes.impute_map = &impute_map;
+        if (nthreads > 1)
+            impute_stripes.locks = std::vector<std::mutex>(std::min(input_data.nrows, (size_t)64 * (size_t)nthreads));
+        for (WorkerMemory &w : worker_memory)
+            w.impute_stripes = &impute_stripes;
+    }
 
     /* Global variable that determines if the procedure receives a stop signal */
     interrupt_switch = false;
@@ -434,28 +708,6 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
         if (interrupt_switch)
             continue; /* Cannot break with OpenMP==2.0 (MSVC) */
 
-        if (
-            model_params.impute_at_fit &&
-            input_data.n_missing &&
-            !worker_memory[omp_get_thread_num()].impute_vec.size() &&
-            !worker_memory[omp_get_thread_num()].impute_map.size()
-            )
-        {
-            #ifdef _OPENMP
-            if (nthreads > 1)
-            {
-                worker_memory[omp_get_thread_num()].impute_vec = impute_vec;
-                worker_memory[omp_get_thread_num()].impute_map = impute_map;
-            }
-
-            else
-            #endif
-            {
-                worker_memory[0].impute_vec = std::move(impute_vec);
-                worker_memory[0].impute_map = std::move(impute_map);
-            }
-        }
-
         fit_itree((model_outputs != NULL)? &model_outputs->trees[tree] : NULL,
                   (model_outputs_ext != NULL)? &model_outputs_ext->hplanes[tree] : NULL,
                   worker_memory[omp_get_thread_num()],
@@ -476,6 +728,16 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
         #endif
     }
 
+    #if defined(_OPENMP) && !((_OPENMP < 200801) || defined(_WIN32) || defined(_WIN64))
+    omp_set_max_active_levels(prev_max_active_levels);
+    #endif
+
+    for (WorkerMemory &w : worker_memory)
+    {
+        w.tmat_stripes = NULL;
+        w.impute_stripes = NULL;
+    }
+
     /* check if the procedure got interrupted */
     if (interrupt_switch) return EXIT_FAILURE;
     interrupt_switch = false;
@@ -485,14 +747,13 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
     else
         model_outputs_ext->hplanes.shrink_to_fit();
 
-    /* if calculating similarity/distance, now need to reduce and average */
+    /* if calculating similarity/distance, now need to average */
     if (calc_dist)
-        gather_sim_result(NULL, &worker_memory,
-                          NULL, &input_data,
-                          model_outputs, model_outputs_ext,
-                          tmat, NULL, 0,
-                          model_params.ntrees, false,
-                          standardize_dist, nthreads);
+        transform_sim_result(NULL, &input_data,
+                             model_outputs, model_outputs_ext,
+                             tmat, NULL, 0,
+                             model_params.ntrees, false,
+                             standardize_dist, nthreads);
 
     /* same for depths */
     if (output_depths != NULL)
@@ -520,36 +781,28 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
         {
             double depth_divisor = (double)ntrees * ((model_outputs != NULL)?
                                                      model_outputs->exp_avg_depth : model_outputs_ext->exp_avg_depth);
-            for (size_t_for row = 0; row < nrows; row++)
+            for (size_t_for row = 0; row < input_data.nrows; row++)
                 output_depths[row] = exp2( - output_depths[row] / depth_divisor );
         }
 
         else
         {
             double ntrees_dbl = (double) ntrees;
-            for (size_t_for row = 0; row < nrows; row++)
+            for (size_t_for row = 0; row < input_data.nrows; row++)
                 output_depths[row] /= ntrees_dbl;
         }
     }
 
-    /* if imputing missing values, now need to reduce and write final values */
+    /* if imputing missing values, now need to write final values */
     if (model_params.impute_at_fit)
     {
-        #ifdef _OPENMP
-        if (nthreads > 1)
-        {
-            for (WorkerMemory &w : worker_memory)
-                combine_tree_imputations(w, impute_vec, impute_map, input_data.has_missing, nthreads);
-        }
-
-        else
-        #endif
-        {
-            impute_vec = std::move(worker_memory[0].impute_vec);
-            impute_map = std::move(worker_memory[0].impute_map);
-        }
-
         apply_imputation_results(impute_vec, impute_map, *imputer, input_data, nthreads);
+
+        /* the data got modified, so whatever was determined from it needs to be redone */
+        kurt_weights.clear();
+        profile_columns(input_data, nthreads);
+        input_data.has_missing.clear();
+        input_data.n_missing = 0;
     }
 
     return EXIT_SUCCESS;
@@ -688,6 +941,9 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
 *       what was originally passed to 'fit_iforest'.
 * - random_seed
 *       Seed that will be used to generate random numbers used by the model.
+* - rng_type
+*       Same parameter as for 'fit_iforest' (see the documentation in there for details). Can be changed from
+*       what was originally passed to 'fit_iforest'.
 */
 int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              double numeric_data[],  size_t ncols_numeric,
@@ -703,28 +959,69 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              CategSplit cat_split_type, NewCategAction new_cat_action,
              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
              bool   all_perm, std::vector<ImputeNode> *impute_nodes, size_t min_imp_obs,
-             uint64_t random_seed)
+             uint64_t random_seed, RNGType rng_type)
 {
-    int max_categ = 0;
-    for (size_t col = 0; col < ncols_categ; col++)
-        max_categ = (ncat[col] > max_categ)? ncat[col] : max_categ;
-
-    InputData input_data     = {numeric_data, ncols_numeric, categ_data, ncat, max_categ, ncols_categ,
-                                nrows, ncols_numeric + ncols_categ, sample_weights,
-                                false, col_weights,
+    /* the data is prepared in the same way as for 'fit_iforest' and 'add_trees' (e.g. constant columns
+       are never picked for a split), so that the resulting tree is the same regardless of the function */
+    TrainingSession session;
+    initialize_training_session(session,
+                                numeric_data, ncols_numeric,
+                                categ_data, ncols_categ, ncat,
                                 Xc, Xc_ind, Xc_indptr,
-                                0, 0, std::vector<double>(),
-                                std::vector<char>(), 0};
+                                sample_weights, nrows, 1);
+    return add_tree(&session, model_outputs, model_outputs_ext,
+                    ndim, ntry, coef_type, coef_by_prop,
+                    max_depth, limit_depth, penalize_range,
+                    col_weights, weigh_by_kurt,
+                    prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                    prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                    min_gain, missing_action,
+                    cat_split_type, new_cat_action,
+                    depth_imp, weigh_imp_rows,
+                    all_perm, impute_nodes, min_imp_obs,
+                    random_seed, rng_type);
+}
+
+/* Add additional trees to already-fitted isolation forest model, using the data from a training session
+* 
+* Same as the 'add_tree' that takes the data, but the data and the memory for building the tree are taken
+* from a 'TrainingSession' object (see 'create_training_session'). The session must have been created with
+* the same data that is to be used for this tree. Parameters are the same as for the 'add_tree' that
+* takes the data (see the documentation in there for details).
+*/
+int add_tree(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+             size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+             size_t max_depth, bool limit_depth, bool penalize_range,
+             double col_weights[], bool weigh_by_kurt,
+             double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+             double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+             double min_gain, MissingAction missing_action,
+             CategSplit cat_split_type, NewCategAction new_cat_action,
+             UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+             bool   all_perm, std::vector<ImputeNode> *impute_nodes, size_t min_imp_obs,
+             uint64_t random_seed, RNGType rng_type)
+{
+    InputData &input_data = session->input_data;
+    input_data.weight_as_sample = false;
+    input_data.col_weights = col_weights;
+    input_data.has_missing.clear();
+    input_data.n_missing = 0;
+
+    size_t nrows = input_data.nrows;
     ModelParams model_params = {false, nrows, (size_t)1,
                                 max_depth? max_depth : (nrows - 1),
-                                penalize_range, random_seed, weigh_by_kurt,
+                                penalize_range, random_seed, rng_type, weigh_by_kurt,
                                 prob_pick_by_gain_avg, (model_outputs == NULL)? 0 : prob_split_by_gain_avg,
                                 prob_pick_by_gain_pl,  (model_outputs == NULL)? 0 : prob_split_by_gain_pl,
                                 min_gain, cat_split_type, new_cat_action, missing_action, all_perm,
                                 (model_outputs != NULL)? 0 : ndim, (model_outputs != NULL)? 0 : ntry,
                                 coef_type, coef_by_prop, false, false, false, depth_imp, weigh_imp_rows, min_imp_obs};
 
-    std::unique_ptr<WorkerMemory> workspace = std::unique_ptr<WorkerMemory>(new WorkerMemory);
+    if (!session->worker_memory.size())
+        session->worker_memory.resize(1);
+    WorkerMemory &workspace = session->worker_memory[0];
+    reset_worker_memory(workspace);
+    workspace.nthreads_cols = 1;
 
     size_t last_tree;
     if (model_outputs != NULL)
@@ -741,7 +1038,7 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
 
     fit_itree((model_outputs != NULL)? &model_outputs->trees.back() : NULL,
               (model_outputs_ext != NULL)? &model_outputs_ext->hplanes.back() : NULL,
-              *workspace,
+              workspace,
               input_data,
               model_params,
               impute_nodes,
@@ -755,6 +1052,587 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
     return EXIT_SUCCESS;
 }
 
+/* Add multiple additional trees to already-fitted isolation forest model
+* 
+* Same as 'add_tree', but builds 'ntrees' trees at once, in parallel, sharing the same processed data
+* and the same per-thread working memory across all of them. The trees are appended to the model
+* in the same order and with the same random seeds as if they had been added one by one through
+* 'add_tree' using the same 'random_seed' (i.e. the trees are identical to those from calling
+* 'add_tree' 'ntrees' times with the same data and parameters), so the results do not depend
+* on the number of threads.
+* Parameters are the same as for 'add_tree' (see the documentation in there for details), with the
+* following differences:
+* 
+* Parameters
+* ==========
+* - ntrees
+*       Number of trees to add to the model.
+* - imputer
+*       Pointer to already-fitted imputer object to which imputation nodes for the new trees will be
+*       appended (in the compact layout if the imputer was converted through 'compact_imputer').
+*       Pass NULL if the model was not built with an imputer.
+* - nthreads
+*       Number of parallel threads to use. Note that, the more threads, the more memory will be
+*       allocated, even if the thread does not end up being used.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) upon completion.
+* If the process receives an interrupt signal, will return instead
+* 'EXIT_FAILURE' (typically =1), and the model will be left without any of the new trees.
+*/
+int add_trees(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+              double numeric_data[],  size_t ncols_numeric,
+              int    categ_data[],    size_t ncols_categ,    int ncat[],
+              double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+              size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+              double sample_weights[], size_t nrows, size_t ntrees, size_t max_depth,
+              bool   limit_depth,   bool penalize_range,
+              double col_weights[], bool weigh_by_kurt,
+              double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+              double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+              double min_gain, MissingAction missing_action,
+              CategSplit cat_split_type, NewCategAction new_cat_action,
+              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+              bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+              uint64_t random_seed, RNGType rng_type, int nthreads)
+{
+    TrainingSession session;
+    initialize_training_session(session,
+                                numeric_data, ncols_numeric,
+                                categ_data, ncols_categ, ncat,
+                                Xc, Xc_ind, Xc_indptr,
+                                sample_weights, nrows, nthreads);
+    return add_trees(&session, model_outputs, model_outputs_ext,
+                     ndim, ntry, coef_type, coef_by_prop,
+                     ntrees, max_depth, limit_depth, penalize_range,
+                     col_weights, weigh_by_kurt,
+                     prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                     prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                     min_gain, missing_action,
+                     cat_split_type, new_cat_action,
+                     depth_imp, weigh_imp_rows,
+                     all_perm, imputer, min_imp_obs,
+                     random_seed, rng_type, nthreads);
+}
+
+/* Add multiple additional trees to already-fitted isolation forest model, using the data from a training session
+* 
+* Same as the 'add_trees' that takes the data, but the data and the memory for building the trees are taken
+* from a 'TrainingSession' object (see 'create_training_session').
+*/
+int add_trees(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+              size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+              size_t ntrees, size_t max_depth, bool limit_depth, bool penalize_range,
+              double col_weights[], bool weigh_by_kurt,
+              double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+              double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+              double min_gain, MissingAction missing_action,
+              CategSplit cat_split_type, NewCategAction new_cat_action,
+              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+              bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+              uint64_t random_seed, RNGType rng_type, int nthreads)
+{
+    if (!ntrees) return EXIT_SUCCESS;
+
+    InputData &input_data = session->input_data;
+    input_data.weight_as_sample = false;
+    input_data.col_weights = col_weights;
+    input_data.has_missing.clear();
+    input_data.n_missing = 0;
+
+    size_t nrows = input_data.nrows;
+    ModelParams model_params = {false, nrows, ntrees,
+                                max_depth? max_depth : (nrows - 1),
+                                penalize_range, random_seed, rng_type, weigh_by_kurt,
+                                prob_pick_by_gain_avg, (model_outputs == NULL)? 0 : prob_split_by_gain_avg,
+                                prob_pick_by_gain_pl,  (model_outputs == NULL)? 0 : prob_split_by_gain_pl,
+                                min_gain, cat_split_type, new_cat_action, missing_action, all_perm,
+                                (model_outputs != NULL)? 0 : ndim, (model_outputs != NULL)? 0 : ntry,
+                                coef_type, coef_by_prop, false, false, false, depth_imp, weigh_imp_rows, min_imp_obs};
+
+    /* the new trees go at the end, numbered as if they had been added one at a time */
+    size_t last_tree;
+    if (model_outputs != NULL)
+    {
+        last_tree = model_outputs->trees.size();
+        model_outputs->trees.resize(last_tree + ntrees);
+    }
+
+    else
+    {
+        last_tree = model_outputs_ext->hplanes.size();
+        model_outputs_ext->hplanes.resize(last_tree + ntrees);
+    }
+
+    /* if the imputer is in the compact layout, the nodes of each new tree are compacted after fitting it */
+    bool compact_imputer = imputer != NULL && imputer->imputer_tree_compact.size();
+    std::vector<std::vector<ImputeNode>> new_impute_nodes;
+    if (compact_imputer)
+    {
+        new_impute_nodes.resize(ntrees);
+        imputer->imputer_tree_compact.resize(last_tree + ntrees);
+    }
+    else if (imputer != NULL)
+        imputer->imputer_tree.resize(last_tree + ntrees);
+
+    /* initialize thread-private memory - if there are more threads than trees and the
+       columns are chosen by gain, the remaining threads are used for evaluating columns */
+    int nthreads_cols = 1;
+    if (nthreads < 1) nthreads = 1;
+    if ((size_t)nthreads > ntrees)
+    {
+        if (model_outputs != NULL && (prob_pick_by_gain_avg > 0 || prob_pick_by_gain_pl > 0))
+            nthreads_cols = nthreads / (int)ntrees;
+        nthreads = (int)ntrees;
+    }
+    std::vector<WorkerMemory> &worker_memory = session->worker_memory;
+    #ifdef _OPENMP
+        worker_memory.resize(std::max(worker_memory.size(), (size_t)nthreads));
+        #if (_OPENMP < 200801) || defined(_WIN32) || defined(_WIN64) /* OpenMP < 3.0 */
+        if (nthreads > 1) nthreads_cols = 1;
+        #else
+        int prev_max_active_levels = omp_get_max_active_levels();
+        if (nthreads > 1 && nthreads_cols > 1)
+            omp_set_max_active_levels(std::max(prev_max_active_levels, 2));
+        #endif
+    #else
+        worker_memory.resize(std::max(worker_memory.size(), (size_t)1));
+        nthreads_cols = 1;
+    #endif
+    for (WorkerMemory &w : worker_memory)
+    {
+        reset_worker_memory(w);
+        w.nthreads_cols = nthreads_cols;
+    }
+
+    interrupt_switch = false;
+    #if !defined(_WIN32) && !defined(_WIN64) && !defined(_MSC_VER)
+    struct sigaction sig_handle = {};
+    sig_handle.sa_flags = SA_RESETHAND;
+    sig_handle.sa_handler = set_interrup_global_variable;
+    sigemptyset(&sig_handle.sa_mask);
+    #endif
+
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic) \
+            shared(model_outputs, model_outputs_ext, worker_memory, input_data, model_params, imputer, last_tree, \
+                   compact_imputer, new_impute_nodes)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        if (interrupt_switch)
+            continue; /* Cannot break with OpenMP==2.0 (MSVC) */
+
+        fit_itree((model_outputs != NULL)? &model_outputs->trees[last_tree + tree] : NULL,
+                  (model_outputs_ext != NULL)? &model_outputs_ext->hplanes[last_tree + tree] : NULL,
+                  worker_memory[omp_get_thread_num()],
+                  input_data,
+                  model_params,
+                  (imputer == NULL)? NULL : (compact_imputer? &new_impute_nodes[tree] : &(imputer->imputer_tree[last_tree + tree])),
+                  last_tree + tree);
+
+        if (compact_imputer)
+        {
+            compact_impute_tree(new_impute_nodes[tree], imputer->imputer_tree_compact[last_tree + tree],
+                                imputer->ncols_numeric, imputer->imputer_tree_compact[0].as_float);
+            new_impute_nodes[tree].clear();
+            new_impute_nodes[tree].shrink_to_fit();
+        }
+
+        if ((model_outputs != NULL))
+            model_outputs->trees[last_tree + tree].shrink_to_fit();
+        else
+            model_outputs_ext->hplanes[last_tree + tree].shrink_to_fit();
+
+        #if !defined(_WIN32) && !defined(_WIN64) && !defined(_MSC_VER)
+        sigaction(SIGINT, &sig_handle, NULL);
+        #else
+        signal(SIGINT, set_interrup_global_variable);
+        #endif
+    }
+
+    #if defined(_OPENMP) && !((_OPENMP < 200801) || defined(_WIN32) || defined(_WIN64))
+    omp_set_max_active_levels(prev_max_active_levels);
+    #endif
+
+    /* if the procedure got interrupted, leave the model as it was before */
+    if (interrupt_switch)
+    {
+        if (model_outputs != NULL)
+            model_outputs->trees.resize(last_tree);
+        else
+            model_outputs_ext->hplanes.resize(last_tree);
+        if (compact_imputer)
+            imputer->imputer_tree_compact.resize(last_tree);
+        else if (imputer != NULL)
+            imputer->imputer_tree.resize(last_tree);
+        interrupt_switch = false;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* Fit Isolation Forest model to data that is read in chunks
+* 
+* Same as 'fit_iforest', but instead of taking the whole data as one array, it takes a function
+* that produces the data in chunks of rows, which gets called until it signals that there are
+* no more rows. The sample for each tree is drawn in one pass over the chunks through reservoir
+* sampling (weighted if using sample weights as sampling probabilities), and the trees are built
+* afterwards from their samples, so the memory required is proportional to
+* 'ntrees * sample_size * (ncols_numeric + ncols_categ)' regardless of the number of rows in the data.
+* 
+* Note that the samples are drawn differently than in 'fit_iforest', so the results will not be the
+* same as when passing the same data at once. Sampling is always done without replacement, and this
+* function does not support sparse data, imputers, nor outputs calculated during the fitting procedure
+* (distances and depths).
+* 
+* Parameters
+* ==========
+* - read_chunk
+*       Function which, each time it is called, sets 'numeric_data', 'categ_data' and 'sample_weights'
+*       to point to the next chunk of rows and returns the number of rows in it, in the same format as
+*       the data for 'fit_iforest' (column-major arrays with as many rows as the chunk has). Pointers
+*       for data that is not used (e.g. categorical data when 'ncols_categ=0') can be left untouched.
+*       The arrays only need to remain valid until the next call. Should return zero once there are no
+*       more rows, or '(size_t)-1' if it failed to produce the data, in which case the fitting procedure
+*       will be aborted. It is always called from the same thread that calls this function.
+*       Either all the chunks or none of them should have sample weights.
+* - reader_data
+*       Pointer that will be passed as first argument to 'read_chunk'.
+* - ncols_numeric, ncols_categ, ncat
+*       Number of numeric and categorical columns in each chunk, and number of categories
+*       of each categorical column, same as for 'fit_iforest'.
+* - weight_as_sample
+*       Whether the sample weights produced by 'read_chunk' (if any) are to be taken as sampling
+*       probabilities, or as distribution density weights (same as for 'fit_iforest').
+* - sample_size
+*       Number of rows to sample for each tree. Unlike in 'fit_iforest', it cannot be zero, as the
+*       number of rows is not known beforehand. If the data has fewer rows than this, will take all of them.
+* - ndim, ntry, coef_type, coef_by_prop, ntrees, max_depth, limit_depth, penalize_range, col_weights,
+*   weigh_by_kurt, prob_pick_by_gain_avg, prob_split_by_gain_avg, prob_pick_by_gain_pl, prob_split_by_gain_pl,
+*   min_gain, missing_action, cat_split_type, new_cat_action, all_perm, random_seed, rng_type, nthreads
+*       Same as for 'fit_iforest' (see the documentation in there for details).
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) upon completion.
+* If the process receives an interrupt signal (also while reading the chunks), if 'read_chunk'
+* signals a failure, if only some of the chunks have sample weights, or if there were no rows
+* to sample, will return instead 'EXIT_FAILURE' (typically =1).
+*/
+int fit_iforest_streaming(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          ChunkReader read_chunk, void *reader_data,
+                          size_t ncols_numeric, size_t ncols_categ, int ncat[],
+                          size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                          bool   weight_as_sample, size_t sample_size, size_t ntrees, size_t max_depth,
+                          bool   limit_depth, bool penalize_range,
+                          double col_weights[], bool weigh_by_kurt,
+                          double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                          double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                          double min_gain, MissingAction missing_action,
+                          CategSplit cat_split_type, NewCategAction new_cat_action,
+                          bool   all_perm, uint64_t random_seed, RNGType rng_type, int nthreads)
+{
+    if (!sample_size || !ntrees) return EXIT_FAILURE;
+    if (nthreads < 1) nthreads = 1;
+
+    int max_categ = 0;
+    for (size_t col = 0; col < ncols_categ; col++)
+        max_categ = (ncat[col] > max_categ)? ncat[col] : max_categ;
+
+    /* the sampling uses a different seed than the one used for building the trees afterwards */
+    std::vector<TreeReservoir> reservoirs(ntrees);
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        reservoirs[tree].numeric_data.resize(sample_size * ncols_numeric);
+        reservoirs[tree].categ_data.resize(sample_size * ncols_categ);
+        reservoirs[tree].n_filled = 0;
+        reservoirs[tree].rnd_generator.seed(~(random_seed + (uint64_t)tree), rng_type);
+    }
+
+    interrupt_switch = false;
+    #if !defined(_WIN32) && !defined(_WIN64) && !defined(_MSC_VER)
+    struct sigaction sig_handle = {};
+    sig_handle.sa_flags = SA_RESETHAND;
+    sig_handle.sa_handler = set_interrup_global_variable;
+    sigemptyset(&sig_handle.sa_mask);
+    #endif
+
+    /* read the chunks and pass their rows through the reservoirs of all the trees */
+    size_t nrows_read = 0;
+    bool has_weights = false;
+    bool store_weights = false;
+    bool weighted_sample = false;
+    while (true)
+    {
+        if (interrupt_switch) return EXIT_FAILURE;
+
+        double *chunk_numeric = NULL;
+        int    *chunk_categ   = NULL;
+        double *chunk_weights = NULL;
+        size_t chunk_nrows = read_chunk(reader_data, &chunk_numeric, &chunk_categ, &chunk_weights);
+        if (chunk_nrows == (size_t)-1) return EXIT_FAILURE;
+        if (!chunk_nrows) break;
+
+        /* whether there are weights is decided by the first chunk, and the rest must follow it */
+        if (!nrows_read && chunk_weights != NULL)
+        {
+            has_weights = true;
+            weighted_sample = weight_as_sample;
+            store_weights = !weight_as_sample;
+            if (store_weights)
+                for (TreeReservoir &res : reservoirs)
+                    res.sample_weights.resize(sample_size);
+        }
+        if (has_weights != (chunk_weights != NULL))
+            return EXIT_FAILURE;
+
+        #pragma omp parallel for num_threads(nthreads) schedule(static) shared(reservoirs, chunk_numeric, chunk_categ, chunk_weights, chunk_nrows, nrows_read)
+        for (size_t_for tree = 0; tree < ntrees; tree++)
+        {
+            if (weighted_sample)
+                add_chunk_to_weighted_reservoir(reservoirs[tree], sample_size,
+                                                chunk_numeric, ncols_numeric, chunk_categ, ncols_categ,
+                                                chunk_weights, chunk_nrows);
+            else
+                add_chunk_to_reservoir(reservoirs[tree], sample_size,
+                                       chunk_numeric, ncols_numeric, chunk_categ, ncols_categ,
+                                       store_weights? chunk_weights : NULL, chunk_nrows, nrows_read);
+        }
+
+        nrows_read += chunk_nrows;
+
+        #if !defined(_WIN32) && !defined(_WIN64) && !defined(_MSC_VER)
+        sigaction(SIGINT, &sig_handle, NULL);
+        #else
+        signal(SIGINT, set_interrup_global_variable);
+        #endif
+    }
+
+    /* all the reservoirs end up with the same number of rows - if the data had fewer rows
+       than the sample size, need to remove the gaps between columns */
+    size_t nrows_sample = reservoirs.front().n_filled;
+    if (!nrows_sample) return EXIT_FAILURE;
+    if (nrows_sample < sample_size)
+    {
+        for (TreeReservoir &res : reservoirs)
+        {
+            for (size_t col = 1; col < ncols_numeric; col++)
+                std::copy(res.numeric_data.begin() + col * sample_size,
+                          res.numeric_data.begin() + col * sample_size + nrows_sample,
+                          res.numeric_data.begin() + col * nrows_sample);
+            for (size_t col = 1; col < ncols_categ; col++)
+                std::copy(res.categ_data.begin() + col * sample_size,
+                          res.categ_data.begin() + col * sample_size + nrows_sample,
+                          res.categ_data.begin() + col * nrows_sample);
+        }
+    }
+
+    ModelParams model_params = {false, nrows_sample, ntrees,
+                                limit_depth? log2ceil(nrows_sample) : max_depth? max_depth : (nrows_sample - 1),
+                                penalize_range, random_seed, rng_type, weigh_by_kurt,
+                                prob_pick_by_gain_avg, (model_outputs == NULL)? 0 : prob_split_by_gain_avg,
+                                prob_pick_by_gain_pl,  (model_outputs == NULL)? 0 : prob_split_by_gain_pl,
+                                min_gain, cat_split_type, new_cat_action, missing_action, all_perm,
+                                (model_outputs != NULL)? 0 : ndim, (model_outputs != NULL)? 0 : ntry,
+                                coef_type, coef_by_prop, false, false, false, Higher, Inverse, 3};
+
+    if (model_outputs != NULL)
+    {
+        model_outputs->trees.resize(ntrees);
+        model_outputs->trees.shrink_to_fit();
+        model_outputs->new_cat_action = new_cat_action;
+        model_outputs->cat_split_type = cat_split_type;
+        model_outputs->missing_action = missing_action;
+        model_outputs->exp_avg_depth  = expected_avg_depth(nrows_sample);
+        model_outputs->exp_avg_sep = expected_separation_depth(nrows_sample);
+        model_outputs->orig_sample_size = nrows_read;
+    }
+
+    else
+    {
+        model_outputs_ext->hplanes.resize(ntrees);
+        model_outputs_ext->hplanes.shrink_to_fit();
+        model_outputs_ext->new_cat_action = new_cat_action;
+        model_outputs_ext->cat_split_type = cat_split_type;
+        model_outputs_ext->missing_action = missing_action;
+        model_outputs_ext->exp_avg_depth  = expected_avg_depth(nrows_sample);
+        model_outputs_ext->exp_avg_sep = expected_separation_depth(nrows_sample);
+        model_outputs_ext->orig_sample_size = nrows_read;
+    }
+
+    /* each tree is fit to its own sample, which is freed right after */
+    if ((size_t)nthreads > ntrees)
+        nthreads = (int)ntrees;
+    #ifdef _OPENMP
+    std::vector<WorkerMemory> worker_memory(nthreads);
+    #else
+    std::vector<WorkerMemory> worker_memory(1);
+    #endif
+    for (WorkerMemory &w : worker_memory)
+        w.nthreads_cols = 1;
+
+    #pragma omp parallel for num_threads(nthreads) schedule(dynamic) shared(model_outputs, model_outputs_ext, worker_memory, reservoirs, model_params)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        if (interrupt_switch)
+            continue; /* Cannot break with OpenMP==2.0 (MSVC) */
+
+        TreeReservoir &res = reservoirs[tree];
+        InputData input_data = {ncols_numeric? res.numeric_data.data() : NULL, ncols_numeric,
+                                ncols_categ? res.categ_data.data() : NULL, ncat, max_categ, ncols_categ,
+                                nrows_sample, ncols_numeric + ncols_categ,
+                                res.sample_weights.size()? res.sample_weights.data() : NULL,
+                                false, col_weights,
+                                NULL, NULL, NULL,
+                                0, 0, std::vector<double>(),
+                                std::vector<double>(), std::vector<size_t>(),
+                                std::vector<char>(), 0,
+                                std::vector<char>(), std::vector<char>()};
+        profile_columns(input_data, 1);
+
+        /* the memory is sized after the first data it sees, which differs from tree to tree */
+        WorkerMemory &workspace = worker_memory[omp_get_thread_num()];
+        reset_worker_memory(workspace);
+        fit_itree((model_outputs != NULL)? &model_outputs->trees[tree] : NULL,
+                  (model_outputs_ext != NULL)? &model_outputs_ext->hplanes[tree] : NULL,
+                  workspace,
+                  input_data,
+                  model_params,
+                  NULL,
+                  tree);
+
+        if ((model_outputs != NULL))
+            model_outputs->trees[tree].shrink_to_fit();
+        else
+            model_outputs_ext->hplanes[tree].shrink_to_fit();
+
+        std::vector<double>().swap(res.numeric_data);
+        std::vector<int>().swap(res.categ_data);
+        std::vector<double>().swap(res.sample_weights);
+
+        #if !defined(_WIN32) && !defined(_WIN64) && !defined(_MSC_VER)
+        sigaction(SIGINT, &sig_handle, NULL);
+        #else
+        signal(SIGINT, set_interrup_global_variable);
+        #endif
+    }
+
+    if (interrupt_switch) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+static void copy_row_to_reservoir(TreeReservoir &res, size_t slot, size_t sample_size,
+                                  double *restrict numeric_data, size_t ncols_numeric,
+                                  int *restrict categ_data, size_t ncols_categ,
+                                  double *restrict sample_weights,
+                                  size_t row, size_t nrows)
+{
+    for (size_t col = 0; col < ncols_numeric; col++)
+        res.numeric_data[slot + col * sample_size] = numeric_data[row + col * nrows];
+    for (size_t col = 0; col < ncols_categ; col++)
+        res.categ_data[slot + col * sample_size] = categ_data[row + col * nrows];
+    if (sample_weights != NULL)
+        res.sample_weights[slot] = sample_weights[row];
+}
+
+/* draws a number in (0,1), so that its logarithm is always finite */
+static double draw_unif_nonzero(RNG_engine &rnd_generator)
+{
+    return std::uniform_real_distribution<double>(std::numeric_limits<double>::min(), 1.)(rnd_generator);
+}
+
+/* Reservoir sampling with skips ('algorithm L' from Li, Kim-Hung - "Reservoir-sampling algorithms of time
+   complexity O(n(1 + log(N/n)))"), which only needs to draw random numbers for the rows that get taken */
+static void set_next_reservoir_row(TreeReservoir &res, size_t sample_size, size_t last_row)
+{
+    res.log_W += log(draw_unif_nonzero(res.rnd_generator)) / (double)sample_size;
+    double skip = floor(log(draw_unif_nonzero(res.rnd_generator)) / log1p(-exp(res.log_W)));
+    if (isnan(skip) || skip >= (double)(SIZE_MAX - last_row - 1))
+        res.next_row = SIZE_MAX;
+    else
+        res.next_row = last_row + 1 + (size_t)skip;
+}
+
+void add_chunk_to_reservoir(TreeReservoir &res, size_t sample_size,
+                            double numeric_data[], size_t ncols_numeric,
+                            int categ_data[], size_t ncols_categ,
+                            double sample_weights[], size_t nrows, size_t nrows_before)
+{
+    size_t row = 0;
+    for (; row < nrows && res.n_filled < sample_size; row++)
+    {
+        copy_row_to_reservoir(res, res.n_filled++, sample_size,
+                              numeric_data, ncols_numeric, categ_data, ncols_categ,
+                              sample_weights, row, nrows);
+        if (res.n_filled == sample_size)
+        {
+            res.log_W = 0;
+            set_next_reservoir_row(res, sample_size, nrows_before + row);
+        }
+    }
+
+    if (row == nrows) return;
+    std::uniform_int_distribution<size_t> slot_chooser(0, sample_size - 1);
+    while (res.next_row < nrows_before + nrows)
+    {
+        row = res.next_row - nrows_before;
+        copy_row_to_reservoir(res, slot_chooser(res.rnd_generator), sample_size,
+                              numeric_data, ncols_numeric, categ_data, ncols_categ,
+                              sample_weights, row, nrows);
+        set_next_reservoir_row(res, sample_size, res.next_row);
+    }
+}
+
+/* Weighted reservoir sampling with exponential jumps ('algorithm A-ExpJ' from Efraimidis, Pavlos S., and
+   Paul G. Spirakis - "Weighted random sampling with a reservoir"), in which each row gets a key u^(1/w) and the
+   sample keeps the rows with the largest keys. The keys are kept here in log scale, in a min-heap. */
+static void set_next_weighted_jump(TreeReservoir &res)
+{
+    double min_key = res.key_heap.front().first;
+    res.weight_to_skip = (min_key < 0)? (log(draw_unif_nonzero(res.rnd_generator)) / min_key) : HUGE_VAL;
+}
+
+void add_chunk_to_weighted_reservoir(TreeReservoir &res, size_t sample_size,
+                                     double numeric_data[], size_t ncols_numeric,
+                                     int categ_data[], size_t ncols_categ,
+                                     double sample_weights[], size_t nrows)
+{
+    std::greater<std::pair<double, size_t>> heap_cmp;
+    for (size_t row = 0; row < nrows; row++)
+    {
+        double w = sample_weights[row];
+        if (!(w > 0) || isinf(w)) continue;
+
+        if (res.n_filled < sample_size)
+        {
+            res.key_heap.emplace_back(log(draw_unif_nonzero(res.rnd_generator)) / w, res.n_filled);
+            std::push_heap(res.key_heap.begin(), res.key_heap.end(), heap_cmp);
+            copy_row_to_reservoir(res, res.n_filled++, sample_size,
+                                  numeric_data, ncols_numeric, categ_data, ncols_categ,
+                                  NULL, row, nrows);
+            if (res.n_filled == sample_size)
+                set_next_weighted_jump(res);
+            continue;
+        }
+
+        res.weight_to_skip -= w;
+        if (res.weight_to_skip > 0) continue;
+
+        /* the new key is drawn conditional on being larger than the smallest one */
+        double min_key_w = exp(res.key_heap.front().first * w);
+        double new_key = log(min_key_w + (1. - min_key_w) * std::uniform_real_distribution<double>(0, 1)(res.rnd_generator)) / w;
+        std::pop_heap(res.key_heap.begin(), res.key_heap.end(), heap_cmp);
+        res.key_heap.back().first = new_key;
+        size_t slot = res.key_heap.back().second;
+        std::push_heap(res.key_heap.begin(), res.key_heap.end(), heap_cmp);
+        copy_row_to_reservoir(res, slot, sample_size,
+                              numeric_data, ncols_numeric, categ_data, ncols_categ,
+                              NULL, row, nrows);
+        set_next_weighted_jump(res);
+    }
+}
+
 void fit_itree(std::vector<IsoTree>    *tree_root,
                std::vector<IsoHPlane>  *hplane_root,
                WorkerMemory             &workspace,
@@ -769,26 +1647,29 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
 
     /* choose random sample of rows */
     if (!workspace.ix_arr.size()) workspace.ix_arr.resize(model_params.sample_size);
-    if (input_data.log2_n > 0)
+    if (input_data.Xc_indptr != NULL && !workspace.buffer_ix.size())
+        workspace.buffer_ix.resize(model_params.sample_size); /* for partitioning sparse columns */
+    if (input_data.log2_n > 0 && input_data.weight_as_sample && !model_params.with_replacement)
         workspace.btree_weights.assign(input_data.btree_weights_init.begin(),
                                        input_data.btree_weights_init.end());
-    workspace.rnd_generator.seed(model_params.random_seed + tree_num);
-    if (input_data.col_weights != NULL)
-        workspace.col_sampler = std::discrete_distribution<size_t>(input_data.col_weights,
-                                                                   input_data.col_weights + input_data.ncols_numeric + input_data.ncols_categ);
-    workspace.runif = std::uniform_int_distribution<size_t>(0, input_data.ncols_tot - 1);
+    workspace.rnd_generator.seed(model_params.random_seed + tree_num, model_params.rng_type);
     workspace.rbin  = std::uniform_real_distribution<double>(0, 1);
+    /* the normal distribution caches generated values, which would otherwise carry over
+       from the previous tree built with this same memory and make the results depend on
+       which thread got to build which tree */
+    workspace.coef_norm.reset();
     sample_random_rows(workspace.ix_arr, input_data.nrows, model_params.with_replacement,
                        workspace.rnd_generator, workspace.ix_all,
                        (input_data.weight_as_sample)? input_data.sample_weights : NULL,
                        workspace.btree_weights, input_data.log2_n, input_data.btree_offset,
-                       workspace.is_repeated);
+                       workspace.is_repeated, input_data.alias_prob, input_data.alias_ix);
     workspace.st  = 0;
     workspace.end = model_params.sample_size - 1;
-    if (!workspace.cols_possible.size())
-        workspace.cols_possible.resize(input_data.ncols_tot, true);
+    if (!workspace.col_sampler.col_indices.size())
+        initialize_col_sampler(workspace.col_sampler, input_data.ncols_tot, input_data.col_weights,
+                               input_data.col_is_const.size()? input_data.col_is_const.data() : NULL);
     else
-        workspace.cols_possible.assign(workspace.cols_possible.size(), true);
+        restore_col_sampler(workspace.col_sampler, 0);
 
     /* set expected tree size and add root node */
     {
@@ -826,6 +1707,8 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
             workspace.coef_unif = std::uniform_real_distribution<double>(-1, 1);
 
         workspace.cols_shuffled.resize(input_data.ncols_tot);
+        workspace.col_taken_gen.assign(input_data.ncols_tot, 0);
+        workspace.curr_gen = 0;
         workspace.comb_val.resize(model_params.sample_size);
         workspace.col_take.resize(model_params.ndim);
         workspace.col_take_type.resize(model_params.ndim);
@@ -839,12 +1722,12 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
 
         if (input_data.ncols_categ)
         {
-            workspace.ext_fill_new.resize(input_data.max_categ);
+            workspace.ext_fill_new.resize(input_data.ncols_tot);
             switch(model_params.cat_split_type)
             {
                 case SingleCateg:
                 {
-                    workspace.chosen_cat.resize(input_data.max_categ);
+                    workspace.chosen_cat.resize(input_data.ncols_tot);
                     break;
                 }
 
@@ -945,10 +1828,6 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
         }
     }
 
-    /* if producing distance/similarity, also need to initialize the triangular matrix */
-    if (model_params.calc_dist && !workspace.tmat_sep.size())
-        workspace.tmat_sep.resize((input_data.nrows * (input_data.nrows - 1)) / 2, 0);
-
     /* make space for buffers if not already allocated */
     if (
             (model_params.prob_split_by_gain_avg || model_params.prob_pick_by_gain_avg ||
@@ -983,7 +1862,7 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
         if (hplane_root != NULL)
         {
             min_size_dbl = std::max(min_size_dbl, pow2(log2ceil(input_data.ncols_tot) + 1));
-            if (model_params.missing_action != Fail)
+            if (model_params.missing_action != Fail || gain)
             {
                 min_size_szt = std::max(min_size_szt, model_params.sample_size);
                 min_size_dbl = std::max(min_size_dbl, model_params.sample_size);
@@ -995,10 +1874,12 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
                 min_size_dbl = std::max(min_size_dbl, (size_t)input_data.max_categ);
             }
 
-            if (model_params.weigh_by_kurt)
-                min_size_szt = std::max(min_size_szt, input_data.ncols_tot);
         }
 
+        /* for gathering the sample of each column when calculating kurtosis */
+        if (model_params.weigh_by_kurt && input_data.Xc_indptr == NULL && input_data.ncols_numeric)
+            min_size_dbl = std::max(min_size_dbl, model_params.sample_size);
+
         /* now resize */
         if (workspace.buffer_dbl.size() < min_size_dbl)
             workspace.buffer_dbl.resize(min_size_dbl);
@@ -1026,37 +1907,14 @@ void fit_itree(std::vector<IsoTree>    *tree_root,
     /* weigh columns by kurtosis in the sample if required */
     if (model_params.weigh_by_kurt)
     {
-        std::vector<double> kurt_weights(input_data.ncols_numeric + input_data.ncols_categ);
-
-        if (input_data.Xc_indptr == NULL)
-        {
-            for (size_t col = 0; col < input_data.ncols_numeric; col++)
-                kurt_weights[col] = calc_kurtosis(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                  input_data.numeric_data + col * input_data.nrows,
-                                                  model_params.missing_action);
-        }
-
-        else
-        {
-            std::sort(workspace.ix_arr.begin(), workspace.ix_arr.end());
-            for (size_t col = 0; col < input_data.ncols_numeric; col++)
-                kurt_weights[col] = calc_kurtosis(workspace.ix_arr.data(), workspace.st, workspace.end, col,
-                                                  input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr,
-                                                  model_params.missing_action);
-        }
-
-        for (size_t col = 0; col < input_data.ncols_categ; col++)
-            kurt_weights[col + input_data.ncols_numeric] =
-                calc_kurtosis(workspace.ix_arr.data(), workspace.st, workspace.end,
-                              input_data.categ_data + col * input_data.nrows, input_data.ncat[col],
-                              workspace.buffer_szt.data(), workspace.buffer_dbl.data(),
-                              model_params.missing_action, model_params.cat_split_type, workspace.rnd_generator);
-
-        for (size_t col = 0; col < input_data.ncols_tot; col++)
-            if (kurt_weights[col] <= 0 || is_na_or_inf(kurt_weights[col]))
-                workspace.cols_possible[col] = false;
-
-        workspace.col_sampler = std::discrete_distribution<size_t>(kurt_weights.begin(), kurt_weights.end());
+        std::vector<double> kurt_weights(input_data.ncols_tot);
+        calc_kurtosis_weights(kurt_weights.data(), workspace.ix_arr.data(), workspace.st, workspace.end,
+                              input_data, model_params,
+                              workspace.buffer_dbl.data(), workspace.buffer_szt.data(), workspace.rnd_generator);
+
+        /* columns with non-positive or invalid kurtosis will be left out by the sampler */
+        initialize_col_sampler(workspace.col_sampler, input_data.ncols_tot, kurt_weights.data(),
+                               input_data.col_is_const.size()? input_data.col_is_const.data() : NULL);
     }
 
     if (tree_root != NULL)
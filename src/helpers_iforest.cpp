@@ -45,13 +45,9 @@
 #include "isotree.hpp"
 
 void decide_column(size_t ncols_numeric, size_t ncols_categ, size_t &col_chosen, ColType &col_type,
-                   RNG_engine &rnd_generator, std::uniform_int_distribution<size_t> &runif,
-                   std::discrete_distribution<size_t> &col_sampler)
+                   RNG_engine &rnd_generator, ColumnSampler &col_sampler)
 {
-    if (!col_sampler.max())
-        col_chosen = runif(rnd_generator);
-    else
-        col_chosen = col_sampler(rnd_generator);
+    col_chosen = sample_col(col_sampler, rnd_generator);
 
     if (col_chosen >= ncols_numeric)
     {
@@ -65,70 +61,148 @@ void decide_column(size_t ncols_numeric, size_t ncols_categ, size_t &col_chosen,
 void add_unsplittable_col(WorkerMemory &workspace, IsoTree &tree, InputData &input_data)
 {
     if (tree.col_type == Numeric)
-        workspace.cols_possible[tree.col_num] = false;
+        drop_col(workspace.col_sampler, tree.col_num);
     else
-        workspace.cols_possible[tree.col_num + input_data.ncols_numeric] = false;
+        drop_col(workspace.col_sampler, tree.col_num + input_data.ncols_numeric);
 }
 
 void add_unsplittable_col(WorkerMemory &workspace, InputData &input_data)
 {
     if (workspace.col_type == Numeric)
-        workspace.cols_possible[workspace.col_chosen] = false;
+        drop_col(workspace.col_sampler, workspace.col_chosen);
     else
-        workspace.cols_possible[workspace.col_chosen + input_data.ncols_numeric] = false;
+        drop_col(workspace.col_sampler, workspace.col_chosen + input_data.ncols_numeric);
 }
 
-bool check_is_not_unsplittable_col(WorkerMemory &workspace, IsoTree &tree, InputData &input_data)
+/* Goes once over each column of the data before fitting the trees, in order to determine which columns
+   have missing values (these are the only ones that need NA handling when splitting them) and which ones
+   are constant in the whole data (these can never be split at any node, so they are never sampled). */
+void profile_columns(InputData &input_data, int nthreads)
 {
-    if (tree.col_type == Numeric)
-        return workspace.cols_possible[tree.col_num];
-    else
-        return workspace.cols_possible[tree.col_num + input_data.ncols_numeric];
+    input_data.col_is_const.assign(input_data.ncols_tot, false);
+    input_data.col_has_NA.assign(input_data.ncols_tot, false);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(input_data)
+    for (size_t_for col = 0; col < input_data.ncols_tot; col++)
+    {
+        bool has_NA = false;
+        bool is_const;
+
+        if (col < input_data.ncols_numeric)
+        {
+            /* NaNs are ignored for the range, the same as in 'get_range' */
+            double xmin =  HUGE_VAL;
+            double xmax = -HUGE_VAL;
+
+            if (input_data.Xc_indptr == NULL)
+            {
+                double *restrict x = input_data.numeric_data + col * input_data.nrows;
+                for (size_t row = 0; row < input_data.nrows; row++)
+                {
+                    has_NA = has_NA || is_na_or_inf(x[row]);
+                    xmin = fmin(xmin, x[row]);
+                    xmax = fmax(xmax, x[row]);
+                }
+            }
+
+            else
+            {
+                for (size_t ix = input_data.Xc_indptr[col]; ix < input_data.Xc_indptr[col + 1]; ix++)
+                {
+                    has_NA = has_NA || is_na_or_inf(input_data.Xc[ix]);
+                    xmin = fmin(xmin, input_data.Xc[ix]);
+                    xmax = fmax(xmax, input_data.Xc[ix]);
+                }
+
+                if ((size_t)(input_data.Xc_indptr[col + 1] - input_data.Xc_indptr[col]) < input_data.nrows)
+                {
+                    xmin = fmin(xmin, 0);
+                    xmax = fmax(xmax, 0);
+                }
+            }
+
+            is_const = (xmin == xmax) || (xmin == HUGE_VAL && xmax == -HUGE_VAL);
+        }
+
+        else
+        {
+            int *restrict x = input_data.categ_data + (col - input_data.ncols_numeric) * input_data.nrows;
+            int first_categ = -1;
+            is_const = true;
+            for (size_t row = 0; row < input_data.nrows; row++)
+            {
+                if (x[row] < 0)
+                    has_NA = true;
+                else if (first_categ < 0)
+                    first_categ = x[row];
+                else if (x[row] != first_categ)
+                    is_const = false;
+            }
+        }
+
+        input_data.col_is_const[col] = is_const;
+        input_data.col_has_NA[col] = has_NA;
+    }
+}
+
+/* Columns known to have no missing values can be split without checking for NAs, using the same routines as
+   for 'missing_action=Fail', which produce the same results when there are no NAs */
+MissingAction col_missing_action(InputData &input_data, ModelParams &model_params, size_t col_num, ColType col_type)
+{
+    if (model_params.missing_action == Fail || !input_data.col_has_NA.size())
+        return model_params.missing_action;
+    if (col_type == Categorical)
+        col_num += input_data.ncols_numeric;
+    return input_data.col_has_NA[col_num]? model_params.missing_action : Fail;
 }
 
 /* for use in regular model */
 void get_split_range(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params, IsoTree &tree)
 {
+    MissingAction missing_action = col_missing_action(input_data, model_params, tree.col_num, tree.col_type);
+
     if (tree.col_type == Numeric)
     {
         if (input_data.Xc_indptr == NULL)
             get_range(workspace.ix_arr.data(), input_data.numeric_data + input_data.nrows * tree.col_num,
-                      workspace.st, workspace.end, model_params.missing_action,
+                      workspace.st, workspace.end, missing_action,
                       workspace.xmin, workspace.xmax, workspace.unsplittable);
         else
             get_range(workspace.ix_arr.data(), workspace.st, workspace.end, tree.col_num,
                       input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr,
-                      model_params.missing_action, workspace.xmin, workspace.xmax, workspace.unsplittable);
+                      missing_action, workspace.xmin, workspace.xmax, workspace.unsplittable);
     }
 
     else
     {
         get_categs(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * tree.col_num,
                    workspace.st, workspace.end, input_data.ncat[tree.col_num],
-                   model_params.missing_action, workspace.categs.data(), workspace.npresent, workspace.unsplittable);
+                   missing_action, workspace.categs.data(), workspace.npresent, workspace.unsplittable);
     }
 }
 
 /* for use in extended model */
 void get_split_range(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params)
 {
+    MissingAction missing_action = col_missing_action(input_data, model_params, workspace.col_chosen, workspace.col_type);
+
     if (workspace.col_type == Numeric)
     {
         if (input_data.Xc_indptr == NULL)
             get_range(workspace.ix_arr.data(), input_data.numeric_data + input_data.nrows * workspace.col_chosen,
-                      workspace.st, workspace.end, model_params.missing_action,
+                      workspace.st, workspace.end, missing_action,
                       workspace.xmin, workspace.xmax, workspace.unsplittable);
         else
             get_range(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.col_chosen,
                       input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr,
-                      model_params.missing_action, workspace.xmin, workspace.xmax, workspace.unsplittable);
+                      missing_action, workspace.xmin, workspace.xmax, workspace.unsplittable);
     }
 
     else
     {
         get_categs(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * workspace.col_chosen,
                    workspace.st, workspace.end, input_data.ncat[workspace.col_chosen],
-                   model_params.missing_action, workspace.categs.data(), workspace.npresent, workspace.unsplittable);
+                   missing_action, workspace.categs.data(), workspace.npresent, workspace.unsplittable);
     }
 }
 
@@ -152,52 +226,236 @@ int choose_cat_from_present(WorkerMemory &workspace, InputData &input_data, size
     return -1; /* this will never be reached, but CRAN complains otherwise */
 }
 
-void update_col_sampler(WorkerMemory &workspace, InputData &input_data)
+/* Evaluates the gain of every available column at a node, when the column to split is chosen by gain.
+   If the node has enough rows and the model was fit with more threads than trees, the columns are split
+   across threads, each with its own buffers. Criteria that reorder the indices are evaluated over a copy
+   of them when running in parallel (or when sparse columns need them sorted), and ties in gain are resolved
+   in favor of the lowest column number (numeric columns first), so the chosen split doesn't depend on the
+   number of threads nor the order in which columns are evaluated.
+   Leaves the best gain in 'tree.score' (-HUGE_VAL if no column can be split) along with its split. */
+#define MIN_ROWS_PARALLEL_COLS 1024
+void eval_guided_split_all_cols(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params, IsoTree &tree)
 {
-    if (!workspace.col_sampler.max())
-        return;
+    size_t n = workspace.end - workspace.st + 1;
+    workspace.cols_eval.clear();
+    for (size_t col = 0; col < input_data.ncols_tot; col++)
+        if (is_col_available(workspace.col_sampler, col))
+            workspace.cols_eval.push_back(col);
+    size_t ncols_eval = workspace.cols_eval.size();
+    workspace.cols_eval_gain.resize(ncols_eval);
 
-    std::vector<double> col_weights = workspace.col_sampler.probabilities();
-    for (size_t col = 0; col < input_data.ncols_numeric; col++)
-        if (!workspace.cols_possible[col])
-            col_weights[col] = 0;
-    for (size_t col = 0; col < input_data.ncols_categ; col++)
-        if (!workspace.cols_possible[col + input_data.ncols_numeric])
-            col_weights[col + input_data.ncols_numeric] = 0;
-    workspace.col_sampler = std::discrete_distribution<size_t>(col_weights.begin(), col_weights.end());
+    int nthreads = 1;
+    if (n >= MIN_ROWS_PARALLEL_COLS && workspace.nthreads_cols > 1)
+        nthreads = (int) std::min((size_t)workspace.nthreads_cols, ncols_eval);
+    nthreads = std::max(nthreads, 1);
+
+    if (workspace.col_workers.size() < (size_t)nthreads)
+    {
+        size_t n_prev = workspace.col_workers.size();
+        workspace.col_workers.resize(nthreads);
+        for (size_t thread = n_prev; thread < (size_t)nthreads; thread++)
+        {
+            GuidedColWorker &worker = workspace.col_workers[thread];
+            if (input_data.Xc_indptr != NULL)
+            {
+                worker.buffer_dbl.resize(model_params.sample_size);
+                worker.buffer_ix.resize(model_params.sample_size);
+            }
+            if (input_data.ncols_categ)
+            {
+                worker.buffer_dbl.resize(std::max(worker.buffer_dbl.size(), (size_t)input_data.max_categ + 1));
+                worker.buffer_szt.resize(2 * input_data.max_categ);
+                worker.buffer_chr.resize(input_data.max_categ);
+                if (model_params.cat_split_type == SubSet)
+                {
+                    worker.split_categ.resize(input_data.max_categ);
+                    worker.best_split_categ.resize(input_data.max_categ);
+                }
+            }
+        }
+    }
+
+    /* when evaluating sequentially, dense columns can reorder the indices of the node in place */
+    bool copy_ix_dense = nthreads > 1;
+    bool copy_ix_categ = nthreads > 1 || input_data.Xc_indptr != NULL;
+    for (int thread = 0; thread < nthreads; thread++)
+    {
+        workspace.col_workers[thread].best_gain = -HUGE_VAL;
+        workspace.col_workers[thread].best_col  = SIZE_MAX;
+        if ((copy_ix_dense || copy_ix_categ) && workspace.col_workers[thread].ix_arr.size() < n)
+            workspace.col_workers[thread].ix_arr.resize(model_params.sample_size);
+    }
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) if(nthreads > 1) \
+            shared(workspace, input_data, model_params, ncols_eval, n, copy_ix_dense, copy_ix_categ)
+    for (size_t_for ix = 0; ix < ncols_eval; ix++)
+    {
+        GuidedColWorker &worker = workspace.col_workers[omp_get_thread_num()];
+        size_t col = workspace.cols_eval[ix];
+        double this_gain;
+        double split_point = 0, xmin = 0, xmax = 0;
+        int chosen_cat = 0;
+        size_t split_ix;
+        MissingAction missing_action = (col < input_data.ncols_numeric)?
+                                       col_missing_action(input_data, model_params, col, Numeric)
+                                         :
+                                       col_missing_action(input_data, model_params, col - input_data.ncols_numeric, Categorical);
+
+        if (col < input_data.ncols_numeric)
+        {
+            if (input_data.Xc_indptr == NULL)
+            {
+                ix_t *ix_arr = workspace.ix_arr.data();
+                size_t st = workspace.st, end = workspace.end;
+                if (copy_ix_dense)
+                {
+                    std::copy(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1, worker.ix_arr.begin());
+                    ix_arr = worker.ix_arr.data();
+                    st = 0; end = n - 1;
+                }
+
+                this_gain = eval_guided_crit(ix_arr, st, end,
+                                             input_data.numeric_data + col * input_data.nrows,
+                                             split_ix, split_point, xmin, xmax,
+                                             workspace.criterion, model_params.min_gain,
+                                             missing_action);
+            }
+
+            else
+            {
+                this_gain = eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
+                                             col, input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr,
+                                             worker.buffer_dbl.data(), worker.buffer_ix.data(),
+                                             split_point, xmin, xmax,
+                                             workspace.criterion, model_params.min_gain, missing_action);
+            }
+        }
+
+        else
+        {
+            /* here the indices only get reordered when moving NAs to the front */
+            ix_t *ix_arr = workspace.ix_arr.data();
+            size_t st = workspace.st, end = workspace.end;
+            if (missing_action != Fail && copy_ix_categ)
+            {
+                std::copy(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1, worker.ix_arr.begin());
+                ix_arr = worker.ix_arr.data();
+                st = 0; end = n - 1;
+            }
+
+            this_gain = eval_guided_crit(ix_arr, st, end,
+                                         input_data.categ_data + (col - input_data.ncols_numeric) * input_data.nrows,
+                                         input_data.ncat[col - input_data.ncols_numeric],
+                                         worker.buffer_szt.data(), worker.buffer_szt.data() + input_data.max_categ,
+                                         worker.buffer_dbl.data(), chosen_cat, worker.split_categ.data(),
+                                         worker.buffer_chr.data(), workspace.criterion, model_params.min_gain,
+                                         model_params.all_perm, missing_action, model_params.cat_split_type);
+        }
+
+        workspace.cols_eval_gain[ix] = this_gain;
+        if (this_gain > -HUGE_VAL && (this_gain > worker.best_gain || (this_gain == worker.best_gain && col < worker.best_col)))
+        {
+            worker.best_gain        = this_gain;
+            worker.best_col         = col;
+            worker.best_split_point = split_point;
+            worker.best_xmin        = xmin;
+            worker.best_xmax        = xmax;
+            worker.best_categ       = chosen_cat;
+            if (col >= input_data.ncols_numeric && model_params.cat_split_type == SubSet)
+                std::copy(worker.split_categ.begin(),
+                          worker.split_categ.begin() + input_data.ncat[col - input_data.ncols_numeric],
+                          worker.best_split_categ.begin());
+        }
+    }
+
+    /* columns that cannot be split are dropped in the same order as they were listed */
+    for (size_t ix = 0; ix < ncols_eval; ix++)
+        if (workspace.cols_eval_gain[ix] <= -HUGE_VAL)
+            drop_col(workspace.col_sampler, workspace.cols_eval[ix]);
+
+    GuidedColWorker *best = NULL;
+    for (int thread = 0; thread < nthreads; thread++)
+    {
+        GuidedColWorker &worker = workspace.col_workers[thread];
+        if (worker.best_col == SIZE_MAX) continue;
+        if (best == NULL || worker.best_gain > best->best_gain ||
+            (worker.best_gain == best->best_gain && worker.best_col < best->best_col))
+            best = &worker;
+    }
+
+    tree.score = -HUGE_VAL;
+    if (best == NULL) return;
+
+    tree.score   = best->best_gain;
+    tree.col_num = best->best_col;
+    if (best->best_col < input_data.ncols_numeric)
+    {
+        tree.num_split = best->best_split_point;
+        if (model_params.penalize_range)
+        {
+            tree.range_low  = best->best_xmin - best->best_xmax + tree.num_split;
+            tree.range_high = best->best_xmax - best->best_xmin + tree.num_split;
+        }
+    }
+
+    else
+    {
+        switch(model_params.cat_split_type)
+        {
+            case SingleCateg:
+            {
+                tree.chosen_cat = best->best_categ;
+                break;
+            }
+
+            case SubSet:
+            {
+                tree.cat_split.assign(best->best_split_categ.begin(),
+                                      best->best_split_categ.begin() + input_data.ncat[best->best_col - input_data.ncols_numeric]);
+                break;
+            }
+        }
+    }
+}
+
+/* Columns taken in the current hyperplane are those whose generation number matches the current
+   one, so starting a new hyperplane only requires increasing the counter instead of clearing an array */
+void clear_cols_taken(WorkerMemory &workspace)
+{
+    workspace.curr_gen++;
+    if (workspace.curr_gen == 0) /* overflow */
+    {
+        std::fill(workspace.col_taken_gen.begin(), workspace.col_taken_gen.end(), (size_t)0);
+        workspace.curr_gen = 1;
+    }
 }
 
-bool is_col_taken(std::vector<bool> &col_is_taken, std::unordered_set<size_t> &col_is_taken_s,
-                  InputData &input_data, size_t col_num, ColType col_type)
+bool is_col_taken(WorkerMemory &workspace, InputData &input_data, size_t col_num, ColType col_type)
 {
     col_num += ((col_type == Categorical)? 0 : input_data.ncols_categ);
-    if (col_is_taken.size())
-        return col_is_taken[col_num];
-    else
-        return col_is_taken_s.find(col_num) != col_is_taken_s.end();
+    return workspace.col_taken_gen[col_num] == workspace.curr_gen;
 }
 
-void set_col_as_taken(std::vector<bool> &col_is_taken, std::unordered_set<size_t> &col_is_taken_s,
-                      InputData &input_data, size_t col_num, ColType col_type)
+void set_col_as_taken(WorkerMemory &workspace, InputData &input_data, size_t col_num, ColType col_type)
 {
     col_num += ((col_type == Categorical)? 0 : input_data.ncols_categ);
-    if (col_is_taken.size())
-        col_is_taken[col_num] = true;
-    else
-        col_is_taken_s.insert(col_num);
+    workspace.col_taken_gen[col_num] = workspace.curr_gen;
 }
 
 void add_separation_step(WorkerMemory &workspace, InputData &input_data, double remainder)
 {
-    if (workspace.weights_arr.size())
-        increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                              input_data.nrows, workspace.tmat_sep.data(), workspace.weights_arr.data(), remainder);
-    else if (workspace.weights_map.size())
-        increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                              input_data.nrows, workspace.tmat_sep.data(), workspace.weights_map, remainder);
-    else
-        increase_comb_counter(workspace.ix_arr.data(), workspace.st, workspace.end,
-                              input_data.nrows, workspace.tmat_sep.data(), remainder);
+    /* Note: distances are only calculated when using the full sample, so the weights here
+       cannot be in a hash map, and the rows are taken as they come in the sample */
+    if (workspace.end <= workspace.st || workspace.end == SIZE_MAX)
+        return;
+
+    /* the order of the indices is used by the splitting procedures, so the sorting is done on a copy */
+    workspace.tmat_ix.assign(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
+    std::sort(workspace.tmat_ix.begin(), workspace.tmat_ix.end());
+    increase_comb_counter_striped(workspace.tmat_ix.data(), 0, workspace.tmat_ix.size() - 1,
+                                  input_data.nrows, *workspace.tmat_stripes,
+                                  workspace.weights_arr.size()? workspace.weights_arr.data() : (double*)NULL,
+                                  remainder);
 }
 
 void add_remainder_separation_steps(WorkerMemory &workspace, InputData &input_data, long double sum_weight)
@@ -275,14 +533,13 @@ void backup_recursion_state(WorkerMemory &workspace, RecursionState &recursion_s
     recursion_state.end_NA        = workspace.end_NA;
     recursion_state.split_ix      = workspace.split_ix;
     recursion_state.end           = workspace.end;
-    recursion_state.cols_possible = workspace.cols_possible;
-    recursion_state.col_sampler   = workspace.col_sampler;
+    recursion_state.col_sampler_mark = workspace.col_sampler.dropped.size();
 
     /* for the extended model, it's not necessary to copy everything */
     if (!workspace.comb_val.size())
     {
-        recursion_state.ix_arr = std::vector<size_t>(workspace.ix_arr.begin() + workspace.st_NA,
-                                                     workspace.ix_arr.begin() + workspace.end + 1);
+        recursion_state.ix_arr = std::vector<ix_t>(workspace.ix_arr.begin() + workspace.st_NA,
+                                                   workspace.ix_arr.begin() + workspace.end + 1);
         size_t tot = workspace.end - workspace.st_NA + 1;
         if (workspace.weights_arr.size() || workspace.weights_map.size())
             recursion_state.weights_arr = std::unique_ptr<double[]>(new double[tot]);
@@ -305,8 +562,7 @@ void restore_recursion_state(WorkerMemory &workspace, RecursionState &recursion_
     workspace.end_NA        = recursion_state.end_NA;
     workspace.split_ix      = recursion_state.split_ix;
     workspace.end           = recursion_state.end;
-    workspace.cols_possible = std::move(recursion_state.cols_possible);
-    workspace.col_sampler   = std::move(recursion_state.col_sampler);
+    restore_col_sampler(workspace.col_sampler, recursion_state.col_sampler_mark);
 
     if (!workspace.comb_val.size())
     {
@@ -322,3 +578,33 @@ void restore_recursion_state(WorkerMemory &workspace, RecursionState &recursion_
                 workspace.weights_map[workspace.ix_arr[ix + workspace.st_NA]] = recursion_state.weights_arr[ix];
     }
 }
+
+/* Weights for each column according to their kurtosis in the sample given by 'ix_arr'.
+   Note that for sparse inputs, this will sort the sample indices. */
+void calc_kurtosis_weights(double kurt_weights[], ix_t ix_arr[], size_t st, size_t end,
+                           InputData &input_data, ModelParams &model_params,
+                           double buffer_dbl[], size_t buffer_szt[], RNG_engine &rnd_generator)
+{
+    if (input_data.Xc_indptr == NULL)
+    {
+        calc_kurtosis_all_cols(ix_arr, st, end, input_data.numeric_data,
+                               input_data.nrows, input_data.ncols_numeric,
+                               model_params.missing_action, buffer_dbl, kurt_weights);
+    }
+
+    else
+    {
+        std::sort(ix_arr + st, ix_arr + end + 1);
+        for (size_t col = 0; col < input_data.ncols_numeric; col++)
+            kurt_weights[col] = calc_kurtosis(ix_arr, st, end, col,
+                                              input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr,
+                                              model_params.missing_action);
+    }
+
+    for (size_t col = 0; col < input_data.ncols_categ; col++)
+        kurt_weights[col + input_data.ncols_numeric] =
+            calc_kurtosis(ix_arr, st, end,
+                          input_data.categ_data + col * input_data.nrows, input_data.ncat[col],
+                          buffer_szt, buffer_dbl,
+                          model_params.missing_action, model_params.cat_split_type, rnd_generator);
+}
@@ -47,6 +47,46 @@
 
 /* TODO: this file is a complete mess, needs a refactor from scratch along with the data structs */
 
+#define IMPUTE_BLOCK_ROWS 256
+
+/* Collects the columns with missing values in a row, used for grouping rows by missing pattern */
+static void get_missing_pattern(PredictionData &prediction_data, Imputer &imputer, size_t row, std::vector<size_t> &pattern)
+{
+    pattern.clear();
+    if (prediction_data.numeric_data != NULL)
+    {
+        for (size_t col = 0; col < imputer.ncols_numeric; col++)
+            if (is_na_or_inf(prediction_data.numeric_data[row + col * prediction_data.nrows]))
+                pattern.push_back(col);
+    }
+
+    else if (prediction_data.Xr != NULL)
+    {
+        for (size_t ix = prediction_data.Xr_indptr[row]; ix < prediction_data.Xr_indptr[row + 1]; ix++)
+            if (is_na_or_inf(prediction_data.Xr[ix]))
+                pattern.push_back(prediction_data.Xr_ind[ix]);
+    }
+
+    if (prediction_data.categ_data != NULL)
+    {
+        for (size_t col = 0; col < imputer.ncols_categ; col++)
+            if (prediction_data.categ_data[row + col * prediction_data.nrows] < 0)
+                pattern.push_back(col + imputer.ncols_numeric);
+    }
+}
+
+/* FNV-1a hash of a missing pattern */
+struct MissingPatternHash
+{
+    size_t operator()(const std::vector<size_t> &pattern) const
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t col : pattern)
+            hash = (hash ^ (uint64_t)col) * 1099511628211ULL;
+        return (size_t)hash;
+    }
+};
+
 /* Impute missing values in new data
 * 
 * Parameters
@@ -117,73 +157,136 @@ void impute_missing_values(double numeric_data[], int categ_data[],
                                       NULL, NULL, NULL,
                                       Xr, Xr_ind, Xr_indptr};
 
-    std::vector<size_t> ix_arr(nrows);
-    std::iota(ix_arr.begin(), ix_arr.end(), (size_t) 0);
+    std::vector<ix_t> ix_arr(nrows);
+    std::iota(ix_arr.begin(), ix_arr.end(), (ix_t) 0);
 
     size_t end = check_for_missing(prediction_data, imputer, ix_arr.data(), nthreads);
 
     if (end == 0)
         return;
 
-    if ((size_t)nthreads > end)
-        nthreads = (int)end;
+    /* Rows with the same missing pattern need the same columns from each terminal node, so they
+       are grouped together and processed in blocks, passing each block through one tree at a time
+       (which keeps the tree and its imputation nodes in cache), with the sums of the whole block
+       in a single flat buffer. Each row still adds the trees in the same order as before.
+       The pattern of each row is obtained only once and mapped to an integer ID, so that the
+       sorting doesn't need to look at the data again. If most rows have a pattern of their own,
+       the grouping would not result in any larger blocks, so the rows are then passed one by one. */
+    std::vector<std::vector<size_t>> row_pattern(end);
+    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(end, row_pattern, prediction_data, imputer, ix_arr)
+    for (size_t_for row = 0; row < end; row++)
+        get_missing_pattern(prediction_data, imputer, ix_arr[row], row_pattern[row]);
+
+    std::vector<std::pair<size_t, ix_t>> patterns(end);
+    std::unordered_map<std::vector<size_t>, size_t, MissingPatternHash> pattern_id;
+    for (size_t row = 0; row < end; row++)
+    {
+        size_t next_id = pattern_id.size();
+        patterns[row] = {pattern_id.emplace(std::move(row_pattern[row]), next_id).first->second, ix_arr[row]};
+    }
+    row_pattern.clear();
+    row_pattern.shrink_to_fit();
+
+    std::vector<size_t> block_st;
+    if (2 * pattern_id.size() > end)
+    {
+        block_st.resize(end);
+        std::iota(block_st.begin(), block_st.end(), (size_t)0);
+    }
+
+    else
+    {
+        std::sort(patterns.begin(), patterns.end());
+        for (size_t row = 0; row < end; row++)
+        {
+            ix_arr[row] = patterns[row].second;
+            if (
+                row == 0 ||
+                row - block_st.back() >= IMPUTE_BLOCK_ROWS ||
+                patterns[row].first != patterns[row - 1].first
+                )
+                block_st.push_back(row);
+        }
+    }
+    block_st.push_back(end);
+    pattern_id.clear();
+    patterns.clear();
+    patterns.shrink_to_fit();
+    size_t n_blocks = block_st.size() - 1;
+
+    if ((size_t)nthreads > n_blocks)
+        nthreads = (int)n_blocks;
+    bool compact = imputer.imputer_tree_compact.size() > 0;
     #ifdef _OPENMP
         std::vector<ImputedData> imp_memory(nthreads);
+        std::vector<std::vector<imp_sum_t>> block_sums(nthreads);
     #else
         std::vector<ImputedData> imp_memory(1);
+        std::vector<std::vector<imp_sum_t>> block_sums(1);
     #endif
 
-
-    if (model_outputs != NULL)
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) \
+            shared(n_blocks, block_st, compact, imp_memory, block_sums, prediction_data, model_outputs, model_outputs_ext, ix_arr, imputer)
+    for (size_t_for block = 0; block < n_blocks; block++)
     {
-        #pragma omp parallel for schedule(dynamic) num_threads(nthreads) \
-                shared(end, imp_memory, prediction_data, model_outputs, ix_arr, imputer)
-        for (size_t_for row = 0; row < end; row++)
+        ImputedData &imp = imp_memory[omp_get_thread_num()];
+        std::vector<imp_sum_t> &sums = block_sums[omp_get_thread_num()];
+        size_t st       = block_st[block];
+        size_t st_next  = block_st[block + 1];
+
+        initialize_impute_calc(imp, prediction_data, imputer, ix_arr[st]);
+        imp.imputer = &imputer;
+        size_t row_size = 2 * (imp.n_missing_num + imp.n_missing_sp);
+        for (size_t ix = 0; ix < imp.n_missing_cat; ix++)
+            row_size += imputer.ncat[imp.missing_cat[ix]];
+        sums.assign(row_size * (st_next - st), 0);
+
+        if (model_outputs != NULL)
         {
-            initialize_impute_calc(imp_memory[omp_get_thread_num()], prediction_data, imputer, ix_arr[row]);
-
-            for (std::vector<IsoTree> &tree : model_outputs->trees)
+            for (size_t tree = 0; tree < model_outputs->trees.size(); tree++)
             {
-                traverse_itree(tree,
-                               *model_outputs,
-                               prediction_data,
-                               &imputer.imputer_tree[&tree - &(model_outputs->trees[0])],
-                               &imp_memory[omp_get_thread_num()],
-                               (double) 1,
-                               ix_arr[row],
-                               NULL,
-                               (size_t) 0);
+                if (compact) imp.compact_tree = &imputer.imputer_tree_compact[tree];
+                IsoTreeNodes tree_nodes(model_outputs->trees[tree], *model_outputs);
+                for (size_t row = st; row < st_next; row++)
+                {
+                    imp.row_sums = sums.data() + (row - st) * row_size;
+                    traverse_itree(tree_nodes,
+                                   prediction_data,
+                                   compact? NULL : &imputer.imputer_tree[tree],
+                                   &imp,
+                                   (double) 1,
+                                   ix_arr[row],
+                                   NULL,
+                                   (size_t) 0);
+                }
             }
-
-            apply_imputation_results(prediction_data, imp_memory[omp_get_thread_num()], imputer, (size_t) ix_arr[row]);
-
         }
-    }
 
-    else
-    {
-        double temp;
-        #pragma omp parallel for schedule(dynamic) num_threads(nthreads) \
-                shared(end, imp_memory, prediction_data, model_outputs_ext, ix_arr, imputer) \
-                private(temp)
-        for (size_t_for row = 0; row < end; row++)
+        else
         {
-            initialize_impute_calc(imp_memory[omp_get_thread_num()], prediction_data, imputer, ix_arr[row]);
-
-            for (std::vector<IsoHPlane> &hplane : model_outputs_ext->hplanes)
+            double temp;
+            for (size_t tree = 0; tree < model_outputs_ext->hplanes.size(); tree++)
             {
-                traverse_hplane(hplane,
-                                *model_outputs_ext,
-                                prediction_data,
-                                temp,
-                                &imputer.imputer_tree[&hplane - &(model_outputs_ext->hplanes[0])],
-                                &imp_memory[omp_get_thread_num()],
-                                NULL,
-                                ix_arr[row]);
+                if (compact) imp.compact_tree = &imputer.imputer_tree_compact[tree];
+                IsoHPlaneNodes hplane_nodes(model_outputs_ext->hplanes[tree], *model_outputs_ext);
+                for (size_t row = st; row < st_next; row++)
+                {
+                    imp.row_sums = sums.data() + (row - st) * row_size;
+                    traverse_hplane(hplane_nodes,
+                                    prediction_data,
+                                    temp,
+                                    compact? NULL : &imputer.imputer_tree[tree],
+                                    &imp,
+                                    NULL,
+                                    ix_arr[row]);
+                }
             }
+        }
 
-            apply_imputation_results(prediction_data, imp_memory[omp_get_thread_num()], imputer, (size_t) ix_arr[row]);
-
+        for (size_t row = st; row < st_next; row++)
+        {
+            imp.row_sums = sums.data() + (row - st) * row_size;
+            apply_imputation_results(prediction_data, imp, imputer, (size_t) ix_arr[row]);
         }
     }
 
@@ -403,7 +506,7 @@ void build_impute_node(ImputeNode &imputer,    WorkerMemory &workspace,
 
     if (input_data.Xc_indptr != NULL) /* sparse numeric */
     {
-        size_t *ix_arr = workspace.ix_arr.data();
+        ix_t *ix_arr = workspace.ix_arr.data();
         size_t st_col, end_col, ind_end_col, curr_pos;
         std::fill(imputer.num_weight.begin(), imputer.num_weight.end(), wsum);
 
@@ -413,7 +516,7 @@ void build_impute_node(ImputeNode &imputer,    WorkerMemory &workspace,
             end_col     =  input_data.Xc_indptr[col + 1] - 1;
             ind_end_col =  input_data.Xc_ind[end_col];
             curr_pos    =  st_col;
-            for (size_t *row = std::lower_bound(ix_arr + workspace.st, ix_arr + workspace.end + 1, input_data.Xc_ind[st_col]);
+            for (ix_t *row = std::lower_bound(ix_arr + workspace.st, ix_arr + workspace.end + 1, input_data.Xc_ind[st_col]);
                  row != ix_arr + workspace.end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
                 )
             {
@@ -656,140 +759,252 @@ void drop_nonterminal_imp_node(std::vector<ImputeNode>  &imputer_tree,
     imputer_tree.shrink_to_fit();
 }
 
-void combine_imp_single(ImputedData &imp_addfrom, ImputedData &imp_addto)
+static bool is_terminal_impute_node(const ImputeNode &node)
 {
-    size_t col;
-    for (size_t ix = 0; ix < imp_addfrom.n_missing_num; ix++)
-    {
-        imp_addto.num_sum[ix]    += imp_addfrom.num_sum[ix];
-        imp_addto.num_weight[ix] += imp_addfrom.num_weight[ix];
-    }
+    /* 'drop_nonterminal_imp_node' leaves the non-terminal nodes empty */
+    return node.num_sum.size() || node.cat_sum.size();
+}
+
+template <class real_t>
+static void fill_compact_values(const std::vector<ImputeNode> &impute_nodes, CompactImputeTree &compact_tree,
+                                size_t ncols_numeric, std::vector<real_t> &num_vals, std::vector<real_t> &cat_vals)
+{
+    num_vals.resize(2 * ncols_numeric * (compact_tree.cat_indptr.size() - 1));
+    cat_vals.resize(compact_tree.cat_col.size());
 
-    for (size_t ix = 0; ix < imp_addfrom.n_missing_cat; ix++)
+    size_t terminal = 0;
+    size_t entry = 0;
+    for (const ImputeNode &node : impute_nodes)
     {
-        col = imp_addfrom.missing_cat[ix];
-        for (size_t cat = 0; cat < imp_addto.cat_sum[col].size(); cat++)
+        if (!is_terminal_impute_node(node))
+            continue;
+
+        real_t *restrict node_vals = num_vals.data() + 2 * ncols_numeric * terminal;
+        for (size_t col = 0; col < node.num_sum.size(); col++)
         {
-            imp_addto.cat_sum[col][cat] += imp_addfrom.cat_sum[col][cat];
+            node_vals[col]                  =  node.num_sum[col];
+            node_vals[col + ncols_numeric]  =  node.num_weight[col];
         }
+
+        compact_tree.cat_indptr[terminal] = entry;
+        for (size_t col = 0; col < node.cat_sum.size(); col++)
+        {
+            for (size_t cat = 0; cat < node.cat_sum[col].size(); cat++)
+            {
+                if (node.cat_sum[col][cat] != 0)
+                {
+                    compact_tree.cat_col[entry] = (uint32_t) col;
+                    compact_tree.cat_cat[entry] = (uint32_t) cat;
+                    cat_vals[entry]             = node.cat_sum[col][cat];
+                    entry++;
+                }
+            }
+        }
+        terminal++;
     }
+    compact_tree.cat_indptr[terminal] = entry;
+}
 
-    for (size_t ix = 0; ix < imp_addfrom.n_missing_sp; ix++)
+void compact_impute_tree(const std::vector<ImputeNode> &impute_nodes, CompactImputeTree &compact_tree,
+                         size_t ncols_numeric, bool as_float)
+{
+    compact_tree.as_float       =  as_float;
+    compact_tree.terminal_ix.assign(impute_nodes.size(), UINT32_MAX);
+
+    size_t n_terminal = 0;
+    size_t n_entries  = 0;
+    for (size_t node = 0; node < impute_nodes.size(); node++)
     {
-        imp_addto.sp_num_sum[ix]    += imp_addfrom.sp_num_sum[ix];
-        imp_addto.sp_num_weight[ix] += imp_addfrom.sp_num_weight[ix];
+        if (!is_terminal_impute_node(impute_nodes[node]))
+            continue;
+        compact_tree.terminal_ix[node] = (uint32_t) n_terminal++;
+        for (const std::vector<double> &cat_sum : impute_nodes[node].cat_sum)
+            for (double cat : cat_sum)
+                n_entries += cat != 0;
     }
+
+    compact_tree.cat_indptr.resize(n_terminal + 1);
+    compact_tree.cat_col.resize(n_entries);
+    compact_tree.cat_cat.resize(n_entries);
+    if (!as_float)
+        fill_compact_values(impute_nodes, compact_tree, ncols_numeric, compact_tree.num_dbl, compact_tree.cat_dbl);
+    else
+        fill_compact_values(impute_nodes, compact_tree, ncols_numeric, compact_tree.num_flt, compact_tree.cat_flt);
 }
 
-void combine_tree_imputations(WorkerMemory &workspace,
-                              std::vector<ImputedData> &impute_vec,
-                              std::unordered_map<size_t, ImputedData> &impute_map,
-                              std::vector<char> &has_missing,
-                              int nthreads)
+/* Convert the imputation nodes of an already-fitted imputer to the compact layout
+* 
+* Parameters
+* ==========
+* - imputer (in, out)
+*       Imputer object fitted through 'fit_iforest'. Its member 'imputer_tree' will be emptied
+*       and member 'imputer_tree_compact' will be filled instead.
+* - as_float
+*       Whether to store the sums and weights as 'float' (32-bit) instead of 'double'. This
+*       halves the memory needed for them, at the expense of some precision in the imputations.
+* - nthreads
+*       Number of parallel threads to use.
+*/
+void compact_imputer(Imputer &imputer, bool as_float, int nthreads)
+{
+    size_t ntrees = imputer.imputer_tree.size();
+    if (!ntrees)
+        return;
+
+    imputer.imputer_tree_compact.resize(ntrees);
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(imputer, ntrees, as_float)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        compact_impute_tree(imputer.imputer_tree[tree], imputer.imputer_tree_compact[tree],
+                            imputer.ncols_numeric, as_float);
+        imputer.imputer_tree[tree].clear();
+        imputer.imputer_tree[tree].shrink_to_fit();
+    }
+
+    imputer.imputer_tree.clear();
+    imputer.imputer_tree.shrink_to_fit();
+}
+
+/* When imputing a block of rows with the same missing pattern, the sums of each row are kept in a
+   flat buffer laid out as [num_sum, num_weight, cat_sum] */
+static void get_imputed_sums(ImputedData &imp, imp_sum_t *&num_sum, imp_sum_t *&num_weight, imp_sum_t *&cat_sum)
 {
-    if (workspace.impute_vec.size())
+    if (imp.row_sums != NULL)
     {
-        #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(has_missing, workspace, impute_vec)
-        for (size_t_for row = 0; row < has_missing.size(); row++)
-            if (has_missing[row])
-                combine_imp_single(workspace.impute_vec[row], impute_vec[row]);
+        size_t n_num = imp.n_missing_num + imp.n_missing_sp;
+        num_sum    = imp.row_sums;
+        num_weight = imp.row_sums + n_num;
+        cat_sum    = imp.row_sums + 2 * n_num;
     }
 
-    else if (workspace.impute_map.size())
+    else
     {
-        #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(has_missing, workspace, impute_map)
-        for (size_t_for row = 0; row < has_missing.size(); row++)
-            if (has_missing[row])
-                combine_imp_single(workspace.impute_map[row], impute_map[row]);
+        num_sum    = imp.num_sum.data();
+        num_weight = imp.num_weight.data();
+        cat_sum    = imp.cat_sum.data();
     }
 }
 
-
 void add_from_impute_node(ImputeNode &imputer, ImputedData &imputed_data, double w)
 {
+    imp_sum_t *num_sum;
+    imp_sum_t *num_weight;
+    imp_sum_t *cat_sum;
+    get_imputed_sums(imputed_data, num_sum, num_weight, cat_sum);
+
     size_t col;
     for (size_t ix = 0; ix < imputed_data.n_missing_num; ix++)
     {
         col = imputed_data.missing_num[ix];
-        imputed_data.num_sum[ix]    += (!is_na_or_inf(imputer.num_sum[col]))? (w * imputer.num_sum[col]) : 0;
-        imputed_data.num_weight[ix] += w * imputer.num_weight[ix];
+        num_sum[ix]    += (!is_na_or_inf(imputer.num_sum[col]))? (w * imputer.num_sum[col]) : 0;
+        num_weight[ix] += w * imputer.num_weight[ix];
     }
 
     for (size_t ix = 0; ix < imputed_data.n_missing_sp; ix++)
     {
         col = imputed_data.missing_sp[ix];
-        imputed_data.sp_num_sum[ix]    += (!is_na_or_inf(imputer.num_sum[col]))? (w * imputer.num_sum[col]) : 0;
-        imputed_data.sp_num_weight[ix] += w * imputer.num_weight[ix];
+        num_sum[ix]    += (!is_na_or_inf(imputer.num_sum[col]))? (w * imputer.num_sum[col]) : 0;
+        num_weight[ix] += w * imputer.num_weight[ix];
     }
 
     for (size_t ix = 0; ix < imputed_data.n_missing_cat; ix++)
     {
         col = imputed_data.missing_cat[ix];
         for (size_t cat = 0; cat < imputer.cat_sum[col].size(); cat++)
-            imputed_data.cat_sum[col][cat] += w * imputer.cat_sum[col][cat];
+            cat_sum[cat] += w * imputer.cat_sum[col][cat];
+        cat_sum += imputer.cat_sum[col].size();
     }
 }
 
 
-void add_from_impute_node(ImputeNode &imputer, WorkerMemory &workspace, InputData &input_data)
+template <class real_t>
+static void add_from_compact_node(CompactImputeTree &compact_tree, Imputer &imputer,
+                                  const real_t *restrict num_vals, const real_t *restrict cat_vals,
+                                  size_t terminal, ImputedData &imputed_data, double w)
 {
-    if (workspace.impute_vec.size())
+    imp_sum_t *num_sum;
+    imp_sum_t *num_weight;
+    imp_sum_t *cat_sum;
+    get_imputed_sums(imputed_data, num_sum, num_weight, cat_sum);
+
+    const real_t *restrict node_sum    = num_vals + 2 * imputer.ncols_numeric * terminal;
+    const real_t *restrict node_weight = node_sum + imputer.ncols_numeric;
+    size_t col;
+    for (size_t ix = 0; ix < imputed_data.n_missing_num; ix++)
     {
-        if (!workspace.weights_arr.size() && !workspace.weights_map.size())
-        {
-            for (size_t row = workspace.st; row <= workspace.end;  row++)
-                if (input_data.has_missing[workspace.ix_arr[row]])
-                    add_from_impute_node(imputer,
-                                         workspace.impute_vec[workspace.ix_arr[row]],
-                                         (double)1);
-        }
+        col = imputed_data.missing_num[ix];
+        num_sum[ix]    += (!is_na_or_inf(node_sum[col]))? (w * node_sum[col]) : 0;
+        num_weight[ix] += w * node_weight[ix];
+    }
 
-        else if (workspace.weights_arr.size())
-        {
-            for (size_t row = workspace.st; row <= workspace.end;  row++)
-                if (input_data.has_missing[workspace.ix_arr[row]])
-                    add_from_impute_node(imputer,
-                                         workspace.impute_vec[workspace.ix_arr[row]],
-                                         workspace.weights_arr[workspace.ix_arr[row]]);
-        }
+    for (size_t ix = 0; ix < imputed_data.n_missing_sp; ix++)
+    {
+        col = imputed_data.missing_sp[ix];
+        num_sum[ix]    += (!is_na_or_inf(node_sum[col]))? (w * node_sum[col]) : 0;
+        num_weight[ix] += w * node_weight[ix];
+    }
 
-        else
-        {
-            for (size_t row = workspace.st; row <= workspace.end;  row++)
-                if (input_data.has_missing[workspace.ix_arr[row]])
-                    add_from_impute_node(imputer,
-                                         workspace.impute_vec[workspace.ix_arr[row]],
-                                         workspace.weights_map[workspace.ix_arr[row]]);
-        }
+    /* both the entries of the node and the missing columns are sorted by column */
+    size_t entry     = compact_tree.cat_indptr[terminal];
+    size_t end_entry = compact_tree.cat_indptr[terminal + 1];
+    for (size_t ix = 0; ix < imputed_data.n_missing_cat; ix++)
+    {
+        col = imputed_data.missing_cat[ix];
+        while (entry < end_entry && compact_tree.cat_col[entry] < col) entry++;
+        for (; entry < end_entry && compact_tree.cat_col[entry] == col; entry++)
+            cat_sum[compact_tree.cat_cat[entry]] += w * cat_vals[entry];
+        cat_sum += imputer.ncat[col];
     }
+}
+
+/* the number of columns and categories are taken from 'imputed_data.imputer' */
+void add_from_impute_node(CompactImputeTree &compact_tree, size_t node, ImputedData &imputed_data, double w)
+{
+    if (!compact_tree.as_float)
+        add_from_compact_node(compact_tree, *imputed_data.imputer,
+                              compact_tree.num_dbl.data(), compact_tree.cat_dbl.data(),
+                              compact_tree.terminal_ix[node], imputed_data, w);
+    else
+        add_from_compact_node(compact_tree, *imputed_data.imputer,
+                              compact_tree.num_flt.data(), compact_tree.cat_flt.data(),
+                              compact_tree.terminal_ix[node], imputed_data, w);
+}
+
+
+/* Note: the sums are shared across threads, and when using more than one thread, each row is
+   locked while adding to it */
+void add_from_impute_node(ImputeNode &imputer, WorkerMemory &workspace, InputData &input_data)
+{
+    ImputeStripes &impute_stripes = *workspace.impute_stripes;
+    if (!impute_stripes.impute_vec->size() && !impute_stripes.impute_map->size())
+        return;
 
-    else if (workspace.impute_map.size())
+    size_t row;
+    double w;
+    for (size_t ix = workspace.st; ix <= workspace.end; ix++)
     {
-        if (!workspace.weights_arr.size() && !workspace.weights_map.size())
-        {
-            for (size_t row = workspace.st; row <= workspace.end;  row++)
-                if (input_data.has_missing[workspace.ix_arr[row]])
-                    add_from_impute_node(imputer,
-                                         workspace.impute_map[workspace.ix_arr[row]],
-                                         (double)1);
-        }
+        row = workspace.ix_arr[ix];
+        if (!input_data.has_missing[row])
+            continue;
+
+        if (workspace.weights_arr.size())
+            w = workspace.weights_arr[row];
+        else if (workspace.weights_map.size())
+            w = workspace.weights_map[row];
+        else
+            w = 1;
 
-        else if (workspace.weights_arr.size())
+        ImputedData &imputed_data = impute_stripes.impute_vec->size()?
+                                    (*impute_stripes.impute_vec)[row] : impute_stripes.impute_map->find(row)->second;
+        if (impute_stripes.locks.size())
         {
-            for (size_t row = workspace.st; row <= workspace.end;  row++)
-                if (input_data.has_missing[workspace.ix_arr[row]])
-                    add_from_impute_node(imputer,
-                                         workspace.impute_map[workspace.ix_arr[row]],
-                                         workspace.weights_arr[workspace.ix_arr[row]]);
+            std::lock_guard<std::mutex> lock(impute_stripes.locks[row % impute_stripes.locks.size()]);
+            add_from_impute_node(imputer, imputed_data, w);
         }
 
         else
         {
-            for (size_t row = workspace.st; row <= workspace.end;  row++)
-                if (input_data.has_missing[workspace.ix_arr[row]])
-                    add_from_impute_node(imputer,
-                                         workspace.impute_map[workspace.ix_arr[row]],
-                                         workspace.weights_map[workspace.ix_arr[row]]);
+            add_from_impute_node(imputer, imputed_data, w);
         }
     }
 }
@@ -814,12 +1029,12 @@ void apply_imputation_results(imp_arr    &impute_vec,
                 if (is_na_or_inf(input_data.Xc[ix]))
                 {
                     row = input_data.Xc_ind[ix];
-                    if (impute_vec[row].sp_num_weight[row_pos[row]] > 0 && !is_na_or_inf(impute_vec[row].sp_num_sum[row_pos[row]]))
+                    if (impute_vec[row].num_weight[row_pos[row]] > 0 && !is_na_or_inf(impute_vec[row].num_sum[row_pos[row]]))
                         input_data.Xc[ix]
                             =
-                        impute_vec[row].sp_num_sum[row_pos[row]]
+                        impute_vec[row].num_sum[row_pos[row]]
                             /
-                        impute_vec[row].sp_num_weight[row_pos[row]];
+                        impute_vec[row].num_weight[row_pos[row]];
                     else
                         input_data.Xc[ix]
                             =
@@ -831,7 +1046,8 @@ void apply_imputation_results(imp_arr    &impute_vec,
         }
     }
 
-    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(input_data, impute_vec, imputer) private(col)
+    imp_sum_t *cat_sum;
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(input_data, impute_vec, imputer) private(col, cat_sum)
     for (size_t_for row = 0; row < input_data.nrows; row++)
     {
         if (input_data.has_missing[row])
@@ -849,19 +1065,19 @@ void apply_imputation_results(imp_arr    &impute_vec,
                     imputer.col_means[col];
             }
 
+            cat_sum = impute_vec[row].cat_sum.data();
             for (size_t ix = 0; ix < impute_vec[row].n_missing_cat; ix++)
             {
                 col = impute_vec[row].missing_cat[ix];
                 input_data.categ_data[row + col * input_data.nrows]
                     =
-                std::distance(impute_vec[row].cat_sum[col].begin(),
-                              std::max_element(impute_vec[row].cat_sum[col].begin(),
-                                                 impute_vec[row].cat_sum[col].end()));
+                std::distance(cat_sum, std::max_element(cat_sum, cat_sum + input_data.ncat[col]));
 
-                if (input_data.categ_data[row + col * input_data.nrows] == 0 && impute_vec[row].cat_sum[col][0] <= 0)
+                if (input_data.categ_data[row + col * input_data.nrows] == 0 && cat_sum[0] <= 0)
                     input_data.categ_data[row + col * input_data.nrows]
                         =
                     imputer.col_modes[col];
+                cat_sum += input_data.ncat[col];
             }
         }
     }
@@ -885,15 +1101,20 @@ void apply_imputation_results(PredictionData  &prediction_data,
                               Imputer         &imputer,
                               size_t          row)
 {
+    imp_sum_t *num_sum;
+    imp_sum_t *num_weight;
+    imp_sum_t *cat_sum;
+    get_imputed_sums(imp, num_sum, num_weight, cat_sum);
+
     size_t col;
     size_t pos = 0;
     for (size_t ix = 0; ix < imp.n_missing_num; ix++)
     {
         col = imp.missing_num[ix];
-        if (imp.num_weight[ix] > 0 && !is_na_or_inf(imp.num_sum[ix]))
+        if (num_weight[ix] > 0 && !is_na_or_inf(num_sum[ix]))
             prediction_data.numeric_data[row + col * prediction_data.nrows]
                 =
-            imp.num_sum[ix] / imp.num_weight[ix];
+            num_sum[ix] / num_weight[ix];
         else
             prediction_data.numeric_data[row + col * prediction_data.nrows]
                 =
@@ -905,10 +1126,10 @@ void apply_imputation_results(PredictionData  &prediction_data,
         {
             if (is_na_or_inf(prediction_data.Xr[ix]))
             {
-                if (imp.sp_num_weight[pos] > 0 && !is_na_or_inf(imp.sp_num_sum[pos]))
+                if (num_weight[pos] > 0 && !is_na_or_inf(num_sum[pos]))
                     prediction_data.Xr[ix]
                         =
-                    imp.sp_num_sum[pos] / imp.sp_num_weight[pos];
+                    num_sum[pos] / num_weight[pos];
                 else
                     prediction_data.Xr[ix]
                         =
@@ -922,13 +1143,13 @@ void apply_imputation_results(PredictionData  &prediction_data,
         col = imp.missing_cat[ix];
         prediction_data.categ_data[row + col * prediction_data.nrows]
                     =
-        std::distance(imp.cat_sum[col].begin(),
-                      std::max_element(imp.cat_sum[col].begin(), imp.cat_sum[col].end()));
+        std::distance(cat_sum, std::max_element(cat_sum, cat_sum + imputer.ncat[col]));
 
-        if (prediction_data.categ_data[row + col * prediction_data.nrows] == 0 && imp.cat_sum[col][0] <= 0)
+        if (prediction_data.categ_data[row + col * prediction_data.nrows] == 0 && cat_sum[0] <= 0)
             prediction_data.categ_data[row + col * prediction_data.nrows]
                 =
             imputer.col_modes[col];
+        cat_sum += imputer.ncat[col];
     }
 }
 
@@ -938,6 +1159,8 @@ void initialize_impute_calc(ImputedData &imp, InputData &input_data, size_t row)
     imp.n_missing_num = 0;
     imp.n_missing_cat = 0;
     imp.n_missing_sp  = 0;
+    imp.row_sums      = NULL;
+    imp.compact_tree  = NULL;
 
     if (input_data.numeric_data != NULL)
     {
@@ -968,8 +1191,9 @@ void initialize_impute_calc(ImputedData &imp, InputData &input_data, size_t row)
                 imp.missing_sp[imp.n_missing_sp++] = col;
             }
         }
-        imp.sp_num_sum.assign(imp.n_missing_sp,    0);
-        imp.sp_num_weight.assign(imp.n_missing_sp, 0);
+        imp.missing_sp.resize(imp.n_missing_sp);
+        imp.num_sum.assign(imp.n_missing_sp,    0);
+        imp.num_weight.assign(imp.n_missing_sp, 0);
     }
     
     if (input_data.categ_data != NULL)
@@ -979,10 +1203,10 @@ void initialize_impute_calc(ImputedData &imp, InputData &input_data, size_t row)
             if (input_data.categ_data[row + col * input_data.nrows] < 0)
                 imp.missing_cat[imp.n_missing_cat++] = col;
         imp.missing_cat.resize(imp.n_missing_cat);
-        imp.cat_weight.assign(imp.n_missing_cat, 0);
-        imp.cat_sum.resize(input_data.ncols_categ);
-        for (size_t cat = 0; cat < imp.n_missing_cat; cat++)
-            imp.cat_sum[imp.missing_cat[cat]].assign(input_data.ncat[imp.missing_cat[cat]], 0);
+        size_t n_cat_sum = 0;
+        for (size_t ix = 0; ix < imp.n_missing_cat; ix++)
+            n_cat_sum += input_data.ncat[imp.missing_cat[ix]];
+        imp.cat_sum.assign(n_cat_sum, 0);
     }
 }
 
@@ -991,6 +1215,8 @@ void initialize_impute_calc(ImputedData &imp, PredictionData &prediction_data, I
     imp.n_missing_num = 0;
     imp.n_missing_cat = 0;
     imp.n_missing_sp  = 0;
+    imp.row_sums      = NULL;
+    imp.compact_tree  = NULL;
 
     if (prediction_data.numeric_data != NULL)
     {
@@ -1021,16 +1247,16 @@ void initialize_impute_calc(ImputedData &imp, PredictionData &prediction_data, I
             if (is_na_or_inf(prediction_data.Xr[ix]))
                 imp.missing_sp[imp.n_missing_sp++] = prediction_data.Xr_ind[ix];
 
-        if (!imp.sp_num_sum.size())
+        if (!imp.num_sum.size())
         {
-            imp.sp_num_sum.resize(imputer.ncols_numeric,    0);
-            imp.sp_num_weight.resize(imputer.ncols_numeric, 0);
+            imp.num_sum.resize(imputer.ncols_numeric,    0);
+            imp.num_weight.resize(imputer.ncols_numeric, 0);
         }
 
         else
         {
-            std::fill(imp.sp_num_sum.begin(),     imp.sp_num_sum.begin()    + imp.n_missing_sp,  0);
-            std::fill(imp.sp_num_weight.begin(),  imp.sp_num_weight.begin() + imp.n_missing_sp,  0);
+            std::fill(imp.num_sum.begin(),     imp.num_sum.begin()    + imp.n_missing_sp,  0);
+            std::fill(imp.num_weight.begin(),  imp.num_weight.begin() + imp.n_missing_sp,  0);
         }
     }
     
@@ -1044,21 +1270,17 @@ void initialize_impute_calc(ImputedData &imp, PredictionData &prediction_data, I
                 imp.missing_cat[imp.n_missing_cat++] = col;
         }
 
-        if (!imp.cat_weight.size())
+        if (!imp.cat_sum.size())
         {
-            imp.cat_weight.resize(imputer.ncols_categ, 0);
-            imp.cat_sum.resize(imputer.ncols_categ);
-            for (size_t col = 0; col < imputer.ncols_categ; col++)
-                imp.cat_sum[col].resize(imputer.ncat[col], 0);
+            imp.cat_sum.resize(std::accumulate(imputer.ncat.begin(), imputer.ncat.end(), (size_t)0), 0);
         }
 
         else
         {
-            std::fill(imp.cat_weight.begin(), imp.cat_weight.begin() + imp.n_missing_cat, 0);
-            for (size_t col = 0; col < imp.n_missing_cat; col++)
-                std::fill(imp.cat_sum[imp.missing_cat[col]].begin(),
-                          imp.cat_sum[imp.missing_cat[col]].end(),
-                          0);
+            size_t n_cat_sum = 0;
+            for (size_t ix = 0; ix < imp.n_missing_cat; ix++)
+                n_cat_sum += imputer.ncat[imp.missing_cat[ix]];
+            std::fill(imp.cat_sum.begin(), imp.cat_sum.begin() + n_cat_sum, 0);
         }
     }
 }
@@ -1147,7 +1369,7 @@ void check_for_missing(InputData &input_data,
 
 size_t check_for_missing(PredictionData  &prediction_data,
                          Imputer         &imputer,
-                         size_t          ix_arr[],
+                         ix_t          ix_arr[],
                          int             nthreads)
 {
     std::vector<char> has_missing(prediction_data.nrows, false);
@@ -52,13 +52,14 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                            size_t                   curr_depth)
 {
     long double sum_weight = -HUGE_VAL;
+    MissingAction missing_action = model_params.missing_action;
+    bool is_split = false;
 
     /* calculate imputation statistics if desired */
     if (impute_nodes != NULL)
     {
         if (input_data.Xc_indptr != NULL)
-            std::sort(workspace.ix_arr.begin() + workspace.st,
-                      workspace.ix_arr.begin() + workspace.end + 1);
+            ensure_sorted_ix(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.buffer_ix.data());
         build_impute_node(impute_nodes->back(), workspace,
                           input_data, model_params,
                           *impute_nodes, curr_depth,
@@ -82,7 +83,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
 
     /* for sparse matrices, need to sort the indices */
     if (input_data.Xc_indptr != NULL && impute_nodes == NULL)
-        std::sort(workspace.ix_arr.begin() + workspace.st, workspace.ix_arr.begin() + workspace.end + 1);
+        ensure_sorted_ix(workspace.ix_arr.data(), workspace.st, workspace.end, workspace.buffer_ix.data());
 
     /* pick column to split according to criteria */
     workspace.prob_split_type = workspace.rbin(workspace.rnd_generator);
@@ -107,100 +108,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
             workspace.criterion = Pooled;
 
         /* evaluate gain for all columns */
-        trees.back().score = -HUGE_VAL; /* this is used to track the best gain */
-        if (input_data.Xc_indptr == NULL)
-        {
-            for (size_t col = 0; col < input_data.ncols_numeric; col++)
-            {
-                workspace.this_gain = eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                       input_data.numeric_data + col * input_data.nrows,
-                                                       workspace.split_ix, workspace.this_split_point,
-                                                       workspace.xmin, workspace.xmax,
-                                                       workspace.criterion, model_params.min_gain,
-                                                       model_params.missing_action);
-                if (workspace.this_gain <= -HUGE_VAL)
-                {
-                    workspace.cols_possible[col] = false;
-                }
-
-                else if (workspace.this_gain > trees.back().score)
-                {
-                    trees.back().score     = workspace.this_gain;
-                    trees.back().col_num   = col;
-                    trees.back().num_split = workspace.this_split_point;
-                    if (model_params.penalize_range)
-                    {
-                        trees.back().range_low  = workspace.xmin - workspace.xmax + trees.back().num_split;
-                        trees.back().range_high = workspace.xmax - workspace.xmin + trees.back().num_split;
-                    }
-                }
-            }
-
-        }
-
-        else
-        {
-            for (size_t col = 0; col < input_data.ncols_numeric; col++)
-            {
-                workspace.this_gain = eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                       col, input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr,
-                                                       workspace.buffer_dbl.data(), workspace.buffer_szt.data(),
-                                                       workspace.this_split_point, workspace.xmin, workspace.xmax,
-                                                       workspace.criterion, model_params.min_gain, model_params.missing_action);
-                if (workspace.this_gain <= -HUGE_VAL)
-                {
-                    workspace.cols_possible[col] = false;
-                }
-
-                else if (workspace.this_gain > trees.back().score)
-                {
-                    trees.back().score     = workspace.this_gain;
-                    trees.back().col_num   = col;
-                    trees.back().num_split = workspace.this_split_point;
-                    if (model_params.penalize_range)
-                    {
-                        trees.back().range_low  = workspace.xmin - workspace.xmax + trees.back().num_split;
-                        trees.back().range_high = workspace.xmax - workspace.xmin + trees.back().num_split;
-                    }
-                }
-            }
-        }
-
-        for (size_t col = 0; col < input_data.ncols_categ; col++)
-        {
-            workspace.this_gain = eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
-                                                   input_data.categ_data + col * input_data.nrows, input_data.ncat[col],
-                                                   workspace.buffer_szt.data(), workspace.buffer_szt.data() + input_data.max_categ,
-                                                   workspace.buffer_dbl.data(), workspace.this_categ, workspace.this_split_categ.data(),
-                                                   workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
-                                                   model_params.all_perm, model_params.missing_action, model_params.cat_split_type);
-            if (workspace.this_gain <= -HUGE_VAL)
-            {
-                workspace.cols_possible[col + input_data.ncols_numeric] = false;
-            }
-
-            else if (workspace.this_gain > trees.back().score)
-            {
-                trees.back().score    = workspace.this_gain;
-                trees.back().col_num  = col + input_data.ncols_numeric;
-                switch(model_params.cat_split_type)
-                {
-                    case SingleCateg:
-                    {
-                        trees.back().chosen_cat = workspace.this_categ;
-                        break;
-                    }
-
-                    case SubSet:
-                    {
-                        trees.back().cat_split.assign(workspace.this_split_categ.begin(),
-                                                      workspace.this_split_categ.begin() + input_data.ncat[col]);
-                        break;
-                    }
-                }
-            }
-        }
-
+        eval_guided_split_all_cols(workspace, input_data, model_params, trees.back());
 
         if (trees.back().score <= 0.)
             goto terminal_statistics;
@@ -252,143 +160,32 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
             workspace.criterion = NoCrit;
 
 
-        /* pick column at random */
-        decide_column(input_data.ncols_numeric, input_data.ncols_categ,
-                      trees.back().col_num, trees.back().col_type,
-                      workspace.rnd_generator, workspace.runif,
-                      workspace.col_sampler);
-
-        /* get the range of possible splits */
-        get_split_range(workspace, input_data, model_params, trees.back());
-
-        /* if it's not possible to split, will have to try more */
-        if (workspace.unsplittable)
+        /* pick column at random among the ones that are still available, discarding
+           those that turn out to be unsplittable along the way */
+        while (true)
         {
-            /* keep track of which columns are tried */
-            add_unsplittable_col(workspace, trees.back(), input_data);
+            /* if no further splits are possible, end the procedure here */
+            if (!workspace.col_sampler.n_active) goto terminal_statistics;
 
-            /* try more random columns for {(1/2) * ncols} times */
-            workspace.ncols_tried = 1;
-            do
-            {
-                decide_column(input_data.ncols_numeric, input_data.ncols_categ,
-                              trees.back().col_num, trees.back().col_type,
-                              workspace.rnd_generator, workspace.runif,
-                              workspace.col_sampler);
-                if (!check_is_not_unsplittable_col(workspace, trees.back(), input_data))
-                {
-                    get_split_range(workspace, input_data, model_params, trees.back());
-                    if (!workspace.unsplittable)
-                        break;
-                    else
-                        add_unsplittable_col(workspace, trees.back(), input_data);
-                }
-                workspace.ncols_tried++;
-            }
-            while (workspace.ncols_tried < input_data.ncols_tot / 2);
+            decide_column(input_data.ncols_numeric, input_data.ncols_categ,
+                          trees.back().col_num, trees.back().col_type,
+                          workspace.rnd_generator, workspace.col_sampler);
 
-            /* if that didn't work, then check all the columns that are still splittable */
-            if (workspace.unsplittable)
-            {
-                workspace.ncols_tried = 0; /* note: this is used here as a counter for the number of still splittable columns */
-                if (input_data.Xc_indptr == NULL)
-                {
-                    for (size_t col = 0; col < input_data.ncols_numeric; col++)
-                    {
-                        if (!workspace.cols_possible[col]) continue;
-                        get_range(workspace.ix_arr.data(), input_data.numeric_data + input_data.nrows * col,
-                                  workspace.st, workspace.end, model_params.missing_action,
-                                  workspace.xmin, workspace.xmax, workspace.unsplittable);
-                        workspace.cols_possible[col] = !workspace.unsplittable;
-                        workspace.ncols_tried += !workspace.unsplittable;
-                    }
-                }
-
-                else
-                {
-                    for (size_t col = 0; col < input_data.ncols_numeric; col++)
-                    {
-                        if (!workspace.cols_possible[col]) continue;
-                        get_range(workspace.ix_arr.data(), workspace.st, workspace.end, col,
-                                  input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr,
-                                  model_params.missing_action, workspace.xmin, workspace.xmax, workspace.unsplittable);
-                        workspace.cols_possible[col] = !workspace.unsplittable;
-                        workspace.ncols_tried += !workspace.unsplittable;
-                    }
-                }
-
-                for (size_t col = 0; col < input_data.ncols_categ; col++)
-                {
-                    if (!workspace.cols_possible[col + input_data.ncols_numeric]) continue;
-                    get_categs(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * col,
-                               workspace.st, workspace.end, input_data.ncat[col],
-                               model_params.missing_action, workspace.categs.data(), workspace.npresent, workspace.unsplittable);
-                    workspace.cols_possible[col + input_data.ncols_numeric] = !workspace.unsplittable;
-                    workspace.ncols_tried += !workspace.unsplittable;
-                }
-            
-
-                /* if no further splits are possible, end the procedure here */
-                workspace.npresent = workspace.ncols_tried;
-                if (!workspace.npresent) goto terminal_statistics;
-
-                /* otherwise, pick a column at random from the possible ones */
-                if (!workspace.col_sampler.max())
-                {
-                    /* no weights by columns */
-                    trees.back().col_num = std::uniform_int_distribution<size_t>
-                                                    (0, workspace.npresent - 1)
-                                                    (workspace.rnd_generator);
-                    workspace.ncols_tried = 0;
-                    for (size_t col = 0; col < input_data.ncols_tot; col++)
-                    {
-
-                        if (workspace.cols_possible[col])
-                        {
-                            if (workspace.ncols_tried == trees.back().col_num)
-                            {
-                                if (col < input_data.ncols_numeric)
-                                {
-                                    trees.back().col_num  = col;
-                                    trees.back().col_type = Numeric;
-                                } 
-
-                                else
-                                {
-                                    trees.back().col_num  = col - input_data.ncols_numeric;
-                                    trees.back().col_type = Categorical;
-                                }
-                                break;
-                            }
-                            workspace.ncols_tried++;
-                        }
-
-                    }
-                }
-
-                else
-                {
-                    /* weights by columns */
-                    std::vector<double> col_weights = workspace.col_sampler.probabilities();
-                    update_col_sampler(workspace, input_data);
-
-                    decide_column(input_data.ncols_numeric, input_data.ncols_categ,
-                                  trees.back().col_num, trees.back().col_type,
-                                  workspace.rnd_generator, workspace.runif,
-                                  workspace.col_sampler);
-                }
-
-            }
-
-            /* finally, check the range if needed, and later decide on the split point */
-            if (workspace.criterion == NoCrit)
-                get_split_range(workspace, input_data, model_params, trees.back());
+            /* get the range of possible splits */
+            get_split_range(workspace, input_data, model_params, trees.back());
+            if (!workspace.unsplittable)
+                break;
 
+            /* keep track of which columns are tried */
+            add_unsplittable_col(workspace, trees.back(), input_data);
         }
 
     }
 
 
+    /* columns that have no missing values are split without checking for NAs */
+    missing_action = col_missing_action(input_data, model_params, trees.back().col_num, trees.back().col_type);
+
     /* for numeric, choose a random point, or pick the best point as determined earlier */
     if (trees.back().col_type == Numeric)
     {
@@ -413,11 +210,11 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                          workspace.split_ix, trees.back().num_split,
                                          workspace.xmin, workspace.xmax,
                                          workspace.criterion, model_params.min_gain,
-                                         model_params.missing_action);
-                        if (model_params.missing_action == Fail) /* data is already split */
+                                         missing_action);
+                        if (missing_action == Fail) /* data is already split */
                         {
                             workspace.split_ix++;
-                            goto follow_branches;
+                            is_split = true;
                         }
                     }
 
@@ -425,10 +222,10 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                     {
                         eval_guided_crit(workspace.ix_arr.data(), workspace.st, workspace.end,
                                          trees.back().col_num, input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr,
-                                         workspace.buffer_dbl.data(), workspace.buffer_szt.data(),
+                                         workspace.buffer_dbl.data(), workspace.buffer_ix.data(),
                                          trees.back().num_split, workspace.xmin, workspace.xmax,
                                          workspace.criterion, model_params.min_gain,
-                                         model_params.missing_action);
+                                         missing_action);
                     }
                     break;
                 }
@@ -441,14 +238,19 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
             }
         }
         
-        if (input_data.Xc_indptr == NULL)
-            divide_subset_split(workspace.ix_arr.data(), input_data.numeric_data + input_data.nrows * trees.back().col_num,
-                                workspace.st, workspace.end, trees.back().num_split, model_params.missing_action,
-                                workspace.st_NA, workspace.end_NA, workspace.split_ix);
-        else
-            divide_subset_split(workspace.ix_arr.data(), workspace.st, workspace.end, trees.back().col_num,
-                                input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr, trees.back().num_split,
-                                model_params.missing_action, workspace.st_NA, workspace.end_NA, workspace.split_ix);
+        /* data is already split if the gain was evaluated without NAs */
+        if (!is_split)
+        {
+            if (input_data.Xc_indptr == NULL)
+                divide_subset_split(workspace.ix_arr.data(), input_data.numeric_data + input_data.nrows * trees.back().col_num,
+                                    workspace.st, workspace.end, trees.back().num_split, missing_action,
+                                    workspace.st_NA, workspace.end_NA, workspace.split_ix);
+            else
+                divide_subset_split(workspace.ix_arr.data(), workspace.st, workspace.end, trees.back().col_num,
+                                    input_data.Xc, input_data.Xc_ind, input_data.Xc_indptr, trees.back().num_split,
+                                    missing_action, workspace.st_NA, workspace.end_NA, workspace.split_ix,
+                                    workspace.buffer_ix.data());
+        }
     } 
 
     /* for categorical, there are different ways of splitting */
@@ -459,7 +261,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
         {
             trees.back().chosen_cat = 0;
             divide_subset_split(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * trees.back().col_num,
-                                workspace.st, workspace.end, (int)0, model_params.missing_action,
+                                workspace.st, workspace.end, (int)0, missing_action,
                                 workspace.st_NA, workspace.end_NA, workspace.split_ix);
             trees.back().cat_split.clear();
             trees.back().cat_split.shrink_to_fit();
@@ -493,7 +295,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                                  workspace.buffer_szt.data(), workspace.buffer_szt.data() + input_data.max_categ,
                                                  workspace.buffer_dbl.data(), trees.back().chosen_cat, workspace.this_split_categ.data(),
                                                  workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
-                                                 model_params.all_perm, model_params.missing_action, model_params.cat_split_type);
+                                                 model_params.all_perm, missing_action, model_params.cat_split_type);
                                 break;
                             }
                         }
@@ -501,7 +303,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
 
 
                     divide_subset_split(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * trees.back().col_num,
-                                        workspace.st, workspace.end, trees.back().chosen_cat, model_params.missing_action,
+                                        workspace.st, workspace.end, trees.back().chosen_cat, missing_action,
                                         workspace.st_NA, workspace.end_NA, workspace.split_ix);
                     break;
                 }
@@ -545,7 +347,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                                  workspace.buffer_szt.data(), workspace.buffer_szt.data() + input_data.max_categ,
                                                  workspace.buffer_dbl.data(), trees.back().chosen_cat, trees.back().cat_split.data(),
                                                  workspace.buffer_chr.data(), workspace.criterion, model_params.min_gain,
-                                                 model_params.all_perm, model_params.missing_action, model_params.cat_split_type);
+                                                 model_params.all_perm, missing_action, model_params.cat_split_type);
                                 break;
                             }
                         }
@@ -557,7 +359,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                 trees.back().cat_split[cat] = workspace.rbin(workspace.rnd_generator) < 0.5;
 
                     divide_subset_split(workspace.ix_arr.data(), input_data.categ_data + input_data.nrows * trees.back().col_num,
-                                        workspace.st, workspace.end, trees.back().cat_split.data(), model_params.missing_action,
+                                        workspace.st, workspace.end, trees.back().cat_split.data(), missing_action,
                                         workspace.st_NA, workspace.end_NA, workspace.split_ix);
                 }
 
@@ -568,17 +370,23 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
     }
 
 
+    /* if the column had no NAs, the split was done as with 'missing_action=Fail' */
+    if (missing_action != model_params.missing_action)
+    {
+        workspace.st_NA  = workspace.split_ix;
+        workspace.end_NA = workspace.split_ix;
+    }
+
     /* if it hasn't reached the limit, continue splitting from here */
-    follow_branches:
     {
         /* add another round of separation depth for distance */
         if (model_params.calc_dist && curr_depth > 0)
             add_separation_step(workspace, input_data, (double)(-1));
         
         size_t tree_from = trees.size() - 1;
-        size_t ix2, ix3;
-        std::unique_ptr<std::vector<bool>> cols_possible_ptr;
-        std::unique_ptr<std::discrete_distribution<size_t>> col_sampler_ptr;
+        size_t ix2 = workspace.split_ix;
+        size_t ix3 = workspace.end;
+        size_t col_sampler_mark = workspace.col_sampler.dropped.size();
         trees.back().score = -1;
 
         /* compute statistics for NAs and remember recursion indices/weights */
@@ -624,15 +432,6 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
                                             /
                                          (long double) (workspace.end - workspace.st + 1);
 
-            ix2 = workspace.split_ix;
-            ix3 = workspace.end;
-            cols_possible_ptr  = std::unique_ptr<std::vector<bool>>(new std::vector<bool>);
-            *cols_possible_ptr = workspace.cols_possible;
-            if (workspace.col_sampler.max())
-            {
-                col_sampler_ptr  = std::unique_ptr<std::discrete_distribution<size_t>>(new std::discrete_distribution<size_t>);
-                *col_sampler_ptr = workspace.col_sampler;
-            }
             workspace.end = workspace.split_ix - 1;
         }
 
@@ -696,9 +495,7 @@ void split_itree_recursive(std::vector<IsoTree>     &trees,
         {
             workspace.st  = ix2;
             workspace.end = ix3;
-            workspace.cols_possible = std::move(*cols_possible_ptr);
-            if (col_sampler_ptr)
-                workspace.col_sampler = std::move(*col_sampler_ptr);
+            restore_col_sampler(workspace.col_sampler, col_sampler_mark);
         }
 
         trees[tree_from].tree_right = trees.size();
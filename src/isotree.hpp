@@ -53,6 +53,8 @@
 #include <iterator>
 #include <numeric>
 #include <algorithm>
+#include <functional>
+#include <limits>
 #include <random>
 #include <unordered_set>
 #include <unordered_map>
@@ -60,6 +62,8 @@
 #include <utility>
 #include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <atomic>
 #ifndef _FOR_R
     #include <stdio.h> 
 #else
@@ -80,15 +84,16 @@
     #include <fstream>
 #endif
 
-/* By default, will use Mersenne-Twister for RNG, but can be switched to something faster */
+/* By default, will use Mersenne-Twister for RNG, but can be switched to something faster
+   (either at compile time through this macro, or at runtime through 'RNGType') */
 #ifdef _USE_MERSENNE_TWISTER
     #if SIZE_MAX >= UINT64_MAX /* 64-bit systems or higher */
-        #define RNG_engine std::mt19937_64
+        typedef std::mt19937_64 RNG_default;
     #else /* 32-bit systems and non-standard architectures */
-        #define RNG_engine std::mt19937
+        typedef std::independent_bits_engine<std::mt19937, 64, uint64_t> RNG_default;
     #endif
 #else
-    #define RNG_engine std::default_random_engine
+    typedef std::independent_bits_engine<std::default_random_engine, 64, uint64_t> RNG_default;
 #endif
 
 /* Short functions */
@@ -99,6 +104,7 @@
 #define square(x) ((x) * (x))
 /* https://stackoverflow.com/questions/2249731/how-do-i-get-bit-by-bit-data-from-an-integer-value-in-c */
 #define extract_bit(number, bit) (((number) >> (bit)) & 1)
+#define ix_comb(i, j, n, ncomb) (  ((ncomb)  + ((j) - (i))) - 1 - (((n) - (i)) * ((n) - (i) - 1)) / 2  )
 #ifndef isinf
     #define isinf std::isinf
 #endif
@@ -143,6 +149,25 @@
     #define sparse_ix size_t
 #endif
 
+/* For the row indices that get partitioned while building the trees and when calculating
+   distances or imputations - using 32-bit integers halves the memory traffic of those loops,
+   but limits the data to less than 2^32 rows (R matrices will never have that many rows) */
+#if defined(_FOR_R) || defined(_USE_32BIT_INDICES)
+    #define ix_t uint32_t
+#else
+    #define ix_t size_t
+#endif
+
+
+/* For the sums of imputed values that are accumulated for each row with missing values - by default these
+   are 'long double', which on x86 takes 16 bytes per value; using 'double' halves their memory usage at the
+   expense of some precision when adding the values from many trees */
+#ifdef _USE_DOUBLE_IMPUTE_SUMS
+    #define imp_sum_t double
+#else
+    #define imp_sum_t long double
+#endif
+
 
 /* Types used through the package */
 typedef enum  NewCategAction {Weighted, Smallest, Random}      NewCategAction; /* Weighted means Impute in the extended model */
@@ -153,6 +178,11 @@ typedef enum  GainCriterion  {Averaged, Pooled,   NoCrit}      Criterion;      /
 typedef enum  CoefType       {Uniform,  Normal}                CoefType;       /* For extended model */
 typedef enum  UseDepthImp    {Lower,    Higher,   Same}        UseDepthImp;    /* For NA imputation */
 typedef enum  WeighImpRows   {Inverse,  Prop,     Flat}        WeighImpRows;   /* For NA imputation */
+typedef enum  RNGType        {MersenneTwister, Xoshiro}        RNGType;
+typedef enum  MappedDataUse  {UseForFitting, UseForPrediction, UseForImputation} MappedDataUse; /* For mapped data files */
+
+/* Produces the next chunk of rows when fitting to data read in parts - see 'fit_iforest_streaming' */
+typedef size_t (*ChunkReader)(void *reader_data, double **numeric_data, int **categ_data, double **sample_weights);
 
 /* Notes about new categorical action:
 *  - For single-variable case, if using 'Smallest', can then pass data at prediction time
@@ -338,26 +368,104 @@ typedef struct ImputeNode {
 
 } ImputeNode; /* this is for each tree node */
 
+/* Imputation nodes of a tree in the layout produced by 'compact_imputer': only the terminal
+   nodes are kept, with their numeric sums and weights one node after another in a flat array
+   (after the look-ups to parent nodes, every numeric column has data at every terminal node),
+   and with only the non-zero category sums, stored as (column, category, value) entries. */
+typedef struct CompactImputeTree {
+    bool                   as_float;    /* whether the values are in the 'float' arrays instead of the 'double' ones */
+    std::vector<uint32_t>  terminal_ix; /* position of each tree node among the terminal nodes */
+    std::vector<double>    num_dbl;     /* 'num_sum' followed by 'num_weight' for each terminal node */
+    std::vector<float>     num_flt;
+    std::vector<size_t>    cat_indptr;  /* entries of terminal node 'i' are in [cat_indptr[i], cat_indptr[i+1]) */
+    std::vector<uint32_t>  cat_col;
+    std::vector<uint32_t>  cat_cat;
+    std::vector<double>    cat_dbl;
+    std::vector<float>     cat_flt;
+
+    #ifdef _ENABLE_CEREAL
+    template<class Archive>
+    void serialize(Archive &archive)
+    {
+        archive(
+            this->as_float,
+            this->terminal_ix,
+            this->num_dbl,
+            this->num_flt,
+            this->cat_indptr,
+            this->cat_col,
+            this->cat_cat,
+            this->cat_dbl,
+            this->cat_flt
+            );
+    }
+    #endif
+    CompactImputeTree() = default;
+
+} CompactImputeTree;
+
 typedef struct Imputer {
     size_t               ncols_numeric;
     size_t               ncols_categ;
     std::vector<int>     ncat;
     std::vector<std::vector<ImputeNode>> imputer_tree;
+    std::vector<CompactImputeTree> imputer_tree_compact; /* used instead of 'imputer_tree' after 'compact_imputer' */
     std::vector<double>  col_means;
     std::vector<int>     col_modes;
 
     #ifdef _ENABLE_CEREAL
+    /* imputers in the compact layout are written with a leading SIZE_MAX in place of
+       'ncols_numeric', so that the format of the non-compact ones remains the same */
     template<class Archive>
-    void serialize(Archive &archive)
+    void save(Archive &archive) const
     {
-        archive(
-            this->ncols_numeric,
-            this->ncols_categ,
-            this->ncat,
-            this->imputer_tree,
-            this->col_means,
-            this->col_modes
-            );
+        if (!this->imputer_tree_compact.size())
+            archive(
+                this->ncols_numeric,
+                this->ncols_categ,
+                this->ncat,
+                this->imputer_tree,
+                this->col_means,
+                this->col_modes
+                );
+        else
+            archive(
+                (size_t) SIZE_MAX,
+                this->ncols_numeric,
+                this->ncols_categ,
+                this->ncat,
+                this->imputer_tree_compact,
+                this->col_means,
+                this->col_modes
+                );
+    }
+
+    template<class Archive>
+    void load(Archive &archive)
+    {
+        size_t first_field;
+        archive(first_field);
+        if (first_field != SIZE_MAX)
+        {
+            this->ncols_numeric = first_field;
+            archive(
+                this->ncols_categ,
+                this->ncat,
+                this->imputer_tree,
+                this->col_means,
+                this->col_modes
+                );
+        }
+
+        else
+            archive(
+                this->ncols_numeric,
+                this->ncols_categ,
+                this->ncat,
+                this->imputer_tree_compact,
+                this->col_means,
+                this->col_modes
+                );
     }
     #endif
 
@@ -366,7 +474,223 @@ typedef struct Imputer {
 } Imputer;
 
 
+/* Data from a file mapped into memory through 'map_data_file' - the pointers are into the file itself */
+typedef struct MappedData {
+    double*     numeric_data;
+    size_t      ncols_numeric;
+    int*        categ_data;
+    size_t      ncols_categ;
+    int*        ncat;
+    double*     Xc;           /* only for sparse matrices */
+    sparse_ix*  Xc_ind;       /* only for sparse matrices */
+    sparse_ix*  Xc_indptr;    /* only for sparse matrices */
+    size_t      nrows;
+    void*       mapped_addr;
+    size_t      mapped_size;
+} MappedData;
+
+/* Index of the terminal nodes at which the rows of a reference set end up in each tree of a
+   model, built through 'build_neighbors_index' and queried through 'query_neighbors_index' */
+typedef struct NeighborsIndex {
+    size_t               nrows;
+    std::vector<size_t>  node_offset;   /* where the nodes of each tree start in the arrays below, plus the total */
+    std::vector<size_t>  parent;        /* indices within the same tree */
+    std::vector<size_t>  depth;
+    std::vector<size_t>  range_st;      /* rows under a node are at positions [range_st, range_end) in 'ordered_rows' */
+    std::vector<size_t>  range_end;
+    std::vector<size_t>  ordered_rows;  /* [tree * nrows + pos] - rows sorted by the depth-first order of their terminal node */
+    std::vector<size_t>  row_nodes;     /* [row * ntrees + tree] - terminal node of each row in each tree */
+} NeighborsIndex;
+
+/* Nodes of models in the files written by 'write_model_file', which are used in place of
+   'IsoTree' and 'IsoHPlane' when predicting from a file mapped through 'map_model_file' */
+typedef struct MappedTreeNode {
+    double    num_split;
+    double    pct_tree_left;
+    double    score;
+    double    range_low;
+    double    range_high;
+    double    remainder;
+    uint64_t  col_num;
+    uint64_t  tree_left;          /* indices within the same tree */
+    uint64_t  tree_right;
+    uint64_t  cat_split_st;       /* position of the first entry of 'cat_split' in the section of categorical splits */
+    uint32_t  cat_split_size;
+    int32_t   chosen_cat;
+    int32_t   col_type;           /* as 'ColType' */
+    uint32_t  reserved;
+} MappedTreeNode;
+
+typedef struct MappedHPlaneNode {
+    double    split_point;
+    double    score;
+    double    range_low;
+    double    range_high;
+    double    remainder;
+    uint64_t  hplane_left;        /* indices within the same tree */
+    uint64_t  hplane_right;
+    uint64_t  col_st;             /* position of the first column in the per-column arrays */
+    uint64_t  ncols;
+    uint64_t  num_st;             /* position of the first numeric column in 'coef' and 'mean' */
+    uint64_t  cat_st;             /* position of the first categorical column in 'chosen_cat', 'fill_new', 'cat_coef_indptr' */
+} MappedHPlaneNode;
+
+/* Model from a file mapped into memory through 'map_model_file' - the pointers are into the file itself */
+typedef struct MappedModel {
+    bool               is_extended;
+    NewCategAction     new_cat_action;
+    CategSplit         cat_split_type;
+    MissingAction      missing_action;
+    double             exp_avg_depth;
+    double             exp_avg_sep;
+    size_t             orig_sample_size;
+    size_t             ntrees;
+    uint64_t*          tree_offsets;     /* [ntrees + 1] - position of the first node of each tree, plus the total */
+    MappedTreeNode*    nodes;            /* only for single-variable models */
+    signed char*       cat_split;        /* only for single-variable models */
+    MappedHPlaneNode*  hplanes;          /* the rest are only for extended models */
+    uint64_t*          col_num;
+    int32_t*           col_type;
+    double*            fill_val;
+    double*            coef;
+    double*            mean;
+    int32_t*           chosen_cat;
+    double*            fill_new;
+    uint64_t*          cat_coef_indptr;
+    double*            cat_coef;
+    void*              mapped_addr;
+    size_t             mapped_size;
+} MappedModel;
+
+
 /* Structs that are only used internally */
+typedef struct MappedDataHeader {
+    char      magic[8];           /* "ISOTDATA" */
+    uint32_t  version;
+    uint32_t  byte_order;         /* 0x01020304 as written by the computer that wrote the file */
+    uint64_t  nrows;
+    uint64_t  ncols_numeric;
+    uint64_t  ncols_categ;
+    uint64_t  nnz;                /* only for sparse matrices */
+    uint32_t  is_sparse;
+    uint32_t  sparse_ix_bytes;    /* size of the indices of sparse matrices */
+    uint64_t  offset_numeric;     /* offsets from the start of the file, zero if the array is not present */
+    uint64_t  offset_Xc_ind;
+    uint64_t  offset_Xc_indptr;
+    uint64_t  offset_categ;
+    uint64_t  offset_ncat;
+    uint64_t  reserved[4];
+} MappedDataHeader;
+
+typedef struct MappedModelHeader {
+    char      magic[8];           /* "ISOTMODL" */
+    uint32_t  version;            /* revision of the format that wrote the file */
+    uint32_t  min_version;        /* oldest revision that can read it */
+    uint32_t  byte_order;         /* 0x01020304 as written by the computer that wrote the file */
+    uint32_t  header_bytes;       /* size of this struct, the table of sections follows it */
+    uint32_t  is_extended;
+    uint32_t  new_cat_action;
+    uint32_t  cat_split_type;
+    uint32_t  missing_action;
+    uint64_t  ntrees;
+    uint64_t  nsections;
+    uint64_t  file_size;
+    uint64_t  checksum;           /* FNV-1a of the 64-bit words of the whole file, taking this field as zero */
+    double    exp_avg_depth;
+    double    exp_avg_sep;
+    uint64_t  orig_sample_size;
+    uint64_t  reserved[5];
+} MappedModelHeader;
+
+typedef struct MappedModelSection {
+    uint32_t  kind;
+    uint32_t  elem_bytes;
+    uint64_t  count;
+    uint64_t  offset;             /* from the start of the file, multiple of 64 */
+} MappedModelSection;
+
+/* Accessors through which the prediction functions read the nodes of a tree, so that the same
+   code works with the trees of a model in memory and with those of a file from 'map_model_file' */
+typedef struct IsoTreeNodes {
+    IsoTree         *nodes;
+    MissingAction   missing_action;
+    CategSplit      cat_split_type;
+    NewCategAction  new_cat_action;
+
+    IsoTreeNodes(std::vector<IsoTree> &tree, IsoForest &model) :
+        nodes(tree.data()), missing_action(model.missing_action),
+        cat_split_type(model.cat_split_type), new_cat_action(model.new_cat_action) {}
+    IsoTree& operator[](size_t node) const {return nodes[node];}
+    size_t cat_split_size(size_t node) const {return nodes[node].cat_split.size();}
+    int cat_split(size_t node, int cat) const {return nodes[node].cat_split[cat];}
+} IsoTreeNodes;
+
+typedef struct MappedTreeNodes {
+    MappedTreeNode  *nodes;
+    signed char     *cat_split_arr;
+    MissingAction   missing_action;
+    CategSplit      cat_split_type;
+    NewCategAction  new_cat_action;
+
+    MappedTreeNodes(MappedModel &model, size_t tree) :
+        nodes(model.nodes + model.tree_offsets[tree]), cat_split_arr(model.cat_split),
+        missing_action(model.missing_action), cat_split_type(model.cat_split_type),
+        new_cat_action(model.new_cat_action) {}
+    MappedTreeNode& operator[](size_t node) const {return nodes[node];}
+    size_t cat_split_size(size_t node) const {return nodes[node].cat_split_size;}
+    int cat_split(size_t node, int cat) const {return cat_split_arr[nodes[node].cat_split_st + cat];}
+} MappedTreeNodes;
+
+/* for the columns of a hyperplane, 'num' and 'cat' are the positions among its numeric and
+   categorical columns, while 'col' is the position among all of them */
+typedef struct IsoHPlaneNodes {
+    IsoHPlane       *nodes;
+    MissingAction   missing_action;
+    CategSplit      cat_split_type;
+
+    IsoHPlaneNodes(std::vector<IsoHPlane> &hplane, ExtIsoForest &model) :
+        nodes(hplane.data()), missing_action(model.missing_action), cat_split_type(model.cat_split_type) {}
+    IsoHPlane& operator[](size_t node) const {return nodes[node];}
+    size_t ncols(size_t node) const {return nodes[node].col_num.size();}
+    size_t col_num(size_t node, size_t col) const {return nodes[node].col_num[col];}
+    ColType col_type(size_t node, size_t col) const {return nodes[node].col_type[col];}
+    double fill_val(size_t node, size_t col) const {return nodes[node].fill_val[col];}
+    double coef(size_t node, size_t num) const {return nodes[node].coef[num];}
+    double mean(size_t node, size_t num) const {return nodes[node].mean[num];}
+    int chosen_cat(size_t node, size_t cat) const {return nodes[node].chosen_cat[cat];}
+    double fill_new(size_t node, size_t cat) const {return nodes[node].fill_new[cat];}
+    size_t ncat(size_t node, size_t cat) const {return nodes[node].cat_coef[cat].size();}
+    double cat_coef(size_t node, size_t cat, int cval) const {return nodes[node].cat_coef[cat][cval];}
+} IsoHPlaneNodes;
+
+typedef struct MappedHPlaneNodes {
+    MappedHPlaneNode  *nodes;
+    MappedModel       &model;
+    MissingAction     missing_action;
+    CategSplit        cat_split_type;
+
+    MappedHPlaneNodes(MappedModel &model, size_t tree) :
+        nodes(model.hplanes + model.tree_offsets[tree]), model(model),
+        missing_action(model.missing_action), cat_split_type(model.cat_split_type) {}
+    MappedHPlaneNode& operator[](size_t node) const {return nodes[node];}
+    size_t ncols(size_t node) const {return nodes[node].ncols;}
+    size_t col_num(size_t node, size_t col) const {return model.col_num[nodes[node].col_st + col];}
+    ColType col_type(size_t node, size_t col) const {return (ColType)model.col_type[nodes[node].col_st + col];}
+    double fill_val(size_t node, size_t col) const {return model.fill_val[nodes[node].col_st + col];}
+    double coef(size_t node, size_t num) const {return model.coef[nodes[node].num_st + num];}
+    double mean(size_t node, size_t num) const {return model.mean[nodes[node].num_st + num];}
+    int chosen_cat(size_t node, size_t cat) const {return model.chosen_cat[nodes[node].cat_st + cat];}
+    double fill_new(size_t node, size_t cat) const {return model.fill_new[nodes[node].cat_st + cat];}
+    size_t ncat(size_t node, size_t cat) const
+    {
+        return model.cat_coef_indptr[nodes[node].cat_st + cat + 1] - model.cat_coef_indptr[nodes[node].cat_st + cat];
+    }
+    double cat_coef(size_t node, size_t cat, int cval) const
+    {
+        return model.cat_coef[model.cat_coef_indptr[nodes[node].cat_st + cat] + cval];
+    }
+} MappedHPlaneNodes;
+
 typedef struct {
     double*     numeric_data;
     size_t      ncols_numeric;
@@ -385,8 +709,12 @@ typedef struct {
     size_t      log2_n;       /* only when using weights for sampling */
     size_t      btree_offset; /* only when using weights for sampling */
     std::vector<double> btree_weights_init;  /* only when using weights for sampling */
+    std::vector<double> alias_prob;          /* only when using weights for sampling with replacement */
+    std::vector<size_t> alias_ix;            /* only when using weights for sampling with replacement */
     std::vector<char>   has_missing;         /* only used when producing missing imputations on-the-fly */
     size_t              n_missing;           /* only used when producing missing imputations on-the-fly */
+    std::vector<char>   col_has_NA;          /* only when fitting a model */
+    std::vector<char>   col_is_const;        /* only when fitting a model */
 } InputData;
 
 
@@ -409,6 +737,7 @@ typedef struct {
     size_t    max_depth;
     bool      penalize_range;
     uint64_t  random_seed;
+    RNGType   rng_type;
     bool      weigh_by_kurt;
     double    prob_pick_by_gain_avg;
     double    prob_split_by_gain_avg;
@@ -435,12 +764,9 @@ typedef struct {
 } ModelParams;
 
 typedef struct ImputedData {
-    std::vector<long double>  num_sum;
-    std::vector<long double>  num_weight;
-    std::vector<std::vector<long double>> cat_sum;
-    std::vector<long double>  cat_weight;
-    std::vector<long double>  sp_num_sum;
-    std::vector<long double>  sp_num_weight;
+    std::vector<imp_sum_t>  num_sum;     /* for the columns in 'missing_num', or in 'missing_sp' if the data is sparse */
+    std::vector<imp_sum_t>  num_weight;
+    std::vector<imp_sum_t>  cat_sum;     /* the categories of each column in 'missing_cat', one column after another */
 
     std::vector<size_t>     missing_num;
     std::vector<size_t>     missing_cat;
@@ -448,18 +774,133 @@ typedef struct ImputedData {
     size_t                  n_missing_num;
     size_t                  n_missing_cat;
     size_t                  n_missing_sp;
+    imp_sum_t              *row_sums;    /* if not NULL, all the sums are taken from this flat buffer instead */
+    CompactImputeTree      *compact_tree; /* if not NULL, the terminal nodes are taken from this instead */
+    Imputer                *imputer;      /* the imputer that 'compact_tree' belongs to */
 
-    ImputedData() {};
+    ImputedData() : row_sums(NULL), compact_tree(NULL), imputer(NULL) {};
 
     ImputedData(InputData &input_data, size_t row);
 
 } ImputedData;
 
+/* xoshiro256++ - much faster than Mersenne-Twister and with a much smaller state.
+   https://prng.di.unimi.it/xoshiro256plusplus.c
+   The state is initialized with splitmix64, so consecutive seeds (e.g. one per tree)
+   result in unrelated streams. */
+typedef struct Xoshiro256PP {
+    uint64_t state[4];
+
+    static uint64_t rotl(const uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    void seed(uint64_t seed)
+    {
+        for (int ix = 0; ix < 4; ix++)
+        {
+            uint64_t z = (seed += 0x9e3779b97f4a7c15);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            state[ix] = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t operator()()
+    {
+        const uint64_t result = rotl(state[0] + state[3], 23) + state[0];
+        const uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+} Xoshiro256PP;
+
+/* Random number generator used throughout the fitting procedure, with the family
+   selected at runtime. Satisfies the requirements of the distributions from <random>. */
+typedef struct RNG_engine {
+    typedef uint64_t result_type;
+    RNGType       rng_type = MersenneTwister;
+    RNG_default   mt;
+    Xoshiro256PP  xoshiro;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    void seed(uint64_t seed, RNGType rng_type)
+    {
+        this->rng_type = rng_type;
+        if (rng_type == Xoshiro)
+            xoshiro.seed(seed);
+        else
+            mt.seed(seed);
+    }
+
+    result_type operator()()
+    {
+        return (rng_type == Xoshiro)? xoshiro() : mt();
+    }
+} RNG_engine;
+
+/* Keeps track of which columns can still be split within a tree branch. Columns that become
+   unsplittable are swapped to the end of the active range (and get their weight set to zero in
+   a binary tree of weight sums when there are column weights), and get logged so that the
+   state of a parent node can be restored by undoing the log up to a given mark, instead of
+   copying a full array of 'ncols' for every node. */
+typedef struct ColumnSampler {
+    std::vector<size_t>  col_indices;   /* the first 'n_active' entries are the columns still available */
+    std::vector<size_t>  col_pos;       /* position of each column in 'col_indices' */
+    size_t               n_active;
+    std::vector<size_t>  dropped;       /* log of the positions from which columns were dropped, in order */
+    std::vector<double>  col_weights;   /* only when using column weights */
+    std::vector<double>  tree_weights;  /* only when using column weights */
+    size_t               log2_n;        /* only when using column weights */
+    size_t               tree_offset;   /* only when using column weights */
+} ColumnSampler;
+
+/* Triangular matrix of separations to which all the threads add while fitting the model,
+   split into stripes of rows that are locked while adding to them */
+typedef struct {
+    double                  *tmat;
+    size_t                  rows_per_stripe;
+    std::vector<std::mutex> locks;
+} TmatStripes;
+
+/* Imputation sums for the rows with missing values, to which all the threads add while fitting
+   the model - when using multiple threads, rows are locked while adding to them, with each lock
+   covering the rows that have the same remainder when divided by the number of locks */
+typedef struct {
+    std::vector<ImputedData>                 *impute_vec;
+    std::unordered_map<size_t, ImputedData>  *impute_map;
+    std::vector<std::mutex>                  locks;
+} ImputeStripes;
+
+/* Scratch memory and best split found so far by each thread when evaluating all the columns for guided splits */
 typedef struct {
-    std::vector<size_t>  ix_arr;
-    std::vector<size_t>  ix_all;
+    std::vector<ix_t>    ix_arr;
+    std::vector<double>  buffer_dbl;
+    std::vector<size_t>  buffer_szt;
+    std::vector<char>    buffer_chr;
+    std::vector<ix_t>    buffer_ix;
+    std::vector<char>    split_categ;
+    double               best_gain;
+    size_t               best_col;
+    double               best_split_point;
+    double               best_xmin;
+    double               best_xmax;
+    int                  best_categ;
+    std::vector<char>    best_split_categ;
+} GuidedColWorker;
+
+typedef struct {
+    std::vector<ix_t>    ix_arr;
+    std::vector<ix_t>    ix_all;
     RNG_engine           rnd_generator;
-    std::uniform_int_distribution<size_t>  runif;
     std::uniform_real_distribution<double> rbin;
     size_t               st;
     size_t               end;
@@ -476,14 +917,14 @@ typedef struct {
     std::vector<char>    categs;
     size_t               ncols_tried;    /* 'npresent' and 'ncols_tried' are used interchangeable and for unrelated things */
     int                  ncat_tried;
-    std::vector<bool>    cols_possible;
     std::vector<double>  btree_weights;  /* only when using weights for sampling */
-    std::discrete_distribution<size_t> col_sampler; /* columns can get eliminated, keep a copy for each thread */
+    ColumnSampler        col_sampler;    /* columns can get eliminated, keep a copy for each thread */
 
     /* for split criterion */
     std::vector<double>  buffer_dbl;
     std::vector<size_t>  buffer_szt;
     std::vector<char>    buffer_chr;
+    std::vector<ix_t>    buffer_ix;  /* row positions when evaluating sparse columns */
     double               prob_split_type;
     GainCriterion        criterion;
     double               this_gain;
@@ -491,6 +932,10 @@ typedef struct {
     int                  this_categ;
     std::vector<char>    this_split_categ;
     bool                 determine_split;
+    int                  nthreads_cols;  /* threads for evaluating columns when choosing them by gain */
+    std::vector<GuidedColWorker> col_workers;
+    std::vector<size_t>  cols_eval;
+    std::vector<double>  cols_eval_gain;
 
     /* for the extended model */
     size_t   ntry;
@@ -501,6 +946,8 @@ typedef struct {
     ColType  col_type;
     double   ext_sd;
     std::vector<size_t>  cols_shuffled;
+    std::vector<size_t>  col_taken_gen;  /* a column is taken if its entry here equals 'curr_gen' */
+    size_t               curr_gen;
     std::vector<double>  comb_val;
     std::vector<size_t>  col_take;
     std::vector<ColType> col_take_type;
@@ -515,19 +962,20 @@ typedef struct {
     std::normal_distribution<double>       coef_norm;
 
     /* for similarity/distance calculations */
-    std::vector<double> tmat_sep;
+    TmatStripes         *tmat_stripes;
+    std::vector<ix_t>   tmat_ix; /* sorted copy of the indices in the node */
 
     /* when calculating average depth on-the-fly */
     std::vector<double> row_depths;
 
     /* when imputing NAs on-the-fly */
-    std::vector<ImputedData> impute_vec;
-    std::unordered_map<size_t, ImputedData> impute_map;
+    ImputeStripes *impute_stripes;
 
 } WorkerMemory;
 
 typedef struct WorkerForSimilarity {
-    std::vector<size_t> ix_arr;
+    std::vector<ix_t>   ix_arr;
+    std::vector<ix_t>   buffer_ix;   /* only for sparse inputs */
     size_t              st;
     size_t              end;
     std::vector<double> weights_arr;
@@ -536,20 +984,90 @@ typedef struct WorkerForSimilarity {
     std::vector<double> rmat;
     size_t              n_from;
     bool                assume_full_distr; /* doesn't need to have one copy per worker */
+    size_t              *row_node;         /* only when recording the terminal node at which each row ends up */
+    bool                rows_divided;      /* only when recording nodes - some row went to both branches */
 } WorkerForSimilarity;
 
+typedef struct TreeNodesForSimilarity {
+    std::vector<size_t> parent;
+    std::vector<size_t> depth;
+    std::vector<double> leaf_sep;   /* separation added when two rows end up in the same terminal node */
+} TreeNodesForSimilarity;
+
+typedef struct WorkerForNeighbors {
+    std::vector<size_t> row_seen;       /* a row was already reached for the current query if its entry equals 'curr_query' */
+    std::vector<size_t> node_on_path;   /* a node is an ancestor of the current query if its entry equals 'curr_query' */
+    size_t              curr_query;
+    std::vector<double> row_sep;        /* separation accumulated so far for each row reached */
+    std::vector<size_t> row_ntrees;     /* number of trees in which each row was reached */
+    std::vector<size_t> candidates;
+    std::vector<double> candidates_sep;
+    std::vector<size_t> curr_node;      /* per tree, node whose rows are to be visited next */
+    std::vector<size_t> prev_node;      /* per tree, child of 'curr_node' whose rows were already visited */
+    std::vector<double> leaf_sep;
+    std::vector<std::pair<double, size_t>> shells;  /* separation of the next rows to visit in each tree */
+    std::vector<std::pair<double, size_t>> top_k;
+} WorkerForNeighbors;
+
 typedef struct {
     size_t  st;
     size_t  st_NA;
     size_t  end_NA;
     size_t  split_ix;
     size_t  end;
-    std::vector<size_t> ix_arr;
-    std::vector<bool>   cols_possible;
+    std::vector<ix_t>   ix_arr;
+    size_t              col_sampler_mark;
     std::unique_ptr<double[]> weights_arr;
-    std::discrete_distribution<size_t> col_sampler;
 } RecursionState;
 
+/* Data and per-thread memory that are kept across different fits to the same data */
+typedef struct TrainingSession {
+    InputData                  input_data;
+    std::vector<WorkerMemory>  worker_memory;
+    std::vector<double>        kurt_weights;         /* only when weighing by kurtosis in a shared sample */
+    size_t                     kurt_sample_size;     /* settings with which 'kurt_weights' were calculated */
+    uint64_t                   kurt_seed;
+    RNGType                    kurt_rng_type;
+    MissingAction              kurt_missing_action;
+    CategSplit                 kurt_cat_split_type;
+} TrainingSession;
+
+/* Rows sampled so far for one tree when fitting to data read in chunks */
+typedef struct TreeReservoir {
+    std::vector<double>  numeric_data;    /* column-major, with 'sample_size' rows */
+    std::vector<int>     categ_data;      /* column-major, with 'sample_size' rows */
+    std::vector<double>  sample_weights;  /* only when the weights are density weights */
+    size_t               n_filled;
+    RNG_engine           rnd_generator;
+    double               log_W;           /* only for uniform sampling */
+    size_t               next_row;        /* only for uniform sampling */
+    std::vector<std::pair<double, size_t>> key_heap;  /* only for weighted sampling */
+    double               weight_to_skip;  /* only for weighted sampling */
+} TreeReservoir;
+
+/* Forest with a fixed number of trees, in which new trees replace the oldest ones.
+   Readers take the current model through 'get_rolling_forest_model', which is never
+   modified after being published - updates build a new one and swap the pointer
+   atomically (readers do not wait for updates, but the atomic shared pointer operations
+   are not necessarily lock-free).
+   The model published before the current one is kept in order to move its trees into
+   the next one once no reader is using it anymore */
+typedef struct RollingForest {
+    std::shared_ptr<IsoForest>     model;
+    std::shared_ptr<ExtIsoForest>  model_ext;
+    std::shared_ptr<IsoForest>     prev_model;
+    std::shared_ptr<ExtIsoForest>  prev_model_ext;
+    std::vector<char>              slot_changed;    /* slots that got new trees in the last update */
+    size_t                         ndim;            /* zero until the first update */
+    size_t                         capacity;
+    size_t                         next_slot;       /* slot holding the oldest tree once full */
+    uint64_t                       ntrees_grown;    /* used for giving each new tree a different seed */
+    std::vector<double>            slot_exp_avg_depth;
+    std::vector<double>            slot_exp_avg_sep;
+    std::vector<size_t>            slot_nrows;
+    std::mutex                     update_mutex;    /* only taken by updates, never by readers */
+} RollingForest;
+
 /* Function prototypes */
 
 /* fit_model.cpp */
@@ -564,14 +1082,14 @@ int fit_iforest(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                 bool   limit_depth, bool penalize_range,
                 bool   standardize_dist, double tmat[],
                 double output_depths[], bool standardize_depth,
-                double col_weights[], bool weigh_by_kurt,
+                double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
                 double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
                 double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
                 double min_gain, MissingAction missing_action,
                 CategSplit cat_split_type, NewCategAction new_cat_action,
                 bool   all_perm, Imputer *imputer, size_t min_imp_obs,
                 UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
-                uint64_t random_seed, int nthreads);
+                uint64_t random_seed, RNGType rng_type, int nthreads);
 int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              double numeric_data[],  size_t ncols_numeric,
              int    categ_data[],    size_t ncols_categ,    int ncat[],
@@ -586,7 +1104,90 @@ int add_tree(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
              CategSplit cat_split_type, NewCategAction new_cat_action,
              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
              bool   all_perm, std::vector<ImputeNode> *impute_nodes, size_t min_imp_obs,
-             uint64_t random_seed);
+             uint64_t random_seed, RNGType rng_type);
+TrainingSession* create_training_session(double numeric_data[],  size_t ncols_numeric,
+                                         int    categ_data[],    size_t ncols_categ,    int ncat[],
+                                         double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                                         double sample_weights[], size_t nrows, int nthreads);
+void delete_training_session(TrainingSession *session);
+void initialize_training_session(TrainingSession &session,
+                                 double numeric_data[],  size_t ncols_numeric,
+                                 int    categ_data[],    size_t ncols_categ,    int ncat[],
+                                 double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                                 double sample_weights[], size_t nrows, int nthreads);
+void reset_worker_memory(WorkerMemory &workspace);
+int fit_iforest(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                bool   with_replacement, bool weight_as_sample,
+                size_t sample_size, size_t ntrees, size_t max_depth,
+                bool   limit_depth, bool penalize_range,
+                bool   standardize_dist, double tmat[],
+                double output_depths[], bool standardize_depth,
+                double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
+                double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                double min_gain, MissingAction missing_action,
+                CategSplit cat_split_type, NewCategAction new_cat_action,
+                bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+                UseDepthImp depth_imp, WeighImpRows weigh_imp_rows, bool impute_at_fit,
+                uint64_t random_seed, RNGType rng_type, int nthreads);
+int add_tree(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+             size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+             size_t max_depth, bool limit_depth, bool penalize_range,
+             double col_weights[], bool weigh_by_kurt,
+             double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+             double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+             double min_gain, MissingAction missing_action,
+             CategSplit cat_split_type, NewCategAction new_cat_action,
+             UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+             bool   all_perm, std::vector<ImputeNode> *impute_nodes, size_t min_imp_obs,
+             uint64_t random_seed, RNGType rng_type);
+int add_trees(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+              double numeric_data[],  size_t ncols_numeric,
+              int    categ_data[],    size_t ncols_categ,    int ncat[],
+              double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+              size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+              double sample_weights[], size_t nrows, size_t ntrees, size_t max_depth,
+              bool   limit_depth,   bool penalize_range,
+              double col_weights[], bool weigh_by_kurt,
+              double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+              double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+              double min_gain, MissingAction missing_action,
+              CategSplit cat_split_type, NewCategAction new_cat_action,
+              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+              bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+              uint64_t random_seed, RNGType rng_type, int nthreads);
+int add_trees(TrainingSession *session, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+              size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+              size_t ntrees, size_t max_depth, bool limit_depth, bool penalize_range,
+              double col_weights[], bool weigh_by_kurt,
+              double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+              double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+              double min_gain, MissingAction missing_action,
+              CategSplit cat_split_type, NewCategAction new_cat_action,
+              UseDepthImp depth_imp, WeighImpRows weigh_imp_rows,
+              bool   all_perm, Imputer *imputer, size_t min_imp_obs,
+              uint64_t random_seed, RNGType rng_type, int nthreads);
+int fit_iforest_streaming(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          ChunkReader read_chunk, void *reader_data,
+                          size_t ncols_numeric, size_t ncols_categ, int ncat[],
+                          size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                          bool   weight_as_sample, size_t sample_size, size_t ntrees, size_t max_depth,
+                          bool   limit_depth, bool penalize_range,
+                          double col_weights[], bool weigh_by_kurt,
+                          double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                          double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                          double min_gain, MissingAction missing_action,
+                          CategSplit cat_split_type, NewCategAction new_cat_action,
+                          bool   all_perm, uint64_t random_seed, RNGType rng_type, int nthreads);
+void add_chunk_to_reservoir(TreeReservoir &res, size_t sample_size,
+                            double numeric_data[], size_t ncols_numeric,
+                            int categ_data[], size_t ncols_categ,
+                            double sample_weights[], size_t nrows, size_t nrows_before);
+void add_chunk_to_weighted_reservoir(TreeReservoir &res, size_t sample_size,
+                                     double numeric_data[], size_t ncols_numeric,
+                                     int categ_data[], size_t ncols_categ,
+                                     double sample_weights[], size_t nrows);
 void fit_itree(std::vector<IsoTree>    *tree_root,
                std::vector<IsoHPlane>  *hplane_root,
                WorkerMemory             &workspace,
@@ -610,8 +1211,7 @@ void split_hplane_recursive(std::vector<IsoHPlane>   &hplanes,
                             ModelParams              &model_params,
                             std::vector<ImputeNode> *impute_nodes,
                             size_t                   curr_depth);
-void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params,
-                       std::vector<bool> &col_is_taken, std::unordered_set<size_t> &col_is_taken_s);
+void add_chosen_column(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params);
 void shrink_to_fit_hplane(IsoHPlane &hplane, bool clear_vectors);
 void simplify_hplane(IsoHPlane &hplane, WorkerMemory &workspace, InputData &input_data, ModelParams &model_params);
 
@@ -623,14 +1223,14 @@ void predict_iforest(double numeric_data[], int categ_data[],
                      size_t nrows, int nthreads, bool standardize,
                      IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                      double output_depths[],   sparse_ix tree_num[]);
-void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
-                               IsoForest             &model_outputs,
+template <class TreeNodes>
+void traverse_itree_no_recurse(TreeNodes             &tree,
                                PredictionData        &prediction_data,
                                double                &output_depth,
                                sparse_ix *restrict   tree_num,
                                size_t                row);
-double traverse_itree(std::vector<IsoTree>     &tree,
-                      IsoForest                &model_outputs,
+template <class TreeNodes>
+double traverse_itree(TreeNodes                &tree,
                       PredictionData           &prediction_data,
                       std::vector<ImputeNode> *impute_nodes,
                       ImputedData             *imputed_data,
@@ -638,14 +1238,14 @@ double traverse_itree(std::vector<IsoTree>     &tree,
                       size_t                   row,
                       sparse_ix *restrict      tree_num,
                       size_t                   curr_lev);
-void traverse_hplane_fast(std::vector<IsoHPlane>  &hplane,
-                          ExtIsoForest            &model_outputs,
+template <class HPlaneNodes>
+void traverse_hplane_fast(HPlaneNodes             &hplane,
                           PredictionData          &prediction_data,
                           double                  &output_depth,
                           sparse_ix *restrict     tree_num,
                           size_t                  row);
-void traverse_hplane(std::vector<IsoHPlane>   &hplane,
-                     ExtIsoForest             &model_outputs,
+template <class HPlaneNodes>
+void traverse_hplane(HPlaneNodes              &hplane,
                      PredictionData           &prediction_data,
                      double                   &output_depth,
                      std::vector<ImputeNode> *impute_nodes,
@@ -673,13 +1273,39 @@ void traverse_hplane_sim(WorkerForSimilarity     &workspace,
                          ExtIsoForest            &model_outputs,
                          std::vector<IsoHPlane>  &hplanes,
                          size_t                  curr_tree);
+int calc_similarity_to_file(const char *file_path, bool as_float,
+                            double numeric_data[], int categ_data[],
+                            double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                            size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                            IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                            size_t n_from);
+template <class real_t>
+bool calc_similarity_tiled(PredictionData &prediction_data,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           real_t *restrict tmat, real_t *restrict rmat, size_t n_from,
+                           bool assume_full_distr, bool standardize_dist, int nthreads);
+bool get_row_nodes_for_sim(PredictionData &prediction_data,
+                           IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                           size_t *restrict row_nodes, int nthreads);
+double calc_leaf_separation(double remainder, size_t n_rows_in_node, bool assume_full_distr);
+void get_tree_nodes_for_sim(TreeNodesForSimilarity &tree_nodes, std::vector<IsoTree> &trees);
+void get_tree_nodes_for_sim(TreeNodesForSimilarity &tree_nodes, std::vector<IsoHPlane> &hplanes);
+double calc_pair_separation(size_t *restrict nodes_row1, size_t *restrict nodes_row2,
+                            std::vector<TreeNodesForSimilarity> &tree_nodes);
 void gather_sim_result(std::vector<WorkerForSimilarity> *worker_memory,
-                       std::vector<WorkerMemory> *worker_memory_m,
                        PredictionData *prediction_data, InputData *input_data,
                        IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                        double *restrict tmat, double *restrict rmat, size_t n_from,
                        size_t ntrees, bool assume_full_distr,
                        bool standardize_dist, int nthreads);
+void transform_sim_result(PredictionData *prediction_data, InputData *input_data,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          double *restrict tmat, double *restrict rmat, size_t n_from,
+                          size_t ntrees, bool assume_full_distr,
+                          bool standardize_dist, int nthreads);
+double calc_sim_divisor(PredictionData *prediction_data, InputData *input_data,
+                        IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                        size_t ntrees, bool assume_full_distr, bool standardize_dist);
 void initialize_worker_for_sim(WorkerForSimilarity  &workspace,
                                PredictionData       &prediction_data,
                                IsoForest            *model_outputs,
@@ -702,13 +1328,11 @@ void shrink_impute_node(ImputeNode &imputer);
 void drop_nonterminal_imp_node(std::vector<ImputeNode>  &imputer_tree,
                                std::vector<IsoTree>     *trees,
                                std::vector<IsoHPlane>   *hplanes);
-void combine_imp_single(ImputedData &imp_addfrom, ImputedData &imp_addto);
-void combine_tree_imputations(WorkerMemory &workspace,
-                              std::vector<ImputedData> &impute_vec,
-                              std::unordered_map<size_t, ImputedData> &impute_map,
-                              std::vector<char> &has_missing,
-                              int nthreads);
+void compact_impute_tree(const std::vector<ImputeNode> &impute_nodes, CompactImputeTree &compact_tree,
+                         size_t ncols_numeric, bool as_float);
+void compact_imputer(Imputer &imputer, bool as_float, int nthreads);
 void add_from_impute_node(ImputeNode &imputer, ImputedData &imputed_data, double w);
+void add_from_impute_node(CompactImputeTree &compact_tree, size_t node, ImputedData &imputed_data, double w);
 void add_from_impute_node(ImputeNode &imputer, WorkerMemory &workspace, InputData &input_data);
 template <class imp_arr>
 void apply_imputation_results(imp_arr    &impute_vec,
@@ -738,30 +1362,32 @@ void check_for_missing(InputData &input_data,
                        int nthreads);
 size_t check_for_missing(PredictionData  &prediction_data,
                          Imputer         &imputer,
-                         size_t          ix_arr[],
+                         ix_t          ix_arr[],
                          int             nthreads);
 
 /* helpers_iforest.cpp */
 void decide_column(size_t ncols_numeric, size_t ncols_categ, size_t &col_chosen, ColType &col_type,
-                   RNG_engine &rnd_generator, std::uniform_int_distribution<size_t> &runif,
-                   std::discrete_distribution<size_t> &col_sampler);
+                   RNG_engine &rnd_generator, ColumnSampler &col_sampler);
 void add_unsplittable_col(WorkerMemory &workspace, IsoTree &tree, InputData &input_data);
 void add_unsplittable_col(WorkerMemory &workspace, InputData &input_data);
-bool check_is_not_unsplittable_col(WorkerMemory &workspace, IsoTree &tree, InputData &input_data);
+void profile_columns(InputData &input_data, int nthreads);
+MissingAction col_missing_action(InputData &input_data, ModelParams &model_params, size_t col_num, ColType col_type);
 void get_split_range(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params, IsoTree &tree);
 void get_split_range(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params);
 int choose_cat_from_present(WorkerMemory &workspace, InputData &input_data, size_t col_num);
-void update_col_sampler(WorkerMemory &workspace, InputData &input_data);
-bool is_col_taken(std::vector<bool> &col_is_taken, std::unordered_set<size_t> &col_is_taken_s,
-                  InputData &input_data, size_t col_num, ColType col_type);
-void set_col_as_taken(std::vector<bool> &col_is_taken, std::unordered_set<size_t> &col_is_taken_s,
-                      InputData &input_data, size_t col_num, ColType col_type);
+void eval_guided_split_all_cols(WorkerMemory &workspace, InputData &input_data, ModelParams &model_params, IsoTree &tree);
+void clear_cols_taken(WorkerMemory &workspace);
+bool is_col_taken(WorkerMemory &workspace, InputData &input_data, size_t col_num, ColType col_type);
+void set_col_as_taken(WorkerMemory &workspace, InputData &input_data, size_t col_num, ColType col_type);
 void add_separation_step(WorkerMemory &workspace, InputData &input_data, double remainder);
 void add_remainder_separation_steps(WorkerMemory &workspace, InputData &input_data, long double sum_weight);
 void remap_terminal_trees(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
                           PredictionData &prediction_data, sparse_ix *restrict tree_num, int nthreads);
 void backup_recursion_state(WorkerMemory &workspace, RecursionState &recursion_state);
 void restore_recursion_state(WorkerMemory &workspace, RecursionState &recursion_state);
+void calc_kurtosis_weights(double kurt_weights[], ix_t ix_arr[], size_t st, size_t end,
+                           InputData &input_data, ModelParams &model_params,
+                           double buffer_dbl[], size_t buffer_szt[], RNG_engine &rnd_generator);
 
 
 /* utils.cpp */
@@ -773,49 +1399,65 @@ double expected_avg_depth(long double approx_sample_size);
 double expected_separation_depth(size_t n);
 double expected_separation_depth_hotstart(double curr, size_t n_curr, size_t n_final);
 double expected_separation_depth(long double n);
-void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n, double counter[], double exp_remainder);
-void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
+void increase_comb_counter(ix_t ix_arr[], size_t st, size_t end, size_t n, double counter[], double exp_remainder);
+void increase_comb_counter(ix_t ix_arr[], size_t st, size_t end, size_t n,
                            double *restrict counter, double *restrict weights, double exp_remainder);
-void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
+void increase_comb_counter(ix_t ix_arr[], size_t st, size_t end, size_t n,
                            double counter[], std::unordered_map<size_t, double> &weights, double exp_remainder);
-void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
+void increase_comb_counter_sorted(ix_t ix_arr[], size_t st, size_t end, size_t n,
+                                  double *restrict counter, double *restrict weights, double exp_remainder);
+void increase_comb_counter_striped(ix_t ix_arr[], size_t st, size_t end, size_t n,
+                                   TmatStripes &tmat_stripes, double *restrict weights, double exp_remainder);
+void increase_comb_counter_in_groups(ix_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
                                      double counter[], double exp_remainder);
-void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
+void increase_comb_counter_in_groups(ix_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
                                      double *restrict counter, double *restrict weights, double exp_remainder);
 void tmat_to_dense(double *restrict tmat, double *restrict dmat, size_t n, bool diag_to_one);
 double calc_sd_raw(size_t cnt, long double sum, long double sum_sq);
 long double calc_sd_raw_l(size_t cnt, long double sum, long double sum_sq);
 void build_btree_sampler(std::vector<double> &btree_weights, double *restrict sample_weights,
                          size_t nrows, size_t &log2_n, size_t &btree_offset);
-void sample_random_rows(std::vector<size_t> &ix_arr, size_t nrows, bool with_replacement,
-                        RNG_engine &rnd_generator, std::vector<size_t> &ix_all,
+void build_alias_sampler(std::vector<double> &alias_prob, std::vector<size_t> &alias_ix,
+                         double sample_weights[], size_t nrows);
+void sample_random_rows(std::vector<ix_t> &ix_arr, size_t nrows, bool with_replacement,
+                        RNG_engine &rnd_generator, std::vector<ix_t> &ix_all,
                         double sample_weights[], std::vector<double> &btree_weights,
-                        size_t log2_n, size_t btree_offset, std::vector<bool> &is_repeated);
+                        size_t log2_n, size_t btree_offset, std::vector<bool> &is_repeated,
+                        std::vector<double> &alias_prob, std::vector<size_t> &alias_ix);
 void weighted_shuffle(size_t *restrict outp, size_t n, double *restrict weights, double *restrict buffer_arr, RNG_engine &rnd_generator);
-size_t divide_subset_split(size_t ix_arr[], double x[], size_t st, size_t end, double split_point);
-void divide_subset_split(size_t ix_arr[], double x[], size_t st, size_t end, double split_point,
+void initialize_col_sampler(ColumnSampler &col_sampler, size_t ncols, double *restrict col_weights, char *restrict col_is_const);
+size_t sample_col(ColumnSampler &col_sampler, RNG_engine &rnd_generator);
+void drop_col(ColumnSampler &col_sampler, size_t col);
+bool is_col_available(ColumnSampler &col_sampler, size_t col);
+void restore_col_sampler(ColumnSampler &col_sampler, size_t mark);
+size_t shuffle_active_cols(ColumnSampler &col_sampler, size_t *restrict outp, RNG_engine &rnd_generator);
+void sort_doubles(double *restrict x, size_t n, double *restrict buffer);
+size_t divide_subset_split(ix_t ix_arr[], double x[], size_t st, size_t end, double split_point, ix_t *restrict buffer);
+void divide_subset_split(ix_t ix_arr[], double x[], size_t st, size_t end, double split_point,
                          MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix);
-void divide_subset_split(size_t ix_arr[], size_t st, size_t end, size_t col_num,
+void divide_subset_split(ix_t ix_arr[], size_t st, size_t end, size_t col_num,
                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[], double split_point,
+                         MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix,
+                         ix_t *restrict buffer);
+void ensure_sorted_ix(ix_t *restrict ix_arr, size_t st, size_t end, ix_t *restrict buffer);
+void divide_subset_split(ix_t ix_arr[], int x[], size_t st, size_t end, char split_categ[],
                          MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix);
-void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, char split_categ[],
-                         MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix);
-void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, char split_categ[],
+void divide_subset_split(ix_t ix_arr[], int x[], size_t st, size_t end, char split_categ[],
                          int ncat, MissingAction missing_action, NewCategAction new_cat_action,
                          bool move_new_to_left, size_t &st_NA, size_t &end_NA, size_t &split_ix);
-void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, int split_categ,
+void divide_subset_split(ix_t ix_arr[], int x[], size_t st, size_t end, int split_categ,
                          MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix);
-void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end,
+void divide_subset_split(ix_t ix_arr[], int x[], size_t st, size_t end,
                          MissingAction missing_action, NewCategAction new_cat_action,
                          bool move_new_to_left, size_t &st_NA, size_t &end_NA, size_t &split_ix);
-void get_range(size_t ix_arr[], double x[], size_t st, size_t end,
+void get_range(ix_t ix_arr[], double x[], size_t st, size_t end,
                MissingAction missing_action, double &xmin, double &xmax, bool &unsplittable);
-void get_range(size_t ix_arr[], size_t st, size_t end, size_t col_num,
+void get_range(ix_t ix_arr[], size_t st, size_t end, size_t col_num,
                double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                MissingAction missing_action, double &xmin, double &xmax, bool &unsplittable);
-void get_categs(size_t ix_arr[], int x[], size_t st, size_t end, int ncat,
+void get_categs(ix_t ix_arr[], int x[], size_t st, size_t end, int ncat,
                 MissingAction missing_action, char categs[], size_t &npresent, bool &unsplittable);
-long double calculate_sum_weights(std::vector<size_t> &ix_arr, size_t st, size_t end, size_t curr_depth,
+long double calculate_sum_weights(std::vector<ix_t> &ix_arr, size_t st, size_t end, size_t curr_depth,
                                   std::vector<double> &weights_arr, std::unordered_map<size_t, double> &weights_map);
 void set_interrup_global_variable(int s);
 int return_EXIT_SUCCESS();
@@ -823,39 +1465,42 @@ int return_EXIT_FAILURE();
 
 
 
-size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, double x[]);
-size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, size_t col_num, double Xc[], size_t Xc_ind[], size_t Xc_indptr[]);
-size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, int x[]);
-size_t center_NAs(size_t *restrict ix_arr, size_t st_left, size_t st, size_t curr_pos);
-void todense(size_t ix_arr[], size_t st, size_t end,
+size_t move_NAs_to_front(ix_t ix_arr[], size_t st, size_t end, double x[]);
+size_t move_NAs_to_front(ix_t ix_arr[], size_t st, size_t end, size_t col_num, double Xc[], size_t Xc_ind[], size_t Xc_indptr[]);
+size_t move_NAs_to_front(ix_t ix_arr[], size_t st, size_t end, int x[]);
+size_t center_NAs(ix_t *restrict ix_arr, size_t st_left, size_t st, size_t curr_pos);
+void todense(ix_t ix_arr[], size_t st, size_t end,
              size_t col_num, double *restrict Xc, sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
              double *restrict buffer_arr);
 
 /* mult.cpp */
-void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, double *restrict x,
+void calc_mean_and_sd(ix_t ix_arr[], size_t st, size_t end, double *restrict x,
                       MissingAction missing_action, double &x_sd, double &x_mean);
-void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, size_t col_num,
+void calc_mean_and_sd(ix_t ix_arr[], size_t st, size_t end, size_t col_num,
                       double *restrict Xc, sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                       double &x_sd, double &x_mean);
-void add_linear_comb(size_t ix_arr[], size_t st, size_t end, double *restrict res,
+void add_linear_comb(ix_t ix_arr[], size_t st, size_t end, double *restrict res,
                      double *restrict x, double &coef, double x_sd, double x_mean, double &fill_val,
                      MissingAction missing_action, double *restrict buffer_arr,
                      size_t *restrict buffer_NAs, bool first_run);
-void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, size_t col_num, double *restrict res,
+void add_linear_comb(ix_t *restrict ix_arr, size_t st, size_t end, size_t col_num, double *restrict res,
                      double *restrict Xc, sparse_ix *restrict Xc_ind, sparse_ix *restrict Xc_indptr,
                      double &coef, double x_sd, double x_mean, double &fill_val, MissingAction missing_action,
                      double *restrict buffer_arr, size_t *restrict buffer_NAs, bool first_run);
-void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, double *restrict res,
+void add_linear_comb(ix_t *restrict ix_arr, size_t st, size_t end, double *restrict res,
                      int x[], int ncat, double *restrict cat_coef, double single_cat_coef, int chosen_cat,
                      double &fill_val, double &fill_new, size_t *restrict buffer_cnt, size_t *restrict buffer_pos,
                      NewCategAction new_cat_action, MissingAction missing_action, CategSplit cat_split_type, bool first_run);
 
 /* crit.cpp */
-double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, double x[], MissingAction missing_action);
-double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, size_t col_num,
+double calc_kurtosis(ix_t ix_arr[], size_t st, size_t end, double x[], MissingAction missing_action);
+void calc_kurtosis_all_cols(ix_t ix_arr[], size_t st, size_t end, double numeric_data[],
+                            size_t nrows, size_t ncols_numeric, MissingAction missing_action,
+                            double *restrict buffer_arr, double *restrict kurt_out);
+double calc_kurtosis(ix_t ix_arr[], size_t st, size_t end, size_t col_num,
                      double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                      MissingAction missing_action);
-double calc_kurtosis(size_t ix_arr[], size_t st, size_t end, int x[], int ncat, size_t buffer_cnt[], double buffer_prob[],
+double calc_kurtosis(ix_t ix_arr[], size_t st, size_t end, int x[], int ncat, size_t buffer_cnt[], double buffer_prob[],
                      MissingAction missing_action, CategSplit cat_split_type, RNG_engine &rnd_generator);
 double expected_sd_cat(double p[], size_t n, size_t pos[]);
 double expected_sd_cat(size_t counts[], double p[], size_t n, size_t pos[]);
@@ -872,16 +1517,16 @@ double categ_gain(size_t cnt_left, size_t cnt_right,
                   long double s_left, long double s_right,
                   long double base_info, long double cnt);
 double eval_guided_crit(double *restrict x, size_t n, GainCriterion criterion, double min_gain,
-                        double &split_point, double &xmin, double &xmax);
-double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, double *restrict x,
+                        double &split_point, double &xmin, double &xmax, double *restrict buffer_arr);
+double eval_guided_crit(ix_t *restrict ix_arr, size_t st, size_t end, double *restrict x,
                         size_t &split_ix, double &split_point, double &xmin, double &xmax,
                         GainCriterion criterion, double min_gain, MissingAction missing_action);
-double eval_guided_crit(size_t ix_arr[], size_t st, size_t end,
+double eval_guided_crit(ix_t ix_arr[], size_t st, size_t end,
                         size_t col_num, double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
-                        double buffer_arr[], size_t buffer_pos[],
+                        double buffer_arr[], ix_t buffer_pos[],
                         double &split_point, double &xmin, double &xmax,
                         GainCriterion criterion, double min_gain, MissingAction missing_action);
-double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, int *restrict x, int ncat,
+double eval_guided_crit(ix_t *restrict ix_arr, size_t st, size_t end, int *restrict x, int ncat,
                         size_t *restrict buffer_cnt, size_t *restrict buffer_pos, double *restrict buffer_prob,
                         int &chosen_cat, char *restrict split_categ, char *restrict buffer_split,
                         GainCriterion criterion, double min_gain, bool all_perm, MissingAction missing_action, CategSplit cat_split_type);
@@ -890,6 +1535,25 @@ double eval_guided_crit(size_t *restrict ix_arr, size_t st, size_t end, int *res
 void merge_models(IsoForest*     model,      IsoForest*     other,
                   ExtIsoForest*  ext_model,  ExtIsoForest*  ext_other,
                   Imputer*       imputer,    Imputer*       iother);
+RollingForest* create_rolling_forest(size_t capacity);
+void delete_rolling_forest(RollingForest *rolling_forest);
+int update_rolling_forest(RollingForest *rolling_forest,
+                          double numeric_data[],  size_t ncols_numeric,
+                          int    categ_data[],    size_t ncols_categ,    int ncat[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                          double sample_weights[], bool with_replacement, bool weight_as_sample,
+                          size_t nrows, size_t sample_size, size_t ntrees, size_t max_depth,
+                          bool   limit_depth, bool penalize_range,
+                          double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
+                          double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                          double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                          double min_gain, MissingAction missing_action,
+                          CategSplit cat_split_type, NewCategAction new_cat_action,
+                          bool   all_perm, uint64_t random_seed, RNGType rng_type, int nthreads);
+void get_rolling_forest_model(RollingForest *rolling_forest,
+                              std::shared_ptr<IsoForest> &model,
+                              std::shared_ptr<ExtIsoForest> &model_ext);
 
 #ifdef _ENABLE_CEREAL
 /* serialize.cpp */
@@ -922,6 +1586,55 @@ void deserialize_imputer(Imputer &output_obj, const wchar_t *input_file_path);
 bool has_msvc();
 #endif /* _ENABLE_CEREAL */
 
+/* mapped_data.cpp */
+int write_mapped_data(const char *file_path,
+                      double numeric_data[],  size_t ncols_numeric,
+                      int    categ_data[],    size_t ncols_categ,    int ncat[],
+                      double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                      size_t nrows);
+int map_data_file(MappedData &mapped, const char *file_path, MappedDataUse use, bool verify);
+void advise_mapped_data(MappedData &mapped, MappedDataUse use);
+void unmap_data_file(MappedData &mapped);
+int map_file(const char *file_path, bool writable, void **mapped_addr, size_t *mapped_size);
+void unmap_file(void *mapped_addr, size_t mapped_size);
+int map_output_file(const char *file_path, size_t n_bytes, void **mapped_addr);
+int unmap_output_file(void *mapped_addr, size_t n_bytes);
+
+/* mapped_model.cpp */
+int write_model_file(const char *file_path, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext);
+int map_model_file(MappedModel &mapped, const char *file_path, bool verify);
+void unmap_model_file(MappedModel &mapped);
+void predict_mapped_model(double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          double Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                          size_t nrows, int nthreads, bool standardize,
+                          MappedModel &model, double output_depths[], sparse_ix tree_num[]);
+
+/* knn_index.cpp */
+int build_neighbors_index(NeighborsIndex &index,
+                          double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          int nthreads);
+int query_neighbors_index(NeighborsIndex &index,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, size_t k, bool assume_full_distr, bool standardize_dist,
+                          size_t neighbors[], double distances[], int nthreads);
+int calc_similarity_graph(double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          double threshold, size_t top_m,
+                          std::vector<size_t> &indptr, std::vector<size_t> &indices, std::vector<double> &values);
+void find_neighbors_single(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                           size_t *restrict query_nodes, size_t k, size_t exclude_row);
+void find_neighbors_above(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                          size_t *restrict query_nodes, double min_sep, size_t exclude_row);
+double calc_neighbor_separation(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                                size_t *restrict query_nodes, size_t row);
+
 /* dealloc.cpp */
 void dealloc_IsoForest(IsoForest &model_outputs);
 void dealloc_IsoExtForest(ExtIsoForest &model_outputs_ext);
@@ -0,0 +1,717 @@
+/*    Isolation forests and variations thereof, with adjustments for incorporation
+*     of categorical variables and missing values.
+*     Writen for C++11 standard and aimed at being used in R and Python.
+*     
+*     This library is based on the following works:
+*     [1] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation forest."
+*         2008 Eighth IEEE International Conference on Data Mining. IEEE, 2008.
+*     [2] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation-based anomaly detection."
+*         ACM Transactions on Knowledge Discovery from Data (TKDD) 6.1 (2012): 3.
+*     [3] Hariri, Sahand, Matias Carrasco Kind, and Robert J. Brunner.
+*         "Extended Isolation Forest."
+*         arXiv preprint arXiv:1811.02141 (2018).
+*     [4] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "On detecting clustered anomalies using SCiForest."
+*         Joint European Conference on Machine Learning and Knowledge Discovery in Databases. Springer, Berlin, Heidelberg, 2010.
+*     [5] https://sourceforge.net/projects/iforest/
+*     [6] https://math.stackexchange.com/questions/3388518/expected-number-of-paths-required-to-separate-elements-in-a-binary-tree
+*     [7] Quinlan, J. Ross. C4. 5: programs for machine learning. Elsevier, 2014.
+*     [8] Cortes, David. "Distance approximation using Isolation Forests." arXiv preprint arXiv:1910.12362 (2019).
+*     [9] Cortes, David. "Imputing missing values with unsupervised random trees." arXiv preprint arXiv:1911.06646 (2019).
+* 
+*     BSD 2-Clause License
+*     Copyright (c) 2019, David Cortes
+*     All rights reserved.
+*     Redistribution and use in source and binary forms, with or without
+*     modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this
+*       list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice,
+*       this list of conditions and the following disclaimer in the documentation
+*       and/or other materials provided with the distribution.
+*     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+*     AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+*     IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+*     FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+*     DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "isotree.hpp"
+
+/* Nearest neighbours under the isolation-based distance
+* 
+* The separation depth between two rows in a given tree is determined by the deepest node
+* that both of them share, so for a given query row, the rows from the reference set can be
+* reached in each tree by going up from the terminal node of the query: first the rows that
+* end up in the same terminal node, then the ones under its parent that were not yet reached,
+* and so on. All the rows reached at a given node have the same separation from the query in
+* that tree (the depth of the node), and rows that are only reached at the root add nothing.
+* 
+* In order to visit the rows under a given node, the reference rows are stored for each tree
+* sorted according to the depth-first order of their terminal nodes, so that the rows under
+* any node form a contiguous range.
+* 
+* The rows are visited by nodes across all trees in decreasing order of separation, adding to
+* each row the separation of the node at which it is reached in each tree. At any point, the
+* separation accumulated for a row is a lower bound of its full separation, and an upper bound
+* is obtained by adding the largest separation among the nodes not yet visited for each tree
+* in which the row was not reached yet. The search stops once there are 'k' rows whose lower
+* bounds are at least as large as the upper bounds of all the other rows, which typically
+* happens before visiting the nodes closer to the root, under which most rows fall.
+* 
+* The results are the same as what would be obtained from 'calc_similarity' with 'n_from' = 1
+* when passing the query row as the first row and the reference rows after it, except for ties
+* (rows with the same distance) at the last position, which might be resolved differently.
+*/
+
+
+static bool get_node_children(std::vector<IsoTree> &trees, size_t node, size_t &left, size_t &right)
+{
+    if (trees[node].score >= 0) return false;
+    left  = trees[node].tree_left;
+    right = trees[node].tree_right;
+    return true;
+}
+
+static bool get_node_children(std::vector<IsoHPlane> &hplanes, size_t node, size_t &left, size_t &right)
+{
+    if (hplanes[node].score >= 0) return false;
+    left  = hplanes[node].hplane_left;
+    right = hplanes[node].hplane_right;
+    return true;
+}
+
+static double get_node_remainder(IsoForest *model_outputs, ExtIsoForest *model_outputs_ext, size_t tree, size_t node)
+{
+    return (model_outputs != NULL)? model_outputs->trees[tree][node].remainder : model_outputs_ext->hplanes[tree][node].remainder;
+}
+
+template <class node_vec>
+static void build_index_single_tree(NeighborsIndex &index, node_vec &tree_nodes, size_t tree, size_t ntrees)
+{
+    size_t nrows = index.nrows;
+    size_t offset = index.node_offset[tree];
+    size_t nnodes = tree_nodes.size();
+    size_t *restrict range_st  = index.range_st.data()  + offset;
+    size_t *restrict range_end = index.range_end.data() + offset;
+
+    TreeNodesForSimilarity nodes_info;
+    get_tree_nodes_for_sim(nodes_info, tree_nodes);
+    std::copy(nodes_info.parent.begin(), nodes_info.parent.end(), index.parent.begin() + offset);
+    std::copy(nodes_info.depth.begin(),  nodes_info.depth.end(),  index.depth.begin()  + offset);
+
+    /* count the rows under each node - children are always added after their parent */
+    std::vector<size_t> node_count(nnodes, 0);
+    for (size_t row = 0; row < nrows; row++)
+        node_count[index.row_nodes[row * ntrees + tree]]++;
+    for (size_t node = nnodes - 1; node > 0; node--)
+        node_count[nodes_info.parent[node]] += node_count[node];
+
+    /* assign ranges in depth-first order, left branch first */
+    size_t left, right;
+    range_st[0]  = 0;
+    range_end[0] = nrows;
+    for (size_t node = 0; node < nnodes; node++)
+    {
+        if (!get_node_children(tree_nodes, node, left, right)) continue;
+        range_st[left]   = range_st[node];
+        range_end[left]  = range_st[node] + node_count[left];
+        range_st[right]  = range_end[left];
+        range_end[right] = range_end[node];
+    }
+
+    /* now place the rows, using the start of each range as cursor */
+    std::vector<size_t> cursor(range_st, range_st + nnodes);
+    size_t *restrict ordered_rows = index.ordered_rows.data() + tree * nrows;
+    size_t node;
+    for (size_t row = 0; row < nrows; row++)
+    {
+        node = index.row_nodes[row * ntrees + tree];
+        ordered_rows[cursor[node]++] = row;
+    }
+}
+
+/* Build an index for finding nearest neighbours in a reference set of rows
+* 
+* Passes each row of the reference set through each tree of the model, storing the terminal
+* node at which it ends up and the rows that end up under each node, so that nearest neighbours
+* for new rows can be found through 'query_neighbors_index' without calculating the distances to
+* every row in the reference set.
+* 
+* The index is tied to the model with which it was built, and should be rebuilt if the trees
+* in the model change (e.g. after adding more trees).
+* 
+* Parameters
+* ==========
+* - index (out)
+*       Object where the index will be built. Any previous contents will be overwritten.
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, nrows
+*       The reference rows, in the same format as for 'calc_similarity'.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if using the extended model.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if using the single-variable model.
+* - nthreads
+*       Number of parallel threads to use.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the index was built successfully, or
+* 'EXIT_FAILURE' (typically =1) if some row has to be divided between both branches of a
+* tree (models with 'missing_action' = 'Divide' or 'new_cat_action' = 'Weighted', when
+* there are missing values or new categories), in which case it cannot be indexed.
+*/
+int build_neighbors_index(NeighborsIndex &index,
+                          double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          int nthreads)
+{
+    PredictionData prediction_data = {numeric_data, categ_data, nrows,
+                                      Xc, Xc_ind, Xc_indptr,
+                                      NULL, NULL, NULL};
+    size_t ntrees = (model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size();
+
+    index.nrows = nrows;
+    index.row_nodes.resize(nrows * ntrees);
+    if (!get_row_nodes_for_sim(prediction_data, model_outputs, model_outputs_ext, index.row_nodes.data(), nthreads))
+    {
+        index = NeighborsIndex();
+        return EXIT_FAILURE;
+    }
+
+    index.node_offset.resize(ntrees + 1);
+    index.node_offset[0] = 0;
+    for (size_t tree = 0; tree < ntrees; tree++)
+        index.node_offset[tree + 1] = index.node_offset[tree] + ((model_outputs != NULL)?
+                                                                   model_outputs->trees[tree].size()
+                                                                     :
+                                                                   model_outputs_ext->hplanes[tree].size());
+    size_t tot_nodes = index.node_offset[ntrees];
+    index.parent.resize(tot_nodes);
+    index.depth.resize(tot_nodes);
+    index.range_st.resize(tot_nodes);
+    index.range_end.resize(tot_nodes);
+    index.ordered_rows.resize(nrows * ntrees);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) shared(index, ntrees, model_outputs, model_outputs_ext)
+    for (size_t_for tree = 0; tree < ntrees; tree++)
+    {
+        if (model_outputs != NULL)
+            build_index_single_tree(index, model_outputs->trees[tree], tree, ntrees);
+        else
+            build_index_single_tree(index, model_outputs_ext->hplanes[tree], tree, ntrees);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void initialize_worker_for_neighbors(WorkerForNeighbors &workspace, NeighborsIndex &index)
+{
+    size_t ntrees = index.node_offset.size() - 1;
+    workspace.row_seen.assign(index.nrows, 0);
+    workspace.row_sep.resize(index.nrows);
+    workspace.row_ntrees.resize(index.nrows);
+    workspace.node_on_path.assign(index.node_offset[ntrees], 0);
+    workspace.curr_node.resize(ntrees);
+    workspace.prev_node.resize(ntrees);
+    workspace.leaf_sep.resize(ntrees);
+    workspace.shells.reserve(ntrees);
+}
+
+/* separation between the query and the rows in its same terminal node depends on how many rows end up
+   there, which includes the query itself when it's one of the indexed rows */
+static void set_query_leaf_sep(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                               IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                               size_t *restrict query_nodes, bool query_in_index, bool assume_full_distr)
+{
+    size_t ntrees = index.node_offset.size() - 1;
+    size_t leaf, offset;
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        leaf = query_nodes[tree];
+        offset = index.node_offset[tree];
+        workspace.leaf_sep[tree] = calc_leaf_separation(get_node_remainder(model_outputs, model_outputs_ext, tree, leaf),
+                                                        index.range_end[offset + leaf] - index.range_st[offset + leaf]
+                                                          + (query_in_index? 0 : 1),
+                                                        assume_full_distr);
+    }
+}
+
+/* Find nearest neighbours of new rows among the rows of a reference set
+* 
+* Parameters
+* ==========
+* - index
+*       Index built from the reference rows through 'build_neighbors_index', with the same model
+*       that is passed here.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if using the extended model.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if using the single-variable model.
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, nrows
+*       The rows for which to find nearest neighbours, in the same format as for 'calc_similarity'.
+* - k
+*       Number of neighbours to find for each row. Must be at most the number of rows in the index.
+* - assume_full_distr
+*       Same as for 'calc_similarity'.
+* - standardize_dist
+*       Whether to output standardized distances (as 'calc_similarity' does) or average separation
+*       depths, in which case nearer neighbours have larger numbers.
+* - neighbors[nrows * k] (out)
+*       Array where to write the indices of the nearest neighbours of each row (as positions in
+*       the reference set), as a row-major matrix with the nearest neighbour first.
+* - distances[nrows * k] (out)
+*       Array where to write the distances (or average separation depths) corresponding to each
+*       entry in 'neighbors'.
+* - nthreads
+*       Number of parallel threads to use. Each thread will process different rows.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the neighbours were found successfully, or
+* 'EXIT_FAILURE' (typically =1) if 'k' is larger than the number of reference rows, if the
+* index does not correspond to the trees in the model, or if some row has to be divided between
+* both branches of a tree (see the documentation for 'build_neighbors_index').
+*/
+int query_neighbors_index(NeighborsIndex &index,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, size_t k, bool assume_full_distr, bool standardize_dist,
+                          size_t neighbors[], double distances[], int nthreads)
+{
+    size_t ntrees = (model_outputs != NULL)? model_outputs->trees.size() : model_outputs_ext->hplanes.size();
+    if (k > index.nrows || index.node_offset.size() != ntrees + 1)
+        return EXIT_FAILURE;
+    for (size_t tree = 0; tree < ntrees; tree++)
+        if (index.node_offset[tree + 1] - index.node_offset[tree] != ((model_outputs != NULL)?
+                                                                        model_outputs->trees[tree].size()
+                                                                          :
+                                                                        model_outputs_ext->hplanes[tree].size()))
+            return EXIT_FAILURE;
+
+    PredictionData prediction_data = {numeric_data, categ_data, nrows,
+                                      Xc, Xc_ind, Xc_indptr,
+                                      NULL, NULL, NULL};
+    std::vector<size_t> query_nodes(nrows * ntrees);
+    if (!get_row_nodes_for_sim(prediction_data, model_outputs, model_outputs_ext, query_nodes.data(), nthreads))
+        return EXIT_FAILURE;
+
+    /* distances are standardized as if the query row had been passed together with the reference rows */
+    prediction_data.nrows = index.nrows + 1;
+    double div_trees = calc_sim_divisor(&prediction_data, NULL, model_outputs, model_outputs_ext,
+                                        ntrees, assume_full_distr, standardize_dist);
+    double ntrees_dbl = (double) ntrees;
+
+    #ifdef _OPENMP
+    std::vector<WorkerForNeighbors> worker_memory(nthreads);
+    #else
+    std::vector<WorkerForNeighbors> worker_memory(1);
+    #endif
+    for (WorkerForNeighbors &workspace : worker_memory)
+        initialize_worker_for_neighbors(workspace, index);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) \
+            shared(nrows, ntrees, k, index, query_nodes, worker_memory, neighbors, distances, \
+                   model_outputs, model_outputs_ext, assume_full_distr, standardize_dist, div_trees, ntrees_dbl)
+    for (size_t_for row = 0; row < nrows; row++)
+    {
+        WorkerForNeighbors &workspace = worker_memory[omp_get_thread_num()];
+        size_t *restrict curr_nodes = query_nodes.data() + row * ntrees;
+        workspace.curr_query = row + 1;
+        set_query_leaf_sep(workspace, index, model_outputs, model_outputs_ext, curr_nodes, false, assume_full_distr);
+        find_neighbors_single(workspace, index, curr_nodes, k, SIZE_MAX);
+
+        for (size_t ix = 0; ix < k; ix++)
+        {
+            neighbors[row * k + ix] = workspace.top_k[ix].second;
+            distances[row * k + ix] = standardize_dist?
+                                        exp2( - workspace.top_k[ix].first / div_trees)
+                                          :
+                                        ((workspace.top_k[ix].first + ntrees_dbl) / ntrees_dbl);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* Calculate a sparse graph with the pairs of rows that are close to each other
+* 
+* Calculates the same distances or average separation depths as 'calc_similarity', but only
+* for the pairs of rows that are below a given distance from each other and/or among the nearest
+* neighbours of each other, producing a sparse matrix in CSR format instead of a dense matrix.
+* The rows are indexed as in 'build_neighbors_index' and the neighbours of each row are found
+* by visiting the rows that end up in the same nodes as it, so the memory requirements are
+* proportional to the number of rows times the number of trees plus the number of pairs in the
+* output, rather than to the number of rows squared as for 'calc_similarity'.
+* 
+* Parameters
+* ==========
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, nrows, nthreads, assume_full_distr,
+*   standardize_dist, model_outputs, model_outputs_ext
+*       Same as for 'calc_similarity'.
+* - threshold
+*       Pairs of rows will be output only if their distance is at most this number (when passing
+*       'standardize_dist' = 'true'), or if their average separation depth is at least this
+*       number (when passing 'standardize_dist' = 'false'). Pass NAN to output pairs regardless
+*       of their distance, in which case 'top_m' must be passed.
+* - top_m
+*       Maximum number of pairs to output for each row, which will be the ones with the smallest
+*       distance to that row (ties might be resolved in any way). If passing both 'threshold'
+*       and 'top_m', will output the pairs that meet both criteria. Pass zero to output pairs
+*       regardless of how many there are for each row, in which case 'threshold' must be passed.
+*       Note that the resulting graph will not necessarily be symmetric when passing it.
+* - indptr (out)
+*       Vector where to write the position at which the entries for each row start in 'indices'
+*       and 'values', with 'nrows' + 1 entries.
+* - indices (out)
+*       Vector where to write the other row in each pair, sorted in ascending order for each row.
+*       A row is never paired with itself.
+* - values (out)
+*       Vector where to write the distance or average separation depth for each pair.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the graph was calculated successfully, or
+* 'EXIT_FAILURE' (typically =1) if passing neither 'threshold' nor 'top_m', or if some row has
+* to be divided between both branches of a tree (see the documentation for 'build_neighbors_index').
+*/
+int calc_similarity_graph(double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t nrows, int nthreads, bool assume_full_distr, bool standardize_dist,
+                          IsoForest *model_outputs, ExtIsoForest *model_outputs_ext,
+                          double threshold, size_t top_m,
+                          std::vector<size_t> &indptr, std::vector<size_t> &indices, std::vector<double> &values)
+{
+    bool use_threshold = !isnan(threshold);
+    if (!use_threshold && !top_m)
+        return EXIT_FAILURE;
+    top_m = std::min(top_m, (nrows > 0)? (nrows - 1) : (size_t)0);
+
+    NeighborsIndex index;
+    if (build_neighbors_index(index, numeric_data, categ_data, Xc, Xc_ind, Xc_indptr,
+                              nrows, model_outputs, model_outputs_ext, nthreads) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+
+    size_t ntrees = index.node_offset.size() - 1;
+    double ntrees_dbl = (double) ntrees;
+    PredictionData prediction_data = {numeric_data, categ_data, nrows,
+                                      Xc, Xc_ind, Xc_indptr,
+                                      NULL, NULL, NULL};
+    double div_trees = calc_sim_divisor(&prediction_data, NULL, model_outputs, model_outputs_ext,
+                                        ntrees, assume_full_distr, standardize_dist);
+
+    /* pairs are discarded early according to their separation, and the threshold is applied
+       at the end on the final outputs, so this doesn't need to match exactly */
+    double min_sep = - HUGE_VAL;
+    if (use_threshold)
+    {
+        if (standardize_dist)
+            min_sep = (threshold > 0)? (- div_trees * log2(threshold)) : HUGE_VAL;
+        else
+            min_sep = threshold * ntrees_dbl - ntrees_dbl;
+        min_sep -= 1e-8 * std::max(1., std::fabs(min_sep));
+    }
+
+    #ifdef _OPENMP
+    std::vector<WorkerForNeighbors> worker_memory(nthreads);
+    #else
+    std::vector<WorkerForNeighbors> worker_memory(1);
+    #endif
+    for (WorkerForNeighbors &workspace : worker_memory)
+        initialize_worker_for_neighbors(workspace, index);
+    std::vector<std::vector<std::pair<size_t, double>>> row_pairs(nrows);
+
+    #pragma omp parallel for schedule(dynamic) num_threads(nthreads) \
+            shared(nrows, ntrees, index, worker_memory, row_pairs, model_outputs, model_outputs_ext, \
+                   assume_full_distr, standardize_dist, div_trees, ntrees_dbl, use_threshold, threshold, min_sep, top_m)
+    for (size_t_for row = 0; row < nrows; row++)
+    {
+        WorkerForNeighbors &workspace = worker_memory[omp_get_thread_num()];
+        size_t *restrict curr_nodes = index.row_nodes.data() + row * ntrees;
+        workspace.curr_query = row + 1;
+        set_query_leaf_sep(workspace, index, model_outputs, model_outputs_ext, curr_nodes, true, assume_full_distr);
+        if (top_m)
+            find_neighbors_single(workspace, index, curr_nodes, top_m, row);
+        else
+            find_neighbors_above(workspace, index, curr_nodes, min_sep, row);
+
+        for (auto &neighbor : workspace.top_k)
+        {
+            neighbor.first = standardize_dist?
+                               exp2( - neighbor.first / div_trees)
+                                 :
+                               ((neighbor.first + ntrees_dbl) / ntrees_dbl);
+            if (!use_threshold || (standardize_dist? (neighbor.first <= threshold) : (neighbor.first >= threshold)))
+                row_pairs[row].emplace_back(neighbor.second, neighbor.first);
+        }
+        std::sort(row_pairs[row].begin(), row_pairs[row].end());
+    }
+
+    indptr.assign(nrows + 1, 0);
+    for (size_t row = 0; row < nrows; row++)
+        indptr[row + 1] = indptr[row] + row_pairs[row].size();
+    indices.resize(indptr[nrows]);
+    values.resize(indptr[nrows]);
+    for (size_t row = 0; row < nrows; row++)
+    {
+        for (size_t ix = 0; ix < row_pairs[row].size(); ix++)
+        {
+            indices[indptr[row] + ix] = row_pairs[row][ix].first;
+            values[indptr[row] + ix]  = row_pairs[row][ix].second;
+        }
+        std::vector<std::pair<size_t, double>>().swap(row_pairs[row]);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/* a neighbour is better than another if it has a larger separation depth, or the lowest index in case of ties */
+static bool is_better_neighbor(const std::pair<double, size_t> &a, const std::pair<double, size_t> &b)
+{
+    return (a.first > b.first) || (a.first == b.first && a.second < b.second);
+}
+
+static void add_shell_separation(WorkerForNeighbors &workspace, size_t *restrict ordered_rows,
+                                 size_t st, size_t end, double sep)
+{
+    size_t row;
+    for (size_t pos = st; pos < end; pos++)
+    {
+        row = ordered_rows[pos];
+        if (workspace.row_seen[row] != workspace.curr_query)
+        {
+            workspace.row_seen[row]   = workspace.curr_query;
+            workspace.row_sep[row]    = 0;
+            workspace.row_ntrees[row] = 0;
+            workspace.candidates.push_back(row);
+        }
+        workspace.row_sep[row] += sep;
+        workspace.row_ntrees[row]++;
+    }
+}
+
+/* Mark the path from the terminal node of the query up to the root in each tree, and set the
+   terminal nodes as the first ones to visit. If the query is one of the indexed rows, it is
+   marked as already reached so that it doesn't get to the results. */
+static void start_neighbors_search(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                                   size_t *restrict query_nodes, size_t exclude_row)
+{
+    size_t ntrees = index.node_offset.size() - 1;
+    workspace.top_k.clear();
+    workspace.candidates.clear();
+    workspace.shells.clear();
+    if (exclude_row != SIZE_MAX)
+        workspace.row_seen[exclude_row] = workspace.curr_query;
+
+    size_t offset, node;
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        offset = index.node_offset[tree];
+        node = query_nodes[tree];
+        workspace.curr_node[tree] = node;
+        workspace.prev_node[tree] = SIZE_MAX;
+        workspace.shells.emplace_back((double) ((index.depth[offset + node] > 1)? (index.depth[offset + node] - 1) : 0)
+                                        + workspace.leaf_sep[tree],
+                                      tree);
+        while (true)
+        {
+            workspace.node_on_path[offset + node] = workspace.curr_query;
+            if (node == 0) break;
+            node = index.parent[offset + node];
+        }
+    }
+    std::make_heap(workspace.shells.begin(), workspace.shells.end());
+}
+
+/* Add the separation of the rows under the node with the largest separation among those not yet
+   visited, which are the ones at the top of 'workspace.shells' */
+static void visit_next_shell(WorkerForNeighbors &workspace, NeighborsIndex &index)
+{
+    std::pop_heap(workspace.shells.begin(), workspace.shells.end());
+    double sep  = workspace.shells.back().first;
+    size_t tree = workspace.shells.back().second;
+    workspace.shells.pop_back();
+
+    size_t offset = index.node_offset[tree];
+    size_t node = workspace.curr_node[tree];
+    size_t prev = workspace.prev_node[tree];
+    size_t *restrict ordered_rows = index.ordered_rows.data() + tree * index.nrows;
+    if (prev == SIZE_MAX)
+    {
+        add_shell_separation(workspace, ordered_rows, index.range_st[offset + node], index.range_end[offset + node], sep);
+    }
+
+    else
+    {
+        add_shell_separation(workspace, ordered_rows, index.range_st[offset + node], index.range_st[offset + prev], sep);
+        add_shell_separation(workspace, ordered_rows, index.range_end[offset + prev], index.range_end[offset + node], sep);
+    }
+
+    /* rows reached only at the root have zero separation */
+    if (node != 0 && index.parent[offset + node] != 0)
+    {
+        workspace.prev_node[tree] = node;
+        workspace.curr_node[tree] = index.parent[offset + node];
+        workspace.shells.emplace_back((double) index.depth[offset + workspace.curr_node[tree]], tree);
+        std::push_heap(workspace.shells.begin(), workspace.shells.end());
+    }
+}
+
+/* Check whether the 'k' rows with the largest separation accumulated so far are the nearest
+   neighbours, given that rows can get at most 'max_sep' from each tree in which they were not
+   yet reached. If so, leaves them in 'workspace.top_k' with their full separation. */
+static bool check_neighbors_found(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                                  size_t *restrict query_nodes, size_t k, double max_sep,
+                                  size_t nrows_search)
+{
+    size_t ntrees = index.node_offset.size() - 1;
+    size_t ncand = workspace.candidates.size();
+    if (ncand < k) return false;
+
+    workspace.candidates_sep.resize(ncand);
+    for (size_t ix = 0; ix < ncand; ix++)
+        workspace.candidates_sep[ix] = workspace.row_sep[workspace.candidates[ix]];
+    std::nth_element(workspace.candidates_sep.begin(), workspace.candidates_sep.begin() + (k - 1),
+                     workspace.candidates_sep.end(), std::greater<double>());
+    double kth_sep = workspace.candidates_sep[k - 1];
+
+    /* rows not yet reached in any tree */
+    if (ncand < nrows_search && (double)ntrees * max_sep > kth_sep)
+        return false;
+    size_t row;
+    for (size_t ix = 0; ix < ncand; ix++)
+    {
+        row = workspace.candidates[ix];
+        if (workspace.row_sep[row] > kth_sep) continue;
+        if (workspace.row_sep[row] + (double)(ntrees - workspace.row_ntrees[row]) * max_sep > kth_sep)
+            return false;
+    }
+
+    workspace.top_k.clear();
+    for (size_t ix = 0; ix < ncand; ix++)
+    {
+        row = workspace.candidates[ix];
+        if (workspace.row_sep[row] >= kth_sep)
+            workspace.top_k.emplace_back(workspace.row_sep[row], row);
+    }
+    std::partial_sort(workspace.top_k.begin(), workspace.top_k.begin() + k, workspace.top_k.end(), is_better_neighbor);
+    workspace.top_k.resize(k);
+    for (auto &neighbor : workspace.top_k)
+        neighbor.first = calc_neighbor_separation(workspace, index, query_nodes, neighbor.second);
+    return true;
+}
+
+/* Find the 'k' indexed rows with the largest separation depth with respect to a query row,
+   leaving them in 'workspace.top_k' sorted from best to worst. Pass 'exclude_row' = SIZE_MAX
+   if the query is not one of the indexed rows. */
+void find_neighbors_single(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                           size_t *restrict query_nodes, size_t k, size_t exclude_row)
+{
+    size_t nrows_search = index.nrows - ((exclude_row != SIZE_MAX)? 1 : 0);
+    start_neighbors_search(workspace, index, query_nodes, exclude_row);
+    if (!k) return;
+
+    double max_sep, last_check = HUGE_VAL;
+    while (!workspace.shells.empty())
+    {
+        /* checking is linear in the number of rows reached, so it's done only when the bound decreases enough */
+        max_sep = workspace.shells.front().first;
+        if (max_sep <= last_check - 1)
+        {
+            last_check = max_sep;
+            if (check_neighbors_found(workspace, index, query_nodes, k, max_sep, nrows_search))
+                goto sort_neighbors;
+        }
+        visit_next_shell(workspace, index);
+    }
+
+    /* at this point the separations are exact, and rows not reached have zero separation */
+    if (!workspace.candidates.empty())
+        check_neighbors_found(workspace, index, query_nodes, std::min(k, workspace.candidates.size()), 0., nrows_search);
+    for (size_t row = 0; row < index.nrows && workspace.top_k.size() < k; row++)
+        if (workspace.row_seen[row] != workspace.curr_query)
+            workspace.top_k.emplace_back(0., row);
+
+    sort_neighbors:
+    std::sort(workspace.top_k.begin(), workspace.top_k.end(), is_better_neighbor);
+}
+
+/* Find all the indexed rows with a separation depth of at least 'min_sep' with respect to a query
+   row, leaving them in 'workspace.top_k' in no particular order */
+void find_neighbors_above(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                          size_t *restrict query_nodes, double min_sep, size_t exclude_row)
+{
+    size_t ntrees = index.node_offset.size() - 1;
+    start_neighbors_search(workspace, index, query_nodes, exclude_row);
+
+    /* rows not yet reached in any tree can get at most 'max_sep' from each tree */
+    double max_sep = 0;
+    while (!workspace.shells.empty())
+    {
+        max_sep = workspace.shells.front().first;
+        if ((double)ntrees * max_sep < min_sep)
+            break;
+        visit_next_shell(workspace, index);
+    }
+    if (workspace.shells.empty())
+        max_sep = 0;
+
+    double sep;
+    for (size_t row : workspace.candidates)
+    {
+        if (workspace.row_sep[row] + (double)(ntrees - workspace.row_ntrees[row]) * max_sep < min_sep)
+            continue;
+        sep = calc_neighbor_separation(workspace, index, query_nodes, row);
+        if (sep >= min_sep)
+            workspace.top_k.emplace_back(sep, row);
+    }
+
+    if (workspace.shells.empty() && min_sep <= 0)
+    {
+        for (size_t row = 0; row < index.nrows; row++)
+            if (workspace.row_seen[row] != workspace.curr_query)
+                workspace.top_k.emplace_back(0., row);
+    }
+}
+
+/* Separation depth between the query and a reference row summed across trees, adding the same
+   amounts as 'calc_pair_separation' */
+double calc_neighbor_separation(WorkerForNeighbors &workspace, NeighborsIndex &index,
+                                size_t *restrict query_nodes, size_t row)
+{
+    size_t ntrees = index.node_offset.size() - 1;
+    size_t *restrict row_nodes = index.row_nodes.data() + row * ntrees;
+    double sep = 0;
+    size_t offset, node;
+    for (size_t tree = 0; tree < ntrees; tree++)
+    {
+        offset = index.node_offset[tree];
+        node = row_nodes[tree];
+        if (node == query_nodes[tree])
+        {
+            if (index.depth[offset + node] > 1)
+                sep += (double) (index.depth[offset + node] - 1);
+            sep += workspace.leaf_sep[tree];
+        }
+
+        else
+        {
+            while (workspace.node_on_path[offset + node] != workspace.curr_query)
+                node = index.parent[offset + node];
+            sep += (double) index.depth[offset + node];
+        }
+    }
+    return sep;
+}
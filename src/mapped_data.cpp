@@ -0,0 +1,521 @@
+/*    Isolation forests and variations thereof, with adjustments for incorporation
+*     of categorical variables and missing values.
+*     Writen for C++11 standard and aimed at being used in R and Python.
+*     
+*     This library is based on the following works:
+*     [1] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation forest."
+*         2008 Eighth IEEE International Conference on Data Mining. IEEE, 2008.
+*     [2] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation-based anomaly detection."
+*         ACM Transactions on Knowledge Discovery from Data (TKDD) 6.1 (2012): 3.
+*     [3] Hariri, Sahand, Matias Carrasco Kind, and Robert J. Brunner.
+*         "Extended Isolation Forest."
+*         arXiv preprint arXiv:1811.02141 (2018).
+*     [4] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "On detecting clustered anomalies using SCiForest."
+*         Joint European Conference on Machine Learning and Knowledge Discovery in Databases. Springer, Berlin, Heidelberg, 2010.
+*     [5] https://sourceforge.net/projects/iforest/
+*     [6] https://math.stackexchange.com/questions/3388518/expected-number-of-paths-required-to-separate-elements-in-a-binary-tree
+*     [7] Quinlan, J. Ross. C4. 5: programs for machine learning. Elsevier, 2014.
+*     [8] Cortes, David. "Distance approximation using Isolation Forests." arXiv preprint arXiv:1910.12362 (2019).
+*     [9] Cortes, David. "Imputing missing values with unsupervised random trees." arXiv preprint arXiv:1911.06646 (2019).
+* 
+*     BSD 2-Clause License
+*     Copyright (c) 2019, David Cortes
+*     All rights reserved.
+*     Redistribution and use in source and binary forms, with or without
+*     modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this
+*       list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice,
+*       this list of conditions and the following disclaimer in the documentation
+*       and/or other materials provided with the distribution.
+*     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+*     AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+*     IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+*     FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+*     DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "isotree.hpp"
+#include <fstream>
+#if defined(_WIN32) || defined(_WIN64)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <errno.h>
+#endif
+
+#define MAPPED_DATA_VERSION 1
+#define MAPPED_DATA_BYTE_ORDER 0x01020304
+#define MAPPED_DATA_ALIGNMENT 64
+static const char mapped_data_magic[8] = {'I', 'S', 'O', 'T', 'D', 'A', 'T', 'A'};
+
+static size_t align_mapped_offset(size_t offset)
+{
+    return (offset + MAPPED_DATA_ALIGNMENT - 1) / MAPPED_DATA_ALIGNMENT * MAPPED_DATA_ALIGNMENT;
+}
+
+static void write_mapped_block(std::ofstream &output, size_t &curr_offset, uint64_t &block_offset,
+                               const void *data, size_t n_bytes)
+{
+    if (!n_bytes) return;
+    size_t new_offset = align_mapped_offset(curr_offset);
+    static const char padding[MAPPED_DATA_ALIGNMENT] = {0};
+    output.write(padding, new_offset - curr_offset);
+    output.write((const char*)data, n_bytes);
+    block_offset = new_offset;
+    curr_offset = new_offset + n_bytes;
+}
+
+/* Write data to a file in the layout that can be memory-mapped through 'map_data_file'
+* 
+* The file consists of a header ('MappedDataHeader') followed by the arrays for the data, each
+* starting at an offset which is a multiple of 64 bytes: numeric data (either as a column-major
+* matrix of doubles, or as the non-zero values of a CSC matrix followed by its indices and index
+* pointer, which are stored with the size of 'sparse_ix'), categorical data (column-major 32-bit
+* integers), and the number of categories of each categorical column. The numbers are stored with the
+* endianness of the computer that writes the file, and such a file cannot be mapped in a computer with
+* different endianness.
+* 
+* Parameters
+* ==========
+* - file_path
+*       Name of the file to write. If it already exists, will be overwritten.
+* - numeric_data, ncols_numeric, categ_data, ncols_categ, ncat, Xc, Xc_ind, Xc_indptr, nrows
+*       Data to write, in the same format as taken by 'fit_iforest' (see the documentation in there
+*       for details). Sparse data must be in CSC format.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the file was written successfully,
+* or 'EXIT_FAILURE' (typically =1) otherwise.
+*/
+int write_mapped_data(const char *file_path,
+                      double numeric_data[],  size_t ncols_numeric,
+                      int    categ_data[],    size_t ncols_categ,    int ncat[],
+                      double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                      size_t nrows)
+{
+    std::ofstream output(file_path, std::ios::binary | std::ios::trunc);
+    if (!output.is_open()) return EXIT_FAILURE;
+
+    MappedDataHeader header = {};
+    memcpy(header.magic, mapped_data_magic, sizeof(mapped_data_magic));
+    header.version = MAPPED_DATA_VERSION;
+    header.byte_order = MAPPED_DATA_BYTE_ORDER;
+    header.nrows = nrows;
+    header.ncols_numeric = ncols_numeric;
+    header.ncols_categ = ncols_categ;
+    header.is_sparse = Xc_indptr != NULL;
+    header.nnz = header.is_sparse? Xc_indptr[ncols_numeric] : 0;
+    header.sparse_ix_bytes = sizeof(sparse_ix);
+
+    /* the header gets written again at the end, once the offsets are known */
+    output.write((const char*)&header, sizeof(MappedDataHeader));
+    size_t curr_offset = sizeof(MappedDataHeader);
+    if (!header.is_sparse)
+    {
+        if (numeric_data != NULL)
+            write_mapped_block(output, curr_offset, header.offset_numeric,
+                               numeric_data, nrows * ncols_numeric * sizeof(double));
+    }
+
+    else
+    {
+        write_mapped_block(output, curr_offset, header.offset_numeric,
+                           Xc, header.nnz * sizeof(double));
+        write_mapped_block(output, curr_offset, header.offset_Xc_ind,
+                           Xc_ind, header.nnz * sizeof(sparse_ix));
+        write_mapped_block(output, curr_offset, header.offset_Xc_indptr,
+                           Xc_indptr, (ncols_numeric + 1) * sizeof(sparse_ix));
+    }
+
+    if (categ_data != NULL)
+    {
+        write_mapped_block(output, curr_offset, header.offset_categ,
+                           categ_data, nrows * ncols_categ * sizeof(int));
+        write_mapped_block(output, curr_offset, header.offset_ncat,
+                           ncat, ncols_categ * sizeof(int));
+    }
+
+    output.seekp(0);
+    output.write((const char*)&header, sizeof(MappedDataHeader));
+    output.close();
+    return output.fail()? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static bool is_valid_mapped_block(uint64_t offset, size_t n_bytes, size_t file_size)
+{
+    if (!n_bytes) return true;
+    if (!offset || offset % sizeof(double)) return false;
+    return offset <= file_size && n_bytes <= file_size - offset;
+}
+
+static bool is_valid_mapped_header(const MappedDataHeader &header, size_t file_size)
+{
+    if (memcmp(header.magic, mapped_data_magic, sizeof(mapped_data_magic))) return false;
+    if (header.version != MAPPED_DATA_VERSION || header.byte_order != MAPPED_DATA_BYTE_ORDER) return false;
+    if (header.is_sparse && header.sparse_ix_bytes != sizeof(sparse_ix)) return false;
+
+    /* sizes are checked through divisions so that corrupted headers cannot overflow them */
+    size_t max_bytes = file_size;
+    if (header.ncols_numeric && !header.is_sparse && header.nrows > max_bytes / sizeof(double) / header.ncols_numeric)
+        return false;
+    if (header.ncols_categ && header.nrows > max_bytes / sizeof(int) / header.ncols_categ)
+        return false;
+    if (header.nnz > max_bytes / sizeof(double) || header.ncols_numeric >= max_bytes / sizeof(sparse_ix))
+        return false;
+
+    if (!header.is_sparse)
+    {
+        if (!is_valid_mapped_block(header.offset_numeric, header.nrows * header.ncols_numeric * sizeof(double), file_size))
+            return false;
+    }
+
+    else
+    {
+        if (!is_valid_mapped_block(header.offset_numeric, header.nnz * sizeof(double), file_size) ||
+            !is_valid_mapped_block(header.offset_Xc_ind, header.nnz * sizeof(sparse_ix), file_size) ||
+            !is_valid_mapped_block(header.offset_Xc_indptr, (header.ncols_numeric + 1) * sizeof(sparse_ix), file_size))
+            return false;
+    }
+
+    return is_valid_mapped_block(header.offset_categ, header.nrows * header.ncols_categ * sizeof(int), file_size) &&
+           is_valid_mapped_block(header.offset_ncat, header.ncols_categ * sizeof(int), file_size);
+}
+
+/* Checks that the indices of a mapped sparse matrix stay within the arrays, which is what the
+   functions that use the data assume - the pointers of the columns ('Xc_indptr') are cheap to
+   check, while the row indices and the categories require reading the whole data */
+static bool is_valid_mapped_data(const MappedData &mapped, uint64_t nnz, bool verify)
+{
+    if (mapped.Xc_indptr != NULL)
+    {
+        if (mapped.Xc_indptr[0] != 0 || (uint64_t)mapped.Xc_indptr[mapped.ncols_numeric] != nnz)
+            return false;
+        for (size_t col = 0; col < mapped.ncols_numeric; col++)
+            if (mapped.Xc_indptr[col] > mapped.Xc_indptr[col + 1])
+                return false;
+    }
+
+    if (!verify) return true;
+
+    if (mapped.Xc_ind != NULL)
+    {
+        for (size_t col = 0; col < mapped.ncols_numeric; col++)
+        {
+            for (size_t ix = mapped.Xc_indptr[col]; ix < mapped.Xc_indptr[col + 1]; ix++)
+            {
+                if (mapped.Xc_ind[ix] >= mapped.nrows)
+                    return false;
+                if (ix > mapped.Xc_indptr[col] && mapped.Xc_ind[ix] <= mapped.Xc_ind[ix - 1])
+                    return false;
+            }
+        }
+    }
+
+    for (size_t col = 0; col < mapped.ncols_categ; col++)
+    {
+        if (mapped.ncat[col] < 0)
+            return false;
+        const int *restrict col_data = mapped.categ_data + col * mapped.nrows;
+        for (size_t row = 0; row < mapped.nrows; row++)
+            if (col_data[row] >= mapped.ncat[col])
+                return false;
+    }
+
+    return true;
+}
+
+static bool set_mapped_pointers(MappedData &mapped, bool verify)
+{
+    const MappedDataHeader &header = *(MappedDataHeader*)mapped.mapped_addr;
+    char *base = (char*)mapped.mapped_addr;
+    if (!is_valid_mapped_header(header, mapped.mapped_size))
+        return false;
+
+    mapped.nrows = header.nrows;
+    mapped.ncols_numeric = header.ncols_numeric;
+    mapped.ncols_categ = header.ncols_categ;
+    if (!header.is_sparse)
+    {
+        if (header.offset_numeric)
+            mapped.numeric_data = (double*)(base + header.offset_numeric);
+    }
+
+    else
+    {
+        mapped.Xc        = header.nnz? (double*)(base + header.offset_numeric) : NULL;
+        mapped.Xc_ind    = header.nnz? (sparse_ix*)(base + header.offset_Xc_ind) : NULL;
+        mapped.Xc_indptr = (sparse_ix*)(base + header.offset_Xc_indptr);
+    }
+
+    if (header.offset_categ)
+    {
+        mapped.categ_data = (int*)(base + header.offset_categ);
+        mapped.ncat = (int*)(base + header.offset_ncat);
+    }
+
+    return is_valid_mapped_data(mapped, header.nnz, verify);
+}
+
+/* Map a whole existing file into memory, either as read-only or as writable and shared with the file */
+int map_file(const char *file_path, bool writable, void **mapped_addr, size_t *mapped_size)
+{
+    *mapped_addr = NULL;
+    *mapped_size = 0;
+    size_t file_size;
+
+    #if defined(_WIN32) || defined(_WIN64)
+    HANDLE file_handle = CreateFileA(file_path, writable? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ,
+                                     FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                                     FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) return EXIT_FAILURE;
+    LARGE_INTEGER file_size_li;
+    if (!GetFileSizeEx(file_handle, &file_size_li) || file_size_li.QuadPart <= 0)
+    {
+        CloseHandle(file_handle);
+        return EXIT_FAILURE;
+    }
+    file_size = (size_t)file_size_li.QuadPart;
+    HANDLE mapping_handle = CreateFileMappingA(file_handle, NULL, writable? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file_handle);
+    if (mapping_handle == NULL) return EXIT_FAILURE;
+    /* the view keeps the mapping alive after closing its handle */
+    void *addr = MapViewOfFile(mapping_handle, writable? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping_handle);
+    if (addr == NULL) return EXIT_FAILURE;
+    #else
+    int fd = open(file_path, writable? O_RDWR : O_RDONLY);
+    if (fd < 0) return EXIT_FAILURE;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) || file_stat.st_size <= 0)
+    {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    file_size = (size_t)file_stat.st_size;
+    void *addr = mmap(NULL, file_size, writable? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return EXIT_FAILURE;
+    #endif
+
+    *mapped_addr = addr;
+    *mapped_size = file_size;
+    return EXIT_SUCCESS;
+}
+
+void unmap_file(void *mapped_addr, size_t mapped_size)
+{
+    if (mapped_addr == NULL) return;
+    #if defined(_WIN32) || defined(_WIN64)
+    UnmapViewOfFile(mapped_addr);
+    #else
+    munmap(mapped_addr, mapped_size);
+    #endif
+}
+
+/* Map into memory a data file written by 'write_mapped_data'
+* 
+* The data is not read nor copied - the pointers in the output object point directly into the
+* mapped file, so they can be passed to 'fit_iforest', 'predict_iforest', 'calc_similarity' and
+* 'impute_missing_values' the same way as arrays in memory would be, e.g.:
+*     predict_iforest(mapped.numeric_data, mapped.categ_data,
+*                     mapped.Xc, mapped.Xc_ind, mapped.Xc_indptr,
+*                     NULL, NULL, NULL,
+*                     mapped.nrows, nthreads, true, &model, NULL, outlier_scores, NULL);
+* 
+* The pages get loaded as they are accessed and are shared with other processes that map the same file.
+* 
+* Parameters
+* ==========
+* - mapped (out)
+*       Object where to put the pointers to the data. Must be released through 'unmap_data_file'.
+*       Data that is not in the file (e.g. categorical columns) will have NULL pointers.
+* - file_path
+*       Name of the file to map.
+* - use
+*       What the data will be used for, which determines the hints given to the operating system
+*       about the pattern in which the data will be accessed (see 'advise_mapped_data'), and
+*       whether it can be modified. When passing 'UseForImputation', the mapping will be writable
+*       and shared with the file, so the imputed values (from 'impute_missing_values' or from
+*       'fit_iforest' with 'impute_at_fit=true') will be written into the file. Otherwise, the data
+*       is mapped as read-only, and trying to modify it will end the process.
+* - verify
+*       Whether to check that all the row indices of sparse data are within the number of rows and
+*       sorted within each column, and that all the categories are within the number of categories
+*       of their column. Data with invalid values would make the functions that use it read outside
+*       of the arrays. This requires reading all of the indices and categorical data when the file is
+*       mapped, so it should only be skipped for files that come from a trusted source. The sizes of
+*       the arrays and the column pointers of sparse data ('Xc_indptr') are always checked.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the file was mapped successfully,
+* or 'EXIT_FAILURE' (typically =1) if it could not be opened or is not a valid data file.
+*/
+int map_data_file(MappedData &mapped, const char *file_path, MappedDataUse use, bool verify)
+{
+    mapped = MappedData();
+    void *addr;
+    size_t file_size;
+    if (map_file(file_path, use == UseForImputation, &addr, &file_size) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    if (file_size < sizeof(MappedDataHeader))
+    {
+        unmap_file(addr, file_size);
+        return EXIT_FAILURE;
+    }
+
+    mapped.mapped_addr = addr;
+    mapped.mapped_size = file_size;
+    if (!set_mapped_pointers(mapped, verify))
+    {
+        unmap_data_file(mapped);
+        return EXIT_FAILURE;
+    }
+
+    advise_mapped_data(mapped, use);
+    return EXIT_SUCCESS;
+}
+
+/* Give hints about the pattern in which the mapped data will be accessed
+* 
+* When fitting a model, each column is first read in full while preparing the data (e.g. for finding
+* constant columns and columns with missing values), and the rows are then accessed at the positions
+* sampled for each tree, so the default read-ahead of the operating system is kept ('UseForFitting').
+* When predicting or imputing, the rows are processed in order, so each column is read sequentially and
+* its pages can be loaded further ahead and dropped soon after use ('UseForPrediction' and
+* 'UseForImputation'). The hints are already set by
+* 'map_data_file', but can be changed with this function if the same mapping is used for something else.
+* These are only hints to the operating system and do not change the results. Note that this function
+* does not make a read-only mapping writable.
+*/
+void advise_mapped_data(MappedData &mapped, MappedDataUse use)
+{
+    if (mapped.mapped_addr == NULL) return;
+    #if defined(MADV_NORMAL) && defined(MADV_SEQUENTIAL)
+    madvise(mapped.mapped_addr, mapped.mapped_size, (use == UseForFitting)? MADV_NORMAL : MADV_SEQUENTIAL);
+    #endif
+}
+
+void unmap_data_file(MappedData &mapped)
+{
+    unmap_file(mapped.mapped_addr, mapped.mapped_size);
+    mapped = MappedData();
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* Reserves the disk space for a file, so that running out of space is noticed here instead of
+   as a crash when writing to the mapped memory. If the system or file system cannot reserve it
+   without writing, the file gets filled with zeros instead. */
+static bool allocate_file(int fd, size_t n_bytes)
+{
+    #if !defined(__APPLE__)
+    int err = posix_fallocate(fd, 0, (off_t)n_bytes);
+    if (err != EINVAL && err != EOPNOTSUPP)
+        return err == 0;
+    #endif
+
+    static const char zeros[65536] = {0};
+    size_t n_written = 0;
+    while (n_written < n_bytes)
+    {
+        ssize_t n_curr = write(fd, zeros, std::min(sizeof(zeros), n_bytes - n_written));
+        if (n_curr < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        n_written += (size_t)n_curr;
+    }
+    return true;
+}
+#endif
+
+/* Create a file of a given size and map it for writing, for outputs that might not fit in memory
+* 
+* The file is created with 'n_bytes' (overwriting it if it already exists), reserving the space for
+* it in the disk, and mapped in shared mode, so whatever is written to the memory at '*mapped_addr'
+* ends up in the file. The pages are written back to the file as the operating system sees fit, which
+* is why the outputs written through this should be produced about sequentially. Must be released with
+* 'unmap_output_file', which returns 'EXIT_FAILURE' if the contents could not be flushed. If the
+* file cannot be created with that size (e.g. there is not enough space in the disk), will return
+* 'EXIT_FAILURE' and the file will not be left in the disk.
+*/
+int map_output_file(const char *file_path, size_t n_bytes, void **mapped_addr)
+{
+    *mapped_addr = NULL;
+    if (!n_bytes) return EXIT_FAILURE;
+
+    #if defined(_WIN32) || defined(_WIN64)
+    HANDLE file_handle = CreateFileA(file_path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                     FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) return EXIT_FAILURE;
+    /* creating the mapping with a given size also extends the file to that size */
+    HANDLE mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READWRITE,
+                                               (DWORD)((uint64_t)n_bytes >> 32), (DWORD)((uint64_t)n_bytes & 0xFFFFFFFF),
+                                               NULL);
+    CloseHandle(file_handle);
+    if (mapping_handle == NULL)
+    {
+        DeleteFileA(file_path);
+        return EXIT_FAILURE;
+    }
+    void *addr = MapViewOfFile(mapping_handle, FILE_MAP_WRITE, 0, 0, 0);
+    CloseHandle(mapping_handle);
+    if (addr == NULL)
+    {
+        DeleteFileA(file_path);
+        return EXIT_FAILURE;
+    }
+    #else
+    int fd = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return EXIT_FAILURE;
+    if (!allocate_file(fd, n_bytes))
+    {
+        close(fd);
+        unlink(file_path);
+        return EXIT_FAILURE;
+    }
+    void *addr = mmap(NULL, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        unlink(file_path);
+        return EXIT_FAILURE;
+    }
+    #if defined(MADV_SEQUENTIAL)
+    madvise(addr, n_bytes, MADV_SEQUENTIAL);
+    #endif
+    #endif
+
+    *mapped_addr = addr;
+    return EXIT_SUCCESS;
+}
+
+int unmap_output_file(void *mapped_addr, size_t n_bytes)
+{
+    if (mapped_addr == NULL) return EXIT_SUCCESS;
+    bool flushed;
+    #if defined(_WIN32) || defined(_WIN64)
+    flushed = FlushViewOfFile(mapped_addr, 0) != 0;
+    UnmapViewOfFile(mapped_addr);
+    #else
+    flushed = msync(mapped_addr, n_bytes, MS_SYNC) == 0;
+    munmap(mapped_addr, n_bytes);
+    #endif
+    return flushed? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,763 @@
+/*    Isolation forests and variations thereof, with adjustments for incorporation
+*     of categorical variables and missing values.
+*     Writen for C++11 standard and aimed at being used in R and Python.
+*     
+*     This library is based on the following works:
+*     [1] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation forest."
+*         2008 Eighth IEEE International Conference on Data Mining. IEEE, 2008.
+*     [2] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "Isolation-based anomaly detection."
+*         ACM Transactions on Knowledge Discovery from Data (TKDD) 6.1 (2012): 3.
+*     [3] Hariri, Sahand, Matias Carrasco Kind, and Robert J. Brunner.
+*         "Extended Isolation Forest."
+*         arXiv preprint arXiv:1811.02141 (2018).
+*     [4] Liu, Fei Tony, Kai Ming Ting, and Zhi-Hua Zhou.
+*         "On detecting clustered anomalies using SCiForest."
+*         Joint European Conference on Machine Learning and Knowledge Discovery in Databases. Springer, Berlin, Heidelberg, 2010.
+*     [5] https://sourceforge.net/projects/iforest/
+*     [6] https://math.stackexchange.com/questions/3388518/expected-number-of-paths-required-to-separate-elements-in-a-binary-tree
+*     [7] Quinlan, J. Ross. C4. 5: programs for machine learning. Elsevier, 2014.
+*     [8] Cortes, David. "Distance approximation using Isolation Forests." arXiv preprint arXiv:1910.12362 (2019).
+*     [9] Cortes, David. "Imputing missing values with unsupervised random trees." arXiv preprint arXiv:1911.06646 (2019).
+* 
+*     BSD 2-Clause License
+*     Copyright (c) 2019, David Cortes
+*     All rights reserved.
+*     Redistribution and use in source and binary forms, with or without
+*     modification, are permitted provided that the following conditions are met:
+*     * Redistributions of source code must retain the above copyright notice, this
+*       list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above copyright notice,
+*       this list of conditions and the following disclaimer in the documentation
+*       and/or other materials provided with the distribution.
+*     THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+*     AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+*     IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+*     DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+*     FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+*     DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+*     SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+*     CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+*     OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+*     OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+#include "isotree.hpp"
+#include <fstream>
+
+#define MAPPED_MODEL_VERSION 1
+#define MAPPED_MODEL_BYTE_ORDER 0x01020304
+#define MAPPED_MODEL_ALIGNMENT 64
+static const char mapped_model_magic[8] = {'I', 'S', 'O', 'T', 'M', 'O', 'D', 'L'};
+
+/* Kinds of sections in the files - later revisions of the format can add new kinds,
+   which are skipped by readers that do not know them */
+#define SECTION_TREE_OFFSETS     1
+#define SECTION_TREE_NODES       2
+#define SECTION_CAT_SPLIT        3
+#define SECTION_HPLANE_NODES     4
+#define SECTION_COL_NUM          5
+#define SECTION_COL_TYPE         6
+#define SECTION_FILL_VAL         7
+#define SECTION_COEF             8
+#define SECTION_MEAN             9
+#define SECTION_CHOSEN_CAT       10
+#define SECTION_FILL_NEW         11
+#define SECTION_CAT_COEF_INDPTR  12
+#define SECTION_CAT_COEF         13
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME        0x100000001b3ULL
+
+static uint64_t hash_words(uint64_t hash, const char *data, size_t n_bytes)
+{
+    uint64_t word;
+    for (size_t ix = 0; ix < n_bytes; ix += sizeof(uint64_t))
+    {
+        memcpy(&word, data + ix, sizeof(uint64_t));
+        hash = (hash ^ word) * FNV_PRIME;
+    }
+    return hash;
+}
+
+typedef struct ModelFileWriter {
+    std::ofstream  output;
+    uint64_t       curr_offset;
+    uint64_t       checksum;
+    char           tail[sizeof(uint64_t)];  /* bytes at the end that do not yet make a full word */
+    size_t         n_tail;
+} ModelFileWriter;
+
+static void write_model_bytes(ModelFileWriter &writer, const void *data, size_t n_bytes)
+{
+    if (!n_bytes) return;
+    writer.output.write((const char*)data, n_bytes);
+    writer.curr_offset += n_bytes;
+
+    const char *ptr = (const char*)data;
+    if (writer.n_tail)
+    {
+        size_t n_fill = std::min(n_bytes, sizeof(uint64_t) - writer.n_tail);
+        memcpy(writer.tail + writer.n_tail, ptr, n_fill);
+        writer.n_tail += n_fill;
+        ptr += n_fill;
+        n_bytes -= n_fill;
+        if (writer.n_tail < sizeof(uint64_t))
+            return;
+        writer.checksum = hash_words(writer.checksum, writer.tail, sizeof(uint64_t));
+        writer.n_tail = 0;
+    }
+    size_t n_words_bytes = n_bytes - n_bytes % sizeof(uint64_t);
+    writer.checksum = hash_words(writer.checksum, ptr, n_words_bytes);
+    memcpy(writer.tail + writer.n_tail, ptr + n_words_bytes, n_bytes - n_words_bytes);
+    writer.n_tail += n_bytes - n_words_bytes;
+}
+
+static void pad_model_file(ModelFileWriter &writer, uint64_t new_offset)
+{
+    static const char padding[MAPPED_MODEL_ALIGNMENT] = {0};
+    while (writer.curr_offset < new_offset)
+        write_model_bytes(writer, padding, std::min((uint64_t)MAPPED_MODEL_ALIGNMENT, new_offset - writer.curr_offset));
+}
+
+template <class T>
+static void write_model_array(ModelFileWriter &writer, const std::vector<T> &arr)
+{
+    write_model_bytes(writer, arr.data(), arr.size() * sizeof(T));
+}
+
+static void add_model_section(std::vector<MappedModelSection> &sections, uint32_t kind, uint32_t elem_bytes, uint64_t count)
+{
+    MappedModelSection section = {};
+    section.kind = kind;
+    section.elem_bytes = elem_bytes;
+    section.count = count;
+    sections.push_back(section);
+}
+
+/* Writes the entries that one section takes from the nodes of each tree, buffering them
+   per tree. The function 'append' adds the entries of a node to the buffer. */
+template <class T, class Node, class Fun>
+static void write_model_section(ModelFileWriter &writer, const MappedModelSection &section,
+                                std::vector<std::vector<Node>> &trees, Fun append)
+{
+    pad_model_file(writer, section.offset);
+    std::vector<T> buffer;
+    for (std::vector<Node> &tree : trees)
+    {
+        buffer.clear();
+        for (Node &node : tree)
+            append(node, buffer);
+        write_model_array(writer, buffer);
+    }
+}
+
+static void get_mapped_node(IsoTree &node, CategSplit cat_split_type, uint64_t cat_split_st, MappedTreeNode &mapped_node)
+{
+    mapped_node = MappedTreeNode();
+    mapped_node.score = node.score;
+    mapped_node.range_low = node.range_low;
+    mapped_node.range_high = node.range_high;
+    mapped_node.col_type = node.col_type;
+    if (node.score >= 0)
+    {
+        mapped_node.remainder = node.remainder;
+        return;
+    }
+
+    mapped_node.col_num = node.col_num;
+    mapped_node.tree_left = node.tree_left;
+    mapped_node.tree_right = node.tree_right;
+    mapped_node.pct_tree_left = node.pct_tree_left;
+    if (node.col_type == Numeric)
+        mapped_node.num_split = node.num_split;
+    else if (node.col_type == Categorical)
+    {
+        mapped_node.cat_split_st = cat_split_st;
+        mapped_node.cat_split_size = node.cat_split.size();
+        if (cat_split_type == SingleCateg)
+            mapped_node.chosen_cat = node.chosen_cat;
+    }
+}
+
+static void get_mapped_node(IsoHPlane &node, uint64_t col_st, uint64_t num_st, uint64_t cat_st, MappedHPlaneNode &mapped_node)
+{
+    mapped_node = MappedHPlaneNode();
+    mapped_node.score = node.score;
+    mapped_node.range_low = node.range_low;
+    mapped_node.range_high = node.range_high;
+    if (node.score >= 0)
+    {
+        mapped_node.remainder = node.remainder;
+        return;
+    }
+
+    mapped_node.split_point = node.split_point;
+    mapped_node.hplane_left = node.hplane_left;
+    mapped_node.hplane_right = node.hplane_right;
+    mapped_node.col_st = col_st;
+    mapped_node.ncols = node.col_num.size();
+    mapped_node.num_st = num_st;
+    mapped_node.cat_st = cat_st;
+}
+
+static size_t count_col_type(IsoHPlane &node, ColType col_type)
+{
+    return std::count(node.col_type.begin(), node.col_type.end(), col_type);
+}
+
+/* Write a model to a file in a layout that can be used for predictions right after being mapped
+* into memory through 'map_model_file', without de-serializing it
+* 
+* The file consists of a header ('MappedModelHeader'), a table with the kind, element size,
+* number of elements and offset of each section ('MappedModelSection'), and the sections
+* themselves, each starting at an offset which is a multiple of 64 bytes. The sections hold
+* the nodes of all the trees one after the other as plain structs ('MappedTreeNode' or
+* 'MappedHPlaneNode') along with where each tree starts, and the variable-length parts of the
+* nodes (such as categorical splits or the columns of hyperplanes) in separate arrays which
+* the nodes index into. The header contains a checksum of the whole file, and the
+* revision of the format together with the oldest revision that is able to read it - later
+* revisions are meant to add new kinds of sections, which older readers will skip.
+* 
+* The numbers are stored with the endianness of the computer that writes the file, and such
+* a file cannot be mapped in a computer with different endianness. The file does not depend
+* on Cereal, and is written one tree at a time without making a copy of the whole model.
+* 
+* Parameters
+* ==========
+* - file_path
+*       Name of the file to write. If it already exists, will be overwritten.
+* - model_outputs
+*       Pointer to fitted single-variable model object from function 'fit_iforest'. Pass NULL
+*       if the model to write is an extended model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* - model_outputs_ext
+*       Pointer to fitted extended model object from function 'fit_iforest'. Pass NULL
+*       if the model to write is a single-variable model. Can only pass one of
+*       'model_outputs' and 'model_outputs_ext'.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the file was written successfully,
+* or 'EXIT_FAILURE' (typically =1) otherwise.
+*/
+int write_model_file(const char *file_path, IsoForest *model_outputs, ExtIsoForest *model_outputs_ext)
+{
+    MappedModelHeader header = {};
+    memcpy(header.magic, mapped_model_magic, sizeof(mapped_model_magic));
+    header.version = MAPPED_MODEL_VERSION;
+    header.min_version = MAPPED_MODEL_VERSION;
+    header.byte_order = MAPPED_MODEL_BYTE_ORDER;
+    header.header_bytes = sizeof(MappedModelHeader);
+    header.is_extended = model_outputs == NULL;
+
+    std::vector<uint64_t> tree_offsets(1, 0);
+    std::vector<MappedModelSection> sections;
+    if (model_outputs != NULL)
+    {
+        header.new_cat_action = model_outputs->new_cat_action;
+        header.cat_split_type = model_outputs->cat_split_type;
+        header.missing_action = model_outputs->missing_action;
+        header.exp_avg_depth = model_outputs->exp_avg_depth;
+        header.exp_avg_sep = model_outputs->exp_avg_sep;
+        header.orig_sample_size = model_outputs->orig_sample_size;
+        header.ntrees = model_outputs->trees.size();
+
+        uint64_t n_cat_split = 0;
+        for (std::vector<IsoTree> &tree : model_outputs->trees)
+        {
+            tree_offsets.push_back(tree_offsets.back() + tree.size());
+            for (IsoTree &node : tree)
+                if (node.score < 0 && node.col_type == Categorical)
+                    n_cat_split += node.cat_split.size();
+        }
+        add_model_section(sections, SECTION_TREE_OFFSETS, sizeof(uint64_t), tree_offsets.size());
+        add_model_section(sections, SECTION_TREE_NODES, sizeof(MappedTreeNode), tree_offsets.back());
+        add_model_section(sections, SECTION_CAT_SPLIT, sizeof(signed char), n_cat_split);
+    }
+
+    else
+    {
+        header.new_cat_action = model_outputs_ext->new_cat_action;
+        header.cat_split_type = model_outputs_ext->cat_split_type;
+        header.missing_action = model_outputs_ext->missing_action;
+        header.exp_avg_depth = model_outputs_ext->exp_avg_depth;
+        header.exp_avg_sep = model_outputs_ext->exp_avg_sep;
+        header.orig_sample_size = model_outputs_ext->orig_sample_size;
+        header.ntrees = model_outputs_ext->hplanes.size();
+
+        uint64_t n_cols = 0, n_num = 0, n_cat = 0, n_cat_coef = 0;
+        for (std::vector<IsoHPlane> &tree : model_outputs_ext->hplanes)
+        {
+            tree_offsets.push_back(tree_offsets.back() + tree.size());
+            for (IsoHPlane &node : tree)
+            {
+                if (node.score >= 0) continue;
+                n_cols += node.col_num.size();
+                n_num += count_col_type(node, Numeric);
+                size_t n_cat_node = count_col_type(node, Categorical);
+                for (size_t col = 0; col < std::min(n_cat_node, node.cat_coef.size()); col++)
+                    n_cat_coef += node.cat_coef[col].size();
+                n_cat += n_cat_node;
+            }
+        }
+        add_model_section(sections, SECTION_TREE_OFFSETS, sizeof(uint64_t), tree_offsets.size());
+        add_model_section(sections, SECTION_HPLANE_NODES, sizeof(MappedHPlaneNode), tree_offsets.back());
+        add_model_section(sections, SECTION_COL_NUM, sizeof(uint64_t), n_cols);
+        add_model_section(sections, SECTION_COL_TYPE, sizeof(int32_t), n_cols);
+        add_model_section(sections, SECTION_FILL_VAL, sizeof(double), n_cols);
+        add_model_section(sections, SECTION_COEF, sizeof(double), n_num);
+        add_model_section(sections, SECTION_MEAN, sizeof(double), n_num);
+        add_model_section(sections, SECTION_CHOSEN_CAT, sizeof(int32_t), n_cat);
+        add_model_section(sections, SECTION_FILL_NEW, sizeof(double), n_cat);
+        add_model_section(sections, SECTION_CAT_COEF_INDPTR, sizeof(uint64_t), n_cat + 1);
+        add_model_section(sections, SECTION_CAT_COEF, sizeof(double), n_cat_coef);
+    }
+
+    header.nsections = sections.size();
+    uint64_t curr_offset = header.header_bytes + sections.size() * sizeof(MappedModelSection);
+    for (MappedModelSection &section : sections)
+    {
+        section.offset = (curr_offset + MAPPED_MODEL_ALIGNMENT - 1) / MAPPED_MODEL_ALIGNMENT * MAPPED_MODEL_ALIGNMENT;
+        curr_offset = section.offset + section.count * section.elem_bytes;
+    }
+    header.file_size = (curr_offset + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+
+    ModelFileWriter writer;
+    writer.output.open(file_path, std::ios::binary | std::ios::trunc);
+    if (!writer.output.is_open()) return EXIT_FAILURE;
+    writer.checksum = FNV_OFFSET_BASIS;
+    writer.n_tail = 0;
+
+    /* the header gets written again at the end, once the checksum is known - the
+       checksum covers the header too, taking the checksum field itself as zero */
+    writer.curr_offset = 0;
+    write_model_bytes(writer, &header, sizeof(MappedModelHeader));
+    write_model_array(writer, sections);
+
+    if (model_outputs != NULL)
+    {
+        CategSplit cat_split_type = model_outputs->cat_split_type;
+        uint64_t cat_split_st = 0;
+        pad_model_file(writer, sections[0].offset);
+        write_model_array(writer, tree_offsets);
+        write_model_section<MappedTreeNode>(writer, sections[1], model_outputs->trees,
+            [&cat_split_st, cat_split_type](IsoTree &node, std::vector<MappedTreeNode> &buffer)
+            {
+                buffer.emplace_back();
+                get_mapped_node(node, cat_split_type, cat_split_st, buffer.back());
+                cat_split_st += buffer.back().cat_split_size;
+            });
+        write_model_section<signed char>(writer, sections[2], model_outputs->trees,
+            [](IsoTree &node, std::vector<signed char> &buffer)
+            {
+                if (node.score < 0 && node.col_type == Categorical)
+                    buffer.insert(buffer.end(), node.cat_split.begin(), node.cat_split.end());
+            });
+    }
+
+    else
+    {
+        uint64_t col_st = 0, num_st = 0, cat_st = 0, cat_coef_st = 0;
+        std::vector<std::vector<IsoHPlane>> &trees = model_outputs_ext->hplanes;
+        pad_model_file(writer, sections[0].offset);
+        write_model_array(writer, tree_offsets);
+        write_model_section<MappedHPlaneNode>(writer, sections[1], trees,
+            [&col_st, &num_st, &cat_st](IsoHPlane &node, std::vector<MappedHPlaneNode> &buffer)
+            {
+                buffer.emplace_back();
+                get_mapped_node(node, col_st, num_st, cat_st, buffer.back());
+                if (node.score >= 0) return;
+                col_st += node.col_num.size();
+                num_st += count_col_type(node, Numeric);
+                cat_st += count_col_type(node, Categorical);
+            });
+        write_model_section<uint64_t>(writer, sections[2], trees,
+            [](IsoHPlane &node, std::vector<uint64_t> &buffer)
+            {
+                if (node.score < 0)
+                    buffer.insert(buffer.end(), node.col_num.begin(), node.col_num.end());
+            });
+        write_model_section<int32_t>(writer, sections[3], trees,
+            [](IsoHPlane &node, std::vector<int32_t> &buffer)
+            {
+                if (node.score < 0)
+                    buffer.insert(buffer.end(), node.col_type.begin(), node.col_type.end());
+            });
+        /* when the model does not impute missing values, there are no fill values */
+        write_model_section<double>(writer, sections[4], trees,
+            [](IsoHPlane &node, std::vector<double> &buffer)
+            {
+                if (node.score < 0)
+                    for (size_t col = 0; col < node.col_num.size(); col++)
+                        buffer.push_back((col < node.fill_val.size())? node.fill_val[col] : 0.);
+            });
+        write_model_section<double>(writer, sections[5], trees,
+            [](IsoHPlane &node, std::vector<double> &buffer)
+            {
+                if (node.score < 0)
+                    for (size_t col = 0; col < count_col_type(node, Numeric); col++)
+                        buffer.push_back(node.coef[col]);
+            });
+        write_model_section<double>(writer, sections[6], trees,
+            [](IsoHPlane &node, std::vector<double> &buffer)
+            {
+                if (node.score < 0)
+                    for (size_t col = 0; col < count_col_type(node, Numeric); col++)
+                        buffer.push_back(node.mean[col]);
+            });
+        /* categorical columns have either a chosen category or coefficients for every category */
+        write_model_section<int32_t>(writer, sections[7], trees,
+            [](IsoHPlane &node, std::vector<int32_t> &buffer)
+            {
+                if (node.score < 0)
+                    for (size_t col = 0; col < count_col_type(node, Categorical); col++)
+                        buffer.push_back((col < node.chosen_cat.size())? node.chosen_cat[col] : 0);
+            });
+        write_model_section<double>(writer, sections[8], trees,
+            [](IsoHPlane &node, std::vector<double> &buffer)
+            {
+                if (node.score < 0)
+                    for (size_t col = 0; col < count_col_type(node, Categorical); col++)
+                        buffer.push_back((col < node.fill_new.size())? node.fill_new[col] : 0.);
+            });
+        write_model_section<uint64_t>(writer, sections[9], trees,
+            [&cat_coef_st](IsoHPlane &node, std::vector<uint64_t> &buffer)
+            {
+                if (node.score < 0)
+                    for (size_t col = 0; col < count_col_type(node, Categorical); col++)
+                    {
+                        buffer.push_back(cat_coef_st);
+                        if (col < node.cat_coef.size())
+                            cat_coef_st += node.cat_coef[col].size();
+                    }
+            });
+        write_model_bytes(writer, &cat_coef_st, sizeof(uint64_t));
+        write_model_section<double>(writer, sections[10], trees,
+            [](IsoHPlane &node, std::vector<double> &buffer)
+            {
+                if (node.score < 0)
+                    for (size_t col = 0; col < std::min(count_col_type(node, Categorical), node.cat_coef.size()); col++)
+                        buffer.insert(buffer.end(), node.cat_coef[col].begin(), node.cat_coef[col].end());
+            });
+    }
+
+    pad_model_file(writer, header.file_size);
+    if (writer.curr_offset != header.file_size || writer.n_tail)
+        return EXIT_FAILURE;
+    header.checksum = writer.checksum;
+    writer.output.seekp(0);
+    writer.output.write((const char*)&header, sizeof(MappedModelHeader));
+    writer.output.close();
+    return writer.output.fail()? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static bool is_valid_model_header(const MappedModelHeader &header, size_t file_size)
+{
+    if (memcmp(header.magic, mapped_model_magic, sizeof(mapped_model_magic))) return false;
+    if (header.byte_order != MAPPED_MODEL_BYTE_ORDER || header.min_version > MAPPED_MODEL_VERSION) return false;
+    if (header.header_bytes < sizeof(MappedModelHeader) || header.header_bytes % sizeof(uint64_t)) return false;
+    if (header.file_size != file_size || file_size % sizeof(uint64_t) || header.header_bytes > file_size) return false;
+    if (header.nsections > (file_size - header.header_bytes) / sizeof(MappedModelSection)) return false;
+    if (header.is_extended > 1 || header.new_cat_action > Random ||
+        header.cat_split_type > SingleCateg || header.missing_action > Fail)
+        return false;
+    return header.ntrees && header.ntrees < file_size / sizeof(uint64_t);
+}
+
+static bool is_valid_model_section(const MappedModelSection &section, uint32_t elem_bytes, size_t file_size)
+{
+    if (section.elem_bytes != elem_bytes) return false;
+    if (!section.count) return true;
+    if (!section.offset || section.offset % sizeof(uint64_t)) return false;
+    return section.count <= file_size / elem_bytes &&
+           section.offset <= file_size &&
+           section.count * elem_bytes <= file_size - section.offset;
+}
+
+/* 'counts' will have the number of elements of each known kind of section, and zero for those that are missing */
+static bool set_model_pointers(MappedModel &mapped, std::vector<uint64_t> &counts)
+{
+    const MappedModelHeader &header = *(MappedModelHeader*)mapped.mapped_addr;
+    char *base = (char*)mapped.mapped_addr;
+    if (!is_valid_model_header(header, mapped.mapped_size))
+        return false;
+
+    mapped.is_extended = header.is_extended;
+    mapped.new_cat_action = (NewCategAction) header.new_cat_action;
+    mapped.cat_split_type = (CategSplit) header.cat_split_type;
+    mapped.missing_action = (MissingAction) header.missing_action;
+    mapped.exp_avg_depth = header.exp_avg_depth;
+    mapped.exp_avg_sep = header.exp_avg_sep;
+    mapped.orig_sample_size = header.orig_sample_size;
+    mapped.ntrees = header.ntrees;
+
+    counts.assign(SECTION_CAT_COEF + 1, 0);
+    MappedModelSection *sections = (MappedModelSection*)(base + header.header_bytes);
+    for (size_t ix = 0; ix < header.nsections; ix++)
+    {
+        MappedModelSection &section = sections[ix];
+        void *ptr = section.count? (void*)(base + section.offset) : NULL;
+        switch(section.kind)
+        {
+            #define set_section(ptr_out, type) \
+                if (!is_valid_model_section(section, sizeof(type), mapped.mapped_size)) return false; \
+                ptr_out = (type*)ptr; counts[section.kind] = section.count; break;
+            case SECTION_TREE_OFFSETS:     {set_section(mapped.tree_offsets, uint64_t)}
+            case SECTION_TREE_NODES:       {set_section(mapped.nodes, MappedTreeNode)}
+            case SECTION_CAT_SPLIT:        {set_section(mapped.cat_split, signed char)}
+            case SECTION_HPLANE_NODES:     {set_section(mapped.hplanes, MappedHPlaneNode)}
+            case SECTION_COL_NUM:          {set_section(mapped.col_num, uint64_t)}
+            case SECTION_COL_TYPE:         {set_section(mapped.col_type, int32_t)}
+            case SECTION_FILL_VAL:         {set_section(mapped.fill_val, double)}
+            case SECTION_COEF:             {set_section(mapped.coef, double)}
+            case SECTION_MEAN:             {set_section(mapped.mean, double)}
+            case SECTION_CHOSEN_CAT:       {set_section(mapped.chosen_cat, int32_t)}
+            case SECTION_FILL_NEW:         {set_section(mapped.fill_new, double)}
+            case SECTION_CAT_COEF_INDPTR:  {set_section(mapped.cat_coef_indptr, uint64_t)}
+            case SECTION_CAT_COEF:         {set_section(mapped.cat_coef, double)}
+            #undef set_section
+            default: break;
+        }
+    }
+
+    uint64_t n_nodes = counts[mapped.is_extended? SECTION_HPLANE_NODES : SECTION_TREE_NODES];
+    if (counts[SECTION_TREE_OFFSETS] != header.ntrees + 1 || mapped.tree_offsets[0] != 0 || mapped.tree_offsets[header.ntrees] != n_nodes)
+        return false;
+    for (size_t tree = 0; tree < header.ntrees; tree++)
+        if (mapped.tree_offsets[tree + 1] <= mapped.tree_offsets[tree])
+            return false;
+
+    if (!mapped.is_extended)
+        return mapped.hplanes == NULL;
+    uint64_t n_cat = counts[SECTION_CHOSEN_CAT];
+    return mapped.nodes == NULL &&
+           counts[SECTION_COL_TYPE] == counts[SECTION_COL_NUM] && counts[SECTION_FILL_VAL] == counts[SECTION_COL_NUM] &&
+           counts[SECTION_MEAN] == counts[SECTION_COEF] && counts[SECTION_FILL_NEW] == n_cat &&
+           counts[SECTION_CAT_COEF_INDPTR] == n_cat + 1 && mapped.cat_coef_indptr[n_cat] == counts[SECTION_CAT_COEF];
+}
+
+/* checks that following the indices in the nodes stays within the arrays of the file */
+static bool are_valid_model_nodes(MappedModel &mapped, std::vector<uint64_t> &counts)
+{
+    uint64_t n_cat_split = counts[SECTION_CAT_SPLIT], n_cols = counts[SECTION_COL_NUM];
+    uint64_t n_coef = counts[SECTION_COEF], n_cat = counts[SECTION_CHOSEN_CAT];
+
+    for (size_t tree = 0; tree < mapped.ntrees; tree++)
+    {
+        uint64_t tree_size = mapped.tree_offsets[tree + 1] - mapped.tree_offsets[tree];
+        for (uint64_t node = mapped.tree_offsets[tree]; node < mapped.tree_offsets[tree + 1]; node++)
+        {
+            if (!mapped.is_extended)
+            {
+                MappedTreeNode &tree_node = mapped.nodes[node];
+                if (tree_node.score > 0) continue;
+                if (tree_node.tree_left >= tree_size || tree_node.tree_right >= tree_size)
+                    return false;
+                if (tree_node.col_type == Categorical)
+                {
+                    if (tree_node.cat_split_st > n_cat_split || tree_node.cat_split_size > n_cat_split - tree_node.cat_split_st)
+                        return false;
+                }
+                else if (tree_node.col_type != Numeric && !(tree_node.score >= 0))
+                    return false;
+            }
+
+            else
+            {
+                MappedHPlaneNode &hplane = mapped.hplanes[node];
+                if (hplane.score > 0) continue;
+                if (hplane.hplane_left >= tree_size || hplane.hplane_right >= tree_size)
+                    return false;
+                if (hplane.col_st > n_cols || hplane.ncols > n_cols - hplane.col_st)
+                    return false;
+                uint64_t n_num_node = 0, n_cat_node = 0;
+                for (uint64_t col = hplane.col_st; col < hplane.col_st + hplane.ncols; col++)
+                {
+                    if (mapped.col_type[col] == Numeric)
+                        n_num_node++;
+                    else if (mapped.col_type[col] == Categorical)
+                        n_cat_node++;
+                    else
+                        return false;
+                }
+                if (hplane.num_st > n_coef || n_num_node > n_coef - hplane.num_st ||
+                    hplane.cat_st > n_cat || n_cat_node > n_cat - hplane.cat_st)
+                    return false;
+            }
+        }
+    }
+
+    if (mapped.is_extended)
+        for (size_t ix = 0; ix < n_cat; ix++)
+            if (mapped.cat_coef_indptr[ix + 1] < mapped.cat_coef_indptr[ix])
+                return false;
+    return true;
+}
+
+/* Map into memory a model file written by 'write_model_file'
+* 
+* The model is not read nor copied - the pointers in the output object point directly into the
+* mapped file, and can be passed to 'predict_mapped_model', which traverses the nodes of the trees
+* in the file itself. Only the header and the table of sections are read when mapping it, and the
+* pages with the nodes get loaded as the predictions reach them and are shared with other processes
+* that map the same file, so mapping a large model takes about the same time as mapping a small one
+* and does not need memory for a copy of it.
+* 
+* Parameters
+* ==========
+* - mapped (out)
+*       Object where to put the pointers to the model. Must be released through 'unmap_model_file'.
+* - file_path
+*       Name of the file to map.
+* - verify
+*       Whether to read the whole file in order to verify its checksum and that the indices stored
+*       in the nodes of the trees are within the bounds of the arrays in the file. If passing 'false',
+*       only the header and the table of sections will be checked, and a corrupted file could make
+*       the predictions read outside of the mapped memory.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) if the file was mapped successfully,
+* or 'EXIT_FAILURE' (typically =1) if it could not be opened, is not a valid model file,
+* was written by a newer revision of the format that this one cannot read, or was written
+* in a computer with different endianness.
+*/
+int map_model_file(MappedModel &mapped, const char *file_path, bool verify)
+{
+    mapped = MappedModel();
+    void *addr;
+    size_t file_size;
+    if (map_file(file_path, false, &addr, &file_size) != EXIT_SUCCESS)
+        return EXIT_FAILURE;
+    mapped.mapped_addr = addr;
+    mapped.mapped_size = file_size;
+
+    std::vector<uint64_t> counts;
+    bool is_valid = file_size >= sizeof(MappedModelHeader) && set_model_pointers(mapped, counts);
+    if (is_valid && verify)
+    {
+        MappedModelHeader header = *(MappedModelHeader*)addr;
+        uint64_t checksum = header.checksum;
+        header.checksum = 0;
+        uint64_t file_checksum = hash_words(FNV_OFFSET_BASIS, (char*)&header, sizeof(MappedModelHeader));
+        file_checksum = hash_words(file_checksum, (char*)addr + sizeof(MappedModelHeader),
+                                   file_size - sizeof(MappedModelHeader));
+        is_valid = file_checksum == checksum && are_valid_model_nodes(mapped, counts);
+    }
+
+    if (!is_valid)
+    {
+        unmap_model_file(mapped);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void unmap_model_file(MappedModel &mapped)
+{
+    unmap_file(mapped.mapped_addr, mapped.mapped_size);
+    mapped = MappedModel();
+}
+
+
+/* Predict outlier score, average depth, or terminal node numbers from a model mapped through 'map_model_file'
+* 
+* This produces the same outputs as 'predict_iforest' with the model from which the file was
+* written, taking the data in the same format, but reads the nodes from the mapped file.
+* 
+* Parameters
+* ==========
+* - numeric_data, categ_data, Xc, Xc_ind, Xc_indptr, Xr, Xr_ind, Xr_indptr, nrows, nthreads, standardize
+*       Same as for 'predict_iforest' (see the documentation there for details).
+* - model
+*       Model mapped from a file through 'map_model_file'.
+* - output_depths[nrows] (out)
+*       Pointer to array where the output average depths or outlier scores will be written into.
+*       Must already be initialized to zeros.
+* - tree_num[nrows * ntrees] (out)
+*       Pointer to array where the output terminal node numbers will be written into.
+*       Pass NULL if only average depths or outlier scores are desired.
+*/
+void predict_mapped_model(double numeric_data[], int categ_data[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          double Xr[], sparse_ix Xr_ind[], sparse_ix Xr_indptr[],
+                          size_t nrows, int nthreads, bool standardize,
+                          MappedModel &model, double output_depths[], sparse_ix tree_num[])
+{
+    PredictionData prediction_data = {numeric_data, categ_data, nrows,
+                                      Xc, Xc_ind, Xc_indptr,
+                                      Xr, Xr_ind, Xr_indptr};
+
+    if ((size_t)nthreads > nrows)
+        nthreads = nrows;
+
+    size_t ntrees = model.ntrees;
+    bool is_simple = model.missing_action == Fail &&
+                     prediction_data.Xc_indptr == NULL && prediction_data.Xr_indptr == NULL;
+    if (!model.is_extended)
+        is_simple = is_simple && (model.new_cat_action != Weighted || prediction_data.categ_data == NULL);
+    else
+        is_simple = is_simple && prediction_data.categ_data == NULL;
+
+    #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, model, prediction_data, output_depths, tree_num, ntrees, is_simple)
+    for (size_t_for row = 0; row < nrows; row++)
+    {
+        for (size_t tree = 0; tree < ntrees; tree++)
+        {
+            sparse_ix *tree_num_tree = (tree_num == NULL)? NULL : tree_num + nrows * tree;
+            if (!model.is_extended)
+            {
+                MappedTreeNodes tree_nodes(model, tree);
+                if (is_simple)
+                    traverse_itree_no_recurse(tree_nodes, prediction_data, output_depths[row], tree_num_tree, (size_t) row);
+                else
+                    output_depths[row] += traverse_itree(tree_nodes, prediction_data, NULL, NULL, 0,
+                                                         (size_t) row, tree_num_tree, (size_t) 0);
+            }
+
+            else
+            {
+                MappedHPlaneNodes hplane_nodes(model, tree);
+                if (is_simple)
+                    traverse_hplane_fast(hplane_nodes, prediction_data, output_depths[row], tree_num_tree, (size_t) row);
+                else
+                    traverse_hplane(hplane_nodes, prediction_data, output_depths[row], NULL, NULL, tree_num_tree, (size_t) row);
+            }
+        }
+    }
+
+    /* translate sum-of-depths to outlier score */
+    double depth_divisor = (double)ntrees * model.exp_avg_depth;
+    if (standardize)
+        #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, output_depths, depth_divisor)
+        for (size_t_for row = 0; row < nrows; row++)
+            output_depths[row] = exp2( - output_depths[row] / depth_divisor );
+    else
+        #pragma omp parallel for schedule(static) num_threads(nthreads) shared(nrows, output_depths, ntrees)
+        for (size_t_for row = 0; row < nrows; row++)
+            output_depths[row] /= (double)ntrees;
+
+    /* re-map tree numbers to start at zero, as done by 'remap_terminal_trees' */
+    if (tree_num != NULL)
+    {
+        std::vector<sparse_ix> tree_mapping;
+        for (size_t tree = 0; tree < ntrees; tree++)
+        {
+            size_t tree_size = model.tree_offsets[tree + 1] - model.tree_offsets[tree];
+            tree_mapping.assign(tree_size, 0);
+            size_t curr_term = 0;
+            for (size_t node = 0; node < tree_size; node++)
+            {
+                double score = model.is_extended? model.hplanes[model.tree_offsets[tree] + node].score
+                                                : model.nodes[model.tree_offsets[tree] + node].score;
+                if (score >= 0)
+                    tree_mapping[node] = curr_term++;
+            }
+
+            #pragma omp parallel for schedule(static) num_threads(nthreads) shared(tree_num, tree_mapping, tree, nrows)
+            for (size_t_for row = 0; row < nrows; row++)
+                tree_num[row + tree * nrows] = tree_mapping[tree_num[row + tree * nrows]];
+        }
+    }
+}
@@ -83,7 +83,11 @@
 * - imputer (in, out)
 *       Pointer to imputation object which has already been fit through 'fit_iforest' along with
 *       either 'model' or 'ext_model' in the same call to 'fit_iforest'.
-*       The imputation nodes from 'iother' will be merged into this (will be at the end of vector member 'imputer_tree').
+*       The imputation nodes from 'iother' will be merged into this (will be at the end of vector member 'imputer_tree',
+*       or of 'imputer_tree_compact' if either of the two imputers is in the compact layout from 'compact_imputer').
+*       Note that if only 'iother' is in the compact layout, this imputer will be converted to the compact layout
+*       (as through 'compact_imputer'), storing its values as 'float' if 'iother' stores them as 'float'.
+*       If only this imputer is in the compact layout, the nodes from 'iother' are converted to its layout instead.
 *       Hyperparameters related to imputation might differ between 'imputer' and 'iother' ('imputer' will preserve its
 *       hyperparameters after the merge).
 *       Pass NULL if this is not to be used.
@@ -110,7 +114,287 @@ void merge_models(IsoForest*     model,      IsoForest*     other,
                                   ext_other->hplanes.end());
 
     if (imputer != NULL && iother != NULL)
-        imputer->imputer_tree.insert(imputer->imputer_tree.end(),
-                                     iother->imputer_tree.begin(),
-                                     iother->imputer_tree.end());
+    {
+        if (!imputer->imputer_tree_compact.size() && !iother->imputer_tree_compact.size())
+            imputer->imputer_tree.insert(imputer->imputer_tree.end(),
+                                         iother->imputer_tree.begin(),
+                                         iother->imputer_tree.end());
+
+        /* if only one of them is in the compact layout, the result will be in the compact layout */
+        else
+        {
+            if (imputer->imputer_tree.size())
+                compact_imputer(*imputer, iother->imputer_tree_compact[0].as_float, 1);
+
+            if (iother->imputer_tree_compact.size())
+                imputer->imputer_tree_compact.insert(imputer->imputer_tree_compact.end(),
+                                                     iother->imputer_tree_compact.begin(),
+                                                     iother->imputer_tree_compact.end());
+            else
+            {
+                size_t last_tree = imputer->imputer_tree_compact.size();
+                imputer->imputer_tree_compact.resize(last_tree + iother->imputer_tree.size());
+                for (size_t tree = 0; tree < iother->imputer_tree.size(); tree++)
+                    compact_impute_tree(iother->imputer_tree[tree], imputer->imputer_tree_compact[last_tree + tree],
+                                        imputer->ncols_numeric,
+                                        imputer->imputer_tree_compact[0].as_float);
+            }
+        }
+    }
+}
+
+/* Create a forest with a fixed number of trees that are replaced by new ones as more data arrives
+* 
+* Parameters
+* ==========
+* - capacity
+*       Maximum number of trees that the model will have. Once it reaches this number, each new tree
+*       that is added replaces the oldest one.
+* 
+* Returns
+* =======
+* Pointer to a new 'RollingForest' object, which must be freed with 'delete_rolling_forest'. It will
+* not contain any model until 'update_rolling_forest' is called.
+*/
+RollingForest* create_rolling_forest(size_t capacity)
+{
+    std::unique_ptr<RollingForest> rolling_forest = std::unique_ptr<RollingForest>(new RollingForest());
+    rolling_forest->ndim = 0;
+    rolling_forest->capacity = capacity;
+    rolling_forest->next_slot = 0;
+    rolling_forest->ntrees_grown = 0;
+    return rolling_forest.release();
+}
+
+void delete_rolling_forest(RollingForest *rolling_forest)
+{
+    delete rolling_forest;
+}
+
+template <class Model, class Node>
+static Model* replace_oldest_trees(const Model *curr, Model *prev, Model &grown,
+                                   std::vector< std::vector<Node> > Model::*trees,
+                                   RollingForest &rolling_forest, size_t nrows)
+{
+    std::unique_ptr<Model> next = std::unique_ptr<Model>(new Model());
+    next->new_cat_action = grown.new_cat_action;
+    next->cat_split_type = grown.cat_split_type;
+    next->missing_action = grown.missing_action;
+
+    size_t n_curr = (curr != NULL)? (curr->*trees).size() : 0;
+    size_t n_prev = (prev != NULL)? (prev->*trees).size() : 0;
+    size_t n_grown = (grown.*trees).size();
+    size_t n_next = std::min(n_curr + n_grown, rolling_forest.capacity);
+    (next.get()->*trees).resize(n_next);
+    rolling_forest.slot_exp_avg_depth.resize(n_next);
+    rolling_forest.slot_exp_avg_sep.resize(n_next);
+    rolling_forest.slot_nrows.resize(n_next);
+
+    /* new trees are appended until reaching the capacity, after which they take the slot of the oldest tree */
+    std::vector<char> is_replaced(n_next, false);
+    size_t n_filled = n_curr;
+    for (size_t tree = 0; tree < n_grown; tree++)
+    {
+        size_t slot;
+        if (n_filled < rolling_forest.capacity)
+        {
+            slot = n_filled++;
+        }
+
+        else
+        {
+            slot = rolling_forest.next_slot;
+            rolling_forest.next_slot = (rolling_forest.next_slot + 1) % rolling_forest.capacity;
+        }
+
+        (next.get()->*trees)[slot] = std::move((grown.*trees)[tree]);
+        is_replaced[slot] = true;
+        rolling_forest.slot_exp_avg_depth[slot] = grown.exp_avg_depth;
+        rolling_forest.slot_exp_avg_sep[slot] = grown.exp_avg_sep;
+        rolling_forest.slot_nrows[slot] = nrows;
+    }
+
+    /* the model that readers might be using cannot be modified, but the one before it (if passed)
+       is not used by anyone anymore, and has the same trees in the slots that did not change in
+       the last update, so those get moved from it - the rest of the trees that stay get copied */
+    for (size_t slot = 0; slot < n_curr; slot++)
+    {
+        if (is_replaced[slot]) continue;
+        if (slot < n_prev && !rolling_forest.slot_changed[slot])
+            (next.get()->*trees)[slot] = std::move((prev->*trees)[slot]);
+        else
+            (next.get()->*trees)[slot] = (curr->*trees)[slot];
+    }
+    rolling_forest.slot_changed.assign(is_replaced.begin(), is_replaced.end());
+
+    /* trees might have been grown on chunks of different sizes, so the expected depth used for
+       standardizing the scores is the average of what each tree would have on its own */
+    next->exp_avg_depth = std::accumulate(rolling_forest.slot_exp_avg_depth.begin(),
+                                          rolling_forest.slot_exp_avg_depth.end(),
+                                          (double)0) / (double)n_next;
+    next->exp_avg_sep   = std::accumulate(rolling_forest.slot_exp_avg_sep.begin(),
+                                          rolling_forest.slot_exp_avg_sep.end(),
+                                          (double)0) / (double)n_next;
+    next->orig_sample_size = std::accumulate(rolling_forest.slot_nrows.begin(),
+                                             rolling_forest.slot_nrows.end(),
+                                             (size_t)0) / n_next;
+    return next.release();
+}
+
+/* The previous model is no longer published, so once its count of references drops to one (the
+   forest's own), no reader can get it again - the fence makes the readers' last accesses to it
+   visible before its trees get moved */
+template <class Model>
+static Model* get_unused_model(std::shared_ptr<Model> &prev)
+{
+    if (prev.get() == NULL || prev.use_count() != 1)
+        return NULL;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return prev.get();
+}
+
+/* Grow new trees on a chunk of data and put them in place of the oldest trees in a rolling forest
+* 
+* The new trees are fit only to the data passed here, in the same way as 'fit_iforest' would do
+* for a model with 'ntrees' trees. Until the forest reaches its capacity, they are added to the
+* existing ones, and afterwards they replace the trees that were added the earliest.
+* 
+* Each update produces a new model object. Models obtained through 'get_rolling_forest_model' before
+* the update are left untouched and can continue being used for predictions while it runs, and
+* 'get_rolling_forest_model' does not wait for it to finish. Note that this is not lock-free: the
+* pointer to the current model is read and swapped through 'std::atomic_load' and 'std::atomic_store',
+* which typical standard library implementations guard with a short-lived internal lock.
+* The trees that remain are moved into the new model from the model that was current
+* before the last update, which the forest keeps until the next update (so up to two models are kept
+* in memory), or are copied from the current model if the previous one is still being used somewhere.
+* Updates to the same forest can be called from different threads, but they will run one at a time.
+* 
+* Parameters are the same as for 'fit_iforest' (see the documentation in there for details), with
+* the following differences:
+* 
+* Parameters
+* ==========
+* - rolling_forest
+*       Pointer to the object created through 'create_rolling_forest'.
+* - ndim
+*       Must be the same in every call to this function for the same forest. The type of model
+*       is determined in the first update (extended model if 'ndim>1', same as for 'fit_iforest'),
+*       and later updates grow trees of the same type as the ones that are already in the forest.
+* - ntrees
+*       Number of new trees to grow on this data. If it's larger than the capacity of the forest,
+*       will grow only as many trees as the capacity.
+* - random_seed
+*       Seed that will be used for the random number generators. Each new tree will use a different
+*       seed derived from this one and from the number of trees that were grown before it, so it's
+*       fine to pass the same seed in each call.
+* 
+* Does not support calculating outputs while fitting, nor building an imputer.
+* 
+* Returns
+* =======
+* Will return macro 'EXIT_SUCCESS' (typically =0) upon completion.
+* If the process receives an interrupt signal, or if 'ndim' does not match with the trees
+* that are already in the forest, will return instead 'EXIT_FAILURE' (typically =1), and
+* the model will remain the same as before.
+*/
+int update_rolling_forest(RollingForest *rolling_forest,
+                          double numeric_data[],  size_t ncols_numeric,
+                          int    categ_data[],    size_t ncols_categ,    int ncat[],
+                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
+                          size_t ndim, size_t ntry, CoefType coef_type, bool coef_by_prop,
+                          double sample_weights[], bool with_replacement, bool weight_as_sample,
+                          size_t nrows, size_t sample_size, size_t ntrees, size_t max_depth,
+                          bool   limit_depth, bool penalize_range,
+                          double col_weights[], bool weigh_by_kurt, size_t kurt_sample_size,
+                          double prob_pick_by_gain_avg, double prob_split_by_gain_avg,
+                          double prob_pick_by_gain_pl,  double prob_split_by_gain_pl,
+                          double min_gain, MissingAction missing_action,
+                          CategSplit cat_split_type, NewCategAction new_cat_action,
+                          bool   all_perm, uint64_t random_seed, RNGType rng_type, int nthreads)
+{
+    ntrees = std::min(ntrees, rolling_forest->capacity);
+    if (!ntrees) return EXIT_SUCCESS;
+
+    std::lock_guard<std::mutex> lock(rolling_forest->update_mutex);
+
+    if (rolling_forest->ndim && ndim != rolling_forest->ndim)
+        return EXIT_FAILURE;
+    std::shared_ptr<IsoForest>     curr_model      =  std::atomic_load(&rolling_forest->model);
+    std::shared_ptr<ExtIsoForest>  curr_model_ext  =  std::atomic_load(&rolling_forest->model_ext);
+
+    IsoForest     grown;
+    ExtIsoForest  grown_ext;
+    IsoForest    *model_outputs      =  NULL;
+    ExtIsoForest *model_outputs_ext  =  NULL;
+    if (curr_model_ext.get() != NULL || (curr_model.get() == NULL && ndim > 1))
+        model_outputs_ext = &grown_ext;
+    else
+        model_outputs = &grown;
+    int ret_val = fit_iforest(model_outputs, model_outputs_ext,
+                              numeric_data,  ncols_numeric,
+                              categ_data,    ncols_categ,    ncat,
+                              Xc, Xc_ind, Xc_indptr,
+                              ndim, ntry, coef_type, coef_by_prop,
+                              sample_weights, with_replacement, weight_as_sample,
+                              nrows, sample_size, ntrees, max_depth,
+                              limit_depth, penalize_range,
+                              false, NULL, NULL, false,
+                              col_weights, weigh_by_kurt, kurt_sample_size,
+                              prob_pick_by_gain_avg, prob_split_by_gain_avg,
+                              prob_pick_by_gain_pl,  prob_split_by_gain_pl,
+                              min_gain, missing_action,
+                              cat_split_type, new_cat_action,
+                              all_perm, NULL, 0, Higher, Inverse, false,
+                              random_seed + rolling_forest->ntrees_grown, rng_type, nthreads);
+    if (ret_val == EXIT_FAILURE)
+        return EXIT_FAILURE;
+
+    if (model_outputs != NULL)
+    {
+        std::shared_ptr<IsoForest> next_model(
+            replace_oldest_trees(curr_model.get(), get_unused_model(rolling_forest->prev_model),
+                                 grown, &IsoForest::trees, *rolling_forest, nrows)
+        );
+        rolling_forest->prev_model = curr_model;
+        std::atomic_store(&rolling_forest->model, next_model);
+    }
+
+    else
+    {
+        std::shared_ptr<ExtIsoForest> next_model(
+            replace_oldest_trees(curr_model_ext.get(), get_unused_model(rolling_forest->prev_model_ext),
+                                 grown_ext, &ExtIsoForest::hplanes, *rolling_forest, nrows)
+        );
+        rolling_forest->prev_model_ext = curr_model_ext;
+        std::atomic_store(&rolling_forest->model_ext, next_model);
+    }
+
+    rolling_forest->ndim = ndim;
+    rolling_forest->ntrees_grown += ntrees;
+    return EXIT_SUCCESS;
+}
+
+/* Get the current model from a rolling forest
+* 
+* The model obtained here will not be modified by later calls to 'update_rolling_forest', so it
+* can be used for predictions (e.g. passing 'model.get()' to 'predict_iforest') at the same time as
+* the forest gets updated. In order to use the newer trees, need to call this function again.
+* 
+* Parameters
+* ==========
+* - rolling_forest
+*       Pointer to the object created through 'create_rolling_forest'.
+* - model (out)
+*       Will be set to the current single-variable model, or to an empty pointer if the
+*       forest uses the extended model or has not yet been updated.
+* - model_ext (out)
+*       Will be set to the current extended model, or to an empty pointer if the forest
+*       uses the single-variable model or has not yet been updated.
+*/
+void get_rolling_forest_model(RollingForest *rolling_forest,
+                              std::shared_ptr<IsoForest> &model,
+                              std::shared_ptr<ExtIsoForest> &model_ext)
+{
+    model      =  std::atomic_load(&rolling_forest->model);
+    model_ext  =  std::atomic_load(&rolling_forest->model_ext);
 }
@@ -45,7 +45,7 @@
 #include "isotree.hpp"
 
 /* for regular numerical */
-void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, double *restrict x,
+void calc_mean_and_sd(ix_t ix_arr[], size_t st, size_t end, double *restrict x,
                       MissingAction missing_action, double &x_sd, double &x_mean)
 {
     long double m = 0;
@@ -85,7 +85,7 @@ void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, double *restrict x
 }
 
 /* for sparse numerical */
-void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, size_t col_num,
+void calc_mean_and_sd(ix_t ix_arr[], size_t st, size_t end, size_t col_num,
                       double *restrict Xc, sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                       double &x_sd, double &x_mean)
 {
@@ -100,7 +100,7 @@ void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, size_t col_num,
     size_t end_col = Xc_indptr[col_num + 1] - 1;
     size_t curr_pos = st_col;
     size_t ind_end_col = (size_t) Xc_ind[end_col];
-    size_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, (size_t)Xc_ind[st_col]);
+    ix_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, (size_t)Xc_ind[st_col]);
 
     size_t cnt = end - st + 1;
     long double sum = 0;
@@ -109,7 +109,7 @@ void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, size_t col_num,
     /* Note: this function will discard NAs regardless of chosen action. If reaching the point of calling
        this function, chances are that the performance gain of not checking for them will not be important */
 
-    for (size_t *row = ptr_st;
+    for (ix_t *row = ptr_st;
          row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
         )
     {
@@ -148,7 +148,7 @@ void calc_mean_and_sd(size_t ix_arr[], size_t st, size_t end, size_t col_num,
    and instead, the index that is stored in ix_arr[n] will have the value in res[n] */
 
 /* for regular numerical */
-void add_linear_comb(size_t ix_arr[], size_t st, size_t end, double *restrict res,
+void add_linear_comb(ix_t ix_arr[], size_t st, size_t end, double *restrict res,
                      double *restrict x, double &coef, double x_sd, double x_mean, double &fill_val,
                      MissingAction missing_action, double *restrict buffer_arr,
                      size_t *restrict buffer_NAs, bool first_run)
@@ -197,11 +197,13 @@ void add_linear_comb(size_t ix_arr[], size_t st, size_t end, double *restrict re
             return;
         }
         
+        /* the median only requires the middle element(s), so there's no need for sorting - after
+           selecting the upper middle, the lower middle is the largest element that goes before it */
         size_t mid_ceil = cnt / 2;
-        std::partial_sort(buffer_arr, buffer_arr + mid_ceil + 1, buffer_arr + cnt);
+        std::nth_element(buffer_arr, buffer_arr + mid_ceil, buffer_arr + cnt);
 
         if ((cnt % 2) == 0)
-            fill_val = (buffer_arr[mid_ceil - 1] + buffer_arr[mid_ceil]) / 2.0;
+            fill_val = (*std::max_element(buffer_arr, buffer_arr + mid_ceil) + buffer_arr[mid_ceil]) / 2.0;
         else
             fill_val = buffer_arr[mid_ceil];
 
@@ -216,7 +218,7 @@ void add_linear_comb(size_t ix_arr[], size_t st, size_t end, double *restrict re
 }
 
 /* for sparse numerical */
-void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, size_t col_num, double *restrict res,
+void add_linear_comb(ix_t *restrict ix_arr, size_t st, size_t end, size_t col_num, double *restrict res,
                      double *restrict Xc, sparse_ix *restrict Xc_ind, sparse_ix *restrict Xc_indptr,
                      double &coef, double x_sd, double x_mean, double &fill_val, MissingAction missing_action,
                      double *restrict buffer_arr, size_t *restrict buffer_NAs, bool first_run)
@@ -249,12 +251,12 @@ void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, size_t col_
     size_t st_col  = Xc_indptr[col_num];
     size_t end_col = Xc_indptr[col_num + 1] - 1;
     size_t curr_pos = st_col;
-    size_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, (size_t)Xc_ind[st_col]);
+    ix_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, (size_t)Xc_ind[st_col]);
 
     size_t cnt_non_NA = 0; /* when NAs need to be imputed */
     size_t cnt_NA = 0; /* when NAs need to be imputed */
     size_t n_sample = end - st + 1;
-    size_t *ix_arr_plus_st = ix_arr + st;
+    ix_t *ix_arr_plus_st = ix_arr + st;
 
     if (first_run)
         coef /= x_sd;
@@ -271,7 +273,7 @@ void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, size_t col_
     {
         if (first_run)
         {
-            for (size_t *row = ptr_st;
+            for (ix_t *row = ptr_st;
                  row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
                 )
             {
@@ -306,7 +308,7 @@ void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, size_t col_
         else
         {
             /* when impute value for missing has already been determined */
-            for (size_t *row = ptr_st;
+            for (ix_t *row = ptr_st;
                  row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
                 )
             {
@@ -405,7 +407,7 @@ void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, size_t col_
 
     else /* no NAs */
     {
-        for (size_t *row = ptr_st;
+        for (ix_t *row = ptr_st;
              row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
             )
         {
@@ -428,7 +430,7 @@ void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, size_t col_
 }
 
 /* for categoricals */
-void add_linear_comb(size_t *restrict ix_arr, size_t st, size_t end, double *restrict res,
+void add_linear_comb(ix_t *restrict ix_arr, size_t st, size_t end, double *restrict res,
                      int x[], int ncat, double *restrict cat_coef, double single_cat_coef, int chosen_cat,
                      double &fill_val, double &fill_new, size_t *restrict buffer_cnt, size_t *restrict buffer_pos,
                      NewCategAction new_cat_action, MissingAction missing_action, CategSplit cat_split_type, bool first_run)
@@ -145,8 +145,8 @@ void predict_iforest(double numeric_data[], int categ_data[],
             {
                 for (std::vector<IsoTree> &tree : model_outputs->trees)
                 {
-                    traverse_itree_no_recurse(tree,
-                                              *model_outputs,
+                    IsoTreeNodes tree_nodes(tree, *model_outputs);
+                    traverse_itree_no_recurse(tree_nodes,
                                               prediction_data,
                                               output_depths[row],
                                               (tree_num == NULL)? NULL : tree_num + nrows * (&tree - &(model_outputs->trees[0])),
@@ -162,8 +162,8 @@ void predict_iforest(double numeric_data[], int categ_data[],
             {
                 for (std::vector<IsoTree> &tree : model_outputs->trees)
                 {
-                    output_depths[row] += traverse_itree(tree,
-                                                         *model_outputs,
+                    IsoTreeNodes tree_nodes(tree, *model_outputs);
+                    output_depths[row] += traverse_itree(tree_nodes,
                                                          prediction_data,
                                                          NULL, NULL, 0,
                                                          (size_t) row,
@@ -189,8 +189,8 @@ void predict_iforest(double numeric_data[], int categ_data[],
             {
                 for (std::vector<IsoHPlane> &hplane : model_outputs_ext->hplanes)
                 {
-                    traverse_hplane_fast(hplane,
-                                         *model_outputs_ext,
+                    IsoHPlaneNodes hplane_nodes(hplane, *model_outputs_ext);
+                    traverse_hplane_fast(hplane_nodes,
                                          prediction_data,
                                          output_depths[row],
                                          (tree_num == NULL)? NULL : tree_num + nrows * (&hplane - &(model_outputs_ext->hplanes[0])),
@@ -206,8 +206,8 @@ void predict_iforest(double numeric_data[], int categ_data[],
             {
                 for (std::vector<IsoHPlane> &hplane : model_outputs_ext->hplanes)
                 {
-                    traverse_hplane(hplane,
-                                    *model_outputs_ext,
+                    IsoHPlaneNodes hplane_nodes(hplane, *model_outputs_ext);
+                    traverse_hplane(hplane_nodes,
                                     prediction_data,
                                     output_depths[row],
                                     NULL, NULL,
@@ -254,8 +254,8 @@ void predict_iforest(double numeric_data[], int categ_data[],
 
 /* TODO: these functions would be faster if done with row-major order,
    should at least give the option of taking arrays as row-major. */
-void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
-                               IsoForest             &model_outputs,
+template <class TreeNodes>
+void traverse_itree_no_recurse(TreeNodes             &tree,
                                PredictionData        &prediction_data,
                                double                &output_depth,
                                sparse_ix *restrict   tree_num,
@@ -288,12 +288,12 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
 
                 case Categorical:
                 {
-                    switch(model_outputs.cat_split_type)
+                    switch(tree.cat_split_type)
                     {
                         case SubSet:
                         {
 
-                            if (!tree[curr_lev].cat_split.size()) /* this is for binary columns */
+                            if (!tree.cat_split_size(curr_lev)) /* this is for binary columns */
                             {
                                 if (prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows] <= 1)
                                 {
@@ -313,14 +313,11 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
                             else
                             {
 
-                                switch(model_outputs.new_cat_action)
+                                switch(tree.new_cat_action)
                                 {
                                     case Random:
                                     {
-                                        curr_lev = (tree[curr_lev].cat_split[
-                                                                prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                                ]
-                                                    )?
+                                        curr_lev = tree.cat_split(curr_lev, prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows])?
                                                     tree[curr_lev].tree_left : tree[curr_lev].tree_right;
                                         break;
                                     }
@@ -329,7 +326,7 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
                                     {
                                         if (
                                             prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                >= (int)tree[curr_lev].cat_split.size()
+                                                >= (int)tree.cat_split_size(curr_lev)
                                             )
                                         {
                                             curr_lev =  (tree[curr_lev].pct_tree_left < .5)? tree[curr_lev].tree_left : tree[curr_lev].tree_right;
@@ -337,10 +334,7 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
 
                                         else
                                         {
-                                            curr_lev = (tree[curr_lev].cat_split[
-                                                                    prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                                    ]
-                                                        )?
+                                            curr_lev = tree.cat_split(curr_lev, prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows])?
                                                         tree[curr_lev].tree_left : tree[curr_lev].tree_right;
                                         }
                                         break;
@@ -369,8 +363,8 @@ void traverse_itree_no_recurse(std::vector<IsoTree>  &tree,
 }
 
 
-double traverse_itree(std::vector<IsoTree>     &tree,
-                      IsoForest                &model_outputs,
+template <class TreeNodes>
+double traverse_itree(TreeNodes                &tree,
                       PredictionData           &prediction_data,
                       std::vector<ImputeNode> *impute_nodes,     /* only when imputing missing */
                       ImputedData             *imputed_data,     /* only when imputing missing */
@@ -396,7 +390,12 @@ double traverse_itree(std::vector<IsoTree>     &tree,
             if (tree_num != NULL)
                 tree_num[row] = curr_lev;
             if (imputed_data != NULL)
-                add_from_impute_node((*impute_nodes)[curr_lev], *imputed_data, curr_weight);
+            {
+                if (imputed_data->compact_tree != NULL)
+                    add_from_impute_node(*imputed_data->compact_tree, curr_lev, *imputed_data, curr_weight);
+                else
+                    add_from_impute_node((*impute_nodes)[curr_lev], *imputed_data, curr_weight);
+            }
 
             return tree[curr_lev].score + range_penalty;
         }
@@ -417,17 +416,17 @@ double traverse_itree(std::vector<IsoTree>     &tree,
 
                     if (isnan(xval))
                     {
-                        switch(model_outputs.missing_action)
+                        switch(tree.missing_action)
                         {
                             case Divide:
                             {
                                 return
                                     tree[curr_lev].pct_tree_left
-                                        * traverse_itree(tree, model_outputs, prediction_data,
+                                        * traverse_itree(tree, prediction_data,
                                                          impute_nodes, imputed_data, curr_weight * tree[curr_lev].pct_tree_left,
                                                          row, NULL, tree[curr_lev].tree_left)
                                     + (1 - tree[curr_lev].pct_tree_left)
-                                        * traverse_itree(tree, model_outputs, prediction_data,
+                                        * traverse_itree(tree, prediction_data,
                                                          impute_nodes, imputed_data, curr_weight * (1 - tree[curr_lev].pct_tree_left),
                                                          row, NULL, tree[curr_lev].tree_right)
                                     + range_penalty;
@@ -461,17 +460,17 @@ double traverse_itree(std::vector<IsoTree>     &tree,
 
                     if (prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows] < 0)
                     {
-                        switch(model_outputs.missing_action)
+                        switch(tree.missing_action)
                         {
                             case Divide:
                             {
                                 return
                                     tree[curr_lev].pct_tree_left
-                                        * traverse_itree(tree, model_outputs, prediction_data,
+                                        * traverse_itree(tree, prediction_data,
                                                          impute_nodes, imputed_data, curr_weight * tree[curr_lev].pct_tree_left,
                                                          row, NULL, tree[curr_lev].tree_left)
                                     + (1 - tree[curr_lev].pct_tree_left)
-                                        * traverse_itree(tree, model_outputs, prediction_data,
+                                        * traverse_itree(tree, prediction_data,
                                                          impute_nodes, imputed_data, curr_weight * (1 - tree[curr_lev].pct_tree_left),
                                                          row, NULL, tree[curr_lev].tree_right)
                                     + range_penalty;
@@ -493,7 +492,7 @@ double traverse_itree(std::vector<IsoTree>     &tree,
 
                     else
                     {
-                        switch(model_outputs.cat_split_type)
+                        switch(tree.cat_split_type)
                         {
                             case SingleCateg:
                             {
@@ -509,7 +508,7 @@ double traverse_itree(std::vector<IsoTree>     &tree,
                             case SubSet:
                             {
 
-                                if (!tree[curr_lev].cat_split.size())
+                                if (!tree.cat_split_size(curr_lev))
                                 {
                                     if (prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows] <= 1)
                                     {
@@ -522,7 +521,7 @@ double traverse_itree(std::vector<IsoTree>     &tree,
 
                                     else
                                     {
-                                        switch(model_outputs.new_cat_action)
+                                        switch(tree.new_cat_action)
                                         {
                                             case Smallest:
                                             {
@@ -534,11 +533,11 @@ double traverse_itree(std::vector<IsoTree>     &tree,
                                             {
                                                 return
                                                     tree[curr_lev].pct_tree_left
-                                                        * traverse_itree(tree, model_outputs, prediction_data,
+                                                        * traverse_itree(tree, prediction_data,
                                                                          impute_nodes, imputed_data, curr_weight * tree[curr_lev].pct_tree_left,
                                                                          row, NULL, tree[curr_lev].tree_left)
                                                     + (1 - tree[curr_lev].pct_tree_left)
-                                                        * traverse_itree(tree, model_outputs, prediction_data,
+                                                        * traverse_itree(tree, prediction_data,
                                                                          impute_nodes, imputed_data, curr_weight * (1 - tree[curr_lev].pct_tree_left),
                                                                          row, NULL, tree[curr_lev].tree_right)
                                                     + range_penalty;
@@ -549,14 +548,11 @@ double traverse_itree(std::vector<IsoTree>     &tree,
 
                                 else
                                 {
-                                    switch(model_outputs.new_cat_action)
+                                    switch(tree.new_cat_action)
                                     {
                                         case Random:
                                         {
-                                            curr_lev = (tree[curr_lev].cat_split[
-                                                                    prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                                    ]
-                                                        )?
+                                            curr_lev = tree.cat_split(curr_lev, prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows])?
                                                         tree[curr_lev].tree_left : tree[curr_lev].tree_right;
                                             break;
                                         }
@@ -565,7 +561,7 @@ double traverse_itree(std::vector<IsoTree>     &tree,
                                         {
                                             if (
                                                 prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                    >= (int)tree[curr_lev].cat_split.size()
+                                                    >= (int)tree.cat_split_size(curr_lev)
                                                 )
                                             {
                                                 curr_lev =  (tree[curr_lev].pct_tree_left < .5)? tree[curr_lev].tree_left : tree[curr_lev].tree_right;
@@ -573,10 +569,7 @@ double traverse_itree(std::vector<IsoTree>     &tree,
 
                                             else
                                             {
-                                                curr_lev = (tree[curr_lev].cat_split[
-                                                                        prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                                        ]
-                                                            )?
+                                                curr_lev = tree.cat_split(curr_lev, prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows])?
                                                             tree[curr_lev].tree_left : tree[curr_lev].tree_right;
                                             }
                                             break;
@@ -586,21 +579,19 @@ double traverse_itree(std::vector<IsoTree>     &tree,
                                         {
                                             if (
                                                 prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                    >= (int)tree[curr_lev].cat_split.size()
+                                                    >= (int)tree.cat_split_size(curr_lev)
                                                 ||
-                                                tree[curr_lev].cat_split[
-                                                            prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                            ]
+                                                tree.cat_split(curr_lev, prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows])
                                                     == (-1)
                                                 )
                                             {
                                                 return
                                                     tree[curr_lev].pct_tree_left
-                                                        * traverse_itree(tree, model_outputs, prediction_data,
+                                                        * traverse_itree(tree, prediction_data,
                                                                          impute_nodes, imputed_data, curr_weight * tree[curr_lev].pct_tree_left,
                                                                          row, NULL, tree[curr_lev].tree_left)
                                                     + (1 - tree[curr_lev].pct_tree_left)
-                                                        * traverse_itree(tree, model_outputs, prediction_data,
+                                                        * traverse_itree(tree, prediction_data,
                                                                          impute_nodes, imputed_data, curr_weight * (1 - tree[curr_lev].pct_tree_left),
                                                                          row, NULL, tree[curr_lev].tree_right)
                                                     + range_penalty;
@@ -608,10 +599,7 @@ double traverse_itree(std::vector<IsoTree>     &tree,
 
                                             else
                                             {
-                                                curr_lev = (tree[curr_lev].cat_split[
-                                                                        prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows]
-                                                                        ]
-                                                            )?
+                                                curr_lev = tree.cat_split(curr_lev, prediction_data.categ_data[row +  tree[curr_lev].col_num * prediction_data.nrows])?
                                                             tree[curr_lev].tree_left : tree[curr_lev].tree_right;
                                             }
                                             break;
@@ -631,8 +619,8 @@ double traverse_itree(std::vector<IsoTree>     &tree,
 
 /* this is a simpler version for situations in which there is
    only numeric data in dense arrays and no missing values */
-void traverse_hplane_fast(std::vector<IsoHPlane>  &hplane,
-                          ExtIsoForest            &model_outputs,
+template <class HPlaneNodes>
+void traverse_hplane_fast(HPlaneNodes             &hplane,
                           PredictionData          &prediction_data,
                           double                  &output_depth,
                           sparse_ix *restrict     tree_num,
@@ -654,9 +642,9 @@ void traverse_hplane_fast(std::vector<IsoHPlane>  &hplane,
         else
         {
             hval = 0;
-            for (size_t col = 0; col < hplane[curr_lev].col_num.size(); col++)
-                hval += (prediction_data.numeric_data[row +  hplane[curr_lev].col_num[col] * prediction_data.nrows] 
-                         - hplane[curr_lev].mean[col]) * hplane[curr_lev].coef[col];
+            for (size_t col = 0; col < hplane.ncols(curr_lev); col++)
+                hval += (prediction_data.numeric_data[row +  hplane.col_num(curr_lev, col) * prediction_data.nrows] 
+                         - hplane.mean(curr_lev, col)) * hplane.coef(curr_lev, col);
         }
 
         output_depth += (hval < hplane[curr_lev].range_low) ||
@@ -667,8 +655,8 @@ void traverse_hplane_fast(std::vector<IsoHPlane>  &hplane,
 }
 
 /* this is the full version that works with potentially missing values, sparse matrices, and categoricals */
-void traverse_hplane(std::vector<IsoHPlane>   &hplane,
-                     ExtIsoForest             &model_outputs,
+template <class HPlaneNodes>
+void traverse_hplane(HPlaneNodes              &hplane,
                      PredictionData           &prediction_data,
                      double                   &output_depth,
                      std::vector<ImputeNode> *impute_nodes,     /* only when imputing missing */
@@ -699,7 +687,10 @@ void traverse_hplane(std::vector<IsoHPlane>   &hplane,
                 tree_num[row] = curr_lev;
             if (imputed_data != NULL)
             {
-                add_from_impute_node((*impute_nodes)[curr_lev], *imputed_data, (double)1);
+                if (imputed_data->compact_tree != NULL)
+                    add_from_impute_node(*imputed_data->compact_tree, curr_lev, *imputed_data, (double)1);
+                else
+                    add_from_impute_node((*impute_nodes)[curr_lev], *imputed_data, (double)1);
             }
             return;
         }
@@ -708,24 +699,24 @@ void traverse_hplane(std::vector<IsoHPlane>   &hplane,
         {
             hval = 0;
             ncols_numeric = 0; ncols_categ = 0;
-            for (size_t col = 0; col < hplane[curr_lev].col_num.size(); col++)
+            for (size_t col = 0; col < hplane.ncols(curr_lev); col++)
             {
-                switch(hplane[curr_lev].col_type[col])
+                switch(hplane.col_type(curr_lev, col))
                 {
                     case Numeric:
                     {
                         if (prediction_data.Xc_indptr == NULL && prediction_data.Xr_indptr == NULL)
-                            xval = prediction_data.numeric_data[row +  hplane[curr_lev].col_num[col] * prediction_data.nrows];
+                            xval = prediction_data.numeric_data[row +  hplane.col_num(curr_lev, col) * prediction_data.nrows];
                         else if (prediction_data.Xc_indptr != NULL)
-                            xval = extract_spC(prediction_data, row, hplane[curr_lev].col_num[col]);
+                            xval = extract_spC(prediction_data, row, hplane.col_num(curr_lev, col));
                         else
-                            xval = extract_spR(prediction_data, row_st, row_end, hplane[curr_lev].col_num[col]);
+                            xval = extract_spR(prediction_data, row_st, row_end, hplane.col_num(curr_lev, col));
 
                         if (is_na_or_inf(xval))
                         {
-                            if (model_outputs.missing_action != Fail)
+                            if (hplane.missing_action != Fail)
                             {
-                                hval += hplane[curr_lev].fill_val[col];
+                                hval += hplane.fill_val(curr_lev, col);
                             }
 
                             else
@@ -737,7 +728,7 @@ void traverse_hplane(std::vector<IsoHPlane>   &hplane,
 
                         else
                         {
-                            hval += (xval - hplane[curr_lev].mean[ncols_numeric]) * hplane[curr_lev].coef[ncols_numeric];
+                            hval += (xval - hplane.mean(curr_lev, ncols_numeric)) * hplane.coef(curr_lev, ncols_numeric);
                         }
 
                         ncols_numeric++;
@@ -746,12 +737,12 @@ void traverse_hplane(std::vector<IsoHPlane>   &hplane,
 
                     case Categorical:
                     {
-                        cval = prediction_data.categ_data[row +  hplane[curr_lev].col_num[col] * prediction_data.nrows];
+                        cval = prediction_data.categ_data[row +  hplane.col_num(curr_lev, col) * prediction_data.nrows];
                         if (cval < 0)
                         {
-                            if (model_outputs.missing_action != Fail)
+                            if (hplane.missing_action != Fail)
                             {
-                                hval += hplane[curr_lev].fill_val[col];
+                                hval += hplane.fill_val(curr_lev, col);
                             }
                             
                             else
@@ -763,20 +754,20 @@ void traverse_hplane(std::vector<IsoHPlane>   &hplane,
 
                         else
                         {
-                            switch(model_outputs.cat_split_type)
+                            switch(hplane.cat_split_type)
                             {
                                 case SingleCateg:
                                 {
-                                    hval += (cval == hplane[curr_lev].chosen_cat[ncols_categ])? hplane[curr_lev].fill_new[ncols_categ] : 0;
+                                    hval += (cval == hplane.chosen_cat(curr_lev, ncols_categ))? hplane.fill_new(curr_lev, ncols_categ) : 0;
                                     break;
                                 }
 
                                 case SubSet:
                                 {
-                                    if (cval >= (int)hplane[curr_lev].cat_coef[ncols_categ].size())
-                                        hval += hplane[curr_lev].fill_new[ncols_categ];
+                                    if (cval >= (int)hplane.ncat(curr_lev, ncols_categ))
+                                        hval += hplane.fill_new(curr_lev, ncols_categ);
                                     else
-                                        hval += hplane[curr_lev].cat_coef[ncols_categ][cval];
+                                        hval += hplane.cat_coef(curr_lev, ncols_categ, cval);
                                     break;
                                 }
                             }
@@ -797,6 +788,20 @@ void traverse_hplane(std::vector<IsoHPlane>   &hplane,
     }
 }
 
+/* the models in files mapped through 'map_model_file' are traversed with these same functions */
+template void traverse_itree_no_recurse<IsoTreeNodes>(IsoTreeNodes&, PredictionData&, double&, sparse_ix *restrict, size_t);
+template void traverse_itree_no_recurse<MappedTreeNodes>(MappedTreeNodes&, PredictionData&, double&, sparse_ix *restrict, size_t);
+template double traverse_itree<IsoTreeNodes>(IsoTreeNodes&, PredictionData&, std::vector<ImputeNode>*, ImputedData*,
+                                             double, size_t, sparse_ix *restrict, size_t);
+template double traverse_itree<MappedTreeNodes>(MappedTreeNodes&, PredictionData&, std::vector<ImputeNode>*, ImputedData*,
+                                                double, size_t, sparse_ix *restrict, size_t);
+template void traverse_hplane_fast<IsoHPlaneNodes>(IsoHPlaneNodes&, PredictionData&, double&, sparse_ix *restrict, size_t);
+template void traverse_hplane_fast<MappedHPlaneNodes>(MappedHPlaneNodes&, PredictionData&, double&, sparse_ix *restrict, size_t);
+template void traverse_hplane<IsoHPlaneNodes>(IsoHPlaneNodes&, PredictionData&, double&, std::vector<ImputeNode>*, ImputedData*,
+                                              sparse_ix *restrict, size_t);
+template void traverse_hplane<MappedHPlaneNodes>(MappedHPlaneNodes&, PredictionData&, double&, std::vector<ImputeNode>*, ImputedData*,
+                                                 sparse_ix *restrict, size_t);
+
 double extract_spC(PredictionData &prediction_data, size_t row, size_t col_num)
 {
     sparse_ix *search_res = std::lower_bound(prediction_data.Xc_ind + prediction_data.Xc_indptr[col_num],
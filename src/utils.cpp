@@ -228,8 +228,7 @@ double expected_separation_depth(long double n)
     return s_l + diff * s_u;
 }
 
-#define ix_comb(i, j, n, ncomb) (  ((ncomb)  + ((j) - (i))) - 1 - (((n) - (i)) * ((n) - (i) - 1)) / 2  )
-void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n, double counter[], double exp_remainder)
+void increase_comb_counter(ix_t ix_arr[], size_t st, size_t end, size_t n, double counter[], double exp_remainder)
 {
     size_t i, j;
     size_t ncomb = (n * (n - 1)) / 2;
@@ -256,7 +255,7 @@ void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n, dou
         }
 }
 
-void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
+void increase_comb_counter(ix_t ix_arr[], size_t st, size_t end, size_t n,
                            double *restrict counter, double *restrict weights, double exp_remainder)
 {
     size_t i, j;
@@ -285,7 +284,7 @@ void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
 }
 
 /* Note to self: don't try merge this into a template with the one above, as the other one has 'restrict' qualifier */
-void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
+void increase_comb_counter(ix_t ix_arr[], size_t st, size_t end, size_t n,
                            double counter[], std::unordered_map<size_t, double> &weights, double exp_remainder)
 {
     size_t i, j;
@@ -313,29 +312,132 @@ void increase_comb_counter(size_t ix_arr[], size_t st, size_t end, size_t n,
         }
 }
 
-void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
-                                     double counter[], double exp_remainder)
+/* Same as 'increase_comb_counter', but requires the indices in 'ix_arr[st:end]' to be sorted in ascending
+   order, which means that the entries for each row are a span of the same row in the condensed matrix,
+   which are written in increasing order of memory addresses. Pass 'weights' = NULL if not using weights.
+   
+   When the indices are dense within their range, the weights of the rows in the node are copied to a
+   contiguous buffer with zeros for the rows that are not in it, and the additions are done over the
+   full spans, which the compiler can vectorize. Adding zeros leaves the other entries unchanged, and the
+   products are calculated in the same order as in 'increase_comb_counter', so the results are the same. */
+#define COMB_DENSE_MIN_ROWS 32
+#define COMB_DENSE_MIN_FRAC 4
+static bool fill_comb_dense_weights(ix_t ix_arr[], size_t st, size_t end, double *restrict weights,
+                                    std::vector<double> &dense_weights)
 {
-    size_t n_group = 0;
-    for (size_t ix = st; ix <= end; ix++)
-        if (ix_arr[ix] < split_ix)
-            n_group++;
+    size_t n_rows = end - st + 1;
+    size_t range = (size_t)ix_arr[end] - (size_t)ix_arr[st] + 1;
+    if (n_rows < COMB_DENSE_MIN_ROWS || n_rows * COMB_DENSE_MIN_FRAC < range)
+        return false;
+
+    dense_weights.assign(range, 0.);
+    for (size_t el = st; el <= end; el++)
+        dense_weights[ix_arr[el] - ix_arr[st]] = (weights == NULL)? 1. : weights[ix_arr[el]];
+    return true;
+}
+
+/* adds the pairs of the rows in 'ix_arr[el1_st:el1_end)' with the rows that come after them up to 'end' */
+static void add_comb_rows_sorted(ix_t ix_arr[], size_t el1_st, size_t el1_end, size_t st, size_t end, size_t n,
+                                 double *restrict counter, double *restrict weights, double exp_remainder,
+                                 double *restrict dense_weights)
+{
+    size_t ncomb = (n * (n - 1)) / 2;
+    size_t ix_min = ix_arr[st];
+    size_t ix_max = ix_arr[end];
+    bool add_one = exp_remainder <= 1;
+    double w_row;
+    size_t i, span_st;
+
+    if (dense_weights != NULL)
+    {
+        for (size_t el1 = el1_st; el1 < el1_end; el1++)
+        {
+            i = ix_arr[el1];
+            w_row = (weights == NULL)? 1. : weights[i];
+            double *restrict span = counter + ix_comb(i, i + 1, n, ncomb);
+            double *restrict w_span = dense_weights + (i + 1 - ix_min);
+            size_t span_len = ix_max - i;
+            if (add_one)
+                for (size_t ix = 0; ix < span_len; ix++)
+                    span[ix] += w_row * w_span[ix];
+            else
+                for (size_t ix = 0; ix < span_len; ix++)
+                    span[ix] += w_row * w_span[ix] * exp_remainder;
+        }
+        return;
+    }
+
+    for (size_t el1 = el1_st; el1 < el1_end; el1++)
+    {
+        i = ix_arr[el1];
+        /* unsigned wrap-around here gets undone when adding the column */
+        span_st = ix_comb(i, i + 1, n, ncomb) - (i + 1);
+        if (weights == NULL)
+        {
+            if (add_one)
+                for (size_t el2 = el1 + 1; el2 <= end; el2++)
+                    counter[span_st + ix_arr[el2]]++;
+            else
+                for (size_t el2 = el1 + 1; el2 <= end; el2++)
+                    counter[span_st + ix_arr[el2]] += exp_remainder;
+        }
+
         else
-            break;
+        {
+            w_row = weights[i];
+            if (add_one)
+                for (size_t el2 = el1 + 1; el2 <= end; el2++)
+                    counter[span_st + ix_arr[el2]] += w_row * weights[ix_arr[el2]];
+            else
+                for (size_t el2 = el1 + 1; el2 <= end; el2++)
+                    counter[span_st + ix_arr[el2]] += w_row * weights[ix_arr[el2]] * exp_remainder;
+        }
+    }
+}
 
-    n = n - split_ix;
+void increase_comb_counter_sorted(ix_t ix_arr[], size_t st, size_t end, size_t n,
+                                  double *restrict counter, double *restrict weights, double exp_remainder)
+{
+    if (end <= st) return;
+    std::vector<double> dense_weights;
+    bool use_dense = fill_comb_dense_weights(ix_arr, st, end, weights, dense_weights);
+    add_comb_rows_sorted(ix_arr, st, end, st, end, n, counter, weights, exp_remainder,
+                         use_dense? dense_weights.data() : (double*)NULL);
+}
 
-    if (exp_remainder <= 1)
-        for (size_t ix1 = st; ix1 < st + n_group; ix1++)
-            for (size_t ix2 = st + n_group; ix2 <= end; ix2++)
-                counter[ix_arr[ix1] * n + ix_arr[ix2] - split_ix]++;
-    else
-        for (size_t ix1 = st; ix1 < st + n_group; ix1++)
-            for (size_t ix2 = st + n_group; ix2 <= end; ix2++)
-                counter[ix_arr[ix1] * n + ix_arr[ix2] - split_ix] += exp_remainder;
+/* Same as 'increase_comb_counter_sorted', but adding to a matrix that is shared across threads.
+   The rows of the node are processed by runs that fall within the same stripe, holding its lock. */
+void increase_comb_counter_striped(ix_t ix_arr[], size_t st, size_t end, size_t n,
+                                   TmatStripes &tmat_stripes, double *restrict weights, double exp_remainder)
+{
+    if (end <= st) return;
+    std::vector<double> dense_weights;
+    bool use_dense = fill_comb_dense_weights(ix_arr, st, end, weights, dense_weights);
+
+    size_t el1_end;
+    size_t stripe;
+    for (size_t el1 = st; el1 < end; el1 = el1_end)
+    {
+        stripe = ix_arr[el1] / tmat_stripes.rows_per_stripe;
+        for (el1_end = el1 + 1; el1_end < end; el1_end++)
+            if (ix_arr[el1_end] / tmat_stripes.rows_per_stripe != stripe)
+                break;
+
+        std::lock_guard<std::mutex> lock(tmat_stripes.locks[stripe]);
+        add_comb_rows_sorted(ix_arr, el1, el1_end, st, end, n, tmat_stripes.tmat, weights, exp_remainder,
+                             use_dense? dense_weights.data() : (double*)NULL);
+    }
 }
 
-void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
+void increase_comb_counter_in_groups(ix_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
+                                     double counter[], double exp_remainder)
+{
+    increase_comb_counter_in_groups(ix_arr, st, end, split_ix, n, counter, (double*)NULL, exp_remainder);
+}
+
+/* The indices must be sorted in ascending order. The second group is written as a dense block
+   (see 'increase_comb_counter_sorted') when its indices are dense enough within their range. */
+void increase_comb_counter_in_groups(ix_t ix_arr[], size_t st, size_t end, size_t split_ix, size_t n,
                                      double *restrict counter, double *restrict weights, double exp_remainder)
 {
     size_t n_group = 0;
@@ -344,21 +446,57 @@ void increase_comb_counter_in_groups(size_t ix_arr[], size_t st, size_t end, siz
             n_group++;
         else
             break;
+    if (!n_group || st + n_group > end) return;
 
     n = n - split_ix;
+    bool add_one = exp_remainder <= 1;
+    size_t st2 = st + n_group;
+    size_t ix_min = ix_arr[st2];
+    size_t range = ix_arr[end] - ix_min + 1;
+    double w_row;
+
+    std::vector<double> dense_weights;
+    if (fill_comb_dense_weights(ix_arr, st2, end, weights, dense_weights))
+    {
+        double *restrict w_span = dense_weights.data();
+        for (size_t ix1 = st; ix1 < st2; ix1++)
+        {
+            w_row = (weights == NULL)? 1. : weights[ix_arr[ix1]];
+            double *restrict span = counter + ix_arr[ix1] * n + ix_min - split_ix;
+            if (add_one)
+                for (size_t ix = 0; ix < range; ix++)
+                    span[ix] += w_row * w_span[ix];
+            else
+                for (size_t ix = 0; ix < range; ix++)
+                    span[ix] += w_row * w_span[ix] * exp_remainder;
+        }
+        return;
+    }
 
-    if (exp_remainder <= 1)
-        for (size_t ix1 = st; ix1 < st + n_group; ix1++)
-            for (size_t ix2 = st + n_group; ix2 <= end; ix2++)
-                counter[ix_arr[ix1] * n + ix_arr[ix2] - split_ix]
-                    +=
-                weights[ix_arr[ix1]] * weights[ix_arr[ix2]];
-    else
-        for (size_t ix1 = st; ix1 < st + n_group; ix1++)
-            for (size_t ix2 = st + n_group; ix2 <= end; ix2++)
-                counter[ix_arr[ix1] * n + ix_arr[ix2] - split_ix]
-                    +=
-                weights[ix_arr[ix1]] * weights[ix_arr[ix2]] * exp_remainder;
+    for (size_t ix1 = st; ix1 < st2; ix1++)
+    {
+        double *restrict row = counter + ix_arr[ix1] * n - split_ix;
+        if (weights == NULL)
+        {
+            if (add_one)
+                for (size_t ix2 = st2; ix2 <= end; ix2++)
+                    row[ix_arr[ix2]]++;
+            else
+                for (size_t ix2 = st2; ix2 <= end; ix2++)
+                    row[ix_arr[ix2]] += exp_remainder;
+        }
+
+        else
+        {
+            w_row = weights[ix_arr[ix1]];
+            if (add_one)
+                for (size_t ix2 = st2; ix2 <= end; ix2++)
+                    row[ix_arr[ix2]] += w_row * weights[ix_arr[ix2]];
+            else
+                for (size_t ix2 = st2; ix2 <= end; ix2++)
+                    row[ix_arr[ix2]] += w_row * weights[ix_arr[ix2]] * exp_remainder;
+        }
+    }
 }
 
 void tmat_to_dense(double *restrict tmat, double *restrict dmat, size_t n, bool diag_to_one)
@@ -426,35 +564,92 @@ void build_btree_sampler(std::vector<double> &btree_weights, double *restrict sa
     }
 }
 
-void sample_random_rows(std::vector<size_t> &ix_arr, size_t nrows, bool with_replacement,
-                        RNG_engine &rnd_generator, std::vector<size_t> &ix_all,
+/* Walker's alias method (Vose's variant) - after building the table once, each weighted draw with
+   replacement takes constant time: pick a row uniformly at random, and then either keep it or take its
+   alias according to the probability stored for that row.
+   https://www.keithschwarz.com/darts-dice-coins/ */
+void build_alias_sampler(std::vector<double> &alias_prob, std::vector<size_t> &alias_ix,
+                         double *restrict sample_weights, size_t nrows)
+{
+    long double wsum = 0;
+    for (size_t row = 0; row < nrows; row++)
+        wsum += sample_weights[row];
+    if (is_na_or_inf(wsum) || wsum <= 0)
+    {
+        fprintf(stderr, "Numeric precision error with sample weights, will not use them.\n");
+        alias_prob.clear();
+        alias_ix.clear();
+        return;
+    }
+
+    alias_prob.resize(nrows);
+    alias_ix.resize(nrows);
+    std::vector<size_t> small, large;
+    for (size_t row = 0; row < nrows; row++)
+    {
+        alias_prob[row] = (double)(((long double)sample_weights[row] * (long double)nrows) / wsum);
+        if (alias_prob[row] < 1)
+            small.push_back(row);
+        else
+            large.push_back(row);
+    }
+
+    size_t row_small, row_large;
+    while (small.size() && large.size())
+    {
+        row_small = small.back(); small.pop_back();
+        row_large = large.back();
+        alias_ix[row_small] = row_large;
+        alias_prob[row_large] -= 1. - alias_prob[row_small];
+        if (alias_prob[row_large] < 1)
+        {
+            large.pop_back();
+            small.push_back(row_large);
+        }
+    }
+
+    /* leftovers are only due to rounding errors */
+    for (size_t row : large) { alias_prob[row] = 1; alias_ix[row] = row; }
+    for (size_t row : small) { alias_prob[row] = 1; alias_ix[row] = row; }
+}
+
+void sample_random_rows(std::vector<ix_t> &ix_arr, size_t nrows, bool with_replacement,
+                        RNG_engine &rnd_generator, std::vector<ix_t> &ix_all,
                         double sample_weights[], std::vector<double> &btree_weights,
-                        size_t log2_n, size_t btree_offset, std::vector<bool> &is_repeated)
+                        size_t log2_n, size_t btree_offset, std::vector<bool> &is_repeated,
+                        std::vector<double> &alias_prob, std::vector<size_t> &alias_ix)
 {
     size_t ntake = ix_arr.size();
 
     /* if with replacement, just generate random uniform numbers */
     if (with_replacement)
     {
-        if (sample_weights == NULL)
+        if (sample_weights == NULL || !alias_prob.size())
         {
             std::uniform_int_distribution<size_t> runif(0, nrows - 1);
-            for (size_t &ix : ix_arr)
+            for (ix_t &ix : ix_arr)
                 ix = runif(rnd_generator);
         }
 
         else
         {
-            std::discrete_distribution<size_t> runif(sample_weights, sample_weights + nrows);
-            for (size_t &ix : ix_arr)
-                ix = runif(rnd_generator);
+            /* a single draw gives both the row and the probability of keeping it over its alias */
+            std::uniform_real_distribution<double> runif(0, (double)nrows);
+            double rnd_draw;
+            for (ix_t &ix : ix_arr)
+            {
+                rnd_draw = runif(rnd_generator);
+                ix = std::min((size_t)rnd_draw, nrows - 1);
+                if (rnd_draw - (double)ix >= alias_prob[ix])
+                    ix = alias_ix[ix];
+            }
         }
     }
 
     /* if all the elements are needed, don't bother with any sampling */
     else if (ntake == nrows)
     {
-        std::iota(ix_arr.begin(), ix_arr.end(), (size_t)0);
+        std::iota(ix_arr.begin(), ix_arr.end(), (ix_t)0);
     }
 
 
@@ -465,7 +660,7 @@ void sample_random_rows(std::vector<size_t> &ix_arr, size_t nrows, bool with_rep
         double rnd_subrange, w_left;
         double curr_subrange;
         size_t curr_ix;
-        for (size_t &ix : ix_arr)
+        for (ix_t &ix : ix_arr)
         {
             /* go down the tree by drawing a random number and
                checking if it falls in the left or right ranges */
@@ -506,7 +701,7 @@ void sample_random_rows(std::vector<size_t> &ix_arr, size_t nrows, bool with_rep
                 ix_all.resize(nrows);
 
             /* in order for random seeds to always be reproducible, don't re-use previous shuffles */
-            std::iota(ix_all.begin(), ix_all.end(), (size_t)0);
+            std::iota(ix_all.begin(), ix_all.end(), (ix_t)0);
 
             /* If the number of sampled elements is large, do a full shuffle, enjoy simd-instructs when copying over */
             if (ntake >= ((nrows * 3)/4))
@@ -643,11 +838,239 @@ void weighted_shuffle(size_t *restrict outp, size_t n, double *restrict weights,
 
 }
 
-/* For hyperplane intersections */
-size_t divide_subset_split(size_t ix_arr[], double x[], size_t st, size_t end, double split_point)
+/* Column sampler for the tree-building procedure - here the same perfectly-balanced binary tree as above
+   is used for weighted sampling, but it's kept alive and updated as columns are dropped, with a log of
+   the dropped columns that allows restoring the state of a parent node by undoing the changes in reverse.
+   Columns that are constant in the whole data ('col_is_const', if passed) are never made available. */
+void initialize_col_sampler(ColumnSampler &col_sampler, size_t ncols, double *restrict col_weights, char *restrict col_is_const)
+{
+    col_sampler.col_indices.resize(ncols);
+    col_sampler.col_pos.resize(ncols);
+    std::iota(col_sampler.col_indices.begin(), col_sampler.col_indices.end(), (size_t)0);
+    std::iota(col_sampler.col_pos.begin(), col_sampler.col_pos.end(), (size_t)0);
+    col_sampler.n_active = ncols;
+    col_sampler.dropped.clear();
+    col_sampler.dropped.reserve(ncols);
+
+    if (col_weights == NULL)
+    {
+        col_sampler.col_weights.clear();
+        col_sampler.tree_weights.clear();
+        col_sampler.log2_n = 0;
+        if (col_is_const != NULL)
+        {
+            for (size_t col = 0; col < ncols; col++)
+                if (col_is_const[col])
+                    drop_col(col_sampler, col);
+            col_sampler.dropped.clear();
+        }
+        return;
+    }
+
+    col_sampler.col_weights.assign(col_weights, col_weights + ncols);
+    for (double &w : col_sampler.col_weights)
+        w = (w > 0 && !is_na_or_inf(w))? w : 0;
+
+    col_sampler.log2_n = (ncols > 1)? log2ceil(ncols) : 1;
+    col_sampler.tree_offset = pow2(col_sampler.log2_n) - 1;
+    col_sampler.tree_weights.assign(pow2(col_sampler.log2_n + 1), 0);
+    std::copy(col_sampler.col_weights.begin(), col_sampler.col_weights.end(),
+              col_sampler.tree_weights.begin() + col_sampler.tree_offset);
+    for (size_t ix = col_sampler.tree_weights.size() - 1; ix > 0; ix--)
+        col_sampler.tree_weights[ix_parent(ix)] += col_sampler.tree_weights[ix];
+
+    /* columns with zero weight will never be available */
+    for (size_t col = 0; col < ncols; col++)
+        if (col_sampler.col_weights[col] <= 0 || (col_is_const != NULL && col_is_const[col]))
+            drop_col(col_sampler, col);
+    col_sampler.dropped.clear();
+}
+
+/* Note: should only be called when there are available columns */
+size_t sample_col(ColumnSampler &col_sampler, RNG_engine &rnd_generator)
+{
+    if (!col_sampler.tree_weights.size())
+        return col_sampler.col_indices[std::uniform_int_distribution<size_t>(0, col_sampler.n_active - 1)(rnd_generator)];
+
+    /* go down the tree subtracting the weight of the left branch when taking the right one */
+    double rnd_subrange = std::uniform_real_distribution<double>(0, col_sampler.tree_weights[0])(rnd_generator);
+    size_t curr_ix = 0;
+    for (size_t lev = 0; lev < col_sampler.log2_n; lev++)
+    {
+        curr_ix = ix_child(curr_ix);
+        if (rnd_subrange >= col_sampler.tree_weights[curr_ix] && col_sampler.tree_weights[curr_ix + 1] > 0)
+        {
+            rnd_subrange -= col_sampler.tree_weights[curr_ix];
+            curr_ix++;
+        }
+    }
+    return curr_ix - col_sampler.tree_offset;
+}
+
+void drop_col(ColumnSampler &col_sampler, size_t col)
+{
+    size_t pos  = col_sampler.col_pos[col];
+    size_t last = --col_sampler.n_active;
+    std::swap(col_sampler.col_indices[pos], col_sampler.col_indices[last]);
+    col_sampler.col_pos[col_sampler.col_indices[pos]] = pos;
+    col_sampler.col_pos[col] = last;
+    col_sampler.dropped.push_back(pos);
+
+    if (col_sampler.tree_weights.size())
+    {
+        size_t curr_ix = col + col_sampler.tree_offset;
+        col_sampler.tree_weights[curr_ix] = 0;
+        for (size_t lev = 0; lev < col_sampler.log2_n; lev++)
+        {
+            curr_ix = ix_parent(curr_ix);
+            col_sampler.tree_weights[curr_ix] =   col_sampler.tree_weights[ix_child(curr_ix)]
+                                                + col_sampler.tree_weights[ix_child(curr_ix) + 1];
+        }
+    }
+}
+
+bool is_col_available(ColumnSampler &col_sampler, size_t col)
+{
+    return col_sampler.col_pos[col] < col_sampler.n_active;
+}
+
+/* Undoes the dropped columns until the log is back at 'mark'. Since columns are dropped by swapping
+   them into the first inactive position, the last dropped column is always at 'n_active', and swapping
+   it back to where it was leaves the arrays exactly as they were before dropping it. */
+void restore_col_sampler(ColumnSampler &col_sampler, size_t mark)
+{
+    while (col_sampler.dropped.size() > mark)
+    {
+        size_t pos = col_sampler.dropped.back();
+        size_t col = col_sampler.col_indices[col_sampler.n_active];
+        col_sampler.dropped.pop_back();
+        std::swap(col_sampler.col_indices[pos], col_sampler.col_indices[col_sampler.n_active]);
+        col_sampler.col_pos[col_sampler.col_indices[col_sampler.n_active]] = col_sampler.n_active;
+        col_sampler.col_pos[col] = pos;
+        col_sampler.n_active++;
+
+        if (col_sampler.tree_weights.size())
+        {
+            size_t curr_ix = col + col_sampler.tree_offset;
+            col_sampler.tree_weights[curr_ix] = col_sampler.col_weights[col];
+            for (size_t lev = 0; lev < col_sampler.log2_n; lev++)
+            {
+                curr_ix = ix_parent(curr_ix);
+                col_sampler.tree_weights[curr_ix] =   col_sampler.tree_weights[ix_child(curr_ix)]
+                                                    + col_sampler.tree_weights[ix_child(curr_ix) + 1];
+            }
+        }
+    }
+}
+
+/* Writes the available columns in random order (weighted if there are column weights),
+   leaving the sampler in the same state as before. Returns the number of columns written. */
+size_t shuffle_active_cols(ColumnSampler &col_sampler, size_t *restrict outp, RNG_engine &rnd_generator)
+{
+    size_t n_active = col_sampler.n_active;
+    size_t mark = col_sampler.dropped.size();
+    for (size_t ix = 0; ix < n_active; ix++)
+    {
+        outp[ix] = sample_col(col_sampler, rnd_generator);
+        drop_col(col_sampler, outp[ix]);
+    }
+    restore_col_sampler(col_sampler, mark);
+    return n_active;
+}
+
+/* Sorts an array of doubles (without NAs) in ascending order. For large arrays, this uses an LSD radix
+   sort over the bit representation of the numbers, which is mapped to unsigned integers that keep the
+   same order (positive numbers get their sign bit flipped, negative numbers get all bits flipped).
+   'buffer' must have space for 'n' elements. */
+#define RADIX_SORT_MIN_N 512
+#define RADIX_NBITS 8
+#define RADIX_NBUCKETS (1 << RADIX_NBITS)
+#define RADIX_NPASSES ((sizeof(uint64_t) * CHAR_BIT) / RADIX_NBITS)
+/* the keys are stored in the same arrays, so they are always copied through memcpy to avoid aliasing issues */
+static inline uint64_t get_sortable_key(const double *x)
+{
+    uint64_t bits;
+    memcpy(&bits, x, sizeof(uint64_t));
+    return bits;
+}
+
+static inline void set_sortable_key(double *x, uint64_t bits)
+{
+    memcpy(x, &bits, sizeof(uint64_t));
+}
+
+void sort_doubles(double *restrict x, size_t n, double *restrict buffer)
+{
+    if (n < RADIX_SORT_MIN_N)
+    {
+        std::sort(x, x + n);
+        return;
+    }
+
+    static_assert(sizeof(double) == sizeof(uint64_t), "Unsupported floating point type.");
+    const uint64_t sign_bit = (uint64_t)1 << 63;
+    uint64_t key;
+
+    /* histograms for all the digits can be obtained in a single pass */
+    size_t counts[RADIX_NPASSES][RADIX_NBUCKETS] = {{0}};
+    for (size_t ix = 0; ix < n; ix++)
+    {
+        key = get_sortable_key(x + ix);
+        key = (key & sign_bit)? (~key) : (key | sign_bit);
+        set_sortable_key(x + ix, key);
+        for (size_t pass = 0; pass < RADIX_NPASSES; pass++)
+            counts[pass][(key >> (pass * RADIX_NBITS)) & (RADIX_NBUCKETS - 1)]++;
+    }
+
+    double *src = x;
+    double *dst = buffer;
+    size_t pos[RADIX_NBUCKETS];
+    for (size_t pass = 0; pass < RADIX_NPASSES; pass++)
+    {
+        /* if all the numbers have the same digit, this pass would not move anything */
+        size_t shift = pass * RADIX_NBITS;
+        if (counts[pass][(get_sortable_key(src) >> shift) & (RADIX_NBUCKETS - 1)] == n)
+            continue;
+
+        pos[0] = 0;
+        for (size_t bucket = 1; bucket < RADIX_NBUCKETS; bucket++)
+            pos[bucket] = pos[bucket - 1] + counts[pass][bucket - 1];
+        for (size_t ix = 0; ix < n; ix++)
+        {
+            key = get_sortable_key(src + ix);
+            set_sortable_key(dst + pos[(key >> shift) & (RADIX_NBUCKETS - 1)]++, key);
+        }
+        std::swap(src, dst);
+    }
+
+    for (size_t ix = 0; ix < n; ix++)
+    {
+        key = get_sortable_key(src + ix);
+        key = (key & sign_bit)? (key & ~sign_bit) : (~key);
+        set_sortable_key(x + ix, key);
+    }
+}
+
+/* For hyperplane intersections - if passing a buffer (which is needed for sparse inputs), it will
+   keep the original order of the indices within each branch, so that sorted indices remain sorted */
+size_t divide_subset_split(ix_t ix_arr[], double x[], size_t st, size_t end, double split_point, ix_t *restrict buffer)
 {
-    size_t temp;
     size_t st_orig = st;
+    if (buffer != NULL)
+    {
+        size_t n_right = 0;
+        for (size_t row = st_orig; row <= end; row++)
+        {
+            if (x[row - st_orig] <= split_point)
+                ix_arr[st++] = ix_arr[row];
+            else
+                buffer[n_right++] = ix_arr[row];
+        }
+        std::copy(buffer, buffer + n_right, ix_arr + st);
+        return st;
+    }
+
+    size_t temp;
     for (size_t row = st_orig; row <= end; row++)
     {
         if (x[row - st_orig] <= split_point)
@@ -662,7 +1085,7 @@ size_t divide_subset_split(size_t ix_arr[], double x[], size_t st, size_t end, d
 }
 
 /* For numerical columns */
-void divide_subset_split(size_t ix_arr[], double x[], size_t st, size_t end, double split_point,
+void divide_subset_split(ix_t ix_arr[], double x[], size_t st, size_t end, double split_point,
                          MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix)
 {
     size_t temp;
@@ -713,267 +1136,96 @@ void divide_subset_split(size_t ix_arr[], double x[], size_t st, size_t end, dou
     }
 }
 
-/* For sparse numeric columns */
-void divide_subset_split(size_t ix_arr[], size_t st, size_t end, size_t col_num,
+/* For sparse numeric columns - the indices must be sorted, and this is done as a stable partition,
+   so the rows that go to the left, the ones with NAs, and the ones that go to the right, will each
+   remain sorted afterwards and there's no need to sort them again at the next node. The rows to the
+   left are moved in-place while the NAs and rows to the right are put in the buffer (NAs at the start
+   and the rest at the end, backwards), which must have space for as many elements as in the range. */
+void divide_subset_split(ix_t ix_arr[], size_t st, size_t end, size_t col_num,
                          double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[], double split_point,
-                         MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix)
+                         MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix,
+                         ix_t *restrict buffer)
 {
-    /* TODO: this is a mess, needs refactoring */
-    /* TODO: when moving zeros, would be better to instead move by '>' (opposite as in here) */
-    if (Xc_indptr[col_num] == Xc_indptr[col_num + 1])
+    size_t n = end - st + 1;
+    size_t end_col = Xc_indptr[col_num + 1];
+    size_t curr_pos = Xc_indptr[col_num];
+    size_t n_NA = 0;
+    size_t n_right = 0;
+    size_t step, hi;
+    double xval;
+    ix_t ix;
+
+    for (size_t row = st; row <= end; row++)
     {
-        if (missing_action == Fail)
+        /* advance to the first non-zero entry whose index is not smaller than this row,
+           by doubling the jump size and then doing a binary search within the last jump */
+        ix = ix_arr[row];
+        if (curr_pos < end_col && (size_t)Xc_ind[curr_pos] < ix)
         {
-            split_ix = (0 <= split_point)? (end+1) : st;
+            step = 1;
+            while (curr_pos + step < end_col && (size_t)Xc_ind[curr_pos + step] < ix)
+            {
+                curr_pos += step;
+                step <<= 1;
+            }
+            hi = std::min(curr_pos + step + 1, end_col);
+            curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + hi, ix) - Xc_ind;
         }
+        xval = (curr_pos < end_col && (size_t)Xc_ind[curr_pos] == ix)? Xc[curr_pos] : 0;
 
+        if (missing_action != Fail && isnan(xval))
+            buffer[n_NA++] = ix;
+        else if (xval <= split_point)
+            ix_arr[st++] = ix;
         else
-        {
-            st_NA  = (0 <= split_point)? (end+1) : st;
-            end_NA = (0 <= split_point)? (end+1) : st;
-        }
-
+            buffer[n - (++n_right)] = ix;
     }
 
-    size_t st_col  = Xc_indptr[col_num];
-    size_t end_col = Xc_indptr[col_num + 1] - 1;
-    size_t curr_pos = st_col;
-    size_t ind_end_col = Xc_ind[end_col];
-    size_t temp;
-    bool   move_zeros = 0 <= split_point;
-    size_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
-
-    if (move_zeros && ptr_st > ix_arr + st)
-        st = ptr_st - ix_arr;
-
     if (missing_action == Fail)
     {
-        if (move_zeros)
-        {
-            for (size_t *row = ptr_st;
-                 row != ix_arr + end + 1;
-                )
-            {
-                if (curr_pos >= end_col + 1)
-                {
-                    for (size_t *r = row; r <= ix_arr + end; r++)
-                    {
-                        temp       = ix_arr[st];
-                        ix_arr[st] = *r;
-                        *r         = temp;
-                        st++;
-                    }
-                    break;
-                }
-
-                if (Xc_ind[curr_pos] == *row)
-                {
-                    if (Xc[curr_pos] <= split_point)
-                    {
-                        temp       = ix_arr[st];
-                        ix_arr[st] = *row;
-                        *row       = temp;
-                        st++;
-                    }
-                    if (curr_pos == end_col && row < ix_arr + end)
-                        for (size_t *r = row + 1; r <= ix_arr + end; r++)
-                        {
-                            temp       = ix_arr[st];
-                            ix_arr[st] = *r;
-                            *r         = temp;
-                            st++;
-                        }
-                    if (row == ix_arr + end || curr_pos == end_col) break;
-                    curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *(++row)) - Xc_ind;
-                }
-
-                else
-                {
-                    if (Xc_ind[curr_pos] > *row)
-                    {
-                        while (row <= ix_arr + end && Xc_ind[curr_pos] > *row)
-                        {
-                            temp       = ix_arr[st];
-                            ix_arr[st] = *row;
-                            *row       = temp;
-                            st++; row++;
-                        }
-                    }
-
-                    else
-                        curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *row) - Xc_ind;
-                }
-            }
-        }
-
-        else /* don't move zeros */
-        {
-            for (size_t *row = ptr_st;
-                 row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
-                )
-            {
-                if (Xc_ind[curr_pos] == *row)
-                {
-                    if (Xc[curr_pos] <= split_point)
-                    {
-                        temp       = ix_arr[st];
-                        ix_arr[st] = *row;
-                        *row       = temp;
-                        st++;
-                    }
-                    if (row == ix_arr + end || curr_pos == end_col) break;
-                    curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *(++row)) - Xc_ind;
-                }
-
-                else
-                {
-                    if (Xc_ind[curr_pos] > *row)
-                        row = std::lower_bound(row + 1, ix_arr + end + 1, Xc_ind[curr_pos]);
-                    else
-                        curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *row) - Xc_ind;
-                }
-            }
-        }
-
         split_ix = st;
     }
 
-    else /* can have NAs */
+    else
     {
-
-        bool has_NAs = false;
-        if (move_zeros)
-        {
-            for (size_t *row = ptr_st;
-                 row != ix_arr + end + 1;
-                )
-            {
-                if (curr_pos >= end_col + 1)
-                {
-                    for (size_t *r = row; r <= ix_arr + end; r++)
-                    {
-                        temp       = ix_arr[st];
-                        ix_arr[st] = *r;
-                        *r         = temp;
-                        st++;
-                    }
-                    break;
-                }
-
-                if (Xc_ind[curr_pos] == *row)
-                {
-                    if (isnan(Xc[curr_pos]))
-                        has_NAs = true;
-                    else if (Xc[curr_pos] <= split_point)
-                    {
-                        temp       = ix_arr[st];
-                        ix_arr[st] = *row;
-                        *row       = temp;
-                        st++;
-                    }
-                    if (curr_pos == end_col && row < ix_arr + end)
-                        for (size_t *r = row + 1; r <= ix_arr + end; r++)
-                        {
-                            temp       = ix_arr[st];
-                            ix_arr[st] = *r;
-                            *r         = temp;
-                            st++;
-                        }
-                    if (row == ix_arr + end || curr_pos == end_col) break;
-                    curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *(++row)) - Xc_ind;
-                }
-
-                else
-                {
-                    if (Xc_ind[curr_pos] > *row)
-                    {
-                        while (row <= ix_arr + end && Xc_ind[curr_pos] > *row)
-                        {
-                            temp       = ix_arr[st];
-                            ix_arr[st] = *row;
-                            *row       = temp;
-                            st++; row++;
-                        }
-                    }
-
-                    else
-                    {
-                        curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *row) - Xc_ind;
-                    }
-                }
-            }
-        }
-
-        else /* don't move zeros */
-        {
-            for (size_t *row = ptr_st;
-                 row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
-                )
-            {
-                if (Xc_ind[curr_pos] == *row)
-                {
-                    if (isnan(Xc[curr_pos])) has_NAs = true;
-                    if (Xc[curr_pos] <= split_point && !isnan(Xc[curr_pos]))
-                    {
-                        temp       = ix_arr[st];
-                        ix_arr[st] = *row;
-                        *row       = temp;
-                        st++;
-                    }
-                    if (row == ix_arr + end || curr_pos == end_col) break;
-                    curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *(++row)) - Xc_ind;
-                }
-
-                else
-                {
-                    if (Xc_ind[curr_pos] > *row)
-                        row = std::lower_bound(row + 1, ix_arr + end + 1, Xc_ind[curr_pos]);
-                    else
-                        curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *row) - Xc_ind;
-                }
-            }
-        }
-
-
         st_NA = st;
-        if (has_NAs)
-        {
-            curr_pos = st_col;
-            std::sort(ix_arr + st, ix_arr + end + 1);
-            for (size_t *row = ix_arr + st;
-                 row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
-                )
-            {
-                if (Xc_ind[curr_pos] == *row)
-                {
-                    if (isnan(Xc[curr_pos]))
-                    {
-                        temp       = ix_arr[st];
-                        ix_arr[st] = *row;
-                        *row       = temp;
-                        st++;
-                    }
-                    if (row == ix_arr + end || curr_pos == end_col) break;
-                    curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *(++row)) - Xc_ind;
-                }
-
-                else
-                {
-                    if (Xc_ind[curr_pos] > *row)
-                        row = std::lower_bound(row + 1, ix_arr + end + 1, Xc_ind[curr_pos]);
-                    else
-                        curr_pos = std::lower_bound(Xc_ind + curr_pos + 1, Xc_ind + end_col + 1, *row) - Xc_ind;
-                }
-            }
-        }
+        std::copy(buffer, buffer + n_NA, ix_arr + st);
+        st += n_NA;
         end_NA = st;
+    }
+
+    std::reverse_copy(buffer + n - n_right, buffer + n, ix_arr + st);
+}
+
+/* For sparse inputs, the indices at each node need to be sorted. Since splits on sparse numeric columns
+   and hyperplanes keep them sorted, they will typically be sorted already, or, when the NAs are sent to
+   both branches, consist of two sorted runs which can be merged in linear time. Other splits (e.g. by
+   categorical columns) might leave them in any order, in which case they are sorted again. */
+void ensure_sorted_ix(ix_t *restrict ix_arr, size_t st, size_t end, ix_t *restrict buffer)
+{
+    ix_t *first = ix_arr + st;
+    ix_t *last  = ix_arr + end + 1;
+    ix_t *mid   = std::is_sorted_until(first, last);
+    if (mid == last)
+        return;
 
+    if (!std::is_sorted(mid, last))
+    {
+        std::sort(first, last);
+        return;
     }
 
+    size_t n_first = mid - first;
+    std::copy(first, mid, buffer);
+    size_t ix1 = 0;
+    ix_t *out = first;
+    while (ix1 < n_first && mid != last)
+        *(out++) = (*mid < buffer[ix1])? *(mid++) : buffer[ix1++];
+    std::copy(buffer + ix1, buffer + n_first, out);
 }
 
 /* For categorical columns split by subset */
-void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, char split_categ[],
+void divide_subset_split(ix_t ix_arr[], int x[], size_t st, size_t end, char split_categ[],
                          MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix)
 {
     size_t temp;
@@ -1025,7 +1277,7 @@ void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, char s
 }
 
 /* For categorical columns split by subset, used at prediction time (with similarity) */
-void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, char split_categ[],
+void divide_subset_split(ix_t ix_arr[], int x[], size_t st, size_t end, char split_categ[],
                          int ncat, MissingAction missing_action, NewCategAction new_cat_action,
                          bool move_new_to_left, size_t &st_NA, size_t &end_NA, size_t &split_ix)
 {
@@ -1113,7 +1365,7 @@ void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, char s
 }
 
 /* For categoricals split on a single category */
-void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, int split_categ,
+void divide_subset_split(ix_t ix_arr[], int x[], size_t st, size_t end, int split_categ,
                          MissingAction missing_action, size_t &st_NA, size_t &end_NA, size_t &split_ix)
 {
     size_t temp;
@@ -1165,7 +1417,7 @@ void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end, int sp
 }
 
 /* For categoricals split on sub-set that turned out to have 2 categories only (prediction-time) */
-void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end,
+void divide_subset_split(ix_t ix_arr[], int x[], size_t st, size_t end,
                          MissingAction missing_action, NewCategAction new_cat_action,
                          bool move_new_to_left, size_t &st_NA, size_t &end_NA, size_t &split_ix)
 {
@@ -1265,7 +1517,7 @@ void divide_subset_split(size_t ix_arr[], int x[], size_t st, size_t end,
 }
 
 /* for regular numeric columns */
-void get_range(size_t ix_arr[], double x[], size_t st, size_t end,
+void get_range(ix_t ix_arr[], double x[], size_t st, size_t end,
                MissingAction missing_action, double &xmin, double &xmax, bool &unsplittable)
 {
     xmin =  HUGE_VAL;
@@ -1294,7 +1546,7 @@ void get_range(size_t ix_arr[], double x[], size_t st, size_t end,
 }
 
 /* for sparse inputs */
-void get_range(size_t ix_arr[], size_t st, size_t end, size_t col_num,
+void get_range(ix_t ix_arr[], size_t st, size_t end, size_t col_num,
                double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
                MissingAction missing_action, double &xmin, double &xmax, bool &unsplittable)
 {
@@ -1331,7 +1583,7 @@ void get_range(size_t ix_arr[], size_t st, size_t end, size_t col_num,
 
     if (missing_action == Fail)
     {
-        for (size_t *row = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
+        for (ix_t *row = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
              row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
             )
         {
@@ -1356,7 +1608,7 @@ void get_range(size_t ix_arr[], size_t st, size_t end, size_t col_num,
 
     else /* can have NAs */
     {
-        for (size_t *row = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
+        for (ix_t *row = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
              row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
             )
         {
@@ -1390,7 +1642,7 @@ void get_range(size_t ix_arr[], size_t st, size_t end, size_t col_num,
 }
 
 
-void get_categs(size_t ix_arr[], int x[], size_t st, size_t end, int ncat,
+void get_categs(ix_t ix_arr[], int x[], size_t st, size_t end, int ncat,
                 MissingAction missing_action, char categs[], size_t &npresent, bool &unsplittable)
 {
     std::fill(categs, categs + ncat, -1);
@@ -1408,7 +1660,7 @@ void get_categs(size_t ix_arr[], int x[], size_t st, size_t end, int ncat,
     unsplittable = npresent < 2;
 }
 
-long double calculate_sum_weights(std::vector<size_t> &ix_arr, size_t st, size_t end, size_t curr_depth,
+long double calculate_sum_weights(std::vector<ix_t> &ix_arr, size_t st, size_t end, size_t curr_depth,
                                   std::vector<double> &weights_arr, std::unordered_map<size_t, double> &weights_map)
 {
     if (curr_depth > 0 && weights_arr.size())
@@ -1425,7 +1677,7 @@ long double calculate_sum_weights(std::vector<size_t> &ix_arr, size_t st, size_t
         return -HUGE_VAL;
 }
 
-size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, double x[])
+size_t move_NAs_to_front(ix_t ix_arr[], size_t st, size_t end, double x[])
 {
     size_t st_non_na = st;
     size_t temp;
@@ -1444,7 +1696,7 @@ size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, double x[])
     return st_non_na;
 }
 
-size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, size_t col_num, double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[])
+size_t move_NAs_to_front(ix_t ix_arr[], size_t st, size_t end, size_t col_num, double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[])
 {
     size_t st_non_na = st;
     size_t temp;
@@ -1454,9 +1706,9 @@ size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, size_t col_num,
     size_t curr_pos = st_col;
     size_t ind_end_col = Xc_ind[end_col];
     std::sort(ix_arr + st, ix_arr + end + 1);
-    size_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
+    ix_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
 
-    for (size_t *row = ptr_st;
+    for (ix_t *row = ptr_st;
          row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
         )
     {
@@ -1486,7 +1738,7 @@ size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, size_t col_num,
     return st_non_na;
 }
 
-size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, int x[])
+size_t move_NAs_to_front(ix_t ix_arr[], size_t st, size_t end, int x[])
 {
     size_t st_non_na = st;
     size_t temp;
@@ -1505,7 +1757,7 @@ size_t move_NAs_to_front(size_t ix_arr[], size_t st, size_t end, int x[])
     return st_non_na;
 }
 
-size_t center_NAs(size_t *restrict ix_arr, size_t st_left, size_t st, size_t curr_pos)
+size_t center_NAs(ix_t *restrict ix_arr, size_t st_left, size_t st, size_t curr_pos)
 {
     size_t temp;
     for (size_t row = st_left; row < st; row++)
@@ -1518,7 +1770,7 @@ size_t center_NAs(size_t *restrict ix_arr, size_t st_left, size_t st, size_t cur
     return curr_pos;
 }
 
-void todense(size_t ix_arr[], size_t st, size_t end,
+void todense(ix_t ix_arr[], size_t st, size_t end,
              size_t col_num, double *restrict Xc, sparse_ix Xc_ind[], sparse_ix Xc_indptr[],
              double *restrict buffer_arr)
 {
@@ -1528,9 +1780,9 @@ void todense(size_t ix_arr[], size_t st, size_t end,
     size_t end_col = Xc_indptr[col_num + 1] - 1;
     size_t curr_pos = st_col;
     size_t ind_end_col = Xc_ind[end_col];
-    size_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
+    ix_t *ptr_st = std::lower_bound(ix_arr + st, ix_arr + end + 1, Xc_ind[st_col]);
 
-    for (size_t *row = ptr_st;
+    for (ix_t *row = ptr_st;
          row != ix_arr + end + 1 && curr_pos != end_col + 1 && ind_end_col >= *row;
         )
     {
@@ -0,0 +1,98 @@
+/* Checks that 'add_trees' produces the same trees as calling 'add_tree' once per tree */
+#include "test_helpers.hpp"
+
+static void check_add_trees(size_t ndim, MissingAction missing_action, bool use_imputer,
+                            double prob_pick_by_gain_avg, int nthreads)
+{
+    TestData data = make_test_data(300, missing_action != Fail, 123);
+    size_t ntrees_init = 3, ntrees_add = 5;
+    uint64_t seed = 456;
+    IsoForest model;
+    ExtIsoForest model_ext;
+    Imputer imputer;
+    IsoForest *model_ptr = (ndim == 1)? &model : NULL;
+    ExtIsoForest *model_ext_ptr = (ndim == 1)? NULL : &model_ext;
+
+    int ret = fit_iforest(model_ptr, model_ext_ptr,
+                          data.numeric_data.data(), data.ncols_numeric,
+                          data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                          NULL, NULL, NULL,
+                          ndim, 3, Normal, false,
+                          NULL, false, false,
+                          data.nrows, 128, ntrees_init, 0, true, true,
+                          false, NULL, NULL, false,
+                          NULL, false, 0,
+                          prob_pick_by_gain_avg, 0, 0, 0,
+                          0, missing_action, SubSet, Weighted,
+                          false, use_imputer? &imputer : NULL, 3, Higher, Inverse, false,
+                          seed, MersenneTwister, 1);
+    CHECK(ret == EXIT_SUCCESS);
+
+    /* one by one */
+    IsoForest model_single = model;
+    ExtIsoForest model_ext_single = model_ext;
+    Imputer imputer_single = imputer;
+    for (size_t tree = 0; tree < ntrees_add; tree++)
+    {
+        if (use_imputer) imputer_single.imputer_tree.emplace_back();
+        ret = add_tree((ndim == 1)? &model_single : NULL, (ndim == 1)? NULL : &model_ext_single,
+                       data.numeric_data.data(), data.ncols_numeric,
+                       data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                       NULL, NULL, NULL,
+                       ndim, 3, Normal, false,
+                       NULL, data.nrows, 0, true, true,
+                       NULL, false,
+                       prob_pick_by_gain_avg, 0, 0, 0,
+                       0, missing_action, SubSet, Weighted,
+                       Higher, Inverse,
+                       false, use_imputer? &imputer_single.imputer_tree.back() : NULL, 3,
+                       seed, MersenneTwister);
+        CHECK(ret == EXIT_SUCCESS);
+    }
+
+    /* all at once */
+    IsoForest model_multi = model;
+    ExtIsoForest model_ext_multi = model_ext;
+    Imputer imputer_multi = imputer;
+    ret = add_trees((ndim == 1)? &model_multi : NULL, (ndim == 1)? NULL : &model_ext_multi,
+                    data.numeric_data.data(), data.ncols_numeric,
+                    data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                    NULL, NULL, NULL,
+                    ndim, 3, Normal, false,
+                    NULL, data.nrows, ntrees_add, 0, true, true,
+                    NULL, false,
+                    prob_pick_by_gain_avg, 0, 0, 0,
+                    0, missing_action, SubSet, Weighted,
+                    Higher, Inverse,
+                    false, use_imputer? &imputer_multi : NULL, 3,
+                    seed, MersenneTwister, nthreads);
+    CHECK(ret == EXIT_SUCCESS);
+
+    if (ndim == 1)
+    {
+        CHECK(model_multi.trees.size() == ntrees_init + ntrees_add);
+        CHECK(same_forest(model_single.trees, model_multi.trees));
+    }
+    else
+    {
+        CHECK(model_ext_multi.hplanes.size() == ntrees_init + ntrees_add);
+        CHECK(same_forest(model_ext_single.hplanes, model_ext_multi.hplanes));
+    }
+    if (use_imputer)
+        CHECK(same_forest(imputer_single.imputer_tree, imputer_multi.imputer_tree));
+}
+
+int main()
+{
+    for (int nthreads : {1, 3})
+    {
+        check_add_trees(1, Divide, false, 0, nthreads);
+        check_add_trees(1, Impute, true, 0, nthreads);
+        check_add_trees(1, Divide, false, 0.5, nthreads);
+        check_add_trees(1, Fail, false, 0, nthreads);
+        check_add_trees(2, Divide, false, 0, nthreads);
+        check_add_trees(3, Impute, true, 0, nthreads);
+        check_add_trees(2, Fail, false, 0.5, nthreads);
+    }
+    return report_tests("test_add_trees");
+}
@@ -0,0 +1,166 @@
+/* Definitions of the helpers declared in 'test_helpers.hpp', which are compiled into each test */
+#include "test_helpers.hpp"
+
+int n_failed = 0;
+
+TestData make_test_data(size_t nrows, bool with_missing, uint64_t seed)
+{
+    TestData data;
+    data.nrows = nrows;
+    data.ncols_numeric = 4;
+    data.ncols_categ = 2;
+    data.numeric_data.resize(nrows * data.ncols_numeric);
+    data.categ_data.resize(nrows * data.ncols_categ);
+    data.ncat = {5, 3};
+
+    std::mt19937_64 rng(seed);
+    std::normal_distribution<double> rnorm(0, 1);
+    for (size_t row = 0; row < nrows; row++)
+    {
+        double z = rnorm(rng);
+        data.numeric_data[row] = z + 0.5 * rnorm(rng);
+        data.numeric_data[row + nrows] = 2. * z + rnorm(rng);
+        data.numeric_data[row + 2 * nrows] = 1.5;
+        data.numeric_data[row + 3 * nrows] = rnorm(rng);
+        data.categ_data[row] = (int)(rng() % 5);
+        data.categ_data[row + nrows] = 2;
+        if (with_missing && row % 7 == 3)
+            data.numeric_data[row + (row % 2) * nrows] = NAN;
+        if (with_missing && row % 11 == 5)
+            data.categ_data[row] = -1;
+    }
+    return data;
+}
+
+SparseData make_sparse_data(TestData &data)
+{
+    SparseData sp;
+    size_t nrows = data.nrows;
+    sp.Xc_indptr.push_back(0);
+    for (size_t col = 0; col < data.ncols_numeric; col++)
+    {
+        for (size_t row = 0; row < nrows; row++)
+        {
+            if ((row + col) % 3 == 0) continue;
+            sp.Xc.push_back(data.numeric_data[row + col * nrows]);
+            sp.Xc_ind.push_back(row);
+        }
+        sp.Xc_indptr.push_back(sp.Xc.size());
+    }
+    sp.Xr_indptr.push_back(0);
+    for (size_t row = 0; row < nrows; row++)
+    {
+        for (size_t col = 0; col < data.ncols_numeric; col++)
+        {
+            if ((row + col) % 3 == 0) continue;
+            sp.Xr.push_back(data.numeric_data[row + col * nrows]);
+            sp.Xr_ind.push_back(col);
+        }
+        sp.Xr_indptr.push_back(sp.Xr.size());
+    }
+    return sp;
+}
+
+bool same_value(double a, double b)
+{
+    return a == b || (isnan(a) && isnan(b));
+}
+
+bool same_values(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t ix = 0; ix < a.size(); ix++)
+        if (!same_value(a[ix], b[ix])) return false;
+    return true;
+}
+
+bool same_values(const std::vector<std::vector<double>> &a, const std::vector<std::vector<double>> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t ix = 0; ix < a.size(); ix++)
+        if (!same_values(a[ix], b[ix])) return false;
+    return true;
+}
+
+bool same_tree(const std::vector<IsoTree> &a, const std::vector<IsoTree> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t node = 0; node < a.size(); node++)
+    {
+        if (a[node].col_type != b[node].col_type || a[node].score != b[node].score) return false;
+        if (a[node].col_type == NotUsed) continue;
+        if (
+            a[node].col_num != b[node].col_num ||
+            a[node].tree_left != b[node].tree_left ||
+            a[node].tree_right != b[node].tree_right ||
+            !same_value(a[node].pct_tree_left, b[node].pct_tree_left) ||
+            !same_value(a[node].range_low, b[node].range_low) ||
+            !same_value(a[node].range_high, b[node].range_high)
+            )
+            return false;
+        if (a[node].col_type == Numeric && !same_value(a[node].num_split, b[node].num_split)) return false;
+        if (a[node].col_type == Categorical && (a[node].cat_split != b[node].cat_split ||
+            (a[node].cat_split.empty() && a[node].chosen_cat != b[node].chosen_cat)))
+            return false;
+    }
+    return true;
+}
+
+bool same_tree(const std::vector<IsoHPlane> &a, const std::vector<IsoHPlane> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t node = 0; node < a.size(); node++)
+    {
+        if (a[node].score != b[node].score || a[node].hplane_left != b[node].hplane_left) return false;
+        if (a[node].hplane_left == 0) continue;
+        if (
+            a[node].hplane_right != b[node].hplane_right ||
+            a[node].col_num != b[node].col_num ||
+            a[node].col_type != b[node].col_type ||
+            a[node].chosen_cat != b[node].chosen_cat ||
+            !same_values(a[node].cat_coef, b[node].cat_coef) ||
+            !same_values(a[node].coef, b[node].coef) ||
+            !same_values(a[node].mean, b[node].mean) ||
+            !same_values(a[node].fill_val, b[node].fill_val) ||
+            !same_values(a[node].fill_new, b[node].fill_new) ||
+            !same_value(a[node].split_point, b[node].split_point) ||
+            !same_value(a[node].range_low, b[node].range_low) ||
+            !same_value(a[node].range_high, b[node].range_high)
+            )
+            return false;
+    }
+    return true;
+}
+
+bool same_tree(const std::vector<ImputeNode> &a, const std::vector<ImputeNode> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t node = 0; node < a.size(); node++)
+    {
+        if (
+            a[node].parent != b[node].parent ||
+            !same_values(a[node].num_sum, b[node].num_sum) ||
+            !same_values(a[node].num_weight, b[node].num_weight) ||
+            !same_values(a[node].cat_sum, b[node].cat_sum) ||
+            !same_values(a[node].cat_weight, b[node].cat_weight)
+            )
+            return false;
+    }
+    return true;
+}
+
+void overwrite_file_bytes(const char *file_path, size_t offset, const void *data, size_t n_bytes)
+{
+    std::fstream file(file_path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(offset);
+    file.write((const char*)data, n_bytes);
+}
+
+int report_tests(const char *name)
+{
+    if (n_failed)
+        fprintf(stderr, "%s: %d checks failed\n", name, n_failed);
+    else
+        printf("%s: all checks passed\n", name);
+    return n_failed? EXIT_FAILURE : EXIT_SUCCESS;
+}
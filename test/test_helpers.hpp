@@ -0,0 +1,53 @@
+/* Helpers shared by the tests - these are small programs that use the non-public functions
+   from 'src/isotree.hpp', returning a non-zero status if any of the checks failed */
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include "isotree.hpp"
+
+extern int n_failed;
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); n_failed++; } } while (0)
+
+/* data with a constant numeric column, a constant categorical column, and some missing values */
+typedef struct TestData {
+    size_t nrows;
+    size_t ncols_numeric;
+    size_t ncols_categ;
+    std::vector<double> numeric_data;
+    std::vector<int>    categ_data;
+    std::vector<int>    ncat;
+} TestData;
+
+TestData make_test_data(size_t nrows, bool with_missing, uint64_t seed);
+
+typedef struct SparseData {
+    std::vector<double>    Xc;
+    std::vector<sparse_ix> Xc_ind;
+    std::vector<sparse_ix> Xc_indptr;
+    std::vector<double>    Xr;
+    std::vector<sparse_ix> Xr_ind;
+    std::vector<sparse_ix> Xr_indptr;
+} SparseData;
+
+/* CSC and CSR copies of the numeric data, leaving out every third entry as a zero */
+SparseData make_sparse_data(TestData &data);
+
+bool same_value(double a, double b);
+bool same_values(const std::vector<double> &a, const std::vector<double> &b);
+bool same_values(const std::vector<std::vector<double>> &a, const std::vector<std::vector<double>> &b);
+bool same_tree(const std::vector<IsoTree> &a, const std::vector<IsoTree> &b);
+bool same_tree(const std::vector<IsoHPlane> &a, const std::vector<IsoHPlane> &b);
+bool same_tree(const std::vector<ImputeNode> &a, const std::vector<ImputeNode> &b);
+
+template <class Tree>
+bool same_forest(const std::vector<Tree> &a, const std::vector<Tree> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t tree = 0; tree < a.size(); tree++)
+        if (!same_tree(a[tree], b[tree])) return false;
+    return true;
+}
+
+void overwrite_file_bytes(const char *file_path, size_t offset, const void *data, size_t n_bytes);
+int report_tests(const char *name);
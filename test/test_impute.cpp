@@ -0,0 +1,200 @@
+/* Checks that imputing missing values for many rows at once, which groups the rows by their
+   missing pattern and passes them by blocks through each tree, produces exactly the same
+   imputations as imputing each row on its own, and that imputers in the compact layout produce
+   the same imputations as the regular ones, also after merging models and serializing them */
+#include "test_helpers.hpp"
+
+static IsoForest model;
+static ExtIsoForest model_ext;
+static Imputer imputer;
+
+static void fit_model(TestData &data, size_t ndim, MissingAction missing_action)
+{
+    model = IsoForest();
+    model_ext = ExtIsoForest();
+    imputer = Imputer();
+    fit_iforest((ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                data.numeric_data.data(), data.ncols_numeric,
+                data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                NULL, NULL, NULL,
+                ndim, 2, Normal, false,
+                NULL, false, false,
+                data.nrows, 64, 20, 0, true, true,
+                false, NULL, NULL, false,
+                NULL, false, 0,
+                0, 0, 0, 0,
+                0, missing_action, SubSet, Smallest,
+                false, &imputer, 3, Higher, Inverse, false,
+                1, MersenneTwister, 1);
+}
+
+static void impute_data(TestData &data, size_t ndim, int nthreads, Imputer &imputer_used = imputer)
+{
+    impute_missing_values(data.numeric_data.data(), data.categ_data.data(), NULL, NULL, NULL,
+                          data.nrows, nthreads,
+                          (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                          imputer_used);
+}
+
+static TestData impute_copy(TestData &data, size_t ndim, Imputer &imputer_used)
+{
+    TestData out = data;
+    impute_data(out, ndim, 2, imputer_used);
+    return out;
+}
+
+static bool same_imputations(TestData &a, TestData &b)
+{
+    return same_values(a.numeric_data, b.numeric_data) && a.categ_data == b.categ_data;
+}
+
+static TestData take_row(TestData &data, size_t row)
+{
+    TestData out = data;
+    out.nrows = 1;
+    out.numeric_data.resize(data.ncols_numeric);
+    out.categ_data.resize(data.ncols_categ);
+    for (size_t col = 0; col < data.ncols_numeric; col++)
+        out.numeric_data[col] = data.numeric_data[row + col * data.nrows];
+    for (size_t col = 0; col < data.ncols_categ; col++)
+        out.categ_data[col] = data.categ_data[row + col * data.nrows];
+    return out;
+}
+
+static void check_batch_same_as_rows(size_t ndim, MissingAction missing_action)
+{
+    TestData data = make_test_data(300, true, 222);
+    fit_model(data, ndim, missing_action);
+
+    TestData by_rows = data;
+    for (size_t row = 0; row < data.nrows; row++)
+    {
+        TestData single_row = take_row(data, row);
+        impute_data(single_row, ndim, 1);
+        for (size_t col = 0; col < data.ncols_numeric; col++)
+            by_rows.numeric_data[row + col * data.nrows] = single_row.numeric_data[col];
+        for (size_t col = 0; col < data.ncols_categ; col++)
+            by_rows.categ_data[row + col * data.nrows] = single_row.categ_data[col];
+    }
+
+    for (int nthreads : {1, 3})
+    {
+        TestData by_batch = data;
+        impute_data(by_batch, ndim, nthreads);
+        CHECK(same_values(by_batch.numeric_data, by_rows.numeric_data));
+        CHECK(by_batch.categ_data == by_rows.categ_data);
+    }
+
+    bool imputed_all = true;
+    for (double x : by_rows.numeric_data) imputed_all = imputed_all && !isnan(x);
+    for (int x : by_rows.categ_data) imputed_all = imputed_all && x >= 0;
+    CHECK(imputed_all);
+}
+
+static Imputer make_compact(Imputer &regular, bool as_float)
+{
+    Imputer out = regular;
+    compact_imputer(out, as_float, 2);
+    return out;
+}
+
+static void check_compact_imputer(size_t ndim, MissingAction missing_action)
+{
+    TestData data = make_test_data(300, true, 333);
+    fit_model(data, ndim, missing_action);
+    TestData expected = impute_copy(data, ndim, imputer);
+
+    Imputer compact = make_compact(imputer, false);
+    CHECK(compact.imputer_tree.empty());
+    CHECK(compact.imputer_tree_compact.size() == imputer.imputer_tree.size());
+    TestData got = impute_copy(data, ndim, compact);
+    CHECK(same_imputations(got, expected));
+
+    /* with 'float', the numeric imputations are only approximately the same */
+    compact = make_compact(imputer, true);
+    got = impute_copy(data, ndim, compact);
+    bool close = true;
+    for (size_t ix = 0; ix < got.numeric_data.size(); ix++)
+        close = close && std::fabs(got.numeric_data[ix] - expected.numeric_data[ix])
+                           <= 1e-5 * std::fmax(1., std::fabs(expected.numeric_data[ix]));
+    CHECK(close);
+}
+
+/* merging where either imputer or both are compact should produce the same as merging the regular ones */
+static void check_compact_merge(size_t ndim, MissingAction missing_action)
+{
+    TestData data = make_test_data(300, true, 444);
+    fit_model(data, ndim, missing_action);
+    IsoForest model1 = model;
+    ExtIsoForest model_ext1 = model_ext;
+    Imputer imputer1 = imputer;
+    data = make_test_data(300, true, 555);
+    fit_model(data, ndim, missing_action);
+    IsoForest model2 = model;
+    ExtIsoForest model_ext2 = model_ext;
+    Imputer imputer2 = imputer;
+
+    model = model1;
+    model_ext = model_ext1;
+    merge_models((ndim == 1)? &model : NULL, (ndim == 1)? &model2 : NULL,
+                 (ndim == 1)? NULL : &model_ext, (ndim == 1)? NULL : &model_ext2,
+                 &imputer1, &imputer2);
+    TestData expected = impute_copy(data, ndim, imputer1);
+    imputer1.imputer_tree.resize(imputer1.imputer_tree.size() - imputer2.imputer_tree.size());
+
+    for (bool compact_this : {false, true})
+    {
+        for (bool compact_other : {false, true})
+        {
+            if (!compact_this && !compact_other) continue;
+            Imputer merged = compact_this? make_compact(imputer1, false) : imputer1;
+            Imputer other  = compact_other? make_compact(imputer2, false) : imputer2;
+            merge_models(NULL, NULL, NULL, NULL, &merged, &other);
+            CHECK(merged.imputer_tree.empty());
+            CHECK(merged.imputer_tree_compact.size() == imputer1.imputer_tree.size() + imputer2.imputer_tree.size());
+            TestData got = impute_copy(data, ndim, merged);
+            CHECK(same_imputations(got, expected));
+        }
+    }
+}
+
+#ifdef _ENABLE_CEREAL
+/* compact imputers are written with a leading SIZE_MAX, which should not affect the regular ones */
+static void check_serialization(size_t ndim, MissingAction missing_action)
+{
+    TestData data = make_test_data(300, true, 666);
+    fit_model(data, ndim, missing_action);
+    TestData expected = impute_copy(data, ndim, imputer);
+
+    for (bool compact : {false, true})
+    {
+        Imputer original = compact? make_compact(imputer, false) : imputer;
+        std::string serialized = serialize_imputer(original);
+        Imputer deserialized;
+        deserialize_imputer(deserialized, serialized, false);
+        CHECK(deserialized.ncols_numeric == original.ncols_numeric);
+        CHECK(deserialized.imputer_tree.size() == original.imputer_tree.size());
+        CHECK(deserialized.imputer_tree_compact.size() == original.imputer_tree_compact.size());
+        CHECK(same_forest(deserialized.imputer_tree, original.imputer_tree));
+        TestData got = impute_copy(data, ndim, deserialized);
+        CHECK(same_imputations(got, expected));
+    }
+}
+#endif
+
+int main()
+{
+    for (size_t ndim : {1, 2})
+    {
+        for (MissingAction missing_action : {Impute, Divide})
+        {
+            check_batch_same_as_rows(ndim, missing_action);
+            check_compact_imputer(ndim, missing_action);
+            check_compact_merge(ndim, missing_action);
+            #ifdef _ENABLE_CEREAL
+            check_serialization(ndim, missing_action);
+            #endif
+        }
+    }
+    return report_tests("test_impute");
+}
@@ -0,0 +1,118 @@
+/* Checks that models fit to data mapped through 'map_data_file' are the same as when fitting
+   to the arrays the file was written from, and that files with invalid indices are rejected */
+#include <cstddef>
+#include "test_helpers.hpp"
+
+static const char *data_file = "test_mapped_data.bin";
+
+static void fit_model(IsoForest &model, TestData &data,
+                      double numeric_data[], int categ_data[],
+                      double Xc[], sparse_ix Xc_ind[], sparse_ix Xc_indptr[])
+{
+    int ret = fit_iforest(&model, NULL,
+                          numeric_data, data.ncols_numeric,
+                          categ_data, data.ncols_categ, data.ncat.data(),
+                          Xc, Xc_ind, Xc_indptr,
+                          1, 1, Normal, false,
+                          NULL, false, false,
+                          data.nrows, 128, 10, 0, true, true,
+                          false, NULL, NULL, false,
+                          NULL, false, 0,
+                          0, 0, 0, 0,
+                          0, Impute, SubSet, Weighted,
+                          false, NULL, 3, Higher, Inverse, false,
+                          1, MersenneTwister, 1);
+    CHECK(ret == EXIT_SUCCESS);
+}
+
+static void check_same_model(bool sparse)
+{
+    TestData data = make_test_data(300, true, 654);
+    SparseData sp = make_sparse_data(data);
+    IsoForest model, model_mapped;
+    fit_model(model, data,
+              sparse? NULL : data.numeric_data.data(), data.categ_data.data(),
+              sparse? sp.Xc.data() : NULL, sparse? sp.Xc_ind.data() : NULL, sparse? sp.Xc_indptr.data() : NULL);
+
+    int ret = write_mapped_data(data_file,
+                                sparse? NULL : data.numeric_data.data(), data.ncols_numeric,
+                                data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                                sparse? sp.Xc.data() : NULL, sparse? sp.Xc_ind.data() : NULL, sparse? sp.Xc_indptr.data() : NULL,
+                                data.nrows);
+    CHECK(ret == EXIT_SUCCESS);
+    MappedData mapped;
+    ret = map_data_file(mapped, data_file, UseForFitting, true);
+    CHECK(ret == EXIT_SUCCESS);
+    if (ret != EXIT_SUCCESS) return;
+    CHECK(mapped.nrows == data.nrows);
+    fit_model(model_mapped, data,
+              mapped.numeric_data, mapped.categ_data,
+              mapped.Xc, mapped.Xc_ind, mapped.Xc_indptr);
+    CHECK(same_forest(model.trees, model_mapped.trees));
+    unmap_data_file(mapped);
+}
+
+/* writes the sparse data, and overwrites one entry of the array that starts at the given header offset */
+static void write_corrupted_file(TestData &data, SparseData &sp, size_t header_offset, size_t entry,
+                                 const void *value, size_t value_size)
+{
+    write_mapped_data(data_file,
+                      NULL, data.ncols_numeric,
+                      data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                      sp.Xc.data(), sp.Xc_ind.data(), sp.Xc_indptr.data(),
+                      data.nrows);
+    MappedDataHeader header;
+    std::ifstream(data_file, std::ios::binary).read((char*)&header, sizeof(MappedDataHeader));
+    uint64_t array_offset = *(uint64_t*)((char*)&header + header_offset);
+    overwrite_file_bytes(data_file, array_offset + entry * value_size, value, value_size);
+}
+
+static void check_rejects_invalid_files()
+{
+    TestData data = make_test_data(100, false, 987);
+    SparseData sp = make_sparse_data(data);
+    MappedData mapped;
+
+    /* a row index beyond the number of rows - only found when verifying */
+    sparse_ix row = data.nrows;
+    write_corrupted_file(data, sp, offsetof(MappedDataHeader, offset_Xc_ind), 5, &row, sizeof(sparse_ix));
+    CHECK(map_data_file(mapped, data_file, UseForFitting, true) == EXIT_FAILURE);
+    CHECK(map_data_file(mapped, data_file, UseForFitting, false) == EXIT_SUCCESS);
+    unmap_data_file(mapped);
+
+    /* row indices out of order within a column */
+    row = sp.Xc_ind[7];
+    write_corrupted_file(data, sp, offsetof(MappedDataHeader, offset_Xc_ind), 8, &row, sizeof(sparse_ix));
+    CHECK(map_data_file(mapped, data_file, UseForFitting, true) == EXIT_FAILURE);
+
+    /* column pointers that decrease - always checked */
+    sparse_ix ptr = sp.Xc_indptr[1] - 1;
+    write_corrupted_file(data, sp, offsetof(MappedDataHeader, offset_Xc_indptr), 2, &ptr, sizeof(sparse_ix));
+    CHECK(map_data_file(mapped, data_file, UseForFitting, false) == EXIT_FAILURE);
+
+    /* column pointers beyond the number of entries - always checked */
+    ptr = sp.Xc.size() + 1;
+    write_corrupted_file(data, sp, offsetof(MappedDataHeader, offset_Xc_indptr), 1, &ptr, sizeof(sparse_ix));
+    CHECK(map_data_file(mapped, data_file, UseForFitting, false) == EXIT_FAILURE);
+
+    /* a category beyond the number of categories - only found when verifying */
+    int categ = data.ncat[0];
+    write_corrupted_file(data, sp, offsetof(MappedDataHeader, offset_categ), 3, &categ, sizeof(int));
+    CHECK(map_data_file(mapped, data_file, UseForPrediction, true) == EXIT_FAILURE);
+    CHECK(map_data_file(mapped, data_file, UseForPrediction, false) == EXIT_SUCCESS);
+    unmap_data_file(mapped);
+
+    /* the unmodified file */
+    write_corrupted_file(data, sp, offsetof(MappedDataHeader, offset_categ), 3, &data.categ_data[3], sizeof(int));
+    CHECK(map_data_file(mapped, data_file, UseForPrediction, true) == EXIT_SUCCESS);
+    unmap_data_file(mapped);
+}
+
+int main()
+{
+    check_same_model(false);
+    check_same_model(true);
+    check_rejects_invalid_files();
+    remove(data_file);
+    return report_tests("test_mapped_data");
+}
@@ -0,0 +1,130 @@
+/* Checks that the models written through 'write_model_file' give the same predictions when
+   mapped as the models they were written from, and that corrupted files are rejected */
+#include <cstddef>
+#include <fstream>
+#include "test_helpers.hpp"
+
+static const char *model_file = "test_mapped_model.bin";
+
+static void check_same_predictions(size_t ndim, MissingAction missing_action, CategSplit cat_split_type,
+                                   NewCategAction new_cat_action, bool sparse)
+{
+    TestData data = make_test_data(500, missing_action != Fail, 789);
+    SparseData sp = make_sparse_data(data);
+    IsoForest model;
+    ExtIsoForest model_ext;
+    double prob_by_gain = (missing_action == Divide)? 0.25 : 0.;
+    int ret = fit_iforest((ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                          sparse? NULL : data.numeric_data.data(), data.ncols_numeric,
+                          data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                          sparse? sp.Xc.data() : NULL, sparse? sp.Xc_ind.data() : NULL, sparse? sp.Xc_indptr.data() : NULL,
+                          ndim, 1, Normal, false,
+                          NULL, false, false,
+                          data.nrows, 256, 20, 0, true, true,
+                          false, NULL, NULL, false,
+                          NULL, false, 0,
+                          prob_by_gain, prob_by_gain, 0, 0,
+                          0, missing_action, cat_split_type, new_cat_action,
+                          false, NULL, 3, Higher, Inverse, false,
+                          1, MersenneTwister, 1);
+    CHECK(ret == EXIT_SUCCESS);
+
+    CHECK(write_model_file(model_file, (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext) == EXIT_SUCCESS);
+    MappedModel mapped;
+    ret = map_model_file(mapped, model_file, true);
+    CHECK(ret == EXIT_SUCCESS);
+    if (ret != EXIT_SUCCESS) return;
+
+    size_t nrows = data.nrows, ntrees = 20;
+    for (int input_type = 0; input_type < 3; input_type++)
+    {
+        if (!sparse && input_type != 0) continue;
+        double    *numeric_data = (input_type == 0)? data.numeric_data.data() : NULL;
+        double    *Xc = (input_type == 1)? sp.Xc.data() : NULL;
+        sparse_ix *Xc_ind = (input_type == 1)? sp.Xc_ind.data() : NULL;
+        sparse_ix *Xc_indptr = (input_type == 1)? sp.Xc_indptr.data() : NULL;
+        double    *Xr = (input_type == 2)? sp.Xr.data() : NULL;
+        sparse_ix *Xr_ind = (input_type == 2)? sp.Xr_ind.data() : NULL;
+        sparse_ix *Xr_indptr = (input_type == 2)? sp.Xr_indptr.data() : NULL;
+        for (bool standardize : {false, true})
+        {
+            std::vector<double> depths(nrows), depths_mapped(nrows);
+            std::vector<sparse_ix> tree_num(nrows * ntrees), tree_num_mapped(nrows * ntrees);
+            predict_iforest(numeric_data, data.categ_data.data(),
+                            Xc, Xc_ind, Xc_indptr, Xr, Xr_ind, Xr_indptr,
+                            nrows, 2, standardize,
+                            (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                            depths.data(), tree_num.data());
+            predict_mapped_model(numeric_data, data.categ_data.data(),
+                                 Xc, Xc_ind, Xc_indptr, Xr, Xr_ind, Xr_indptr,
+                                 nrows, 2, standardize, mapped,
+                                 depths_mapped.data(), tree_num_mapped.data());
+            CHECK(same_values(depths, depths_mapped));
+            CHECK(tree_num == tree_num_mapped);
+        }
+    }
+    unmap_model_file(mapped);
+}
+
+static void check_rejects_corrupted_files()
+{
+    TestData data = make_test_data(300, false, 321);
+    IsoForest model;
+    fit_iforest(&model, NULL,
+                data.numeric_data.data(), data.ncols_numeric,
+                data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                NULL, NULL, NULL,
+                1, 1, Normal, false,
+                NULL, false, false,
+                data.nrows, 256, 10, 0, true, true,
+                false, NULL, NULL, false,
+                NULL, false, 0,
+                0, 0, 0, 0,
+                0, Divide, SubSet, Weighted,
+                false, NULL, 3, Higher, Inverse, false,
+                1, MersenneTwister, 1);
+    MappedModel mapped;
+
+    /* a change in the header */
+    CHECK(write_model_file(model_file, &model, NULL) == EXIT_SUCCESS);
+    double exp_avg_depth = 2. * model.exp_avg_depth;
+    overwrite_file_bytes(model_file, offsetof(MappedModelHeader, exp_avg_depth), &exp_avg_depth, sizeof(double));
+    CHECK(map_model_file(mapped, model_file, true) == EXIT_FAILURE);
+
+    /* a change in the nodes */
+    CHECK(write_model_file(model_file, &model, NULL) == EXIT_SUCCESS);
+    CHECK(map_model_file(mapped, model_file, true) == EXIT_SUCCESS);
+    size_t node_offset = (char*)mapped.nodes - (char*)mapped.mapped_addr;
+    unmap_model_file(mapped);
+    double score = 123.;
+    overwrite_file_bytes(model_file, node_offset + offsetof(MappedTreeNode, score), &score, sizeof(double));
+    CHECK(map_model_file(mapped, model_file, true) == EXIT_FAILURE);
+    CHECK(map_model_file(mapped, model_file, false) == EXIT_SUCCESS);
+    unmap_model_file(mapped);
+
+    /* a newer format which this one cannot read */
+    CHECK(write_model_file(model_file, &model, NULL) == EXIT_SUCCESS);
+    uint32_t min_version = 1000;
+    overwrite_file_bytes(model_file, offsetof(MappedModelHeader, min_version), &min_version, sizeof(uint32_t));
+    CHECK(map_model_file(mapped, model_file, false) == EXIT_FAILURE);
+
+    /* a file which is not a model */
+    std::ofstream(model_file, std::ios::binary | std::ios::trunc) << "not a model";
+    CHECK(map_model_file(mapped, model_file, false) == EXIT_FAILURE);
+}
+
+int main()
+{
+    for (size_t ndim : {1, 2})
+        for (MissingAction missing_action : {Divide, Impute, Fail})
+            for (CategSplit cat_split_type : {SubSet, SingleCateg})
+                for (NewCategAction new_cat_action : {Weighted, Smallest, Random})
+                    for (bool sparse : {false, true})
+                    {
+                        if (ndim > 1 && missing_action == Divide) continue;
+                        check_same_predictions(ndim, missing_action, cat_split_type, new_cat_action, sparse);
+                    }
+    check_rejects_corrupted_files();
+    remove(model_file);
+    return report_tests("test_mapped_model");
+}
@@ -0,0 +1,171 @@
+/* Checks that the nearest neighbours found through 'query_neighbors_index' are the same as
+   the ones obtained by calculating all the distances from each query row through 'calc_similarity',
+   and that the index is rejected when some row has to be divided between branches of a tree */
+#include <algorithm>
+#include "test_helpers.hpp"
+
+static const size_t k = 5;
+
+static IsoForest model;
+static ExtIsoForest model_ext;
+
+static void fit_model(TestData &data, size_t ndim, MissingAction missing_action)
+{
+    model = IsoForest();
+    model_ext = ExtIsoForest();
+    fit_iforest((ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                data.numeric_data.data(), data.ncols_numeric,
+                data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                NULL, NULL, NULL,
+                ndim, 1, Normal, false,
+                NULL, false, false,
+                data.nrows, 64, 30, 0, true, true,
+                false, NULL, NULL, false,
+                NULL, false, 0,
+                0, 0, 0, 0,
+                0, missing_action, SubSet, Smallest,
+                false, NULL, 3, Higher, Inverse, false,
+                1, MersenneTwister, 1);
+}
+
+/* distances from one query row to all the reference rows, passing the query as the first row */
+static std::vector<double> brute_force_distances(TestData &reference, TestData &query, size_t row,
+                                                 size_t ndim, bool assume_full_distr, bool standardize_dist)
+{
+    size_t nrows = reference.nrows + 1;
+    std::vector<double> numeric_data(nrows * reference.ncols_numeric);
+    std::vector<int> categ_data(nrows * reference.ncols_categ);
+    for (size_t col = 0; col < reference.ncols_numeric; col++)
+    {
+        numeric_data[col * nrows] = query.numeric_data[row + col * query.nrows];
+        std::copy(reference.numeric_data.begin() + col * reference.nrows,
+                  reference.numeric_data.begin() + (col + 1) * reference.nrows,
+                  numeric_data.begin() + col * nrows + 1);
+    }
+    for (size_t col = 0; col < reference.ncols_categ; col++)
+    {
+        categ_data[col * nrows] = query.categ_data[row + col * query.nrows];
+        std::copy(reference.categ_data.begin() + col * reference.nrows,
+                  reference.categ_data.begin() + (col + 1) * reference.nrows,
+                  categ_data.begin() + col * nrows + 1);
+    }
+
+    std::vector<double> rmat(reference.nrows);
+    calc_similarity(numeric_data.data(), categ_data.data(), NULL, NULL, NULL,
+                    nrows, 1, assume_full_distr, standardize_dist,
+                    (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                    NULL, rmat.data(), 1);
+    return rmat;
+}
+
+static bool close_value(double a, double b)
+{
+    return std::fabs(a - b) <= 1e-12 * std::fmax(1., std::fabs(a));
+}
+
+/* ties might be resolved differently, so this checks the distances of the neighbours rather than their indices */
+static void check_neighbors(std::vector<double> &distances, size_t *neighbors, double *neighbor_dist,
+                            size_t n_neighbors, bool standardize_dist)
+{
+    std::vector<double> sorted_dist = distances;
+    if (standardize_dist)
+        std::sort(sorted_dist.begin(), sorted_dist.end());
+    else
+        std::sort(sorted_dist.begin(), sorted_dist.end(), std::greater<double>());
+
+    std::vector<size_t> seen(neighbors, neighbors + n_neighbors);
+    std::sort(seen.begin(), seen.end());
+    CHECK(std::unique(seen.begin(), seen.end()) == seen.end());
+    for (size_t ix = 0; ix < n_neighbors; ix++)
+    {
+        CHECK(neighbors[ix] < distances.size());
+        if (neighbors[ix] >= distances.size()) continue;
+        CHECK(close_value(neighbor_dist[ix], distances[neighbors[ix]]));
+        CHECK(close_value(neighbor_dist[ix], sorted_dist[ix]));
+    }
+}
+
+static void check_same_as_brute_force(size_t ndim, bool assume_full_distr, bool standardize_dist)
+{
+    TestData reference = make_test_data(100, false, 123);
+    TestData query = make_test_data(10, false, 456);
+    fit_model(reference, ndim, Impute);
+
+    NeighborsIndex index;
+    int ret = build_neighbors_index(index, reference.numeric_data.data(), reference.categ_data.data(),
+                                    NULL, NULL, NULL, reference.nrows,
+                                    (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext, 2);
+    CHECK(ret == EXIT_SUCCESS);
+
+    for (size_t n_neighbors : {k, reference.nrows})
+    {
+        std::vector<size_t> neighbors(query.nrows * n_neighbors);
+        std::vector<double> neighbor_dist(query.nrows * n_neighbors);
+        ret = query_neighbors_index(index, (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                                    query.numeric_data.data(), query.categ_data.data(), NULL, NULL, NULL,
+                                    query.nrows, n_neighbors, assume_full_distr, standardize_dist,
+                                    neighbors.data(), neighbor_dist.data(), 2);
+        CHECK(ret == EXIT_SUCCESS);
+        if (ret != EXIT_SUCCESS) continue;
+
+        for (size_t row = 0; row < query.nrows; row++)
+        {
+            std::vector<double> distances = brute_force_distances(reference, query, row, ndim,
+                                                                  assume_full_distr, standardize_dist);
+            check_neighbors(distances, neighbors.data() + row * n_neighbors, neighbor_dist.data() + row * n_neighbors,
+                            n_neighbors, standardize_dist);
+        }
+    }
+}
+
+static void check_rejected(size_t ndim)
+{
+    NeighborsIndex index;
+    int ret;
+
+    /* rows with missing values are divided between branches with 'Divide', which is only
+       available for the single-variable model */
+    if (ndim == 1)
+    {
+        TestData with_missing = make_test_data(100, true, 789);
+        fit_model(with_missing, ndim, Divide);
+        ret = build_neighbors_index(index, with_missing.numeric_data.data(), with_missing.categ_data.data(),
+                                    NULL, NULL, NULL, with_missing.nrows, &model, NULL, 1);
+        CHECK(ret == EXIT_FAILURE);
+    }
+
+    /* asking for more neighbours than there are rows, and querying with a different model */
+    TestData reference = make_test_data(100, false, 789);
+    fit_model(reference, ndim, Impute);
+    ret = build_neighbors_index(index, reference.numeric_data.data(), reference.categ_data.data(),
+                                NULL, NULL, NULL, reference.nrows,
+                                (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext, 1);
+    CHECK(ret == EXIT_SUCCESS);
+    std::vector<size_t> neighbors(reference.nrows + 1);
+    std::vector<double> neighbor_dist(reference.nrows + 1);
+    ret = query_neighbors_index(index, (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                                reference.numeric_data.data(), reference.categ_data.data(), NULL, NULL, NULL,
+                                1, reference.nrows + 1, false, true,
+                                neighbors.data(), neighbor_dist.data(), 1);
+    CHECK(ret == EXIT_FAILURE);
+
+    TestData other_data = make_test_data(100, false, 790);
+    fit_model(other_data, ndim, Impute);
+    ret = query_neighbors_index(index, (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                                reference.numeric_data.data(), reference.categ_data.data(), NULL, NULL, NULL,
+                                1, k, false, true,
+                                neighbors.data(), neighbor_dist.data(), 1);
+    CHECK(ret == EXIT_FAILURE);
+}
+
+int main()
+{
+    for (size_t ndim : {1, 2})
+    {
+        for (bool assume_full_distr : {false, true})
+            for (bool standardize_dist : {false, true})
+                check_same_as_brute_force(ndim, assume_full_distr, standardize_dist);
+        check_rejected(ndim);
+    }
+    return report_tests("test_neighbors_index");
+}
@@ -0,0 +1,127 @@
+/* Checks that rolling forests keep the newest trees in the expected slots, that the models
+   obtained before an update are not modified by it, and that mismatched updates are rejected */
+#include "test_helpers.hpp"
+
+static const size_t capacity = 5, ntrees_per_update = 2, n_updates = 4;
+static const uint64_t seed = 111;
+
+static int update(RollingForest *rolling_forest, TestData &data, size_t ndim)
+{
+    return update_rolling_forest(rolling_forest,
+                                 data.numeric_data.data(), data.ncols_numeric,
+                                 data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                                 NULL, NULL, NULL,
+                                 ndim, 3, Normal, false,
+                                 NULL, false, false,
+                                 data.nrows, 64, ntrees_per_update, 0, true, true,
+                                 NULL, false, 0,
+                                 0, 0, 0, 0,
+                                 0, Impute, SubSet, Weighted,
+                                 false, seed, MersenneTwister, 1);
+}
+
+static void set_model_ptrs(IsoForest &model, IsoForest *&model_ptr, ExtIsoForest *&model_ext_ptr)
+{
+    model_ptr = &model;
+    model_ext_ptr = NULL;
+}
+
+static void set_model_ptrs(ExtIsoForest &model_ext, IsoForest *&model_ptr, ExtIsoForest *&model_ext_ptr)
+{
+    model_ptr = NULL;
+    model_ext_ptr = &model_ext;
+}
+
+static std::shared_ptr<IsoForest> current_model(RollingForest *rolling_forest, IsoForest*)
+{
+    std::shared_ptr<IsoForest> model;
+    std::shared_ptr<ExtIsoForest> model_ext;
+    get_rolling_forest_model(rolling_forest, model, model_ext);
+    CHECK(model_ext.get() == NULL);
+    return model;
+}
+
+static std::shared_ptr<ExtIsoForest> current_model(RollingForest *rolling_forest, ExtIsoForest*)
+{
+    std::shared_ptr<IsoForest> model;
+    std::shared_ptr<ExtIsoForest> model_ext;
+    get_rolling_forest_model(rolling_forest, model, model_ext);
+    CHECK(model.get() == NULL);
+    return model_ext;
+}
+
+template <class Model, class Node>
+static void check_rolling_forest(size_t ndim, bool hold_models, std::vector< std::vector<Node> > Model::*trees)
+{
+    std::vector<TestData> chunks;
+    for (size_t chunk = 0; chunk < n_updates; chunk++)
+        chunks.push_back(make_test_data(150 + 10 * chunk, true, 100 + chunk));
+
+    /* the trees of each update are the same as from 'fit_iforest' on the chunk with the seed for that update */
+    std::vector< std::vector<Node> > grown_trees;
+    for (size_t chunk = 0; chunk < n_updates; chunk++)
+    {
+        Model grown;
+        IsoForest *model_ptr;
+        ExtIsoForest *model_ext_ptr;
+        set_model_ptrs(grown, model_ptr, model_ext_ptr);
+        fit_iforest(model_ptr, model_ext_ptr,
+                    chunks[chunk].numeric_data.data(), chunks[chunk].ncols_numeric,
+                    chunks[chunk].categ_data.data(), chunks[chunk].ncols_categ, chunks[chunk].ncat.data(),
+                    NULL, NULL, NULL,
+                    ndim, 3, Normal, false,
+                    NULL, false, false,
+                    chunks[chunk].nrows, 64, ntrees_per_update, 0, true, true,
+                    false, NULL, NULL, false,
+                    NULL, false, 0,
+                    0, 0, 0, 0,
+                    0, Impute, SubSet, Weighted,
+                    false, NULL, 0, Higher, Inverse, false,
+                    seed + chunk * ntrees_per_update, MersenneTwister, 1);
+        for (auto &tree : grown.*trees)
+            grown_trees.push_back(tree);
+    }
+
+    RollingForest *rolling_forest = create_rolling_forest(capacity);
+    std::vector< std::shared_ptr<Model> > held;
+    std::vector< std::vector< std::vector<Node> > > held_trees;
+    for (size_t chunk = 0; chunk < n_updates; chunk++)
+    {
+        CHECK(update(rolling_forest, chunks[chunk], ndim) == EXIT_SUCCESS);
+        std::shared_ptr<Model> model = current_model(rolling_forest, (Model*)NULL);
+        CHECK(model.get() != NULL);
+        if (hold_models)
+        {
+            held.push_back(model);
+            held_trees.push_back(model.get()->*trees);
+        }
+    }
+
+    /* 'capacity=5' with 2 trees per update ends with trees [5, 6, 7, 3, 4] */
+    std::shared_ptr<Model> model = current_model(rolling_forest, (Model*)NULL);
+    std::vector< std::vector<Node> > expected = {grown_trees[5], grown_trees[6], grown_trees[7],
+                                                 grown_trees[3], grown_trees[4]};
+    CHECK(same_forest(model.get()->*trees, expected));
+
+    /* models taken before the later updates keep the trees they had */
+    for (size_t ix = 0; ix < held.size(); ix++)
+        CHECK(same_forest(held[ix].get()->*trees, held_trees[ix]));
+
+    /* the number of dimensions must stay the same */
+    CHECK(update(rolling_forest, chunks[0], ndim + 1) == EXIT_FAILURE);
+    if (ndim > 1)
+        CHECK(update(rolling_forest, chunks[0], 1) == EXIT_FAILURE);
+    CHECK(current_model(rolling_forest, (Model*)NULL) == model);
+
+    delete_rolling_forest(rolling_forest);
+}
+
+int main()
+{
+    for (bool hold_models : {false, true})
+    {
+        check_rolling_forest(1, hold_models, &IsoForest::trees);
+        check_rolling_forest(2, hold_models, &ExtIsoForest::hplanes);
+    }
+    return report_tests("test_rolling_forest");
+}
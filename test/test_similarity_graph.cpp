@@ -0,0 +1,147 @@
+/* Checks that 'calc_similarity_graph' outputs exactly the pairs and distances that would be
+   selected from the full matrix of distances from 'calc_similarity', when selecting them by
+   threshold, by number of nearest neighbours, and by both */
+#include <algorithm>
+#include "test_helpers.hpp"
+
+/* the first three rows are the same, so the distances from other rows to them are tied */
+static TestData make_graph_data()
+{
+    TestData data = make_test_data(40, false, 321);
+    for (size_t row = 1; row < 3; row++)
+    {
+        for (size_t col = 0; col < data.ncols_numeric; col++)
+            data.numeric_data[row + col * data.nrows] = data.numeric_data[col * data.nrows];
+        for (size_t col = 0; col < data.ncols_categ; col++)
+            data.categ_data[row + col * data.nrows] = data.categ_data[col * data.nrows];
+    }
+    return data;
+}
+
+static double get_dist(std::vector<double> &tmat, size_t nrows, size_t i, size_t j)
+{
+    if (i > j) std::swap(i, j);
+    return tmat[ix_comb(i, j, nrows, tmat.size())];
+}
+
+/* pairs that 'calc_similarity_graph' should output for a row, before applying 'top_m' */
+static std::vector<std::pair<double, size_t>> get_row_candidates(std::vector<double> &tmat, size_t nrows, size_t row,
+                                                                 double threshold, bool standardize_dist)
+{
+    std::vector<std::pair<double, size_t>> out;
+    double dist;
+    for (size_t other = 0; other < nrows; other++)
+    {
+        if (other == row) continue;
+        dist = get_dist(tmat, nrows, row, other);
+        if (isnan(threshold) || (standardize_dist? (dist <= threshold) : (dist >= threshold)))
+            out.emplace_back(dist, other);
+    }
+    return out;
+}
+
+static void check_graph(TestData &data, IsoForest *model, ExtIsoForest *model_ext,
+                        std::vector<double> &tmat, bool standardize_dist, double threshold, size_t top_m)
+{
+    size_t nrows = data.nrows;
+    std::vector<size_t> indptr, indices;
+    std::vector<double> values;
+    int ret = calc_similarity_graph(data.numeric_data.data(), data.categ_data.data(), NULL, NULL, NULL,
+                                    nrows, 2, false, standardize_dist,
+                                    model, model_ext, threshold, top_m,
+                                    indptr, indices, values);
+    CHECK(ret == EXIT_SUCCESS);
+    CHECK(indptr.size() == nrows + 1);
+    if (ret != EXIT_SUCCESS || indptr.size() != nrows + 1) return;
+
+    for (size_t row = 0; row < nrows; row++)
+    {
+        std::vector<std::pair<double, size_t>> expected = get_row_candidates(tmat, nrows, row, threshold, standardize_dist);
+        std::vector<double> got_values(values.begin() + indptr[row], values.begin() + indptr[row + 1]);
+        std::vector<size_t> got_indices(indices.begin() + indptr[row], indices.begin() + indptr[row + 1]);
+        CHECK(std::is_sorted(got_indices.begin(), got_indices.end()));
+        for (size_t ix = 0; ix < got_indices.size(); ix++)
+        {
+            CHECK(got_indices[ix] != row && got_indices[ix] < nrows);
+            if (got_indices[ix] != row && got_indices[ix] < nrows)
+                CHECK(got_values[ix] == get_dist(tmat, nrows, row, got_indices[ix]));
+        }
+
+        if (!top_m || top_m >= expected.size())
+        {
+            std::vector<size_t> expected_indices;
+            for (auto &pair : expected) expected_indices.push_back(pair.second);
+            CHECK(got_indices == expected_indices);
+        }
+
+        /* ties at the last position can be resolved in any way, so here only the distances are compared */
+        else
+        {
+            std::vector<double> expected_values;
+            for (auto &pair : expected) expected_values.push_back(pair.first);
+            if (standardize_dist)
+                std::sort(expected_values.begin(), expected_values.end());
+            else
+                std::sort(expected_values.begin(), expected_values.end(), std::greater<double>());
+            expected_values.resize(top_m);
+            std::sort(expected_values.begin(), expected_values.end());
+            std::sort(got_values.begin(), got_values.end());
+            CHECK(got_values == expected_values);
+        }
+    }
+}
+
+static void check_similarity_graph(size_t ndim, bool standardize_dist)
+{
+    TestData data = make_graph_data();
+    size_t nrows = data.nrows;
+    IsoForest model;
+    ExtIsoForest model_ext;
+    IsoForest *model_ptr = (ndim == 1)? &model : NULL;
+    ExtIsoForest *model_ext_ptr = (ndim == 1)? NULL : &model_ext;
+    fit_iforest(model_ptr, model_ext_ptr,
+                data.numeric_data.data(), data.ncols_numeric,
+                data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                NULL, NULL, NULL,
+                ndim, 1, Normal, false,
+                NULL, false, false,
+                nrows, 32, 20, 0, true, true,
+                false, NULL, NULL, false,
+                NULL, false, 0,
+                0, 0, 0, 0,
+                0, Impute, SubSet, Smallest,
+                false, NULL, 3, Higher, Inverse, false,
+                1, MersenneTwister, 1);
+
+    std::vector<double> tmat(nrows * (nrows - 1) / 2);
+    calc_similarity(data.numeric_data.data(), data.categ_data.data(), NULL, NULL, NULL,
+                    nrows, 1, false, standardize_dist,
+                    model_ptr, model_ext_ptr, tmat.data(), NULL, 0);
+
+    /* row 5 has the same distance to each of the first three rows */
+    double threshold = get_dist(tmat, nrows, 5, 0);
+    CHECK(get_dist(tmat, nrows, 5, 1) == threshold && get_dist(tmat, nrows, 5, 2) == threshold);
+
+    check_graph(data, model_ptr, model_ext_ptr, tmat, standardize_dist, threshold, 0);
+    check_graph(data, model_ptr, model_ext_ptr, tmat, standardize_dist, NAN, 5);
+    check_graph(data, model_ptr, model_ext_ptr, tmat, standardize_dist, threshold, 5);
+    check_graph(data, model_ptr, model_ext_ptr, tmat, standardize_dist, NAN, nrows - 1);
+    check_graph(data, model_ptr, model_ext_ptr, tmat, standardize_dist, NAN, nrows + 10);
+    check_graph(data, model_ptr, model_ext_ptr, tmat, standardize_dist, threshold, nrows + 10);
+
+    std::vector<size_t> indptr, indices;
+    std::vector<double> values;
+    int ret = calc_similarity_graph(data.numeric_data.data(), data.categ_data.data(), NULL, NULL, NULL,
+                                    nrows, 1, false, standardize_dist,
+                                    model_ptr, model_ext_ptr, NAN, 0,
+                                    indptr, indices, values);
+    CHECK(ret == EXIT_FAILURE);
+}
+
+int main()
+{
+    for (size_t ndim : {1, 2})
+        for (bool standardize_dist : {false, true})
+            check_similarity_graph(ndim, standardize_dist);
+    return report_tests("test_similarity_graph");
+}
@@ -0,0 +1,68 @@
+/* Checks that calculating distances by blocks of rows ('calc_similarity_tiled') produces
+   exactly the same results as accumulating them by trees, which is what 'calc_similarity'
+   does with a single thread when there are fewer pairs of rows than rows times trees */
+#include "test_helpers.hpp"
+
+static void check_same_paths(size_t ndim, bool sparse, size_t n_from,
+                             bool assume_full_distr, bool standardize_dist)
+{
+    TestData data = make_test_data(60, false, 88);
+    SparseData sp = make_sparse_data(data);
+    size_t nrows = data.nrows;
+    size_t ntrees = 40;
+    double *numeric_data = sparse? NULL : data.numeric_data.data();
+    double *Xc = sparse? sp.Xc.data() : NULL;
+    sparse_ix *Xc_ind = sparse? sp.Xc_ind.data() : NULL;
+    sparse_ix *Xc_indptr = sparse? sp.Xc_indptr.data() : NULL;
+
+    IsoForest model;
+    ExtIsoForest model_ext;
+    IsoForest *model_ptr = (ndim == 1)? &model : NULL;
+    ExtIsoForest *model_ext_ptr = (ndim == 1)? NULL : &model_ext;
+    fit_iforest(model_ptr, model_ext_ptr,
+                numeric_data, data.ncols_numeric,
+                data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                Xc, Xc_ind, Xc_indptr,
+                ndim, 1, Normal, false,
+                NULL, false, false,
+                nrows, 32, ntrees, 0, true, true,
+                false, NULL, NULL, false,
+                NULL, false, 0,
+                0, 0, 0, 0,
+                0, Fail, SubSet, Smallest,
+                false, NULL, 3, Higher, Inverse, false,
+                1, MersenneTwister, 1);
+
+    size_t n_out = n_from? (n_from * (nrows - n_from)) : (nrows * (nrows - 1) / 2);
+    CHECK(n_out < nrows * ntrees);
+    std::vector<double> by_trees(n_out);
+    calc_similarity(numeric_data, data.categ_data.data(), Xc, Xc_ind, Xc_indptr,
+                    nrows, 1, assume_full_distr, standardize_dist,
+                    model_ptr, model_ext_ptr,
+                    n_from? NULL : by_trees.data(), n_from? by_trees.data() : NULL, n_from);
+
+    PredictionData prediction_data = {numeric_data, data.categ_data.data(), nrows,
+                                      Xc, Xc_ind, Xc_indptr,
+                                      NULL, NULL, NULL};
+    for (int nthreads : {1, 3})
+    {
+        std::vector<double> by_rows(n_out);
+        bool calculated = calc_similarity_tiled(prediction_data, model_ptr, model_ext_ptr,
+                                                n_from? (double*)NULL : by_rows.data(),
+                                                n_from? by_rows.data() : (double*)NULL,
+                                                n_from, assume_full_distr, standardize_dist, nthreads);
+        CHECK(calculated);
+        CHECK(same_values(by_rows, by_trees));
+    }
+}
+
+int main()
+{
+    for (size_t ndim : {1, 2})
+        for (bool sparse : {false, true})
+            for (size_t n_from : {0, 15})
+                for (bool assume_full_distr : {false, true})
+                    for (bool standardize_dist : {false, true})
+                        check_same_paths(ndim, sparse, n_from, assume_full_distr, standardize_dist);
+    return report_tests("test_similarity_paths");
+}
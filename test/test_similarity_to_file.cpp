@@ -0,0 +1,112 @@
+/* Checks that 'calc_similarity_to_file' writes the same distances as 'calc_similarity',
+   and that it does not leave a file behind when it fails. The expected distances are
+   calculated by trees, so as to compare against a different code path than the file's */
+#include <fstream>
+#include "test_helpers.hpp"
+
+static const char *output_file = "test_similarity_to_file.bin";
+
+static bool file_exists(const char *file_path)
+{
+    return std::ifstream(file_path).good();
+}
+
+template <class real_t>
+static std::vector<real_t> read_file(const char *file_path, size_t n)
+{
+    std::vector<real_t> out(n);
+    std::ifstream file(file_path, std::ios::binary);
+    file.read((char*)out.data(), n * sizeof(real_t));
+    return out;
+}
+
+static void check_similarity_to_file(size_t ndim, size_t n_from)
+{
+    TestData data = make_test_data(250, false, 55);
+    size_t nrows = data.nrows;
+    size_t ntrees = 150;
+    IsoForest model;
+    ExtIsoForest model_ext;
+    fit_iforest((ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                data.numeric_data.data(), data.ncols_numeric,
+                data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                NULL, NULL, NULL,
+                ndim, 1, Normal, false,
+                NULL, false, false,
+                nrows, 128, ntrees, 0, true, true,
+                false, NULL, NULL, false,
+                NULL, false, 0,
+                0, 0, 0, 0,
+                0, Fail, SubSet, Smallest,
+                false, NULL, 3, Higher, Inverse, false,
+                1, MersenneTwister, 1);
+
+    /* with a single thread, 'calc_similarity' goes by trees when there are fewer pairs than
+       rows times trees, otherwise it would use the same calculation by blocks of rows */
+    size_t n_out = n_from? (n_from * (nrows - n_from)) : (nrows * (nrows - 1) / 2);
+    CHECK(n_out < nrows * ntrees);
+    std::vector<double> expected(n_out);
+    calc_similarity(data.numeric_data.data(), data.categ_data.data(), NULL, NULL, NULL,
+                    nrows, 1, false, true,
+                    (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                    n_from? NULL : expected.data(), n_from? expected.data() : NULL, n_from);
+
+    for (bool as_float : {false, true})
+    {
+        int ret = calc_similarity_to_file(output_file, as_float,
+                                          data.numeric_data.data(), data.categ_data.data(), NULL, NULL, NULL,
+                                          nrows, 2, false, true,
+                                          (ndim == 1)? &model : NULL, (ndim == 1)? NULL : &model_ext,
+                                          n_from);
+        CHECK(ret == EXIT_SUCCESS);
+        if (as_float)
+        {
+            std::vector<float> written = read_file<float>(output_file, n_out);
+            bool same = true;
+            for (size_t ix = 0; ix < n_out; ix++)
+                same = same && written[ix] == (float)expected[ix];
+            CHECK(same);
+        }
+        else
+        {
+            CHECK(same_values(read_file<double>(output_file, n_out), expected));
+        }
+    }
+}
+
+/* rows with missing values have to be divided between branches with 'Divide', which
+   cannot be written by blocks, so the function fails and should remove the file */
+static void check_removes_file_on_failure()
+{
+    TestData data = make_test_data(100, true, 66);
+    IsoForest model;
+    fit_iforest(&model, NULL,
+                data.numeric_data.data(), data.ncols_numeric,
+                data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                NULL, NULL, NULL,
+                1, 1, Normal, false,
+                NULL, false, false,
+                data.nrows, 64, 5, 0, true, true,
+                false, NULL, NULL, false,
+                NULL, false, 0,
+                0, 0, 0, 0,
+                0, Divide, SubSet, Weighted,
+                false, NULL, 3, Higher, Inverse, false,
+                1, MersenneTwister, 1);
+    int ret = calc_similarity_to_file(output_file, false,
+                                      data.numeric_data.data(), data.categ_data.data(), NULL, NULL, NULL,
+                                      data.nrows, 1, false, true, &model, NULL, 0);
+    CHECK(ret == EXIT_FAILURE);
+    CHECK(!file_exists(output_file));
+}
+
+int main()
+{
+    check_similarity_to_file(1, 0);
+    check_similarity_to_file(1, 40);
+    check_similarity_to_file(2, 0);
+    check_similarity_to_file(2, 40);
+    check_removes_file_on_failure();
+    remove(output_file);
+    return report_tests("test_similarity_to_file");
+}
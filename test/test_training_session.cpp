@@ -0,0 +1,160 @@
+/* Checks that fitting from a 'TrainingSession' produces the same models as 'fit_iforest' with
+   the data, also when the same session is reused for fits with different parameters */
+#include "test_helpers.hpp"
+
+typedef struct FitCase {
+    size_t ndim;
+    bool   with_replacement;
+    bool   weight_as_sample;
+    size_t sample_size;
+    bool   weigh_by_kurt;
+    size_t kurt_sample_size;
+    double prob_pick_by_gain_avg;
+    MissingAction missing_action;
+    bool   use_imputer;
+    bool   calc_outputs;
+    uint64_t seed;
+} FitCase;
+
+typedef struct FitResult {
+    IsoForest model;
+    ExtIsoForest model_ext;
+    Imputer imputer;
+    std::vector<double> tmat;
+    std::vector<double> depths;
+} FitResult;
+
+static void fit_case(const FitCase &c, TestData &data, double sample_weights[], TrainingSession *session,
+                     FitResult &res, int nthreads)
+{
+    IsoForest *model_ptr = (c.ndim == 1)? &res.model : NULL;
+    ExtIsoForest *model_ext_ptr = (c.ndim == 1)? NULL : &res.model_ext;
+    if (c.calc_outputs)
+    {
+        res.tmat.assign(data.nrows * (data.nrows - 1) / 2, 0);
+        res.depths.assign(data.nrows, 0);
+    }
+    double *tmat = c.calc_outputs? res.tmat.data() : NULL;
+    double *depths = c.calc_outputs? res.depths.data() : NULL;
+    Imputer *imputer = c.use_imputer? &res.imputer : NULL;
+
+    int ret;
+    if (session == NULL)
+        ret = fit_iforest(model_ptr, model_ext_ptr,
+                          data.numeric_data.data(), data.ncols_numeric,
+                          data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                          NULL, NULL, NULL,
+                          c.ndim, 3, Normal, false,
+                          sample_weights, c.with_replacement, c.weight_as_sample,
+                          data.nrows, c.sample_size, 10, 0, true, true,
+                          true, tmat, depths, true,
+                          NULL, c.weigh_by_kurt, c.kurt_sample_size,
+                          c.prob_pick_by_gain_avg, 0, 0, 0,
+                          0, c.missing_action, SubSet, Weighted,
+                          false, imputer, 3, Higher, Inverse, false,
+                          c.seed, MersenneTwister, nthreads);
+    else
+        ret = fit_iforest(session, model_ptr, model_ext_ptr,
+                          c.ndim, 3, Normal, false,
+                          c.with_replacement, c.weight_as_sample,
+                          c.sample_size, 10, 0, true, true,
+                          true, tmat, depths, true,
+                          NULL, c.weigh_by_kurt, c.kurt_sample_size,
+                          c.prob_pick_by_gain_avg, 0, 0, 0,
+                          0, c.missing_action, SubSet, Weighted,
+                          false, imputer, 3, Higher, Inverse, false,
+                          c.seed, MersenneTwister, nthreads);
+    CHECK(ret == EXIT_SUCCESS);
+}
+
+/* distances and depths are summed across threads in whichever order they finish their trees,
+   so with more than one thread they are only equal up to rounding */
+static bool close_values(const std::vector<double> &a, const std::vector<double> &b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t ix = 0; ix < a.size(); ix++)
+        if (std::fabs(a[ix] - b[ix]) > 1e-12 * std::fmax(1., std::fabs(a[ix])))
+            return false;
+    return true;
+}
+
+static void check_same_fit(const FitCase &c, const FitResult &expected, const FitResult &got)
+{
+    if (c.ndim == 1)
+    {
+        CHECK(same_forest(expected.model.trees, got.model.trees));
+        CHECK(same_value(expected.model.exp_avg_depth, got.model.exp_avg_depth));
+        CHECK(same_value(expected.model.exp_avg_sep, got.model.exp_avg_sep));
+    }
+    else
+    {
+        CHECK(same_forest(expected.model_ext.hplanes, got.model_ext.hplanes));
+        CHECK(same_value(expected.model_ext.exp_avg_depth, got.model_ext.exp_avg_depth));
+        CHECK(same_value(expected.model_ext.exp_avg_sep, got.model_ext.exp_avg_sep));
+    }
+    if (c.use_imputer)
+        CHECK(same_forest(expected.imputer.imputer_tree, got.imputer.imputer_tree));
+    if (c.calc_outputs)
+    {
+        CHECK(close_values(expected.tmat, got.tmat));
+        CHECK(close_values(expected.depths, got.depths));
+    }
+}
+
+static void check_session(bool with_missing, bool with_weights, int nthreads)
+{
+    TestData data = make_test_data(200, with_missing, 789);
+    std::vector<double> weights(data.nrows);
+    for (size_t row = 0; row < data.nrows; row++)
+        weights[row] = 0.5 + (double)(row % 7);
+    double *sample_weights = with_weights? weights.data() : NULL;
+    MissingAction missing_action = with_missing? Impute : Fail;
+
+    std::vector<FitCase> cases = {
+        {1, false, true,  64, false, 0,  0,   missing_action, with_missing, false, 1},
+        {1, true,  false, 64, false, 0,  0,   missing_action, false,        false, 2},
+        {2, false, true,  0,  false, 0,  0,   missing_action, with_missing, true,  3},
+        {1, false, false, 0,  true,  0,  0,   missing_action, false,        true,  4},
+        {1, false, true,  64, true,  50, 0,   missing_action, false,        false, 5},
+        {2, false, true,  64, true,  50, 0.5, missing_action, false,        false, 5},
+        {1, false, true,  64, true,  50, 0,   missing_action, false,        false, 6},
+        {1, false, true,  64, false, 0,  0.5, missing_action, with_missing, false, 7},
+    };
+    if (!with_missing)
+        cases.push_back({1, false, true, 64, false, 0, 0, Divide, false, false, 8});
+
+    TrainingSession *session = create_training_session(data.numeric_data.data(), data.ncols_numeric,
+                                                       data.categ_data.data(), data.ncols_categ, data.ncat.data(),
+                                                       NULL, NULL, NULL,
+                                                       sample_weights, data.nrows, nthreads);
+    std::vector<FitResult> first(cases.size());
+
+    /* each fit from the session must match a fit from the data, in any order */
+    for (size_t ix = 0; ix < cases.size(); ix++)
+    {
+        FitResult expected;
+        fit_case(cases[ix], data, sample_weights, NULL, expected, nthreads);
+        fit_case(cases[ix], data, sample_weights, session, first[ix], nthreads);
+        check_same_fit(cases[ix], expected, first[ix]);
+    }
+    for (size_t ix = cases.size(); ix-- > 0; )
+    {
+        FitResult again;
+        fit_case(cases[ix], data, sample_weights, session, again, nthreads);
+        check_same_fit(cases[ix], first[ix], again);
+    }
+
+    delete_training_session(session);
+}
+
+int main()
+{
+    for (int nthreads : {1, 3})
+    {
+        check_session(false, false, nthreads);
+        check_session(false, true, nthreads);
+        check_session(true, false, nthreads);
+        check_session(true, true, nthreads);
+    }
+    return report_tests("test_training_session");
+}